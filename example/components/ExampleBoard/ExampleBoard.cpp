@@ -150,7 +150,12 @@ bool ExampleBoard::OnboardButtonPressed(void)
     return (gpio_get_level(GPIO_BOOT) == 0) ? true : false;
 }
 
-QueueHandle_t ExampleBoard::GetHttpServerQueue(void)
+HTTPCommandRing* ExampleBoard::GetHttpCommandRing(void)
 {
-    return httpServer.GetQueueHandle();
+    return httpServer.GetCommandRing();
+}
+
+esp_err_t ExampleBoard::SendHttpCommandResult(const HTTPCommand& cmd, uint32_t result)
+{
+    return httpServer.SendCommandResult(cmd, result);
 }
@@ -61,9 +61,14 @@ public:
     bool OnboardButtonPressed(void);
 
     /**
-     * @brief The server queue is used to read the commands received by the HTTP server
+     * @brief The command ring is used to read the commands received by the HTTP server
      */
-    QueueHandle_t GetHttpServerQueue(void);
+    HTTPCommandRing* GetHttpCommandRing(void);
+
+    /**
+     * @brief Sends the result of a command received through the WebSocket
+     */
+    esp_err_t SendHttpCommandResult(const HTTPCommand&, uint32_t result);
 
 protected:
     ExampleBoardHTTPSrv httpServer;
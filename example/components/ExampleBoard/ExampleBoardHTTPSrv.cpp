@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 #include <string.h>
 
@@ -28,9 +29,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 // -----------------------------------------------------------------------------
 
+const HTTPRoute ExampleBoardHTTPSrv::exampleRoutes[] = {
+    HTTPRoute(HTTP_GET, "/example.txt", static_cast<HTTPRouteHandler>(&ExampleBoardHTTPSrv::HandleGet_ExampleTxt)),
+};
+
+// -----------------------------------------------------------------------------
+
 ExampleBoardHTTPSrv::ExampleBoardHTTPSrv() : PaxHttpServer()
 {
     exampleStatusData = 0;
+
+    SetCustomRoutes(exampleRoutes, sizeof(exampleRoutes) / sizeof(exampleRoutes[0]));
 }
 
 ExampleBoardHTTPSrv::~ExampleBoardHTTPSrv(void)
@@ -40,25 +49,27 @@ ExampleBoardHTTPSrv::~ExampleBoardHTTPSrv(void)
 
 // -----------------------------------------------------------------------------
 
-char* ExampleBoardHTTPSrv::CreateJSONStatusString(bool addWhitespaces)
+esp_err_t ExampleBoardHTTPSrv::HandleGet_ExampleTxt(httpd_req_t* req)
 {
-    char *str = nullptr;
+    char str[16];
+    snprintf(str, sizeof(str), "%u", (unsigned)exampleStatusData);
 
-    if (configuration == nullptr) { return str; }
-    if (boardInfo == nullptr) { return str; }
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
+    return httpd_resp_sendstr(req, str);
+}
 
-    ++exampleStatusData;
+// -----------------------------------------------------------------------------
 
-    cJSON *cfg = cJSON_CreateObject();
+bool ExampleBoardHTTPSrv::WriteJSONStatus(JSONWriter& writer)
+{
+    if (configuration == nullptr) { return false; }
+    if (boardInfo == nullptr) { return false; }
 
-    if (cJSON_AddNumberToObject(cfg, "exampleStatusData", exampleStatusData) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
+    // the uptime, in seconds, WriteJSONStatus may be called more than once for a request
+    exampleStatusData = (uint32_t)(esp_timer_get_time() / 1000000);
 
-    if (addWhitespaces) { str = cJSON_Print(cfg); }
-    else                { str = cJSON_PrintUnformatted(cfg); }
+    writer.AddUInt("exampleStatusData", exampleStatusData);
 
-    cJSON_Delete(cfg);
-    return str;
+    return writer.IsOK();
 }
@@ -31,10 +31,11 @@ public:
     uint32_t exampleStatusData;
 
 protected:
-    /**
-     * @warning Delete returned string with 'free' !
-     */
-    virtual char* CreateJSONStatusString(bool addWhitespaces);
+    static const HTTPRoute exampleRoutes[];
+
+    esp_err_t HandleGet_ExampleTxt(httpd_req_t*);
+
+    virtual bool WriteJSONStatus(JSONWriter&);
 };
 
 #endif
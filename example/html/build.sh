@@ -3,7 +3,7 @@
 set -e
 
 script_name="HTML Builder"
-script_version="1.5.1"
+script_version="1.6.0"
 
 tmpDir="tmp"
 webDir="web"
@@ -12,6 +12,7 @@ show_help=0
 clean_mode=0
 clean_before=0
 production_mode=0
+assets_mode=0
 node_help=0
 
 echo "$script_name version $script_version"
@@ -25,6 +26,7 @@ function Usage () {
   echo "-c exit after cleaning the temporary and output directories"
   echo "-k clean before build"
   echo "-p build in production mode"
+  echo "-a build separate files and the asset table, for CONFIG_ESP32BM_WEB_ASSET_TABLE"
   echo "-n help for Node.js, npm and npm modules"
   echo
   echo "Up to date doc should be here:"
@@ -43,6 +45,8 @@ function NodeHelp() {
     echo "    - https://docs.npmjs.com/downloading-and-installing-node-js-and-npm"
     echo "    - https://github.com/nodesource/distributions/blob/master/README.md"
     echo
+    echo "The -a option needs Python 3 and, for brotli compression, the brotli module or program."
+    echo
     echo "The npm modules can be installed by running 'npm install' in this directory."
     echo "The used modules are:"
     echo "    - clean-css and clean-css-cli"
@@ -95,13 +99,29 @@ function BuildHTML_Prod () {
   gzip -k ./${webDir}/index.html
 }
 
-while getopts ":chkpn" option
+function BuildAssets () {
+  # the script and the style are separate files, linked from index.html
+  sed -e 's/<link inline /<link /' -e 's/<script inline /<script /' ./src/index.html > ./${tmpDir}/index.html
+  cp ./${tmpDir}/script.js ./${tmpDir}/style.css ./${webDir}/
+  if [[ $production_mode -eq 1 ]]; then
+    ./node_modules/.bin/html-minifier --collapse-whitespace --remove-comments \
+          --remove-empty-attributes --remove-optional-tags --remove-redundant-attributes \
+          --remove-script-type-attributes --remove-style-link-type-attributes --remove-tag-whitespace \
+          ./${tmpDir}/index.html -o ./${webDir}/index.html
+  else
+    cp ./${tmpDir}/index.html ./${webDir}/index.html
+  fi
+  python3 ../../tools/webassets.py ./${webDir}
+}
+
+while getopts ":achkpn" option
 do
   case $option in
     c ) clean_mode=1;;
     k ) clean_before=1;;
     h ) show_help=1;;
     p ) production_mode=1;;
+    a ) assets_mode=1;;
     n ) node_help=1;;
     * ) Usage; exit 1;;
   esac
@@ -130,7 +150,16 @@ fi
 
 mkdir -p {${tmpDir},${webDir}}
 
-if [[ $production_mode -eq 1 ]]; then
+if [[ $assets_mode -eq 1 ]]; then
+  BuildJS
+  BuildCSS
+  if [[ $production_mode -eq 1 ]]; then
+    MinimizeJS
+    MinimizeCSS
+  fi
+  CopyImages
+  BuildAssets
+elif [[ $production_mode -eq 1 ]]; then
   BuildJS
   MinimizeJS
   BuildCSS
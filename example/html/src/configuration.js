@@ -1,4 +1,6 @@
 const configNames = ['version', 'name', 'pass', 'ap1s', 'ap1p', 'ap2s', 'ap2p', 'ipAddr', 'ipMask', 'ipGateway', 'ipDNS'];
+// not sent by the board, the ones left empty are not sent back so the board keeps them
+const secretNames = ['pass', 'ap1p', 'ap2p'];
 const configVersion = 3;
 const elemPrefix = 'p';
 class Configuration {
@@ -52,6 +54,9 @@ class Configuration {
                 }
             }
         }
-        return JSON.stringify(this);
+        return JSON.stringify(this, (key, value) => {
+            if (secretNames.includes(key) && value === '') return undefined;
+            return value;
+        });
     }
 }
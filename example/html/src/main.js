@@ -44,9 +44,8 @@ class App {
 
         this.GetInfo();
         this.GetConfig();
-        this.GetStatus();
-
-        this.statusTimer = setInterval(function() { app.GetStatus(); }, 2000);
+        this.StartStatusStream();
+        this.OpenCommandSocket();
 
         this.HashHandler();
         window.addEventListener('hashchange', this.HashHandler, false);
@@ -56,7 +55,7 @@ class App {
         let xhr = new XMLHttpRequest();
         xhr.onload = function() {
             if (xhr.readyState === xhr.DONE) {
-                if (xhr.status === 200) {
+                if (xhr.status === 200 || xhr.status === 202) {
                     logger.info(xhr.responseText);
                 }
                 else {
@@ -111,7 +110,85 @@ class App {
         xhr.send();
     }
 
+    StartStatusStream() {
+        if (typeof(EventSource) === "undefined") {
+            this.StartStatusPolling();
+            return;
+        }
+
+        this.statusSource = new EventSource("/status/stream");
+        this.statusSource.onmessage = function(ev) {
+            app.StatusFromString(ev.data);
+        };
+        this.statusSource.onerror = function() {
+            // the board refused the subscription, EventSource does not retry in this case
+            if (app.statusSource.readyState === EventSource.CLOSED) {
+                app.statusSource = null;
+                app.StartStatusPolling();
+            }
+        };
+    }
+
+    StartStatusPolling() {
+        if (this.statusTimer) return;
+
+        this.GetStatus();
+        this.statusTimer = setInterval(function() { app.GetStatus(); }, 2000);
+    }
+
+    OpenCommandSocket() {
+        if (typeof(WebSocket) === "undefined") return;
+
+        this.cmdID = 0;
+        let scheme = (location.protocol === "https:") ? "wss://" : "ws://";
+        this.cmdSocket = new WebSocket(scheme + location.host + "/ws");
+        this.cmdSocket.binaryType = "arraybuffer";
+        this.cmdSocket.onmessage = function(ev) {
+            app.CommandFrame(ev.data);
+        };
+        this.cmdSocket.onclose = function() {
+            // commands are sent with POST until the socket is opened again
+            app.cmdSocket = null;
+            setTimeout(function() { app.OpenCommandSocket(); }, 5000);
+        };
+    }
+
+    CommandFrame(buf) {
+        let v = new DataView(buf);
+        if (v.byteLength < 4) return;
+
+        let id = v.getUint16(2, true);
+        if (v.getUint8(0) === 0x81) {
+            const ackText = ['queued', 'ignored', 'queue full', 'bad frame', 'rate limited'];
+            let status = v.getUint8(1);
+            let text = (status < ackText.length) ? ackText[status] : status;
+            if (status === 0) logger.info("Command " + id + " " + text);
+            else logger.error("Command " + id + " " + text);
+            return;
+        }
+        if ((v.getUint8(0) === 0x82) && (v.byteLength >= 8)) {
+            logger.info("Command " + id + " result " + v.getUint32(4, true));
+        }
+    }
+
+    SendCmdWS(cmdID, data) {
+        if (!this.cmdSocket || (this.cmdSocket.readyState !== WebSocket.OPEN)) return false;
+
+        this.cmdID = (this.cmdID + 1) & 0xFFFF;
+
+        let buf = new ArrayBuffer(8);
+        let v = new DataView(buf);
+        v.setUint8(0, 0x01);
+        v.setUint8(1, cmdID);
+        v.setUint16(2, this.cmdID, true);
+        v.setUint32(4, data >>> 0, true);
+        this.cmdSocket.send(buf);
+        return true;
+    }
+
     SendCmd(cmdID, data) {
+        if (this.SendCmdWS(cmdID, data)) return;
+
         let xhr = new XMLHttpRequest();
         xhr.onload = function() {
             if (xhr.readyState === xhr.DONE) {
@@ -156,30 +233,104 @@ class App {
         let f = systemPage.GetSelectedFile();
         if (f == null) return;
 
+        systemPage.BeginUpload();
+
+        // the board accepts gzip compressed images, compress it here if the browser can
+        if ((typeof CompressionStream === "undefined") || f.name.endsWith(".gz")) {
+            this.UploadPart(f, 0, 0);
+            return;
+        }
+        new Response(f.stream().pipeThrough(new CompressionStream("gzip"))).blob()
+            .then(function(blob) {
+                logger.info("Sending " + blob.size + " of " + f.size + " bytes, compressed");
+                app.UploadPart(blob, 0, 0);
+            })
+            .catch(function() { app.UploadPart(f, 0, 0); });
+    }
+
+    /* The firmware is sent in parts with Content-Range. After an error the
+       board is asked how much it received and the upload resumes from there. */
+    UploadPart(f, start, retries) {
+        const partSize = 65536;
+        let end = Math.min(start + partSize, f.size);
+
         let xhr = new XMLHttpRequest();
         xhr.onreadystatechange = function() {
-            if (xhr.readyState === xhr.DONE) {
-                if (xhr.status === 200) {
-                    logger.info(xhr.responseText);
-                }
-                else {
-                    logger.error(xhr.status + " " + xhr.responseText);
-                }
+            if (xhr.readyState !== xhr.DONE) return;
+
+            if (xhr.status === 200) {
+                logger.info(xhr.responseText);
                 systemPage.EndUpload();
+                return;
+            }
+            if (xhr.status === 202) {
+                app.UploadPart(f, app.ReceivedBytes(xhr), 0);
+                return;
             }
+            if (xhr.status === 416) {
+                app.RetryUpload(f, xhr, retries, function() {
+                    app.UploadPart(f, app.ReceivedBytes(xhr), retries + 1);
+                });
+                return;
+            }
+            app.RetryUpload(f, xhr, retries, function() {
+                app.QueryUpload(f, retries + 1);
+            });
         };
 
         xhr.upload.addEventListener("progress", function(ev) {
             if (ev.lengthComputable) {
-                let percent = 100 * ev.loaded / ev.total | 0;
+                let percent = 100 * (start + ev.loaded) / f.size | 0;
                 systemPage.SetUploadProgress(percent);
             }
         });
 
-        systemPage.BeginUpload();
+        xhr.open("POST", "/update", true);
+        xhr.setRequestHeader("Content-Range", "bytes " + start + "-" + (end - 1) + "/" + f.size);
+        xhr.send(f.slice(start, end));
+    }
+
+    QueryUpload(f, retries) {
+        let xhr = new XMLHttpRequest();
+        xhr.onreadystatechange = function() {
+            if (xhr.readyState !== xhr.DONE) return;
+
+            if (xhr.status === 202) {
+                app.UploadPart(f, app.ReceivedBytes(xhr), retries);
+                return;
+            }
+            app.RetryUpload(f, xhr, retries, function() {
+                app.QueryUpload(f, retries + 1);
+            });
+        };
 
         xhr.open("POST", "/update", true);
-        xhr.send(f);
+        xhr.setRequestHeader("Content-Range", "bytes */" + f.size);
+        xhr.send();
+    }
+
+    /* Only a network error (status 0), a 5xx or a 416, which has the Range
+       received by the board, is retried. Any other error is the answer of the
+       board to a bad upload and retrying can not help. */
+    RetryUpload(f, xhr, retries, next) {
+        const maxRetries = 5;
+        let retriable = (xhr.status === 0) || (xhr.status === 416) || (xhr.status >= 500);
+        if (!retriable || retries >= maxRetries) {
+            logger.error(xhr.status + " " + xhr.responseText);
+            systemPage.EndUpload();
+            return;
+        }
+        logger.warning("Upload interrupted, retrying");
+        setTimeout(next, 1000 * (retries + 1));
+    }
+
+    ReceivedBytes(xhr) {
+        let range = xhr.getResponseHeader("Range");
+        if (range == null) return 0;
+
+        let m = /bytes=0-(\d+)/.exec(range);
+        if (m == null) return 0;
+        return parseInt(m[1], 10) + 1;
     }
 
     TogglePass(b, id) {
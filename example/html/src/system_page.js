@@ -22,7 +22,7 @@ class SystemPage {
 
         s = s + '<h3>Load firmware from file</h3>' +
             '<div class="srow mTop">' +
-                '<input type="file" id="fwf" accept=".bin" style="display:none" onchange="systemPage.SelectFW()" />' +
+                '<input type="file" id="fwf" accept=".bin,.gz,.pxd" style="display:none" onchange="systemPage.SelectFW()" />' +
                 '<button id="fwbs" onclick="systemPage.ClickFW()">Select firmware file</button>' +
                 '<span class="mTop dBlock" id="swf"></span>' +
             '</div>' +
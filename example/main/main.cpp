@@ -70,14 +70,30 @@ extern "C" {
     static void HTTPTask(void *taskParameter) {
         HTTPCommand httpCmd;
 
-        QueueHandle_t serverQueue;
-        serverQueue = board.GetHttpServerQueue();
+        HTTPCommandRing *commandRing;
+        commandRing = board.GetHttpCommandRing();
+        if (commandRing == nullptr) {
+            ESP_LOGE(TAG, "No command ring !");
+            vTaskDelete(NULL);
+            return;
+        }
 
         for(;;) {
-            if (xQueueReceive(serverQueue, &httpCmd, portMAX_DELAY) == pdPASS) {
+            if (commandRing->Receive(httpCmd, portMAX_DELAY)) {
                 cmd.command = httpCmd.command;
                 cmd.data = httpCmd.data;
 
+                if (httpCmd.payload.length > 0) {
+                    // the payload is valid until Release
+                    ESP_LOGI(TAG, "Command %d has a payload of %u bytes", httpCmd.command, httpCmd.payload.length);
+                }
+                commandRing->Release(httpCmd);
+
+                if (httpCmd.sockfd >= 0) {
+                    // received through the WebSocket, the client waits for a result
+                    board.SendHttpCommandResult(httpCmd, 0);
+                }
+
                 if (cmd.command == 0xFE) {
                     vTaskDelay (2000 / portTICK_PERIOD_MS);
                     esp_restart();
@@ -0,0 +1,444 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "BinaryReader.h"
+
+// -----------------------------------------------------------------------------
+
+const uint32_t indefiniteCount = UINT32_MAX;
+
+/**
+ * @brief Converts a IEEE 754 half precision float
+ */
+static double HalfToDouble(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1F;
+    int mantissa = half & 0x3FF;
+
+    double value;
+    if (exponent == 0)       value = ldexp(mantissa, -24);
+    else if (exponent == 31) value = (mantissa == 0) ? INFINITY : NAN;
+    else                     value = ldexp(mantissa + 1024, exponent - 25);
+
+    return ((half & 0x8000) != 0) ? -value : value;
+}
+
+// -----------------------------------------------------------------------------
+
+BinaryReader::BinaryReader(BinaryFormat dataFormat, JSONReaderHandler *readerHandler) : JSONReader(readerHandler)
+{
+    format = dataFormat;
+    Reset();
+}
+
+BinaryReader::~BinaryReader()
+{
+    //
+}
+
+void BinaryReader::Reset(void)
+{
+    JSONReader::Reset();
+
+    step = (handler == nullptr) ? Step::error : Step::head;
+    item = Item::nullValue;
+    indefinite = false;
+    argumentSize = 0;
+    argumentReceived = 0;
+    argument = 0;
+    payloadLeft = 0;
+    keyMask = 0;
+}
+
+bool BinaryReader::HasError(void)
+{
+    return step == Step::error;
+}
+
+bool BinaryReader::Stop(void)
+{
+    step = Step::error;
+    return false;
+}
+
+bool BinaryReader::Feed(const char *data, size_t length)
+{
+    if (data == nullptr) return length == 0 && !HasError();
+
+    for (size_t idx = 0; idx < length; ++idx) {
+        if (!Process((uint8_t)data[idx])) return false;
+    }
+    return step != Step::error;
+}
+
+bool BinaryReader::Finish(void)
+{
+    return step == Step::done;
+}
+
+bool BinaryReader::Process(uint8_t c)
+{
+    switch (step) {
+        case Step::head:
+            return (format == BinaryFormat::cbor) ? DecodeCBOR(c) : DecodeMsgPack(c);
+
+        case Step::argument:
+            argument = (argument << 8) | c;
+            if (++argumentReceived < argumentSize) return true;
+            return EndHead();
+
+        case Step::payload:
+            token[tokenLen++] = (char)c;
+            if (--payloadLeft > 0) return true;
+            step = Step::head;
+            return EndString();
+
+        case Step::done:
+            // data after the end of the document
+            return Stop();
+
+        default:
+            return false;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+bool BinaryReader::DecodeCBOR(uint8_t c)
+{
+    uint8_t major = c >> 5;
+    uint8_t info = c & 0x1F;
+
+    indefinite = false;
+    argument = info;
+    argumentSize = 0;
+
+    if ((info >= 24) && (info <= 27)) {
+        argumentSize = (uint8_t)1 << (info - 24);
+        argument = 0;
+    }
+    else if ((info >= 28) && (info <= 30)) {
+        return Stop();
+    }
+
+    switch (major) {
+        case 0: item = Item::uintValue; break;
+        case 1: item = Item::negValue; break;
+        case 2:
+        case 3: item = Item::string; break;
+        case 4: item = Item::array; break;
+        case 5: item = Item::map; break;
+        case 6: item = Item::tag; break;
+        default:
+            switch (info) {
+                case 20: item = Item::falseValue; break;
+                case 21: item = Item::trueValue; break;
+                case 22:
+                case 23: item = Item::nullValue; break;
+                case 25: item = Item::float16; break;
+                case 26: item = Item::float32; break;
+                case 27: item = Item::float64; break;
+                case 31: item = Item::breakCode; break;
+                default: return Stop();
+            }
+            break;
+    }
+
+    if (info == 31) {
+        if ((item != Item::array) && (item != Item::map) && (item != Item::breakCode)) return Stop();
+        indefinite = true;
+    }
+
+    if (argumentSize == 0) return EndHead();
+
+    argumentReceived = 0;
+    step = Step::argument;
+    return true;
+}
+
+bool BinaryReader::DecodeMsgPack(uint8_t c)
+{
+    indefinite = false;
+    argument = 0;
+    argumentSize = 0;
+
+    if (c <= 0x7F)      { item = Item::uintValue; argument = c; }
+    else if (c <= 0x8F) { item = Item::map;       argument = c & 0x0F; }
+    else if (c <= 0x9F) { item = Item::array;     argument = c & 0x0F; }
+    else if (c <= 0xBF) { item = Item::string;    argument = c & 0x1F; }
+    else if (c >= 0xE0) { item = Item::intValue;  argument = (uint64_t)(int64_t)(int8_t)c; }
+    else {
+        switch (c) {
+            case 0xC0: item = Item::nullValue; break;
+            case 0xC2: item = Item::falseValue; break;
+            case 0xC3: item = Item::trueValue; break;
+            case 0xC4:
+            case 0xC5:
+            case 0xC6: item = Item::string; argumentSize = (uint8_t)1 << (c - 0xC4); break;
+            case 0xCA: item = Item::float32; argumentSize = 4; break;
+            case 0xCB: item = Item::float64; argumentSize = 8; break;
+            case 0xCC:
+            case 0xCD:
+            case 0xCE:
+            case 0xCF: item = Item::uintValue; argumentSize = (uint8_t)1 << (c - 0xCC); break;
+            case 0xD0:
+            case 0xD1:
+            case 0xD2:
+            case 0xD3: item = Item::intValue; argumentSize = (uint8_t)1 << (c - 0xD0); break;
+            case 0xD9:
+            case 0xDA:
+            case 0xDB: item = Item::string; argumentSize = (uint8_t)1 << (c - 0xD9); break;
+            case 0xDC: item = Item::array; argumentSize = 2; break;
+            case 0xDD: item = Item::array; argumentSize = 4; break;
+            case 0xDE: item = Item::map; argumentSize = 2; break;
+            case 0xDF: item = Item::map; argumentSize = 4; break;
+            default: return Stop();
+        }
+    }
+
+    if (argumentSize == 0) return EndHead();
+
+    argumentReceived = 0;
+    step = Step::argument;
+    return true;
+}
+
+bool BinaryReader::EndHead(void)
+{
+    step = Step::head;
+
+    switch (item) {
+        case Item::tag:
+            // the tagged item follows
+            return true;
+
+        case Item::breakCode:
+            if ((depth == 0) || (remaining[depth] != indefiniteCount)) return Stop();
+            if (!InArray() && !IsKeyNext()) return Stop();
+            return CloseContainer() && EndItem();
+
+        case Item::array:
+        case Item::map:
+            if (IsKeyNext()) return Stop();
+            return OpenContainer(item == Item::array, argument);
+
+        case Item::string: {
+            size_t maxLen = IsKeyNext() ? JSONReaderKeySize : JSONReaderTokenSize;
+            if (argument >= maxLen) return Stop();
+            tokenLen = 0;
+            token[0] = 0;
+            if (argument == 0) return EndString();
+            payloadLeft = (uint32_t)argument;
+            step = Step::payload;
+            return true;
+        }
+
+        case Item::falseValue:
+        case Item::trueValue:
+        case Item::nullValue: {
+            if (IsKeyNext()) return Stop();
+            // the same text as the JSON literals
+            const char *text = (item == Item::nullValue) ? "null" : ((item == Item::trueValue) ? "true" : "false");
+            JSONValue value;
+            value.type = (item == Item::nullValue) ? JSONValueType::null : JSONValueType::boolean;
+            value.boolean = (item == Item::trueValue);
+            value.text = token;
+            value.length = strlen(text);
+            memcpy(token, text, value.length + 1);
+            return EndScalar(value);
+        }
+
+        default:
+            if (IsKeyNext()) return Stop();
+            return EndNumber();
+    }
+}
+
+bool BinaryReader::IsKeyNext(void)
+{
+    if ((depth == 0) || InArray()) return false;
+    return (keyMask & ((uint32_t)1 << depth)) != 0;
+}
+
+bool BinaryReader::EndScalar(JSONValue& value)
+{
+    const char *k = (InArray() || (depth == 0)) ? nullptr : key;
+    if (!handler->OnValue(depth, k, value)) return Stop();
+
+    tokenLen = 0;
+    token[0] = 0;
+    return EndItem();
+}
+
+bool BinaryReader::EndString(void)
+{
+    token[tokenLen] = 0;
+
+    if (IsKeyNext()) {
+        memcpy(key, token, tokenLen + 1);
+        keyMask &= ~((uint32_t)1 << depth);
+        tokenLen = 0;
+        token[0] = 0;
+        return true;
+    }
+
+    JSONValue value;
+    value.type = JSONValueType::string;
+    value.boolean = false;
+    value.text = token;
+    value.length = tokenLen;
+    return EndScalar(value);
+}
+
+bool BinaryReader::EndNumber(void)
+{
+    double real = 0;
+    bool isReal = false;
+    int len = 0;
+
+    switch (item) {
+        case Item::uintValue:
+            len = snprintf(token, JSONReaderTokenSize, "%llu", (unsigned long long)argument);
+            break;
+
+        case Item::negValue:
+            // the value is -1 - argument
+            if (argument == UINT64_MAX) return Stop();
+            len = snprintf(token, JSONReaderTokenSize, "-%llu", (unsigned long long)(argument + 1));
+            break;
+
+        case Item::intValue: {
+            int64_t value;
+            switch (argumentSize) {
+                case 1:  value = (int8_t)argument; break;
+                case 2:  value = (int16_t)argument; break;
+                case 4:  value = (int32_t)argument; break;
+                default: value = (int64_t)argument; break;
+            }
+            len = snprintf(token, JSONReaderTokenSize, "%lld", (long long)value);
+            break;
+        }
+
+        case Item::float16:
+            real = HalfToDouble((uint16_t)argument);
+            isReal = true;
+            break;
+
+        case Item::float32: {
+            uint32_t bits = (uint32_t)argument;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            real = f;
+            isReal = true;
+            break;
+        }
+
+        case Item::float64:
+            memcpy(&real, &argument, sizeof(real));
+            isReal = true;
+            break;
+
+        default:
+            return Stop();
+    }
+
+    JSONValue value;
+    value.type = JSONValueType::number;
+    value.boolean = false;
+    value.text = token;
+
+    if (isReal) {
+        if (std::isnan(real) || std::isinf(real)) {
+            // like JSONWriter, which writes them as null
+            token[0] = 0;
+            value.type = JSONValueType::null;
+            value.length = 0;
+            return EndScalar(value);
+        }
+        // the shortest text which converts back to the same value
+        len = snprintf(token, JSONReaderTokenSize, "%.15g", real);
+        if (strtod(token, nullptr) != real) {
+            len = snprintf(token, JSONReaderTokenSize, "%.17g", real);
+        }
+    }
+
+    if ((len <= 0) || (len >= (int)JSONReaderTokenSize)) return Stop();
+    value.length = (size_t)len;
+    return EndScalar(value);
+}
+
+// -----------------------------------------------------------------------------
+
+bool BinaryReader::OpenContainer(bool isArray, uint64_t count)
+{
+    if (depth + 1 >= JSONReaderMaxDepth) return Stop();
+    if (!indefinite && (count >= indefiniteCount)) return Stop();
+
+    const char *k = (InArray() || (depth == 0)) ? nullptr : key;
+    if (!handler->OnBegin(depth + 1, k, isArray)) return Stop();
+
+    ++depth;
+    uint32_t mask = (uint32_t)1 << depth;
+    if (isArray) {
+        arrayMask |= mask;
+        keyMask &= ~mask;
+    }
+    else {
+        arrayMask &= ~mask;
+        keyMask |= mask;
+    }
+    remaining[depth] = indefinite ? indefiniteCount : (uint32_t)count;
+
+    if (remaining[depth] == 0) {
+        return CloseContainer() && EndItem();
+    }
+    return true;
+}
+
+bool BinaryReader::CloseContainer(void)
+{
+    if (depth == 0) return Stop();
+
+    if (!handler->OnEnd(depth, InArray())) return Stop();
+
+    --depth;
+    return true;
+}
+
+bool BinaryReader::EndItem(void)
+{
+    for (;;) {
+        if (depth == 0) {
+            step = Step::done;
+            return true;
+        }
+
+        if (!InArray()) keyMask |= (uint32_t)1 << depth;
+        if (remaining[depth] == indefiniteCount) return true;
+        if (--remaining[depth] > 0) return true;
+
+        // this was the last element, the container is an element of its parent
+        if (!CloseContainer()) return false;
+    }
+}
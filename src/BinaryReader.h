@@ -0,0 +1,99 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BinaryReader_H
+#define BinaryReader_H
+
+#include "JSONReader.h"
+
+enum class BinaryFormat : uint8_t {
+    cbor, msgpack
+};
+
+/**
+ * @brief Incremental CBOR or MessagePack parser with the events of JSONReader
+ *
+ * The same handler can read a JSON, CBOR or MessagePack document. The numbers are given
+ * to the handler as text, like the ones of a JSON document, so the JSONValue conversions work
+ * unchanged. Byte strings are reported as strings. The keys must be strings, CBOR tags are
+ * ignored and the non-finite floats are reported as null. Indefinite length strings and
+ * the MessagePack extension types are not supported.
+ */
+class BinaryReader : public JSONReader
+{
+public:
+    BinaryReader(BinaryFormat format, JSONReaderHandler *handler);
+    virtual ~BinaryReader();
+
+    virtual void Reset(void);
+    virtual bool Feed(const char *data, size_t length);
+    virtual bool Finish(void);
+    virtual bool HasError(void);
+
+protected:
+    enum class Step : uint8_t {
+        head, argument, payload, done, error
+    };
+
+    enum class Item : uint8_t {
+        uintValue, negValue, intValue,
+        float16, float32, float64,
+        string, array, map,
+        falseValue, trueValue, nullValue,
+        tag, breakCode
+    };
+
+    BinaryFormat format;
+    Step step;
+    Item item;
+
+    /** for definite length items, the argument is collected in `argument` */
+    bool indefinite;
+    uint8_t argumentSize;
+    uint8_t argumentReceived;
+    uint64_t argument;
+    uint32_t payloadLeft;
+
+    /** elements left in each container, pairs for the maps, UINT32_MAX if indefinite */
+    uint32_t remaining[JSONReaderMaxDepth];
+    /** bit n is set if the next item of the map at depth n is a key */
+    uint32_t keyMask;
+
+    bool Stop(void);
+    bool Process(uint8_t c);
+
+    bool DecodeCBOR(uint8_t c);
+    bool DecodeMsgPack(uint8_t c);
+    bool EndHead(void);
+
+    bool IsKeyNext(void);
+    bool EndScalar(JSONValue&);
+    bool EndString(void);
+    bool EndNumber(void);
+
+    bool OpenContainer(bool isArray, uint64_t count);
+    bool CloseContainer(void);
+
+    /**
+     * @brief Counts a complete value in its container, closing the containers which are complete
+     */
+    bool EndItem(void);
+};
+
+#endif
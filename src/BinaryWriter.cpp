@@ -0,0 +1,433 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "BinaryWriter.h"
+
+// -----------------------------------------------------------------------------
+
+const uint8_t cborUInt   = 0;
+const uint8_t cborNegInt = 1;
+const uint8_t cborText   = 3;
+
+const uint8_t cborArrayIndefinite = 0x9F;
+const uint8_t cborMapIndefinite   = 0xBF;
+const uint8_t cborFalse   = 0xF4;
+const uint8_t cborTrue    = 0xF5;
+const uint8_t cborNull    = 0xF6;
+const uint8_t cborFloat32 = 0xFA;
+const uint8_t cborFloat64 = 0xFB;
+const uint8_t cborBreak   = 0xFF;
+
+const uint8_t mpNil     = 0xC0;
+const uint8_t mpFalse   = 0xC2;
+const uint8_t mpTrue    = 0xC3;
+const uint8_t mpFloat32 = 0xCA;
+const uint8_t mpFloat64 = 0xCB;
+const uint8_t mpUInt8   = 0xCC;
+const uint8_t mpInt8    = 0xD0;
+const uint8_t mpStr8    = 0xD9;
+const uint8_t mpArray16 = 0xDC;
+const uint8_t mpMap16   = 0xDE;
+
+/**
+ * @brief Returns true if the value is the same as a single precision float
+ */
+static bool FitsFloat(double value)
+{
+    if (std::isnan(value) || std::isinf(value)) return true;
+    return (double)(float)value == value;
+}
+
+static uint32_t FloatBits(double value)
+{
+    float f = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static uint64_t DoubleBits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// -----------------------------------------------------------------------------
+
+CBORWriter::CBORWriter(char *buf, size_t bufSize, JSONSink *dataSink) : JSONWriter(buf, bufSize, dataSink)
+{
+    //
+}
+
+CBORWriter::~CBORWriter()
+{
+    //
+}
+
+bool CBORWriter::PutHead(uint8_t major, uint64_t value)
+{
+    uint8_t type = major << 5;
+    uint8_t size;
+
+    if (value < 24)                 { return Put((char)(type | value)); }
+    else if (value <= 0xFF)         { Put((char)(type | 24)); size = 1; }
+    else if (value <= 0xFFFF)       { Put((char)(type | 25)); size = 2; }
+    else if (value <= 0xFFFFFFFFUL) { Put((char)(type | 26)); size = 4; }
+    else                            { Put((char)(type | 27)); size = 8; }
+
+    while (size > 0) {
+        --size;
+        Put((char)(value >> (8 * size)));
+    }
+    return ok;
+}
+
+bool CBORWriter::PutText(const char *str)
+{
+    if (str == nullptr) str = "";
+
+    size_t len = strlen(str);
+    PutHead(cborText, len);
+    return Put(str, len);
+}
+
+bool CBORWriter::PutKey(const char *key)
+{
+    if (key == nullptr) return ok;
+    return PutText(key);
+}
+
+bool CBORWriter::OpenContainer(const char *key, uint8_t head)
+{
+    if (depth + 1 >= JSONWriterMaxDepth) {
+        ok = false;
+        return false;
+    }
+
+    PutKey(key);
+    ++depth;
+    return Put((char)head);
+}
+
+bool CBORWriter::CloseContainer(void)
+{
+    if (depth == 0) {
+        ok = false;
+        return false;
+    }
+
+    --depth;
+    return Put((char)cborBreak);
+}
+
+bool CBORWriter::BeginObject(const char *key)
+{
+    return OpenContainer(key, cborMapIndefinite);
+}
+
+bool CBORWriter::EndObject(void)
+{
+    return CloseContainer();
+}
+
+bool CBORWriter::BeginArray(const char *key)
+{
+    return OpenContainer(key, cborArrayIndefinite);
+}
+
+bool CBORWriter::EndArray(void)
+{
+    return CloseContainer();
+}
+
+bool CBORWriter::AddString(const char *key, const char *value)
+{
+    PutKey(key);
+    return PutText(value);
+}
+
+bool CBORWriter::AddInt(const char *key, int64_t value)
+{
+    PutKey(key);
+    if (value < 0) {
+        // the argument of a negative integer is -1 - value
+        return PutHead(cborNegInt, (uint64_t)(-(value + 1)));
+    }
+    return PutHead(cborUInt, (uint64_t)value);
+}
+
+bool CBORWriter::AddUInt(const char *key, uint64_t value)
+{
+    PutKey(key);
+    return PutHead(cborUInt, value);
+}
+
+bool CBORWriter::AddDouble(const char *key, double value)
+{
+    PutKey(key);
+
+    uint64_t bits;
+    uint8_t size;
+    if (FitsFloat(value)) {
+        Put((char)cborFloat32);
+        bits = FloatBits(value);
+        size = 4;
+    }
+    else {
+        Put((char)cborFloat64);
+        bits = DoubleBits(value);
+        size = 8;
+    }
+
+    while (size > 0) {
+        --size;
+        Put((char)(bits >> (8 * size)));
+    }
+    return ok;
+}
+
+bool CBORWriter::AddBool(const char *key, bool value)
+{
+    PutKey(key);
+    return Put((char)(value ? cborTrue : cborFalse));
+}
+
+bool CBORWriter::AddNull(const char *key)
+{
+    PutKey(key);
+    return Put((char)cborNull);
+}
+
+// -----------------------------------------------------------------------------
+
+MsgPackWriter::MsgPackWriter(char *buf, size_t bufSize, JSONSink *dataSink) : JSONWriter(buf, bufSize, dataSink)
+{
+    heap = nullptr;
+    counts[0] = 0;
+    headers[0] = 0;
+}
+
+MsgPackWriter::~MsgPackWriter()
+{
+    if (heap != nullptr) {
+        free(heap);
+        heap = nullptr;
+    }
+}
+
+bool MsgPackWriter::Reserve(size_t len)
+{
+    if (!ok) return false;
+    if (used + len <= bufferSize) return true;
+
+    size_t newSize = bufferSize * 2;
+    if (newSize < used + len) newSize = used + len;
+    if (newSize > MsgPackWriterMaxSize) newSize = MsgPackWriterMaxSize;
+    if (used + len > newSize) {
+        ok = false;
+        return false;
+    }
+
+    char *newHeap = (char*)realloc(heap, newSize);
+    if (newHeap == nullptr) {
+        ok = false;
+        return false;
+    }
+    if (heap == nullptr) {
+        memcpy(newHeap, buffer, used);
+    }
+    heap = newHeap;
+    buffer = heap;
+    bufferSize = newSize;
+    return true;
+}
+
+bool MsgPackWriter::PutByte(uint8_t value)
+{
+    if (!Reserve(1)) return false;
+    buffer[used++] = (char)value;
+    return true;
+}
+
+bool MsgPackWriter::PutBytes(const char *data, size_t len)
+{
+    if (!Reserve(len)) return false;
+    memcpy(buffer + used, data, len);
+    used += len;
+    return true;
+}
+
+bool MsgPackWriter::PutBE(uint8_t head, uint64_t value, uint8_t size)
+{
+    if (!Reserve(1 + size)) return false;
+
+    buffer[used++] = (char)head;
+    while (size > 0) {
+        --size;
+        buffer[used++] = (char)(value >> (8 * size));
+    }
+    return true;
+}
+
+bool MsgPackWriter::PutStr(const char *str)
+{
+    if (str == nullptr) str = "";
+
+    size_t len = strlen(str);
+    if (len < 32)               PutByte(0xA0 | (uint8_t)len);
+    else if (len <= 0xFF)       PutBE(mpStr8, len, 1);
+    else if (len <= 0xFFFF)     PutBE(mpStr8 + 1, len, 2);
+    else                        PutBE(mpStr8 + 2, len, 4);
+    return PutBytes(str, len);
+}
+
+bool MsgPackWriter::PutItem(const char *key)
+{
+    if (!ok) return false;
+
+    if (depth > 0) ++counts[depth];
+    if (key == nullptr) return true;
+    return PutStr(key);
+}
+
+bool MsgPackWriter::OpenContainer(const char *key, uint8_t head)
+{
+    if (depth + 1 >= JSONWriterMaxDepth) {
+        ok = false;
+        return false;
+    }
+
+    PutItem(key);
+    ++depth;
+    headers[depth] = used;
+    counts[depth] = 0;
+
+    // the size is written when the container is closed
+    return PutBE(head, 0, 2);
+}
+
+bool MsgPackWriter::CloseContainer(void)
+{
+    if (!ok) return false;
+    if (depth == 0) {
+        ok = false;
+        return false;
+    }
+
+    size_t pos = headers[depth];
+    uint32_t count = counts[depth];
+    bool isMap = (uint8_t)buffer[pos] == mpMap16;
+    --depth;
+
+    if (count < 16) {
+        // use the fixmap or fixarray header, one byte instead of three
+        buffer[pos] = (char)((isMap ? 0x80 : 0x90) | count);
+        memmove(buffer + pos + 1, buffer + pos + 3, used - pos - 3);
+        used -= 2;
+        return true;
+    }
+    if (count > 0xFFFF) {
+        ok = false;
+        return false;
+    }
+    buffer[pos + 1] = (char)(count >> 8);
+    buffer[pos + 2] = (char)count;
+    return true;
+}
+
+bool MsgPackWriter::BeginObject(const char *key)
+{
+    return OpenContainer(key, mpMap16);
+}
+
+bool MsgPackWriter::EndObject(void)
+{
+    return CloseContainer();
+}
+
+bool MsgPackWriter::BeginArray(const char *key)
+{
+    return OpenContainer(key, mpArray16);
+}
+
+bool MsgPackWriter::EndArray(void)
+{
+    return CloseContainer();
+}
+
+bool MsgPackWriter::AddString(const char *key, const char *value)
+{
+    PutItem(key);
+    return PutStr(value);
+}
+
+bool MsgPackWriter::AddInt(const char *key, int64_t value)
+{
+    if (value >= 0) return AddUInt(key, (uint64_t)value);
+
+    PutItem(key);
+    if (value >= -32)           return PutByte((uint8_t)(int8_t)value);
+    if (value >= INT8_MIN)      return PutBE(mpInt8, (uint64_t)value, 1);
+    if (value >= INT16_MIN)     return PutBE(mpInt8 + 1, (uint64_t)value, 2);
+    if (value >= INT32_MIN)     return PutBE(mpInt8 + 2, (uint64_t)value, 4);
+    return PutBE(mpInt8 + 3, (uint64_t)value, 8);
+}
+
+bool MsgPackWriter::AddUInt(const char *key, uint64_t value)
+{
+    PutItem(key);
+    if (value < 0x80)           return PutByte((uint8_t)value);
+    if (value <= 0xFF)          return PutBE(mpUInt8, value, 1);
+    if (value <= 0xFFFF)        return PutBE(mpUInt8 + 1, value, 2);
+    if (value <= 0xFFFFFFFFUL)  return PutBE(mpUInt8 + 2, value, 4);
+    return PutBE(mpUInt8 + 3, value, 8);
+}
+
+bool MsgPackWriter::AddDouble(const char *key, double value)
+{
+    PutItem(key);
+    if (FitsFloat(value)) return PutBE(mpFloat32, FloatBits(value), 4);
+    return PutBE(mpFloat64, DoubleBits(value), 8);
+}
+
+bool MsgPackWriter::AddBool(const char *key, bool value)
+{
+    PutItem(key);
+    return PutByte(value ? mpTrue : mpFalse);
+}
+
+bool MsgPackWriter::AddNull(const char *key)
+{
+    PutItem(key);
+    return PutByte(mpNil);
+}
+
+bool MsgPackWriter::Flush(void)
+{
+    // the sizes of the open containers are not known yet
+    if (depth > 0) return ok;
+    return JSONWriter::Flush();
+}
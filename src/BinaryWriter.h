@@ -0,0 +1,116 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BinaryWriter_H
+#define BinaryWriter_H
+
+#include "JSONWriter.h"
+
+/** the largest document a MsgPackWriter keeps in memory */
+const size_t MsgPackWriterMaxSize = 16384;
+
+/**
+ * @brief Streaming CBOR (RFC 8949) serializer with the interface of JSONWriter
+ *
+ * The objects and arrays are written with indefinite lengths so, like JSONWriter, the data
+ * is handed to the sink each time the buffer is full. The keys are text strings, the
+ * doubles are written as single precision floats when this does not lose precision.
+ */
+class CBORWriter : public JSONWriter
+{
+public:
+    CBORWriter(char *buffer, size_t bufferSize, JSONSink *sink);
+    virtual ~CBORWriter();
+
+    virtual bool BeginObject(const char *key);
+    virtual bool EndObject(void);
+    virtual bool BeginArray(const char *key);
+    virtual bool EndArray(void);
+
+    virtual bool AddString(const char *key, const char *value);
+    virtual bool AddInt(const char *key, int64_t value);
+    virtual bool AddUInt(const char *key, uint64_t value);
+    virtual bool AddDouble(const char *key, double value);
+    virtual bool AddBool(const char *key, bool value);
+    virtual bool AddNull(const char *key);
+
+protected:
+    /**
+     * @brief Writes the initial byte of a data item and its argument
+     */
+    bool PutHead(uint8_t major, uint64_t value);
+    bool PutText(const char *str);
+    bool PutKey(const char *key);
+
+    bool OpenContainer(const char *key, uint8_t head);
+    bool CloseContainer(void);
+};
+
+/**
+ * @brief MessagePack serializer with the interface of JSONWriter
+ *
+ * MessagePack needs the number of elements before the elements, so the whole document
+ * is kept in memory until the top container is closed and the sizes are filled in then.
+ * The buffer of the caller is used first, a larger document is moved to the heap,
+ * up to MsgPackWriterMaxSize bytes. Flush sends the data only when no container is open.
+ */
+class MsgPackWriter : public JSONWriter
+{
+public:
+    MsgPackWriter(char *buffer, size_t bufferSize, JSONSink *sink);
+    virtual ~MsgPackWriter();
+
+    virtual bool BeginObject(const char *key);
+    virtual bool EndObject(void);
+    virtual bool BeginArray(const char *key);
+    virtual bool EndArray(void);
+
+    virtual bool AddString(const char *key, const char *value);
+    virtual bool AddInt(const char *key, int64_t value);
+    virtual bool AddUInt(const char *key, uint64_t value);
+    virtual bool AddDouble(const char *key, double value);
+    virtual bool AddBool(const char *key, bool value);
+    virtual bool AddNull(const char *key);
+
+    virtual bool Flush(void);
+
+protected:
+    /** the document when it outgrew the buffer of the caller */
+    char *heap;
+
+    /** offset of the header of each open container and the number of its elements */
+    size_t headers[JSONWriterMaxDepth];
+    uint32_t counts[JSONWriterMaxDepth];
+
+    bool Reserve(size_t length);
+    bool PutByte(uint8_t value);
+    bool PutBytes(const char *data, size_t length);
+    bool PutBE(uint8_t head, uint64_t value, uint8_t size);
+    bool PutStr(const char *str);
+
+    /**
+     * @brief Counts the element in its container and writes the key, if any
+     */
+    bool PutItem(const char *key);
+
+    bool OpenContainer(const char *key, uint8_t head);
+    bool CloseContainer(void);
+};
+
+#endif
@@ -43,6 +43,8 @@ const char* ConfigJSON = "cfgJSON";
 
 Configuration::Configuration(void)
 {
+    changeCount = 0;
+    jsonVersionOK = false;
     InitData();
 }
 
@@ -64,6 +66,18 @@ void Configuration::InitData(void)
     std::fill(ipMask, ipMask + ipv4BufLen, static_cast<char>(0));
     std::fill(ipGateway, ipGateway + ipv4BufLen, static_cast<char>(0));
     std::fill(ipDNS, ipDNS + ipv4BufLen, static_cast<char>(0));
+
+    MarkChanged();
+}
+
+uint32_t Configuration::GetChangeCount(void)
+{
+    return changeCount;
+}
+
+void Configuration::MarkChanged(void)
+{
+    changeCount = changeCount + 1;
 }
 
 esp_err_t Configuration::InitializeNVS(void)
@@ -85,132 +99,118 @@ esp_err_t Configuration::InitializeNVS(void)
     return err;
 }
 
-bool Configuration::CreateJSON_CustomData(cJSON*)
+bool Configuration::WriteJSON_CustomData(JSONWriter&)
 {
     return true;
 }
 
-char* Configuration::CreateJSONConfigString(bool addWhitespaces)
+bool Configuration::WriteJSON(JSONWriter& writer, bool withSecrets)
 {
-    char *str = nullptr;
+    writer.AddUInt("version", version);
+    writer.AddString("name", name);
+    if (withSecrets) writer.AddString("pass", pass);
 
-    cJSON *cfg = cJSON_CreateObject();
+    writer.AddString("ap1s", ap[0].ssid);
+    if (withSecrets) writer.AddString("ap1p", ap[0].pass);
+    writer.AddString("ap2s", ap[1].ssid);
+    if (withSecrets) writer.AddString("ap2p", ap[1].pass);
 
-    if (cJSON_AddNumberToObject(cfg, "version", version) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "name", name.c_str()) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "pass", name.c_str()) == NULL) { cJSON_Delete(cfg); return str; }
+    writer.AddString("ipAddr", ipAddr);
+    writer.AddString("ipMask", ipMask);
+    writer.AddString("ipGateway", ipGateway);
+    writer.AddString("ipDNS", ipDNS);
 
-    if (cJSON_AddStringToObject(cfg, "ap1s", ap[0].ssid.c_str()) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "ap1p", ap[0].pass.c_str()) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "ap2s", ap[1].ssid.c_str()) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "ap2p", ap[1].pass.c_str()) == NULL) { cJSON_Delete(cfg); return str; }
+    if (!WriteJSON_CustomData(writer)) return false;
 
-    if (cJSON_AddStringToObject(cfg, "ipAddr", ipAddr) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "ipMask", ipMask) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "ipGateway", ipGateway) == NULL) { cJSON_Delete(cfg); return str; }
-    if (cJSON_AddStringToObject(cfg, "ipDNS", ipDNS) == NULL) { cJSON_Delete(cfg); return str; }
+    return writer.IsOK();
+}
 
-    if (!CreateJSON_CustomData(cfg)) { cJSON_Delete(cfg); return str; }
+char* Configuration::CreateJSONConfigString(size_t *length)
+{
+    char buffer[JSONWriterBufferSize];
+    JSONStringSink sink;
+    JSONWriter writer(buffer, JSONWriterBufferSize, &sink);
 
-    if (addWhitespaces) { str = cJSON_Print(cfg); }
-    else                { str = cJSON_PrintUnformatted(cfg); }
+    writer.BeginObject(nullptr);
+    bool res = WriteJSON(writer, true);
+    writer.EndObject();
 
-    cJSON_Delete(cfg);
-    return str;
-}
+    if (!res || !writer.Flush()) { return nullptr; }
 
-bool Configuration::SetFromJSONString_CustomData(cJSON*)
-{
-    return true;
+    return sink.Release(length);
 }
 
-bool Configuration::SetIntFromJSON(int& value, const char *id, cJSON *jstr)
+bool Configuration::SetFromJSON_CustomData(const char*, const JSONValue&)
 {
-    cJSON *item = cJSON_GetObjectItemCaseSensitive(jstr, id);
-    if (item == NULL) return false;
-    if (!cJSON_IsNumber(item)) return false;
-
-    value = item->valueint;
     return true;
 }
 
-bool Configuration::SetStringFromJSON(std::string& str, const char *id, cJSON *jstr)
+void Configuration::BeginJSON(bool keepSecrets)
 {
-    cJSON *item = cJSON_GetObjectItemCaseSensitive(jstr, id);
-    if (item == NULL) return false;
-    if (!cJSON_IsString(item)) return false;
-
-    if (item->valuestring == NULL){
-        str.clear();
+    // set everything to default, any of the members may be missing
+    if (keepSecrets) {
+        std::string secrets[1 + WiFiConfigCnt];
+        secrets[0].swap(pass);
+        for (uint8_t i = 0; i < WiFiConfigCnt; ++i)
+            secrets[1 + i].swap(ap[i].pass);
+
+        InitData();
+
+        pass.swap(secrets[0]);
+        for (uint8_t i = 0; i < WiFiConfigCnt; ++i)
+            ap[i].pass.swap(secrets[1 + i]);
     }
     else {
-        str = item->valuestring;
+        InitData();
     }
-    return true;
+    jsonVersionOK = false;
 }
 
-bool Configuration::SetStringFromJSON(char *str, uint8_t len, const char *id, cJSON *jstr)
+bool Configuration::OnValue(uint8_t depth, const char *key, const JSONValue& value)
 {
-    cJSON *item = cJSON_GetObjectItemCaseSensitive(jstr, id);
-    if (item == NULL) return false;
-    if (!cJSON_IsString(item)) return false;
-
-    std::fill(str, str + len, static_cast<char>(0));
-    if (item->valuestring != NULL) {
-        strncpy(str, item->valuestring, len);
-        str[len - 1] = 0;
+    // only the members of the configuration object are used
+    if ((depth != 1) || (key == nullptr)) return true;
+
+    if (strcmp(key, "version") == 0) {
+        // if the version is not the one I know stop with error
+        if (!value.ToUInt32(version)) return false;
+        jsonVersionOK = (version == ConfigurationVersion);
+        return jsonVersionOK;
     }
 
+    // these are NOT critical configuration values so the result is not checked
+    if      (strcmp(key, "name") == 0) value.ToString(name);
+    else if (strcmp(key, "pass") == 0) value.ToString(pass);
+    else if (strcmp(key, "ap1s") == 0) value.ToString(ap[0].ssid);
+    else if (strcmp(key, "ap1p") == 0) value.ToString(ap[0].pass);
+    else if (strcmp(key, "ap2s") == 0) value.ToString(ap[1].ssid);
+    else if (strcmp(key, "ap2p") == 0) value.ToString(ap[1].pass);
+    else if (strcmp(key, "ipAddr") == 0)    value.ToString(ipAddr, ipv4BufLen);
+    else if (strcmp(key, "ipMask") == 0)    value.ToString(ipMask, ipv4BufLen);
+    else if (strcmp(key, "ipGateway") == 0) value.ToString(ipGateway, ipv4BufLen);
+    else if (strcmp(key, "ipDNS") == 0)     value.ToString(ipDNS, ipv4BufLen);
+    else return SetFromJSON_CustomData(key, value);
+
     return true;
 }
 
-bool Configuration::SetFromJSONString(char *jsonStr)
+bool Configuration::EndJSON(bool parsedOK)
 {
-    cJSON *cfg = cJSON_Parse(jsonStr);
-    if (cfg == NULL) {
-        const char *errStr = cJSON_GetErrorPtr();
-        if (errStr != NULL) {
-            ESP_LOGE(TAG, "JSON error before: \"%s\"", errStr);
-        }
-        return false;
-    }
+    MarkChanged();
+    return parsedOK && jsonVersionOK;
+}
 
-    // we have a valid JSON string, check if the version is OK
-    int value = 0;
-    bool res = SetIntFromJSON(value, "version", cfg);
-    if (!res){
-        cJSON_Delete(cfg);
-        return false;
-    }
-    version = value;
-    if (version != ConfigurationVersion) {
-        // if the version is not the one I know exit with error
-        cJSON_Delete(cfg);
-        return false;
+bool Configuration::SetFromJSONString(const char *jsonStr)
+{
+    if (jsonStr == nullptr) return false;
+
+    JSONReader reader(this);
+    BeginJSON(false);
+    reader.Feed(jsonStr, strlen(jsonStr));
+    bool res = EndJSON(reader.Finish());
+    if (!res) {
+        ESP_LOGE(TAG, "Invalid JSON configuration");
     }
-
-    // set everything to default
-    InitData();
-
-    // these are NOT critical configuration values ...
-    // ... so the exit code is not checked, any of these may be missing
-    // the default values are set by the previous call to InitData
-    SetStringFromJSON(name, "name", cfg);
-    SetStringFromJSON(pass, "pass", cfg);
-    SetStringFromJSON(ap[0].ssid, "ap1s", cfg);
-    SetStringFromJSON(ap[0].pass, "ap1p", cfg);
-    SetStringFromJSON(ap[1].ssid, "ap2s", cfg);
-    SetStringFromJSON(ap[1].pass, "ap2p", cfg);
-
-    SetStringFromJSON(ipAddr, ipv4BufLen, "ipAddr", cfg);
-    SetStringFromJSON(ipMask, ipv4BufLen, "ipMask", cfg);
-    SetStringFromJSON(ipGateway, ipv4BufLen, "ipGateway", cfg);
-    SetStringFromJSON(ipDNS, ipv4BufLen, "ipDNS", cfg);
-
-    SetFromJSONString_CustomData(cfg);
-
-    cJSON_Delete(cfg);
-
     return res;
 }
 
@@ -276,15 +276,14 @@ esp_err_t Configuration::ReadFromNVS(void)
 
 esp_err_t Configuration::WriteToNVS(bool eraseAll)
 {
-    nvs_handle_t nvsHandle;
-
-    esp_err_t err = nvs_open(ConfigNVS, NVS_READWRITE, &nvsHandle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "0x%x Failed to open NVS in readwrite mode", err);
-        return err;
-    }
-
     if (eraseAll) {
+        nvs_handle_t nvsHandle;
+
+        esp_err_t err = nvs_open(ConfigNVS, NVS_READWRITE, &nvsHandle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "0x%x Failed to open NVS in readwrite mode", err);
+            return err;
+        }
         err = nvs_erase_all(nvsHandle);
         if (err != ESP_OK) {
             nvs_close(nvsHandle);
@@ -297,16 +296,37 @@ esp_err_t Configuration::WriteToNVS(bool eraseAll)
             ESP_LOGE(TAG, "0x%x Failed to commit", err);
             return err;
         }
+        nvs_close(nvsHandle);
     }
 
-    char *str = CreateJSONConfigString(false);
+    char *str = CreateJSONConfigString(nullptr);
     if (str == nullptr) {
-        nvs_close(nvsHandle);
         return ESP_FAIL;
     }
 
-    err = nvs_set_str(nvsHandle, ConfigJSON, str);
+    esp_err_t err = WriteStringToNVS(str);
     free(str);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    MarkChanged();
+    return ESP_OK;
+}
+
+esp_err_t Configuration::WriteStringToNVS(const char *jsonStr)
+{
+    if (jsonStr == nullptr) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t nvsHandle;
+
+    esp_err_t err = nvs_open(ConfigNVS, NVS_READWRITE, &nvsHandle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "0x%x Failed to open NVS in readwrite mode", err);
+        return err;
+    }
+
+    err = nvs_set_str(nvsHandle, ConfigJSON, jsonStr);
     if (err != ESP_OK) {
         nvs_close(nvsHandle);
         return err;
@@ -21,14 +21,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define Configuration_H
 
 #include "freertos/FreeRTOS.h"
-#include "cJSON.h"
 #include "WiFiConfig.h"
+#include "JSONWriter.h"
+#include "JSONReader.h"
 
 const uint8_t NameBufLen = 64;
 const uint8_t WiFiConfigCnt = 2;
 const uint8_t ipv4BufLen = 16;
 
-class Configuration
+class Configuration : public JSONReaderHandler
 {
 public:
     Configuration(void);
@@ -51,20 +52,84 @@ public:
     esp_err_t WriteToNVS(bool eraseAll);
 
     /**
+     * @brief Saves a string created by CreateJSONConfigString
+     *
+     * Does not use the members so it can be called from another task,
+     * while the configuration is being changed.
+     */
+    esp_err_t WriteStringToNVS(const char *jsonStr);
+
+    /**
+     * @brief Writes the configuration as the members of an already opened JSON object
+     *
+     * @param withSecrets false to leave out the passwords, for the copies sent to clients.
+     *                    The copy saved in NVS needs them.
+     */
+    bool WriteJSON(JSONWriter&, bool withSecrets);
+
+    /**
+     * @brief Returns the configuration as a compact JSON string
+     *
+     * @param length if not nullptr receives the length of the string
+     *
      * @warning Delete returned string with 'free' !
      */
-    char* CreateJSONConfigString(bool addWhitespaces);
+    char* CreateJSONConfigString(size_t *length);
+
+    /**
+     * @brief Sets the configuration from a complete JSON string
+     */
+    bool SetFromJSONString(const char*);
+
+    /**
+     * @brief Incremental parsing of a JSON configuration
+     *
+     * Call BeginJSON, feed the data, as received, to a JSONReader having this configuration
+     * as handler then call EndJSON with the result of JSONReader::Finish.
+     * The members are set while parsing so, if EndJSON returns false, the configuration
+     * is partially modified and should be read again from NVS.
+     *
+     * @param keepSecrets true to keep the passwords missing from the JSON, which is the case
+     *                    for a configuration received from a client, see WriteJSON
+     */
+    void BeginJSON(bool keepSecrets);
+    bool EndJSON(bool parsedOK);
 
-    bool SetFromJSONString(char*);
+    virtual bool OnValue(uint8_t depth, const char *key, const JSONValue& value);
+
+    /**
+     * @brief Returns a counter incremented each time the configuration changes
+     *
+     * Is incremented by InitData, EndJSON and WriteToNVS.
+     * Used to invalidate the cached serializations of the configuration.
+     */
+    uint32_t GetChangeCount(void);
+
+    /**
+     * @brief Call it after changing the data members directly
+     */
+    void MarkChanged(void);
 
 protected:
-    virtual bool CreateJSON_CustomData(cJSON*);
+    volatile uint32_t changeCount;
 
-    virtual bool SetFromJSONString_CustomData(cJSON*);
+    /**
+     * @brief Override it to write the members added by a derived class
+     *
+     * For `config.json?fields=` the writer drops the members not requested, see JSONWriter::Wants.
+     */
+    virtual bool WriteJSON_CustomData(JSONWriter&);
+
+    /**
+     * @brief Override it to set the members added by a derived class
+     *
+     * Called for each member of the configuration object not known by this class.
+     * Return false only if the value makes the whole configuration invalid.
+     */
+    virtual bool SetFromJSON_CustomData(const char *key, const JSONValue& value);
 
-    bool SetIntFromJSON(int&, const char *id, cJSON *jstr);
-    bool SetStringFromJSON(std::string& str, const char *id, cJSON *jstr);
-    bool SetStringFromJSON(char *str, uint8_t len, const char *id, cJSON *jstr);
+    /** set when a known version is found while parsing */
+    bool jsonVersionOK;
 
 private:
 };
@@ -0,0 +1,254 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include "HTTPAsset.h"
+#include "HTTPResponseCache.h"
+
+// -----------------------------------------------------------------------------
+
+const size_t acceptEncodingBufLen = 128;
+const size_t rangeBufLen = 48;
+const size_t contentRangeBufLen = 48;
+
+enum class HTTPRangeResult : uint8_t {
+    none,           /**< no Range header, or one which is ignored */
+    valid,
+    unsatisfiable
+};
+
+// -----------------------------------------------------------------------------
+
+const HTTPAsset* HTTPFindAsset(const HTTPAsset *table, size_t count, const char *path)
+{
+    if ((table == nullptr) || (path == nullptr)) return nullptr;
+
+    // the query is not part of the path
+    size_t len = strcspn(path, "?#");
+    if ((len == 1) && (path[0] == '/')) {
+        path = "/index.html";
+        len = strlen(path);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if ((strncmp(table[i].path, path, len) == 0) && (table[i].path[len] == 0))
+            return &table[i];
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Returns true if the Accept-Encoding value accepts the coding
+ *
+ * The value is a list like `gzip, deflate;q=0.5, br;q=0`, a coding with q=0 is refused.
+ * The `*` entry applies to the codings not listed.
+ */
+static bool AcceptsEncoding(const char *header, const char *coding)
+{
+    size_t codingLen = strlen(coding);
+    bool any = false;
+
+    const char *p = header;
+    while (*p != 0) {
+        while ((*p == ' ') || (*p == '\t') || (*p == ',')) ++p;
+        if (*p == 0) break;
+
+        const char *name = p;
+        while ((*p != 0) && (*p != ',') && (*p != ';') && (*p != ' ') && (*p != '\t')) ++p;
+        size_t nameLen = p - name;
+
+        bool refused = false;
+        while ((*p != 0) && (*p != ',')) {
+            if (*p == ';') {
+                ++p;
+                while ((*p == ' ') || (*p == '\t')) ++p;
+                if (((*p == 'q') || (*p == 'Q')) && (p[1] == '=')) {
+                    refused = (strtod(p + 2, nullptr) <= 0.0);
+                }
+                continue;
+            }
+            ++p;
+        }
+
+        if ((nameLen == codingLen) && (strncasecmp(name, coding, codingLen) == 0))
+            return !refused;
+        if ((nameLen == 1) && (name[0] == '*'))
+            any = !refused;
+    }
+    return any;
+}
+
+/**
+ * @brief Selects the encoding to send, the smallest one accepted by the client
+ *
+ * If the client accepts none of them the identity is sent even if not listed,
+ * or gzip if this is the only one available.
+ */
+static const HTTPAssetData* SelectEncoding(httpd_req_t *req, const HTTPAsset& asset, const char **encoding)
+{
+    *encoding = nullptr;
+
+    char buf[acceptEncodingBufLen];
+    buf[0] = 0;
+    if (httpd_req_get_hdr_value_len(req, "Accept-Encoding") > 0) {
+        // a truncated value is still usable
+        esp_err_t res = httpd_req_get_hdr_value_str(req, "Accept-Encoding", buf, acceptEncodingBufLen);
+        if ((res != ESP_OK) && (res != ESP_ERR_HTTPD_RESULT_TRUNC)) buf[0] = 0;
+    }
+
+    if ((asset.brotli.start != nullptr) && AcceptsEncoding(buf, "br")) {
+        *encoding = "br";
+        return &asset.brotli;
+    }
+    if ((asset.gzip.start != nullptr) && AcceptsEncoding(buf, "gzip")) {
+        *encoding = "gzip";
+        return &asset.gzip;
+    }
+    if (asset.identity.start != nullptr) {
+        return &asset.identity;
+    }
+    *encoding = "gzip";
+    return &asset.gzip;
+}
+
+/**
+ * @brief Parses a single range of the Range header
+ *
+ * Accepts `bytes=first-last`, `bytes=first-` and `bytes=-suffixLength`.
+ * Multiple ranges and malformed values are ignored, as allowed by RFC 7233.
+ */
+static HTTPRangeResult ParseRange(httpd_req_t *req, const char *etag, size_t length, size_t *first, size_t *last)
+{
+    size_t len = httpd_req_get_hdr_value_len(req, "Range");
+    if ((len == 0) || (len >= rangeBufLen)) return HTTPRangeResult::none;
+
+    char buf[rangeBufLen];
+    if (httpd_req_get_hdr_value_str(req, "Range", buf, rangeBufLen) != ESP_OK)
+        return HTTPRangeResult::none;
+
+    // with If-Range the range applies only to the same version
+    if (httpd_req_get_hdr_value_len(req, "If-Range") > 0) {
+        char ifRange[ETagBufLen];
+        if (httpd_req_get_hdr_value_str(req, "If-Range", ifRange, ETagBufLen) != ESP_OK)
+            return HTTPRangeResult::none;
+        if (strcmp(ifRange, etag) != 0)
+            return HTTPRangeResult::none;
+    }
+
+    if (strncasecmp(buf, "bytes=", 6) != 0) return HTTPRangeResult::none;
+    const char *p = buf + 6;
+    if (strchr(p, ',') != nullptr) return HTTPRangeResult::none;
+
+    while (*p == ' ') ++p;
+    char *endp;
+    if (*p == '-') {
+        if (!isdigit((unsigned char)p[1])) return HTTPRangeResult::none;
+        unsigned long suffix = strtoul(p + 1, &endp, 10);
+        if (*endp != 0) return HTTPRangeResult::none;
+        if ((suffix == 0) || (length == 0)) return HTTPRangeResult::unsatisfiable;
+        *first = (suffix >= length) ? 0 : length - suffix;
+        *last = length - 1;
+        return HTTPRangeResult::valid;
+    }
+
+    if (!isdigit((unsigned char)*p)) return HTTPRangeResult::none;
+    unsigned long from = strtoul(p, &endp, 10);
+    if (*endp != '-') return HTTPRangeResult::none;
+    p = endp + 1;
+
+    unsigned long to = length - 1;
+    if (*p != 0) {
+        if (!isdigit((unsigned char)*p)) return HTTPRangeResult::none;
+        to = strtoul(p, &endp, 10);
+        if ((*endp != 0) || (to < from)) return HTTPRangeResult::none;
+        if (to >= length) to = length - 1;
+    }
+    if (from >= length) return HTTPRangeResult::unsatisfiable;
+
+    *first = from;
+    *last = to;
+    return HTTPRangeResult::valid;
+}
+
+esp_err_t HTTPSendAsset(httpd_req_t *req, const HTTPAsset& asset, const char *cacheControl)
+{
+    const char *encoding;
+    const HTTPAssetData *data = SelectEncoding(req, asset, &encoding);
+    size_t length = data->end - data->start;
+
+    // the response depends on Accept-Encoding even if only one encoding is available now
+    esp_err_t res = httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (res != ESP_OK) return res;
+
+    if (HTTPRequestMatchesETag(req, data->etag)) {
+        return HTTPSendNotModified(req, data->etag, cacheControl);
+    }
+
+    res = httpd_resp_set_type(req, asset.type);
+    if (res != ESP_OK) return res;
+
+    if (encoding != nullptr) {
+        res = httpd_resp_set_hdr(req, "Content-Encoding", encoding);
+        if (res != ESP_OK) return res;
+    }
+
+    res = httpd_resp_set_hdr(req, "ETag", data->etag);
+    if (res != ESP_OK) return res;
+    res = httpd_resp_set_hdr(req, "Cache-Control", cacheControl);
+    if (res != ESP_OK) return res;
+    res = httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+    if (res != ESP_OK) return res;
+
+    // set as header, must be valid until the response is sent
+    char contentRange[contentRangeBufLen];
+
+    size_t first = 0;
+    size_t last = 0;
+    switch (ParseRange(req, data->etag, length, &first, &last)) {
+    case HTTPRangeResult::valid:
+        snprintf(contentRange, contentRangeBufLen, "bytes %u-%u/%u",
+            (unsigned)first, (unsigned)last, (unsigned)length);
+        res = httpd_resp_set_status(req, "206 Partial Content");
+        if (res != ESP_OK) return res;
+        res = httpd_resp_set_hdr(req, "Content-Range", contentRange);
+        if (res != ESP_OK) return res;
+        return httpd_resp_send(req, (const char *)data->start + first, last - first + 1);
+
+    case HTTPRangeResult::unsatisfiable:
+        snprintf(contentRange, contentRangeBufLen, "bytes */%u", (unsigned)length);
+        res = httpd_resp_set_status(req, "416 Range Not Satisfiable");
+        if (res != ESP_OK) return res;
+        res = httpd_resp_set_hdr(req, "Content-Range", contentRange);
+        if (res != ESP_OK) return res;
+        return httpd_resp_send(req, nullptr, 0);
+
+    default:
+        break;
+    }
+
+    return httpd_resp_send(req, (const char *)data->start, length);
+}
@@ -0,0 +1,67 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPAsset_H
+#define HTTPAsset_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief An embedded file in one encoding, start is nullptr if the encoding is not available
+ *
+ * The ETag is quoted and differs between the encodings of an asset.
+ */
+struct HTTPAssetData
+{
+    const uint8_t *start;
+    const uint8_t *end;
+    const char *etag;
+};
+
+/**
+ * @brief An embedded file of the web interface
+ *
+ * The asset tables are generated by tools/webassets.py, see example/html/build.sh.
+ * At least one of identity and gzip is available.
+ */
+struct HTTPAsset
+{
+    const char *path;
+    const char *type;
+    HTTPAssetData identity;
+    HTTPAssetData gzip;
+    HTTPAssetData brotli;
+};
+
+/**
+ * @brief Returns the asset with the path or nullptr, "/" finds "/index.html"
+ */
+const HTTPAsset* HTTPFindAsset(const HTTPAsset *table, size_t count, const char *path);
+
+/**
+ * @brief Sends an asset in the best encoding accepted by the client
+ *
+ * Sends 304 if the If-None-Match header matches the ETag of the selected encoding.
+ * A single range in the Range header is answered with 206, or with 416 if it can not
+ * be satisfied. Multiple ranges are not supported and the whole asset is sent.
+ */
+esp_err_t HTTPSendAsset(httpd_req_t*, const HTTPAsset&, const char *cacheControl);
+
+#endif
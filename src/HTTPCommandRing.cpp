@@ -0,0 +1,322 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+
+#include <new>
+
+#include "HTTPCommandRing.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "HTTPCommandRing";
+
+const uint32_t ringMask = HTTPCommandRingSize - 1;
+
+static_assert((HTTPCommandRingSize & ringMask) == 0, "the ring size must be a power of two");
+static_assert(HTTPPayloadBlockCount <= 32, "the payload blocks are tracked in a 32 bit mask");
+
+// -----------------------------------------------------------------------------
+
+static uint8_t CountBits(uint32_t value)
+{
+    uint8_t count = 0;
+    while (value != 0) {
+        value &= value - 1;
+        ++count;
+    }
+    return count;
+}
+
+static void UpdateMax(std::atomic<uint32_t>& max, uint32_t value)
+{
+    uint32_t current = max.load(std::memory_order_relaxed);
+    while ((value > current) &&
+        !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPCommandRing::HTTPCommandRing(void)
+{
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        slots[lane] = nullptr;
+    }
+    pool = nullptr;
+    consumer.store(nullptr);
+    Reset();
+}
+
+HTTPCommandRing::~HTTPCommandRing()
+{
+    Destroy();
+}
+
+void HTTPCommandRing::Reset(void)
+{
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        if (slots[lane] != nullptr) {
+            for (uint32_t i = 0; i < HTTPCommandRingSize; ++i) {
+                slots[lane][i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        enqueuePos[lane].store(0, std::memory_order_relaxed);
+        dequeuePos[lane].store(0, std::memory_order_relaxed);
+        highWater[lane].store(0, std::memory_order_relaxed);
+    }
+    dropped.store(0, std::memory_order_relaxed);
+    usedBlocks.store(0, std::memory_order_relaxed);
+    poolHighWater.store(0, std::memory_order_release);
+}
+
+bool HTTPCommandRing::Create(void)
+{
+    if (IsCreated()) {
+        // there must be no producers or consumer while emptying it
+        Reset();
+        return true;
+    }
+
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        slots[lane] = new (std::nothrow) HTTPCommandRingSlot[HTTPCommandRingSize];
+        if (slots[lane] == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate the slots");
+            Destroy();
+            return false;
+        }
+    }
+
+    pool = new (std::nothrow) uint8_t[HTTPPayloadBlockSize * HTTPPayloadBlockCount];
+    if (pool == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the payload pool");
+        Destroy();
+        return false;
+    }
+
+    Reset();
+    return true;
+}
+
+void HTTPCommandRing::Destroy(void)
+{
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        if (slots[lane] != nullptr) {
+            delete[] slots[lane];
+            slots[lane] = nullptr;
+        }
+    }
+    if (pool != nullptr) {
+        delete[] pool;
+        pool = nullptr;
+    }
+}
+
+bool HTTPCommandRing::IsCreated(void)
+{
+    return pool != nullptr;
+}
+
+// -----------------------------------------------------------------------------
+
+bool HTTPCommandRing::Push(const HTTPCommand& cmd)
+{
+    return PushAll(&cmd, 1);
+}
+
+bool HTTPCommandRing::PushAll(const HTTPCommand *cmds, uint8_t count)
+{
+    if (count == 0) return true;
+    if (!IsCreated() || (count > HTTPCommandRingSize)) {
+        dropped.fetch_add(count, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint8_t lane = (cmds[0].lane < HTTPCommandLanes) ? cmds[0].lane : HTTPCommandLaneNormal;
+    HTTPCommandRingSlot *ring = slots[lane];
+
+    // claim `count` consecutive slots, all of them must be free
+    uint32_t pos = enqueuePos[lane].load(std::memory_order_relaxed);
+    for (;;) {
+        bool full = false;
+        bool stale = false;
+        for (uint8_t i = 0; i < count; ++i) {
+            uint32_t seq = ring[(pos + i) & ringMask].sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - (pos + i));
+            if (diff < 0) {
+                full = true;
+                break;
+            }
+            if (diff > 0) {
+                stale = true;
+                break;
+            }
+        }
+
+        if (full) {
+            dropped.fetch_add(count, std::memory_order_relaxed);
+            return false;
+        }
+        if (stale) {
+            // another producer claimed the slots
+            pos = enqueuePos[lane].load(std::memory_order_relaxed);
+            continue;
+        }
+        if (enqueuePos[lane].compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+            break;
+    }
+
+    for (uint8_t i = 0; i < count; ++i) {
+        HTTPCommandRingSlot& slot = ring[(pos + i) & ringMask];
+        slot.cmd = cmds[i];
+        slot.cmd.lane = lane;
+        slot.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+
+    Published(lane);
+    return true;
+}
+
+void HTTPCommandRing::Published(uint8_t lane)
+{
+    UpdateMax(highWater[lane], Occupancy(lane));
+
+    TaskHandle_t task = consumer.load(std::memory_order_acquire);
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool HTTPCommandRing::Pop(uint8_t lane, HTTPCommand& cmd)
+{
+    HTTPCommandRingSlot *ring = slots[lane];
+    uint32_t pos = dequeuePos[lane].load(std::memory_order_relaxed);
+    HTTPCommandRingSlot& slot = ring[pos & ringMask];
+
+    uint32_t seq = slot.sequence.load(std::memory_order_acquire);
+    if ((int32_t)(seq - (pos + 1)) < 0) return false; // empty, or not published yet
+
+    cmd = slot.cmd;
+    slot.sequence.store(pos + HTTPCommandRingSize, std::memory_order_release);
+    dequeuePos[lane].store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool HTTPCommandRing::Receive(HTTPCommand& cmd, TickType_t wait)
+{
+    if (!IsCreated()) return false;
+
+    consumer.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+
+    for (;;) {
+        for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+            if (Pop(lane, cmd)) return true;
+        }
+        if (wait == 0) return false;
+
+        // a push done after the checks above has already notified this task
+        if (ulTaskNotifyTake(pdTRUE, wait) == 0) {
+            wait = 0;
+        }
+    }
+}
+
+void HTTPCommandRing::Release(HTTPCommand& cmd)
+{
+    FreePayload(cmd.payload);
+}
+
+// -----------------------------------------------------------------------------
+
+bool HTTPCommandRing::AllocPayload(size_t length, HTTPPayload& payload)
+{
+    payload.data = nullptr;
+    payload.length = 0;
+    payload.firstBlock = 0;
+    payload.blockCount = 0;
+
+    if (!IsCreated() || (length == 0) || (length > UINT16_MAX)) return false;
+
+    uint32_t blocks = (length + HTTPPayloadBlockSize - 1) / HTTPPayloadBlockSize;
+    if (blocks > HTTPPayloadBlockCount) return false;
+
+    uint32_t runMask = (blocks == 32) ? 0xFFFFFFFF : ((1UL << blocks) - 1);
+    uint32_t used = usedBlocks.load(std::memory_order_relaxed);
+    for (;;) {
+        uint8_t first = 0;
+        while ((first + blocks <= HTTPPayloadBlockCount) && ((used & (runMask << first)) != 0)) ++first;
+        if (first + blocks > HTTPPayloadBlockCount) return false;
+
+        uint32_t claimed = used | (runMask << first);
+        if (usedBlocks.compare_exchange_weak(used, claimed, std::memory_order_acquire)) {
+            UpdateMax(poolHighWater, CountBits(claimed));
+
+            payload.data = pool + first * HTTPPayloadBlockSize;
+            payload.length = (uint16_t)length;
+            payload.firstBlock = first;
+            payload.blockCount = (uint8_t)blocks;
+            return true;
+        }
+        // `used` was reloaded by the failed exchange
+    }
+}
+
+void HTTPCommandRing::FreePayload(HTTPPayload& payload)
+{
+    if (payload.blockCount == 0) return;
+
+    uint32_t runMask = (payload.blockCount == 32) ? 0xFFFFFFFF : ((1UL << payload.blockCount) - 1);
+    usedBlocks.fetch_and(~(runMask << payload.firstBlock), std::memory_order_release);
+
+    payload.data = nullptr;
+    payload.length = 0;
+    payload.blockCount = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+uint32_t HTTPCommandRing::Occupancy(uint8_t lane)
+{
+    if (lane >= HTTPCommandLanes) return 0;
+
+    uint32_t head = dequeuePos[lane].load(std::memory_order_acquire);
+    uint32_t tail = enqueuePos[lane].load(std::memory_order_acquire);
+    uint32_t count = tail - head;
+    return (count > HTTPCommandRingSize) ? HTTPCommandRingSize : count;
+}
+
+uint32_t HTTPCommandRing::HighWaterMark(uint8_t lane)
+{
+    if (lane >= HTTPCommandLanes) return 0;
+    return highWater[lane].load(std::memory_order_relaxed);
+}
+
+uint32_t HTTPCommandRing::DroppedCount(void)
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+uint8_t HTTPCommandRing::PayloadBlocksUsed(void)
+{
+    return CountBits(usedBlocks.load(std::memory_order_relaxed));
+}
+
+uint8_t HTTPCommandRing::PayloadHighWaterMark(void)
+{
+    return (uint8_t)poolHighWater.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,185 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPCommandRing_H
+#define HTTPCommandRing_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include <atomic>
+
+constexpr uint32_t HTTPRingRoundUp(uint32_t value, uint32_t pow2 = 1)
+{
+    return (pow2 >= value) ? pow2 : HTTPRingRoundUp(value, pow2 * 2);
+}
+
+/** slots of each lane, a power of two */
+const uint32_t HTTPCommandRingSize = HTTPRingRoundUp(CONFIG_ESP32BM_CMD_QUEUE_LENGTH);
+
+const uint8_t HTTPCommandLaneHigh   = 0;
+const uint8_t HTTPCommandLaneNormal = 1;
+const uint8_t HTTPCommandLanes      = 2;
+
+/** the command is part of a batch, the last one of the batch has also HTTPCommandFlagBatchEnd */
+const uint8_t HTTPCommandFlagBatch    = 0x01;
+const uint8_t HTTPCommandFlagBatchEnd = 0x02;
+
+const uint32_t HTTPPayloadBlockSize  = CONFIG_ESP32BM_CMD_PAYLOAD_BLOCK_SIZE;
+const uint8_t  HTTPPayloadBlockCount = CONFIG_ESP32BM_CMD_PAYLOAD_BLOCKS;
+
+/**
+ * @brief A slice of the payload pool, owned by the command holding it
+ */
+struct HTTPPayload
+{
+    uint8_t *data;
+    uint16_t length;
+    uint8_t firstBlock;
+    uint8_t blockCount;   /**< 0 if there is no payload */
+};
+
+struct HTTPCommand
+{
+    /** type of the command, 0 is not a valid command */
+    uint8_t command;
+    uint8_t flags;
+    uint8_t lane;
+    uint32_t data;
+
+    /**
+     * For commands received through the WebSocket, the correlation id set by the client
+     * and the socket which should receive the result, see PaxHttpServer::SendCommandResult.
+     * sockfd is -1 for commands without a channel for results. session identifies the
+     * connection, the socket number may belong to another client when the result is ready.
+     */
+    uint16_t id;
+    int sockfd;
+    uint32_t session;
+
+    HTTPPayload payload;
+
+    HTTPCommand() {
+        command = 0;
+        flags = 0;
+        lane = HTTPCommandLaneNormal;
+        data = 0;
+        id = 0;
+        sockfd = -1;
+        session = 0;
+        payload.data = nullptr;
+        payload.length = 0;
+        payload.firstBlock = 0;
+        payload.blockCount = 0;
+    }
+};
+
+struct HTTPCommandRingSlot
+{
+    std::atomic<uint32_t> sequence;
+    HTTPCommand cmd;
+};
+
+/**
+ * @brief Multi-producer, single-consumer queue of commands with priority lanes and a payload pool
+ *
+ * Each lane is a bounded ring where each slot has a sequence number telling if it is free
+ * or holds a command, the producers claim slots with compare-and-swap so they never block
+ * and never take a lock. The consumer takes the commands of HTTPCommandLaneHigh first.
+ *
+ * A payload is a run of contiguous blocks of the pool, claimed with compare-and-swap on the
+ * bitmap of used blocks. The producer fills it in place and pushes a command holding it,
+ * the consumer reads it in place and calls Release. The payload is never copied.
+ *
+ * Receive waits using the notifications of the consumer task, it must not use them for
+ * anything else. The counters are approximate while producers are running.
+ */
+class HTTPCommandRing
+{
+public:
+    HTTPCommandRing(void);
+    virtual ~HTTPCommandRing();
+
+    /**
+     * @brief Allocates the slots and the payload pool, empties the ring if already created
+     */
+    bool Create(void);
+    void Destroy(void);
+    bool IsCreated(void);
+
+    /**
+     * @brief Adds a command to the end of its lane, returns false if the lane is full
+     *
+     * On success the ring owns the payload of the command, on failure the caller still owns it.
+     */
+    bool Push(const HTTPCommand&);
+
+    /**
+     * @brief Adds all the commands, in order, or none of them
+     *
+     * All commands go to the lane of the first one. They are consecutive in the lane,
+     * the commands of other producers are before or after them.
+     */
+    bool PushAll(const HTTPCommand*, uint8_t count);
+
+    /**
+     * @brief Takes the next command, from the highest priority lane which has one
+     *
+     * Waits up to `wait` ticks for a command, portMAX_DELAY to wait forever.
+     * Must be called from a single task. Call Release after handling the command.
+     */
+    bool Receive(HTTPCommand&, TickType_t wait);
+
+    /**
+     * @brief Frees the payload of a received command
+     */
+    void Release(HTTPCommand&);
+
+    /**
+     * @brief Claims a payload of `length` bytes, returns false if there is no free run of blocks
+     */
+    bool AllocPayload(size_t length, HTTPPayload&);
+    void FreePayload(HTTPPayload&);
+
+    uint32_t Occupancy(uint8_t lane);
+    uint32_t HighWaterMark(uint8_t lane);
+    uint32_t DroppedCount(void);
+    uint8_t PayloadBlocksUsed(void);
+    uint8_t PayloadHighWaterMark(void);
+
+protected:
+    HTTPCommandRingSlot *slots[HTTPCommandLanes];
+    std::atomic<uint32_t> enqueuePos[HTTPCommandLanes];
+    std::atomic<uint32_t> dequeuePos[HTTPCommandLanes];
+    std::atomic<uint32_t> highWater[HTTPCommandLanes];
+    std::atomic<uint32_t> dropped;
+
+    uint8_t *pool;
+    std::atomic<uint32_t> usedBlocks;
+    std::atomic<uint32_t> poolHighWater;
+
+    std::atomic<TaskHandle_t> consumer;
+
+    void Reset(void);
+    bool Pop(uint8_t lane, HTTPCommand&);
+    void Published(uint8_t lane);
+};
+
+#endif
@@ -0,0 +1,289 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "HTTPConnectionManager.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "HTTPConnections";
+
+// -----------------------------------------------------------------------------
+
+HTTPConnectionManager::HTTPConnectionManager(void)
+{
+    lastSession = 0;
+    Clear();
+}
+
+HTTPConnectionManager::~HTTPConnectionManager()
+{
+    //
+}
+
+void HTTPConnectionManager::Configure(httpd_config_t& config)
+{
+    config.max_open_sockets = HTTPMaxConnections;
+    config.backlog_conn = CONFIG_ESP32BM_HTTP_BACKLOG;
+#ifdef CONFIG_ESP32BM_HTTP_LRU_PURGE
+    config.lru_purge_enable = true;
+#else
+    config.lru_purge_enable = false;
+#endif
+    config.recv_wait_timeout = CONFIG_ESP32BM_HTTP_RECV_TIMEOUT_S;
+    config.send_wait_timeout = CONFIG_ESP32BM_HTTP_SEND_TIMEOUT_S;
+    config.stack_size = CONFIG_ESP32BM_HTTP_STACK_SIZE;
+    config.task_priority = CONFIG_ESP32BM_HTTP_TASK_PRIORITY;
+    config.core_id = (CONFIG_ESP32BM_HTTP_CORE_ID < 0) ? tskNO_AFFINITY : CONFIG_ESP32BM_HTTP_CORE_ID;
+}
+
+void HTTPConnectionManager::Clear(void)
+{
+    for (uint8_t i = 0; i < HTTPMaxConnections; ++i) {
+        connections[i].sockfd = -1;
+        connections[i].state = HTTPConnectionState::free;
+    }
+    opened = 0;
+    evicted = 0;
+}
+
+HTTPConnection* HTTPConnectionManager::Find(int sockfd)
+{
+    for (uint8_t i = 0; i < HTTPMaxConnections; ++i) {
+        if ((connections[i].state != HTTPConnectionState::free) && (connections[i].sockfd == sockfd))
+            return &connections[i];
+    }
+    return nullptr;
+}
+
+void HTTPConnectionManager::Opened(int sockfd)
+{
+    ++opened;
+
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) {
+        for (uint8_t i = 0; i < HTTPMaxConnections; ++i) {
+            if (connections[i].state == HTTPConnectionState::free) {
+                conn = &connections[i];
+                break;
+            }
+        }
+    }
+    if (conn == nullptr) {
+        // the server opens at most HTTPMaxConnections sockets so this should not happen
+        ESP_LOGW(TAG, "No slot for socket %d", sockfd);
+        return;
+    }
+
+    ++lastSession;
+    if (lastSession == 0) ++lastSession;
+
+    int64_t now = esp_timer_get_time();
+    conn->sockfd = sockfd;
+    conn->session = lastSession;
+    conn->state = HTTPConnectionState::waiting;
+    conn->pending = false;
+    conn->evicted = false;
+    conn->openTime = now;
+    conn->lastActivity = now;
+    conn->requestStart = now;
+    conn->requests = 0;
+    conn->bytesReceived = 0;
+    conn->bytesSent = 0;
+}
+
+void HTTPConnectionManager::Closed(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    conn->state = HTTPConnectionState::free;
+    conn->sockfd = -1;
+}
+
+bool HTTPConnectionManager::IsExpired(const HTTPConnection& conn, int64_t now)
+{
+    if (conn.state != HTTPConnectionState::waiting) return false;
+
+    if (conn.pending) {
+        return now - conn.requestStart > (int64_t)HTTPHeaderTimeout * 1000000;
+    }
+    return now - conn.lastActivity > (int64_t)HTTPIdleTimeout * 1000000;
+}
+
+bool HTTPConnectionManager::CanReceive(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return true;
+
+    // a client sending the headers slowly is closed on the next bytes
+    return !(conn->pending && IsExpired(*conn, esp_timer_get_time()));
+}
+
+void HTTPConnectionManager::Received(int sockfd, int length)
+{
+    if (length <= 0) return;
+
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    int64_t now = esp_timer_get_time();
+    conn->lastActivity = now;
+    conn->bytesReceived += length;
+    if ((conn->state == HTTPConnectionState::waiting) && !conn->pending) {
+        conn->pending = true;
+        conn->requestStart = now;
+    }
+}
+
+void HTTPConnectionManager::Sent(int sockfd, int length)
+{
+    if (length <= 0) return;
+
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    conn->lastActivity = esp_timer_get_time();
+    conn->bytesSent += length;
+}
+
+void HTTPConnectionManager::RequestBegin(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    ++conn->requests;
+    if (conn->state == HTTPConnectionState::waiting) {
+        conn->state = HTTPConnectionState::handling;
+    }
+}
+
+void HTTPConnectionManager::RequestEnd(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    if (conn->state == HTTPConnectionState::handling) {
+        conn->state = HTTPConnectionState::waiting;
+        conn->pending = false;
+        conn->lastActivity = esp_timer_get_time();
+    }
+}
+
+void HTTPConnectionManager::SetStreaming(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    conn->state = HTTPConnectionState::streaming;
+}
+
+void HTTPConnectionManager::EndStreaming(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    if (conn->state == HTTPConnectionState::streaming) {
+        conn->state = HTTPConnectionState::waiting;
+        conn->pending = false;
+        conn->lastActivity = esp_timer_get_time();
+    }
+}
+
+void HTTPConnectionManager::SetDetached(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    conn->state = HTTPConnectionState::detached;
+}
+
+void HTTPConnectionManager::EndDetached(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return;
+
+    if (conn->state == HTTPConnectionState::detached) {
+        conn->state = HTTPConnectionState::waiting;
+        conn->pending = false;
+        conn->lastActivity = esp_timer_get_time();
+    }
+}
+
+void HTTPConnectionManager::Evict(httpd_handle_t handle)
+{
+    if (handle == nullptr) return;
+
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < HTTPMaxConnections; ++i) {
+        HTTPConnection& conn = connections[i];
+        if (conn.evicted || !IsExpired(conn, now)) continue;
+
+        ESP_LOGI(TAG, "Closing %s connection %d", conn.pending ? "slow" : "idle", conn.sockfd);
+        if (httpd_sess_trigger_close(handle, conn.sockfd) == ESP_OK) {
+            // the slot is freed when the server calls Closed
+            conn.evicted = true;
+            ++evicted;
+        }
+    }
+}
+
+bool HTTPConnectionManager::Traffic(int sockfd, uint32_t& received, uint32_t& sent)
+{
+    HTTPConnection *conn = Find(sockfd);
+    if (conn == nullptr) return false;
+
+    received = conn->bytesReceived;
+    sent = conn->bytesSent;
+    return true;
+}
+
+uint32_t HTTPConnectionManager::Session(int sockfd)
+{
+    HTTPConnection *conn = Find(sockfd);
+    return (conn == nullptr) ? 0 : conn->session;
+}
+
+const HTTPConnection* HTTPConnectionManager::Get(uint8_t index)
+{
+    if (index >= HTTPMaxConnections) return nullptr;
+    if (connections[index].state == HTTPConnectionState::free) return nullptr;
+    return &connections[index];
+}
+
+uint8_t HTTPConnectionManager::OpenCount(void)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < HTTPMaxConnections; ++i) {
+        if (connections[i].state != HTTPConnectionState::free) ++count;
+    }
+    return count;
+}
+
+uint32_t HTTPConnectionManager::OpenedCount(void)
+{
+    return opened;
+}
+
+uint32_t HTTPConnectionManager::EvictedCount(void)
+{
+    return evicted;
+}
@@ -0,0 +1,159 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPConnectionManager_H
+#define HTTPConnectionManager_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+
+const uint8_t HTTPMaxConnections = CONFIG_ESP32BM_HTTP_MAX_SOCKETS;
+const uint32_t HTTPHeaderTimeout = CONFIG_ESP32BM_HTTP_HEADER_TIMEOUT_S;
+const uint32_t HTTPIdleTimeout = CONFIG_ESP32BM_HTTP_IDLE_TIMEOUT_S;
+
+enum class HTTPConnectionState : uint8_t {
+    free,
+    waiting,    /**< waiting for a request, or for the rest of its headers */
+    handling,   /**< the handler of a request is running */
+    streaming,  /**< event stream or WebSocket, kept open by the server */
+    detached    /**< the request is handled by a worker */
+};
+
+struct HTTPConnection
+{
+    int sockfd;
+    /** different for each connection opened, a socket number is reused, 0 is not used */
+    uint32_t session;
+    HTTPConnectionState state;
+    /** in the waiting state, true if part of a request was received */
+    bool pending;
+    bool evicted;
+
+    int64_t openTime;
+    int64_t lastActivity;
+    int64_t requestStart;
+
+    uint32_t requests;
+    uint32_t bytesReceived;
+    uint32_t bytesSent;
+};
+
+/**
+ * @brief Tracks the connections of the HTTP server and closes the slow or idle ones
+ *
+ * The server settings come from Kconfig, see Configure. The socket receive and send
+ * functions are replaced, by the server, with ones calling Received and Sent.
+ *
+ * A connection waiting for a request is closed if it is idle for HTTPIdleTimeout seconds
+ * or if the headers of the request are not received in HTTPHeaderTimeout seconds
+ * from its first byte. There is no deadline while a handler runs, the receive and send
+ * timeouts of the server apply, or for streaming connections.
+ *
+ * All functions must be called from the server task, except Received and Sent which are
+ * also called by a worker handling a detached request. They change only the connection
+ * of that request, which the server task does not touch until the request is done.
+ */
+class HTTPConnectionManager
+{
+public:
+    HTTPConnectionManager(void);
+    virtual ~HTTPConnectionManager();
+
+    /**
+     * @brief Sets the socket, timeout and task settings of the server
+     */
+    void Configure(httpd_config_t&);
+
+    void Clear(void);
+
+    void Opened(int sockfd);
+    void Closed(int sockfd);
+
+    /**
+     * @brief Returns false if the request is past its deadline and the connection must be closed
+     */
+    bool CanReceive(int sockfd);
+    void Received(int sockfd, int length);
+    void Sent(int sockfd, int length);
+
+    void RequestBegin(int sockfd);
+    void RequestEnd(int sockfd);
+
+    /**
+     * @brief Marks a connection kept open to send events, it has no deadline
+     */
+    void SetStreaming(int sockfd);
+
+    /**
+     * @brief Returns a streaming connection to the waiting state, like after a request
+     */
+    void EndStreaming(int sockfd);
+
+    /**
+     * @brief Marks a connection whose request is handled by a worker, it has no deadline
+     */
+    void SetDetached(int sockfd);
+
+    /**
+     * @brief Returns a detached connection to the waiting state, after its request
+     */
+    void EndDetached(int sockfd);
+
+    /**
+     * @brief Closes the connections past their deadlines, call it periodically
+     */
+    void Evict(httpd_handle_t);
+
+    /**
+     * @brief Gets the byte counters of a connection, returns false if it is not tracked
+     */
+    bool Traffic(int sockfd, uint32_t& received, uint32_t& sent);
+
+    /**
+     * @brief Returns the session of the connection on the socket, 0 if it is not tracked
+     */
+    uint32_t Session(int sockfd);
+
+    const HTTPConnection* Get(uint8_t index);
+    uint8_t OpenCount(void);
+
+    /**
+     * @brief Statistics since the server was started
+     */
+    uint32_t OpenedCount(void);
+    uint32_t EvictedCount(void);
+
+protected:
+    HTTPConnection connections[HTTPMaxConnections];
+    uint32_t opened;
+    uint32_t evicted;
+    /** the last session, not reset by Clear so a session is not reused after a restart */
+    uint32_t lastSession;
+
+    HTTPConnection* Find(int sockfd);
+
+    /**
+     * @brief Returns true if the connection waits for a request past its deadline
+     */
+    bool IsExpired(const HTTPConnection&, int64_t now);
+};
+
+#endif
@@ -0,0 +1,181 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include "HTTPContentFormat.h"
+
+// -----------------------------------------------------------------------------
+
+const size_t acceptBufLen = 128;
+
+enum class MediaMatch : uint8_t {
+    none, json, cbor, msgpack, wildcard
+};
+
+static MediaMatch MatchMediaType(const char *name, size_t len)
+{
+    struct Entry { const char *name; MediaMatch match; };
+    static const Entry entries[] = {
+        { "application/json",        MediaMatch::json },
+        { "application/cbor",        MediaMatch::cbor },
+        { "application/msgpack",     MediaMatch::msgpack },
+        { "application/x-msgpack",   MediaMatch::msgpack },
+        { "application/vnd.msgpack", MediaMatch::msgpack },
+        { "application/*",           MediaMatch::wildcard },
+        { "*/*",                     MediaMatch::wildcard },
+    };
+
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); ++i) {
+        if ((strlen(entries[i].name) == len) && (strncasecmp(entries[i].name, name, len) == 0))
+            return entries[i].match;
+    }
+    return MediaMatch::none;
+}
+
+static HTTPContentFormat ToFormat(MediaMatch match)
+{
+    if (match == MediaMatch::cbor) return HTTPContentFormat::cbor;
+    if (match == MediaMatch::msgpack) return HTTPContentFormat::msgpack;
+    return HTTPContentFormat::json;
+}
+
+/**
+ * @brief Reads a header in buf, a truncated value is still usable
+ */
+static void GetHeader(httpd_req_t *req, const char *field, char *buf, size_t bufLen)
+{
+    buf[0] = 0;
+    if (httpd_req_get_hdr_value_len(req, field) == 0) return;
+
+    esp_err_t res = httpd_req_get_hdr_value_str(req, field, buf, bufLen);
+    if ((res != ESP_OK) && (res != ESP_ERR_HTTPD_RESULT_TRUNC)) buf[0] = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+const char* HTTPContentFormatType(HTTPContentFormat format)
+{
+    switch (format) {
+        case HTTPContentFormat::cbor:    return "application/cbor";
+        case HTTPContentFormat::msgpack: return "application/msgpack";
+        default:                         return HTTPD_TYPE_JSON;
+    }
+}
+
+HTTPContentFormat HTTPAcceptedFormat(httpd_req_t *req)
+{
+    char buf[acceptBufLen];
+    GetHeader(req, "Accept", buf, acceptBufLen);
+
+    MediaMatch best = MediaMatch::none;
+    double bestQ = 0;
+    double wildcardQ = 0;
+
+    const char *p = buf;
+    while (*p != 0) {
+        while ((*p == ' ') || (*p == '\t') || (*p == ',')) ++p;
+        if (*p == 0) break;
+
+        const char *name = p;
+        while ((*p != 0) && (*p != ',') && (*p != ';') && (*p != ' ') && (*p != '\t')) ++p;
+        MediaMatch match = MatchMediaType(name, p - name);
+
+        double q = 1;
+        while ((*p != 0) && (*p != ',')) {
+            if (*p == ';') {
+                ++p;
+                while ((*p == ' ') || (*p == '\t')) ++p;
+                if (((*p == 'q') || (*p == 'Q')) && (p[1] == '=')) {
+                    q = strtod(p + 2, nullptr);
+                }
+                continue;
+            }
+            ++p;
+        }
+
+        if (match == MediaMatch::wildcard) {
+            if (q > wildcardQ) wildcardQ = q;
+        }
+        else if ((match != MediaMatch::none) && (q > bestQ)) {
+            best = match;
+            bestQ = q;
+        }
+    }
+
+    if ((best == MediaMatch::none) || (wildcardQ > bestQ)) return HTTPContentFormat::json;
+    return ToFormat(best);
+}
+
+HTTPContentFormat HTTPRequestFormat(httpd_req_t *req)
+{
+    char buf[acceptBufLen];
+    GetHeader(req, "Content-Type", buf, acceptBufLen);
+
+    size_t len = 0;
+    while ((buf[len] != 0) && (buf[len] != ';') && (buf[len] != ' ') && (buf[len] != '\t')) ++len;
+    return ToFormat(MatchMediaType(buf, len));
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPFormatWriter::HTTPFormatWriter(HTTPContentFormat format, char *buffer, size_t bufferSize, JSONSink *sink) :
+    json(buffer, bufferSize, sink),
+    cbor(buffer, bufferSize, sink),
+    msgpack(buffer, bufferSize, sink)
+{
+    switch (format) {
+        case HTTPContentFormat::cbor:    writer = &cbor; break;
+        case HTTPContentFormat::msgpack: writer = &msgpack; break;
+        default:                         writer = &json; break;
+    }
+}
+
+HTTPFormatWriter::~HTTPFormatWriter()
+{
+    //
+}
+
+JSONWriter& HTTPFormatWriter::Writer(void)
+{
+    return *writer;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPFormatReader::HTTPFormatReader(HTTPContentFormat format, JSONReaderHandler *handler) :
+    json(handler),
+    binary((format == HTTPContentFormat::msgpack) ? BinaryFormat::msgpack : BinaryFormat::cbor, handler)
+{
+    reader = (format == HTTPContentFormat::json) ? &json : &binary;
+}
+
+HTTPFormatReader::~HTTPFormatReader()
+{
+    //
+}
+
+JSONReader& HTTPFormatReader::Reader(void)
+{
+    return *reader;
+}
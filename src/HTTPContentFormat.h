@@ -0,0 +1,94 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPContentFormat_H
+#define HTTPContentFormat_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+
+#include "JSONWriter.h"
+#include "JSONReader.h"
+#include "BinaryWriter.h"
+#include "BinaryReader.h"
+
+enum class HTTPContentFormat : uint8_t {
+    json, cbor, msgpack
+};
+
+const uint8_t HTTPContentFormatCount = 3;
+
+/**
+ * @brief Returns the media type of the format, like "application/cbor"
+ */
+const char* HTTPContentFormatType(HTTPContentFormat);
+
+/**
+ * @brief Selects the format of the response from the Accept header of the request
+ *
+ * Returns the format with the highest q value, the first one listed on ties. JSON is
+ * returned if the request has no Accept header, accepts none of the binary formats or
+ * prefers a wildcard media range to them.
+ * MessagePack is recognized as application/msgpack, application/x-msgpack and application/vnd.msgpack.
+ */
+HTTPContentFormat HTTPAcceptedFormat(httpd_req_t*);
+
+/**
+ * @brief Returns the format of the request body from its Content-Type header, JSON by default
+ */
+HTTPContentFormat HTTPRequestFormat(httpd_req_t*);
+
+/**
+ * @brief The writer for a format, a JSONWriter, a CBORWriter or a MsgPackWriter
+ *
+ * Lets the code written for JSONWriter produce any of the formats.
+ */
+class HTTPFormatWriter
+{
+public:
+    HTTPFormatWriter(HTTPContentFormat, char *buffer, size_t bufferSize, JSONSink *sink);
+    virtual ~HTTPFormatWriter();
+
+    JSONWriter& Writer(void);
+
+protected:
+    JSONWriter json;
+    CBORWriter cbor;
+    MsgPackWriter msgpack;
+    JSONWriter *writer;
+};
+
+/**
+ * @brief The reader for a format, a JSONReader or a BinaryReader
+ */
+class HTTPFormatReader
+{
+public:
+    HTTPFormatReader(HTTPContentFormat, JSONReaderHandler *handler);
+    virtual ~HTTPFormatReader();
+
+    JSONReader& Reader(void);
+
+protected:
+    JSONReader json;
+    BinaryReader binary;
+    JSONReader *reader;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include <cstring>
+
+#include "HTTPEventStream.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "EventStream";
+
+static const char* eventStreamHeader =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-store\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "retry: 3000\n\n";
+
+// -----------------------------------------------------------------------------
+
+HTTPEventStream::HTTPEventStream(void)
+{
+    Clear();
+}
+
+HTTPEventStream::~HTTPEventStream()
+{
+    //
+}
+
+void HTTPEventStream::Clear(void)
+{
+    for (uint8_t i = 0; i < EventStreamMaxClients; ++i) {
+        clients[i] = -1;
+    }
+}
+
+uint8_t HTTPEventStream::Count(void)
+{
+    uint8_t cnt = 0;
+    for (uint8_t i = 0; i < EventStreamMaxClients; ++i) {
+        if (clients[i] >= 0) ++cnt;
+    }
+    return cnt;
+}
+
+esp_err_t HTTPEventStream::Subscribe(httpd_req_t *req)
+{
+    int sockfd = httpd_req_to_sockfd(req);
+    if (sockfd < 0) return ESP_FAIL;
+
+    int8_t slot = -1;
+    for (uint8_t i = 0; i < EventStreamMaxClients; ++i) {
+        if (clients[i] == sockfd) {
+            // a client which reuses a connection
+            slot = i;
+            break;
+        }
+        if ((slot < 0) && (clients[i] < 0)) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        ESP_LOGW(TAG, "No free slot for socket %d", sockfd);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // the headers are sent raw, without Content-Length, the body ends when the connection is closed
+    size_t len = strlen(eventStreamHeader);
+    if (httpd_send(req, eventStreamHeader, len) != (int)len) {
+        return ESP_FAIL;
+    }
+
+    clients[slot] = sockfd;
+    return ESP_OK;
+}
+
+void HTTPEventStream::Unsubscribe(int sockfd)
+{
+    for (uint8_t i = 0; i < EventStreamMaxClients; ++i) {
+        if (clients[i] == sockfd) {
+            clients[i] = -1;
+        }
+    }
+}
+
+bool HTTPEventStream::SendTo(httpd_handle_t handle, int sockfd, const char *data, size_t length)
+{
+    int res = httpd_socket_send(handle, sockfd, data, length, MSG_DONTWAIT);
+    if (res == (int)length) return true;
+
+    // a partial event can not be completed later without blocking, drop the client
+    ESP_LOGW(TAG, "Closing slow or broken client %d (%d)", sockfd, res);
+    Unsubscribe(sockfd);
+    httpd_sess_trigger_close(handle, sockfd);
+    return false;
+}
+
+void HTTPEventStream::Send(httpd_handle_t handle, const char *data, size_t length)
+{
+    for (uint8_t i = 0; i < EventStreamMaxClients; ++i) {
+        if (clients[i] >= 0) {
+            SendTo(handle, clients[i], data, length);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPEventStream_H
+#define HTTPEventStream_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+
+const uint8_t EventStreamMaxClients = CONFIG_ESP32BM_SSE_MAX_CLIENTS;
+
+/**
+ * @brief Server-Sent Events subscribers of a httpd server
+ *
+ * The subscribers are the sockets of requests answered with the event stream headers.
+ * Their handlers return without closing the connection and the events are sent later
+ * with httpd_socket_send from the server task, see httpd_queue_work.
+ *
+ * Events are sent with MSG_DONTWAIT. A client which can not take a whole event
+ * at once is disconnected so a slow client never blocks the others.
+ *
+ * Must be used from the HTTP server task only.
+ */
+class HTTPEventStream
+{
+public:
+    HTTPEventStream(void);
+    virtual ~HTTPEventStream();
+
+    /**
+     * @brief Sends the event stream headers and registers the socket of the request
+     *
+     * Returns ESP_ERR_NO_MEM if there is no free slot, no response is sent in that case.
+     */
+    esp_err_t Subscribe(httpd_req_t*);
+
+    /**
+     * @brief Removes a socket, call it from the close callback of the server
+     */
+    void Unsubscribe(int sockfd);
+
+    /**
+     * @brief Removes all subscribers without closing their sockets
+     */
+    void Clear(void);
+
+    uint8_t Count(void);
+
+    /**
+     * @brief Sends data, which must be one or more complete events, to all subscribers
+     */
+    void Send(httpd_handle_t, const char *data, size_t length);
+
+    /**
+     * @brief Sends data to one subscriber
+     *
+     * Returns false, after closing the connection, if the data could not be sent at once.
+     */
+    bool SendTo(httpd_handle_t, int sockfd, const char *data, size_t length);
+
+protected:
+    int clients[EventStreamMaxClients];
+};
+
+#endif
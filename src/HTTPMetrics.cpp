@@ -0,0 +1,205 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "HTTPMetrics.h"
+
+// -----------------------------------------------------------------------------
+
+const uint32_t HTTPMetricsBuckets[HTTPMetricsBucketCount] = {
+    1000, 5000, 10000, 25000, 50000, 100000,
+    250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+const size_t labelsBufLen = 96;
+
+// -----------------------------------------------------------------------------
+
+HTTPMetricsText::HTTPMetricsText(char *buf, size_t bufSize, JSONSink *dataSink)
+{
+    buffer = buf;
+    bufferSize = bufSize;
+    used = 0;
+    sink = dataSink;
+    ok = (buffer != nullptr) && (bufferSize > 0) && (sink != nullptr);
+}
+
+HTTPMetricsText::~HTTPMetricsText()
+{
+    //
+}
+
+bool HTTPMetricsText::Printf(const char *format, ...)
+{
+    if (!ok) return false;
+
+    for (uint8_t attempt = 0; attempt < 2; ++attempt) {
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buffer + used, bufferSize - used, format, args);
+        va_end(args);
+
+        if (len < 0) {
+            ok = false;
+            return false;
+        }
+        if (used + len < bufferSize) {
+            used += len;
+            return true;
+        }
+
+        // does not fit, retry in the empty buffer
+        if (used == 0) break;
+        if (!Flush()) return false;
+    }
+
+    // longer than the buffer
+    ok = false;
+    return false;
+}
+
+bool HTTPMetricsText::Describe(const char *name, const char *type, const char *help)
+{
+    Printf("# HELP %s %s\n", name, help);
+    return Printf("# TYPE %s %s\n", name, type);
+}
+
+bool HTTPMetricsText::Flush(void)
+{
+    if (!ok) return false;
+    if (used == 0) return true;
+
+    ok = sink->Write(buffer, used);
+    used = 0;
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPMetrics::HTTPMetrics(void)
+{
+    Clear();
+}
+
+HTTPMetrics::~HTTPMetrics()
+{
+    //
+}
+
+void HTTPMetrics::Clear(void)
+{
+    memset(slots, 0, sizeof(slots));
+    slotCount = 1;
+}
+
+HTTPRouteMetrics& HTTPMetrics::Slot(const HTTPRoute *route)
+{
+    if (route == nullptr) return slots[0];
+
+    for (uint8_t i = 1; i < slotCount; ++i) {
+        if (slots[i].route == route) return slots[i];
+    }
+    if (slotCount > HTTPMetricsMaxRoutes) return slots[0];
+
+    slots[slotCount].route = route;
+    return slots[slotCount++];
+}
+
+void HTTPMetrics::Record(const HTTPRoute *route, esp_err_t res, int64_t duration, uint32_t bytesReceived, uint32_t bytesSent)
+{
+    HTTPRouteMetrics& m = Slot(route);
+
+    ++m.requests;
+    if (res != ESP_OK) ++m.errors;
+    m.bytesReceived += bytesReceived;
+    m.bytesSent += bytesSent;
+
+    if (duration < 0) duration = 0;
+    m.durationSum += duration;
+
+    uint8_t idx = 0;
+    while ((idx < HTTPMetricsBucketCount) && (duration > HTTPMetricsBuckets[idx])) ++idx;
+    ++m.buckets[idx];
+}
+
+void HTTPMetrics::Labels(const HTTPRouteMetrics& m, char *buf, size_t bufLen)
+{
+    if (m.route == nullptr) {
+        snprintf(buf, bufLen, "route=\"other\",method=\"\"");
+    }
+    else {
+        snprintf(buf, bufLen, "route=\"%s\",method=\"%s\"",
+            m.route->path, http_method_str((enum http_method)m.route->method));
+    }
+}
+
+bool HTTPMetrics::Write(HTTPMetricsText& text)
+{
+    char labels[labelsBufLen];
+
+    text.Describe("esp32bm_http_requests_total", "counter", "Requests handled, by route");
+    for (uint8_t i = 0; i < slotCount; ++i) {
+        Labels(slots[i], labels, labelsBufLen);
+        text.Printf("esp32bm_http_requests_total{%s} %u\n", labels, (unsigned)slots[i].requests);
+    }
+
+    text.Describe("esp32bm_http_request_errors_total", "counter", "Requests whose handler failed, by route");
+    for (uint8_t i = 0; i < slotCount; ++i) {
+        Labels(slots[i], labels, labelsBufLen);
+        text.Printf("esp32bm_http_request_errors_total{%s} %u\n", labels, (unsigned)slots[i].errors);
+    }
+
+    text.Describe("esp32bm_http_received_bytes_total", "counter", "Bytes received by the handlers, by route");
+    for (uint8_t i = 0; i < slotCount; ++i) {
+        Labels(slots[i], labels, labelsBufLen);
+        text.Printf("esp32bm_http_received_bytes_total{%s} %u\n", labels, (unsigned)slots[i].bytesReceived);
+    }
+
+    text.Describe("esp32bm_http_sent_bytes_total", "counter", "Bytes sent by the handlers, by route");
+    for (uint8_t i = 0; i < slotCount; ++i) {
+        Labels(slots[i], labels, labelsBufLen);
+        text.Printf("esp32bm_http_sent_bytes_total{%s} %u\n", labels, (unsigned)slots[i].bytesSent);
+    }
+
+    text.Describe("esp32bm_http_request_duration_seconds", "histogram", "Time spent in the handlers, by route");
+    for (uint8_t i = 0; i < slotCount; ++i) {
+        const HTTPRouteMetrics& m = slots[i];
+        Labels(m, labels, labelsBufLen);
+
+        uint32_t count = 0;
+        for (uint8_t b = 0; b < HTTPMetricsBucketCount; ++b) {
+            count += m.buckets[b];
+            text.Printf("esp32bm_http_request_duration_seconds_bucket{%s,le=\"%u.%06u\"} %u\n", labels,
+                (unsigned)(HTTPMetricsBuckets[b] / 1000000), (unsigned)(HTTPMetricsBuckets[b] % 1000000),
+                (unsigned)count);
+        }
+        count += m.buckets[HTTPMetricsBucketCount];
+        text.Printf("esp32bm_http_request_duration_seconds_bucket{%s,le=\"+Inf\"} %u\n", labels, (unsigned)count);
+        text.Printf("esp32bm_http_request_duration_seconds_sum{%s} %u.%06u\n", labels,
+            (unsigned)(m.durationSum / 1000000), (unsigned)(m.durationSum % 1000000));
+        text.Printf("esp32bm_http_request_duration_seconds_count{%s} %u\n", labels, (unsigned)count);
+    }
+
+    return text.Flush();
+}
@@ -0,0 +1,123 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPMetrics_H
+#define HTTPMetrics_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#include "HTTPRoute.h"
+#include "JSONWriter.h"
+
+const uint8_t HTTPMetricsMaxRoutes = 24;
+const uint8_t HTTPMetricsBucketCount = 12;
+const size_t HTTPMetricsBufferSize = 512;
+
+/**
+ * @brief Upper bounds of the latency buckets, in microseconds
+ */
+extern const uint32_t HTTPMetricsBuckets[HTTPMetricsBucketCount];
+
+struct HTTPRouteMetrics
+{
+    /** nullptr for the requests without a route, like the assets and the 404s */
+    const HTTPRoute *route;
+
+    uint32_t requests;
+    /** requests whose handler did not return ESP_OK */
+    uint32_t errors;
+    uint32_t bytesReceived;
+    uint32_t bytesSent;
+
+    /** not cumulative, the last one counts the requests slower than all bounds */
+    uint32_t buckets[HTTPMetricsBucketCount + 1];
+    uint64_t durationSum;
+};
+
+/**
+ * @brief Writes text, through a small buffer, to a sink
+ *
+ * Like JSONWriter all functions return false after the first error.
+ */
+class HTTPMetricsText
+{
+public:
+    HTTPMetricsText(char *buffer, size_t bufferSize, JSONSink *sink);
+    virtual ~HTTPMetricsText();
+
+    bool Printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    /**
+     * @brief Writes a `# HELP` and a `# TYPE` line
+     */
+    bool Describe(const char *name, const char *type, const char *help);
+
+    bool Flush(void);
+
+protected:
+    char *buffer;
+    size_t bufferSize;
+    size_t used;
+    JSONSink *sink;
+    bool ok;
+};
+
+/**
+ * @brief Request counters and latency histograms of the routes of the HTTP server
+ *
+ * The slots are assigned on the first request of each route, requests without a route
+ * and the ones of the routes not fitting in HTTPMetricsMaxRoutes are counted as `other`.
+ * Record does not allocate memory and does not lock, it must be called only from the
+ * server task, where the metrics are also written.
+ */
+class HTTPMetrics
+{
+public:
+    HTTPMetrics(void);
+    virtual ~HTTPMetrics();
+
+    void Clear(void);
+
+    /**
+     * @brief Records a request
+     *
+     * @param duration  time spent in the handler, in microseconds
+     */
+    void Record(const HTTPRoute*, esp_err_t res, int64_t duration, uint32_t bytesReceived, uint32_t bytesSent);
+
+    /**
+     * @brief Writes the metrics in the Prometheus text format
+     */
+    bool Write(HTTPMetricsText&);
+
+protected:
+    /** slots[0] is for the `other` requests */
+    HTTPRouteMetrics slots[HTTPMetricsMaxRoutes + 1];
+    uint8_t slotCount;
+
+    HTTPRouteMetrics& Slot(const HTTPRoute*);
+
+    /**
+     * @brief Writes the route and method labels, without braces
+     */
+    void Labels(const HTTPRouteMetrics&, char *buf, size_t bufLen);
+};
+
+#endif
@@ -0,0 +1,215 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "lwip/sockets.h"
+
+#include "sdkconfig.h"
+
+#include "HTTPRateLimiter.h"
+#include "HTTPResponseCache.h"
+
+// -----------------------------------------------------------------------------
+
+const uint32_t tokenUnit = 1000;
+/** microseconds in a minute divided by tokenUnit, the tokens earned are elapsed * rate / refillDivider */
+const int64_t refillDivider = 60000;
+
+// -----------------------------------------------------------------------------
+
+void HTTPTokenBucket::Reset(uint32_t burst, int64_t now)
+{
+    tokens = burst * tokenUnit;
+    lastRefill = now;
+}
+
+void HTTPTokenBucket::Refill(uint32_t rate, uint32_t burst, int64_t now)
+{
+    int64_t elapsed = now - lastRefill;
+    if (elapsed <= 0) return;
+
+    int64_t earned = elapsed * rate / refillDivider;
+    if (earned == 0) return; // keep lastRefill so the fractions add up
+
+    uint64_t value = (uint64_t)tokens + earned;
+    uint64_t max = (uint64_t)burst * tokenUnit;
+    tokens = (value > max) ? (uint32_t)max : (uint32_t)value;
+    lastRefill = now;
+}
+
+bool HTTPTokenBucket::HasToken(void) const
+{
+    return tokens >= tokenUnit;
+}
+
+void HTTPTokenBucket::Take(void)
+{
+    tokens -= tokenUnit;
+}
+
+uint32_t HTTPTokenBucket::WaitTime(uint32_t rate) const
+{
+    if (HasToken() || (rate == 0)) return 1;
+
+    uint64_t wait = (uint64_t)(tokenUnit - tokens) * refillDivider / rate;
+    uint32_t seconds = (uint32_t)((wait + 999999) / 1000000);
+    return (seconds == 0) ? 1 : seconds;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPRateLimiter::HTTPRateLimiter(void)
+{
+    Configure(0, 0, 100);
+}
+
+HTTPRateLimiter::~HTTPRateLimiter()
+{
+    //
+}
+
+void HTTPRateLimiter::Configure(uint32_t reqRate, uint32_t reqBurst, uint8_t clientPercent)
+{
+    if (clientPercent > 100) clientPercent = 100;
+
+    rate = reqRate;
+    burst = (reqBurst == 0) ? 1 : reqBurst;
+    clientRate = rate * clientPercent / 100;
+    clientBurst = burst * clientPercent / 100;
+    if (clientRate == 0) clientRate = 1;
+    if (clientBurst == 0) clientBurst = 1;
+
+    int64_t now = esp_timer_get_time();
+    bucket.Reset(burst, now);
+    for (uint8_t i = 0; i < HTTPRateLimitClients; ++i) {
+        clients[i].address = 0;
+        clients[i].lastSeen = 0;
+        clients[i].bucket.Reset(clientBurst, now);
+    }
+
+    admitted = 0;
+    rejected = 0;
+}
+
+HTTPRateLimitClient& HTTPRateLimiter::FindClient(uint32_t address, int64_t now)
+{
+    uint8_t oldest = 0;
+    for (uint8_t i = 0; i < HTTPRateLimitClients; ++i) {
+        if (clients[i].address == address) {
+            clients[i].lastSeen = now;
+            return clients[i];
+        }
+        if (clients[i].lastSeen < clients[oldest].lastSeen) oldest = i;
+    }
+
+    // a free slot has lastSeen 0 so it is the oldest
+    clients[oldest].address = address;
+    clients[oldest].lastSeen = now;
+    clients[oldest].bucket.Reset(clientBurst, now);
+    return clients[oldest];
+}
+
+bool HTTPRateLimiter::Admit(uint32_t address, uint32_t *retryAfter)
+{
+    if (rate == 0) {
+        ++admitted;
+        return true;
+    }
+
+    int64_t now = esp_timer_get_time();
+    bucket.Refill(rate, burst, now);
+
+    HTTPRateLimitClient *client = nullptr;
+    if (address != 0) {
+        client = &FindClient(address, now);
+        client->bucket.Refill(clientRate, clientBurst, now);
+    }
+
+    if (!bucket.HasToken()) {
+        if (retryAfter != nullptr) *retryAfter = bucket.WaitTime(rate);
+        ++rejected;
+        return false;
+    }
+    if ((client != nullptr) && !client->bucket.HasToken()) {
+        if (retryAfter != nullptr) *retryAfter = client->bucket.WaitTime(clientRate);
+        ++rejected;
+        return false;
+    }
+
+    bucket.Take();
+    if (client != nullptr) client->bucket.Take();
+    ++admitted;
+    return true;
+}
+
+bool HTTPRateLimiter::Admit(httpd_req_t *req, uint32_t *retryAfter)
+{
+    return Admit(HTTPClientAddress(httpd_req_to_sockfd(req)), retryAfter);
+}
+
+uint32_t HTTPRateLimiter::AdmittedCount(void)
+{
+    return admitted;
+}
+
+uint32_t HTTPRateLimiter::RejectedCount(void)
+{
+    return rejected;
+}
+
+// -----------------------------------------------------------------------------
+
+uint32_t HTTPClientAddress(int sockfd)
+{
+    if (sockfd < 0) return 0;
+
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(sockfd, (struct sockaddr *)&addr, &len) != 0) return 0;
+
+    uint32_t hash = 0;
+    if (addr.ss_family == AF_INET) {
+        struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+        hash = HTTPContentHash((const char *)&in->sin_addr, sizeof(in->sin_addr));
+    }
+#ifdef CONFIG_LWIP_IPV6
+    else if (addr.ss_family == AF_INET6) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+        hash = HTTPContentHash((const char *)&in6->sin6_addr, sizeof(in6->sin6_addr));
+    }
+#endif
+    return (hash == 0) ? 1 : hash;
+}
+
+esp_err_t HTTPSendTooManyRequests(httpd_req_t *req, uint32_t retryAfter)
+{
+    char value[12];
+    snprintf(value, sizeof(value), "%u", (unsigned)retryAfter);
+
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Retry-After", value);
+    httpd_resp_sendstr(req, "Too many requests");
+    return ESP_FAIL;
+}
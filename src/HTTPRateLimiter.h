@@ -0,0 +1,125 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPRateLimiter_H
+#define HTTPRateLimiter_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+
+const uint8_t HTTPRateLimitClients = 8;
+
+/**
+ * @brief A token bucket, the tokens are counted in thousandths
+ */
+struct HTTPTokenBucket
+{
+    uint32_t tokens;
+    int64_t lastRefill;
+
+    void Reset(uint32_t burst, int64_t now);
+
+    /**
+     * @brief Adds the tokens earned since lastRefill, up to burst
+     *
+     * @param rate  tokens per minute
+     */
+    void Refill(uint32_t rate, uint32_t burst, int64_t now);
+
+    bool HasToken(void) const;
+    void Take(void);
+
+    /**
+     * @brief Seconds until a token is available, at least 1
+     */
+    uint32_t WaitTime(uint32_t rate) const;
+};
+
+struct HTTPRateLimitClient
+{
+    uint32_t address;   /**< hash of the address of the client, 0 for a free slot */
+    int64_t lastSeen;
+    HTTPTokenBucket bucket;
+};
+
+/**
+ * @brief Admission control for an endpoint, with a token bucket for the endpoint and one for each client
+ *
+ * A request is admitted if both the bucket of the endpoint and the one of its client have
+ * a token. A client gets clientPercent of the rate and burst of the endpoint so it can not
+ * use all of them. The clients are identified by their address, the least recently seen
+ * one is replaced when the table is full.
+ *
+ * A rate of 0 disables the limiter.
+ * Must be used from a single task, usually the server task.
+ */
+class HTTPRateLimiter
+{
+public:
+    HTTPRateLimiter(void);
+    virtual ~HTTPRateLimiter();
+
+    /**
+     * @param rate           requests per minute
+     * @param burst          requests admitted at once after a pause
+     * @param clientPercent  share of rate and burst for each client
+     */
+    void Configure(uint32_t rate, uint32_t burst, uint8_t clientPercent);
+
+    /**
+     * @brief Returns true if the request is admitted
+     *
+     * @param retryAfter set, for a rejected request, to the seconds until a token is available
+     */
+    bool Admit(uint32_t client, uint32_t *retryAfter);
+
+    /**
+     * @brief Admit for the client connected on the socket of the request
+     */
+    bool Admit(httpd_req_t*, uint32_t *retryAfter);
+
+    uint32_t AdmittedCount(void);
+    uint32_t RejectedCount(void);
+
+protected:
+    uint32_t rate;
+    uint32_t burst;
+    uint32_t clientRate;
+    uint32_t clientBurst;
+
+    HTTPTokenBucket bucket;
+    HTTPRateLimitClient clients[HTTPRateLimitClients];
+
+    uint32_t admitted;
+    uint32_t rejected;
+
+    HTTPRateLimitClient& FindClient(uint32_t address, int64_t now);
+};
+
+/**
+ * @brief Returns a hash of the peer address of the socket, 0 if unknown
+ */
+uint32_t HTTPClientAddress(int sockfd);
+
+/**
+ * @brief Sends `429 Too Many Requests` with a Retry-After header
+ */
+esp_err_t HTTPSendTooManyRequests(httpd_req_t*, uint32_t retryAfter);
+
+#endif
@@ -0,0 +1,153 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "HTTPResponseCache.h"
+
+// -----------------------------------------------------------------------------
+
+const size_t ifNoneMatchBufLen = 128;
+
+static const char* cacheControlRevalidate = "private, no-cache";
+
+// -----------------------------------------------------------------------------
+
+uint32_t HTTPContentHash(const char *data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool HTTPRequestMatchesETag(httpd_req_t *req, const char *etag)
+{
+    if ((req == nullptr) || (etag == nullptr)) return false;
+    if (etag[0] == 0) return false;
+
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+    if ((len == 0) || (len >= ifNoneMatchBufLen)) return false;
+
+    char buf[ifNoneMatchBufLen];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", buf, ifNoneMatchBufLen) != ESP_OK)
+        return false;
+
+    if ((buf[0] == '*') && (buf[1] == 0)) return true;
+
+    // the ETags are quoted so a substring match is exact, W/ prefixes are also accepted
+    return strstr(buf, etag) != nullptr;
+}
+
+esp_err_t HTTPSendNotModified(httpd_req_t *req, const char *etag, const char *cacheControl)
+{
+    esp_err_t res = httpd_resp_set_status(req, "304 Not Modified");
+    if (res != ESP_OK) return res;
+
+    res = httpd_resp_set_hdr(req, "ETag", etag);
+    if (res != ESP_OK) return res;
+
+    if (cacheControl != nullptr) {
+        res = httpd_resp_set_hdr(req, "Cache-Control", cacheControl);
+        if (res != ESP_OK) return res;
+    }
+
+    return httpd_resp_send(req, nullptr, 0);
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPCachedResponse::HTTPCachedResponse(void)
+{
+    data = nullptr;
+    length = 0;
+    generation = 0;
+    valid = false;
+    etag[0] = 0;
+}
+
+HTTPCachedResponse::~HTTPCachedResponse()
+{
+    Invalidate();
+}
+
+bool HTTPCachedResponse::IsValid(uint32_t gen)
+{
+    return valid && (generation == gen);
+}
+
+void HTTPCachedResponse::Set(char *newData, size_t newLength, uint32_t gen)
+{
+    Invalidate();
+    if (newData == nullptr) return;
+
+    // the length is added to make collisions even less likely
+    uint32_t hash = HTTPContentHash(newData, newLength);
+    snprintf(etag, ETagBufLen, "\"%08x-%x\"", (unsigned)hash, (unsigned)newLength);
+
+    data = newData;
+    length = newLength;
+    generation = gen;
+    valid = true;
+}
+
+void HTTPCachedResponse::Invalidate(void)
+{
+    valid = false;
+    etag[0] = 0;
+    if (data != nullptr) {
+        free(data);
+        data = nullptr;
+    }
+    length = 0;
+}
+
+esp_err_t HTTPCachedResponse::Send(httpd_req_t *req, const char *contentType)
+{
+    if (!valid) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cache entry not valid");
+        return ESP_FAIL;
+    }
+
+    if (HTTPRequestMatchesETag(req, etag)) {
+        return HTTPSendNotModified(req, etag, cacheControlRevalidate);
+    }
+
+    esp_err_t res = httpd_resp_set_type(req, contentType);
+    if (res != ESP_OK) return res;
+
+    res = httpd_resp_set_hdr(req, "Cache-Control", cacheControlRevalidate);
+    if (res != ESP_OK) return res;
+
+    res = httpd_resp_set_hdr(req, "ETag", etag);
+    if (res != ESP_OK) return res;
+
+    return httpd_resp_send(req, data, length);
+}
+
+const char* HTTPCachedResponse::ETag(void)
+{
+    return etag;
+}
@@ -0,0 +1,87 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPResponseCache_H
+#define HTTPResponseCache_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+
+const size_t ETagBufLen = 24;
+
+/**
+ * @brief FNV-1a hash of a block of data
+ */
+uint32_t HTTPContentHash(const char *data, size_t length);
+
+/**
+ * @brief Returns true if the If-None-Match header of the request matches the ETag
+ *
+ * The ETag must be quoted, like "abcd".
+ * A request with `If-None-Match: *` matches any ETag.
+ */
+bool HTTPRequestMatchesETag(httpd_req_t*, const char *etag);
+
+/**
+ * @brief Sends a 304 Not Modified response
+ */
+esp_err_t HTTPSendNotModified(httpd_req_t*, const char *etag, const char *cacheControl);
+
+/**
+ * @brief A serialized response with its strong ETag
+ *
+ * The entry is tagged with a generation number, usually Configuration::GetChangeCount,
+ * and is valid only for that generation.
+ * Is used from the HTTP server task only so it is not protected by a mutex.
+ */
+class HTTPCachedResponse
+{
+public:
+    HTTPCachedResponse(void);
+    virtual ~HTTPCachedResponse();
+
+    bool IsValid(uint32_t generation);
+
+    /**
+     * @brief Stores a malloc'ed buffer, the cache takes ownership of it
+     *
+     * The buffer is freed with 'free' when the entry is invalidated.
+     */
+    void Set(char *data, size_t length, uint32_t generation);
+
+    void Invalidate(void);
+
+    /**
+     * @brief Sends the cached data or 304 if the client has the same version
+     *
+     * The response has `Cache-Control: private, no-cache` so the clients will always revalidate.
+     */
+    esp_err_t Send(httpd_req_t*, const char *contentType);
+
+    const char* ETag(void);
+
+protected:
+    char *data;
+    size_t length;
+    uint32_t generation;
+    bool valid;
+    char etag[ETagBufLen];
+};
+
+#endif
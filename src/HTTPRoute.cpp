@@ -0,0 +1,131 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "HTTPRoute.h"
+
+// -----------------------------------------------------------------------------
+
+uint32_t HTTPRouteHashURI(const char *uri, size_t *pathLen)
+{
+    uint32_t hash = HTTPRouteHashSeed;
+    const char *str = uri;
+
+    while ((*str != 0) && (*str != '?')) {
+        hash = (hash ^ (uint8_t)(*str)) * HTTPRouteHashPrime;
+        ++str;
+    }
+
+    if (pathLen != nullptr) {
+        *pathLen = str - uri;
+    }
+    return hash;
+}
+
+const char* HTTPQueryString(const char *uri)
+{
+    if (uri == nullptr) return nullptr;
+
+    const char *query = strchr(uri, '?');
+    if (query == nullptr) return nullptr;
+    return query + 1;
+}
+
+// -----------------------------------------------------------------------------
+
+bool HTTPRoute::Matches(int reqMethod, uint32_t reqHash, const char *uri, size_t pathLen) const
+{
+    if (reqHash != hash) return false;
+    if (reqMethod != (int)method) return false;
+
+    // confirm, a hash match does not guarantee a path match
+    if (strncmp(path, uri, pathLen) != 0) return false;
+    return path[pathLen] == 0;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPRouteIndex::HTTPRouteIndex(void)
+{
+    routes = nullptr;
+    count = 0;
+}
+
+HTTPRouteIndex::~HTTPRouteIndex()
+{
+    Clear();
+}
+
+void HTTPRouteIndex::Clear(void)
+{
+    if (routes != nullptr) {
+        delete[] routes;
+        routes = nullptr;
+    }
+    count = 0;
+}
+
+bool HTTPRouteIndex::IsBuilt(void) const
+{
+    return routes != nullptr;
+}
+
+bool HTTPRouteIndex::Build(const HTTPRoute *first, size_t firstCount, const HTTPRoute *second, size_t secondCount)
+{
+    Clear();
+
+    if (first == nullptr) firstCount = 0;
+    if (second == nullptr) secondCount = 0;
+    size_t total = firstCount + secondCount;
+    if (total == 0) return true;
+
+    routes = new (std::nothrow) const HTTPRoute*[total];
+    if (routes == nullptr) return false;
+
+    for (size_t i = 0; i < firstCount; ++i)
+        routes[count++] = &first[i];
+    for (size_t i = 0; i < secondCount; ++i)
+        routes[count++] = &second[i];
+
+    // stable, the routes of the first table stay before the ones of the second
+    std::stable_sort(routes, routes + count,
+        [](const HTTPRoute *a, const HTTPRoute *b) { return a->hash < b->hash; });
+    return true;
+}
+
+const HTTPRoute* HTTPRouteIndex::Find(int method, const char *uri) const
+{
+    if (count == 0) return nullptr;
+
+    size_t pathLen = 0;
+    uint32_t hash = HTTPRouteHashURI(uri, &pathLen);
+
+    const HTTPRoute **end = routes + count;
+    const HTTPRoute **it = std::lower_bound(routes, end, hash,
+        [](const HTTPRoute *route, uint32_t value) { return route->hash < value; });
+
+    for (; (it != end) && ((*it)->hash == hash); ++it) {
+        if ((*it)->Matches(method, hash, uri, pathLen))
+            return *it;
+    }
+    return nullptr;
+}
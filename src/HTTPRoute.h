@@ -0,0 +1,130 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPRoute_H
+#define HTTPRoute_H
+
+#include "esp_http_server.h"
+
+class PaxHttpServer;
+
+typedef esp_err_t (PaxHttpServer::*HTTPRouteHandler)(httpd_req_t*);
+
+const uint32_t HTTPRouteHashSeed  = 2166136261u;
+const uint32_t HTTPRouteHashPrime = 16777619u;
+
+/**
+ * @brief FNV-1a hash of the path part of an URI
+ *
+ * The hash stops at the end of the string or at the start of the query string.
+ * Being constexpr, the hashes of the route tables are computed at compile time.
+ * Use HTTPRouteHashURI at runtime, it returns the same value without recursion.
+ */
+constexpr uint32_t HTTPRouteHash(const char *str, uint32_t hash = HTTPRouteHashSeed)
+{
+    return ((*str == 0) || (*str == '?')) ?
+        hash :
+        HTTPRouteHash(str + 1, (hash ^ (uint8_t)(*str)) * HTTPRouteHashPrime);
+}
+
+/**
+ * @brief Runtime version of HTTPRouteHash
+ *
+ * @param pathLen if not nullptr receives the length of the path part of the URI
+ */
+uint32_t HTTPRouteHashURI(const char *uri, size_t *pathLen);
+
+/**
+ * @brief Returns the query string of an URI, the part after '?', or nullptr if there is none
+ *
+ * The query is used in place, from the URI of the request, so it is not limited
+ * by the size of a buffer like with httpd_req_get_url_query_str.
+ */
+const char* HTTPQueryString(const char *uri);
+
+/**
+ * @brief An entry in a route table
+ *
+ * The route tables should be `const` arrays, the constexpr constructor makes them
+ * constant initialized so they are placed in flash and need no runtime setup.
+ *
+ * Handlers of derived classes are added with a cast to the base class handler type:
+ * @code{.cpp}
+ * const HTTPRoute ExampleBoardHTTPSrv::exampleRoutes[] = {
+ *     HTTPRoute(HTTP_GET, "/example.txt", static_cast<HTTPRouteHandler>(&ExampleBoardHTTPSrv::HandleGet_ExampleTxt)),
+ * };
+ * @endcode
+ */
+struct HTTPRoute
+{
+    httpd_method_t method;
+    uint32_t hash;
+    const char *path;
+    HTTPRouteHandler handler;
+
+    constexpr HTTPRoute(httpd_method_t routeMethod, const char *routePath, HTTPRouteHandler routeHandler) :
+        method(routeMethod),
+        hash(HTTPRouteHash(routePath)),
+        path(routePath),
+        handler(routeHandler) {}
+
+    /**
+     * @brief Returns true if this route matches the method and the path of the request
+     *
+     * `hash` and `pathLen` are the values returned by HTTPRouteHashURI for the request's URI.
+     */
+    bool Matches(int reqMethod, uint32_t reqHash, const char *uri, size_t pathLen) const;
+};
+
+/**
+ * @brief Index of route tables sorted by the hash of the path
+ *
+ * A lookup is a binary search on the hash followed by Matches for the few routes
+ * with the same hash, instead of a scan of every route.
+ * The routes of the first table have priority over the ones of the second table
+ * with the same method and path, like when the tables are scanned in this order.
+ */
+class HTTPRouteIndex
+{
+public:
+    HTTPRouteIndex(void);
+    virtual ~HTTPRouteIndex();
+
+    /**
+     * @brief Indexes the routes of two tables, returns false if there is not enough memory
+     *
+     * The tables must outlive the index, any table may be nullptr.
+     */
+    bool Build(const HTTPRoute *first, size_t firstCount, const HTTPRoute *second, size_t secondCount);
+    void Clear(void);
+
+    bool IsBuilt(void) const;
+
+    /**
+     * @brief Returns the route matching the method and the path of the URI, or nullptr
+     */
+    const HTTPRoute* Find(int method, const char *uri) const;
+
+protected:
+    /** the routes, sorted by hash and in the order of the tables for the same hash */
+    const HTTPRoute **routes;
+    size_t count;
+};
+
+#endif
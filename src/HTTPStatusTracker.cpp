@@ -0,0 +1,303 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+
+#include <cstring>
+
+#include "HTTPStatusTracker.h"
+#include "HTTPResponseCache.h"
+
+// -----------------------------------------------------------------------------
+
+const uint32_t fnvPrime = 16777619u;
+const uint32_t fnvBasis = 2166136261u;
+
+/**
+ * @brief Hash of a key, never 0 which marks the shared slot
+ */
+static uint32_t KeyHash(const char *key)
+{
+    uint32_t hash = HTTPContentHash(key, strlen(key));
+    return (hash == 0) ? 1 : hash;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPStatusTracker::HTTPStatusTracker(void) : JSONWriter(nullptr, 0, nullptr)
+{
+    // nothing is written, the base class has no buffer
+    version = 0;
+    Clear();
+}
+
+HTTPStatusTracker::~HTTPStatusTracker()
+{
+    //
+}
+
+void HTTPStatusTracker::Clear(void)
+{
+    // the version is not reset, a client can not get a delta for an older snapshot
+    count = 0;
+    baseVersion = version + 1;
+    Begin();
+}
+
+void HTTPStatusTracker::Begin(void)
+{
+    ok = true;
+    depth = 0;
+    nextCount = 0;
+    current = -1;
+}
+
+bool HTTPStatusTracker::Commit(bool complete)
+{
+    if (!complete || !ok || (depth != 0)) return false;
+
+    bool sameNames = (nextCount == count) && (version >= baseVersion);
+    for (uint8_t i = 0; sameNames && (i < count); ++i) {
+        if (members[i].keyHash != next[i].keyHash) sameNames = false;
+    }
+
+    if (!sameNames) {
+        ++version;
+        baseVersion = version;
+        for (uint8_t i = 0; i < nextCount; ++i) {
+            members[i] = next[i];
+            members[i].version = version;
+        }
+        count = nextCount;
+        return true;
+    }
+
+    bool changed = false;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (members[i].valueHash == next[i].valueHash) continue;
+
+        if (!changed) {
+            ++version;
+            changed = true;
+        }
+        members[i].valueHash = next[i].valueHash;
+        members[i].version = version;
+    }
+    return changed;
+}
+
+uint32_t HTTPStatusTracker::Version(void)
+{
+    return version;
+}
+
+bool HTTPStatusTracker::HasDelta(uint32_t since)
+{
+    return (since >= baseVersion) && (since <= version);
+}
+
+int8_t HTTPStatusTracker::Find(uint32_t keyHash)
+{
+    int8_t shared = -1;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (members[i].keyHash == keyHash) return i;
+        if (members[i].keyHash == 0) shared = i;
+    }
+    return shared;
+}
+
+bool HTTPStatusTracker::Changed(const char *key, uint32_t since)
+{
+    if (!HasDelta(since)) return true;
+    if (key == nullptr) return true;
+
+    int8_t idx = Find(KeyHash(key));
+    if (idx < 0) return true;
+    return members[idx].version > since;
+}
+
+bool HTTPStatusTracker::AnyChanged(uint32_t since, const JSONFieldList *fields)
+{
+    if (!HasDelta(since)) return true;
+
+    if ((fields == nullptr) || fields->IsEmpty()) {
+        for (uint8_t i = 0; i < count; ++i) {
+            if (members[i].version > since) return true;
+        }
+        return false;
+    }
+
+    // a requested member which is not in the status never changes
+    for (uint8_t i = 0; i < fields->Count(); ++i) {
+        int8_t idx = Find(KeyHash(fields->Name(i)));
+        if ((idx >= 0) && (members[idx].version > since)) return true;
+    }
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+
+void HTTPStatusTracker::Mix(const void *data, size_t length)
+{
+    if (current < 0) return;
+
+    const uint8_t *bytes = (const uint8_t*)data;
+    uint32_t hash = next[current].valueHash;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * fnvPrime;
+    }
+    next[current].valueHash = hash;
+}
+
+void HTTPStatusTracker::Hash(const char *key, char type, const void *data, size_t length)
+{
+    if ((depth == 1) && (key != nullptr)) {
+        // a new member of the status object
+        if (nextCount + 1 < StatusTrackerMaxMembers) {
+            current = nextCount++;
+            next[current].keyHash = KeyHash(key);
+            next[current].valueHash = fnvBasis;
+            next[current].version = 0;
+        }
+        else if (nextCount + 1 == StatusTrackerMaxMembers) {
+            // the last slot takes all the remaining members
+            current = nextCount++;
+            next[current].keyHash = 0;
+            next[current].valueHash = fnvBasis;
+            next[current].version = 0;
+        }
+    }
+    if (current < 0) return;
+
+    Mix(&type, 1);
+    if (key != nullptr) Mix(key, strlen(key) + 1);
+    Mix(data, length);
+}
+
+bool HTTPStatusTracker::Open(const char *key, char type)
+{
+    if (!ok) return false;
+    if (depth + 1 >= JSONWriterMaxDepth) {
+        ok = false;
+        return false;
+    }
+
+    Hash(key, type, nullptr, 0);
+    ++depth;
+    return true;
+}
+
+bool HTTPStatusTracker::Close(char type)
+{
+    if (!ok) return false;
+    if (depth == 0) {
+        ok = false;
+        return false;
+    }
+
+    --depth;
+    Hash(nullptr, type, nullptr, 0);
+    if (depth == 0) {
+        // the status object is closed
+        current = -1;
+    }
+    return true;
+}
+
+bool HTTPStatusTracker::BeginObject(const char *key)
+{
+    return Open(key, '{');
+}
+
+bool HTTPStatusTracker::EndObject(void)
+{
+    return Close('}');
+}
+
+bool HTTPStatusTracker::BeginArray(const char *key)
+{
+    return Open(key, '[');
+}
+
+bool HTTPStatusTracker::EndArray(void)
+{
+    return Close(']');
+}
+
+bool HTTPStatusTracker::AddString(const char *key, const char *value)
+{
+    if (value == nullptr) value = "";
+    Hash(key, 's', value, strlen(value));
+    return ok;
+}
+
+bool HTTPStatusTracker::AddInt(const char *key, int64_t value)
+{
+    Hash(key, 'i', &value, sizeof(value));
+    return ok;
+}
+
+bool HTTPStatusTracker::AddUInt(const char *key, uint64_t value)
+{
+    Hash(key, 'u', &value, sizeof(value));
+    return ok;
+}
+
+bool HTTPStatusTracker::AddDouble(const char *key, double value)
+{
+    Hash(key, 'd', &value, sizeof(value));
+    return ok;
+}
+
+bool HTTPStatusTracker::AddBool(const char *key, bool value)
+{
+    Hash(key, value ? 't' : 'f', nullptr, 0);
+    return ok;
+}
+
+bool HTTPStatusTracker::AddNull(const char *key)
+{
+    Hash(key, 'n', nullptr, 0);
+    return ok;
+}
+
+bool HTTPStatusTracker::Flush(void)
+{
+    return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPStatusDeltaWriter::HTTPStatusDeltaWriter(JSONWriter& target, const JSONFieldList *fields, HTTPStatusTracker& statusTracker, uint32_t sinceVersion) :
+    JSONFilterWriter(target, fields),
+    tracker(statusTracker)
+{
+    since = sinceVersion;
+}
+
+HTTPStatusDeltaWriter::~HTTPStatusDeltaWriter()
+{
+    //
+}
+
+bool HTTPStatusDeltaWriter::Selected(const char *key)
+{
+    if (!JSONFilterWriter::Selected(key)) return false;
+    return tracker.Changed(key, since);
+}
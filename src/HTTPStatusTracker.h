@@ -0,0 +1,158 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPStatusTracker_H
+#define HTTPStatusTracker_H
+
+#include "JSONWriter.h"
+#include "JSONFieldFilter.h"
+#include "HTTPContentFormat.h"
+#include "sdkconfig.h"
+
+const uint8_t StatusTrackerMaxMembers = 32;
+const uint8_t StatusWaitMaxClients = CONFIG_ESP32BM_STATUS_WAIT_MAX_CLIENTS;
+const uint32_t StatusWaitMaxTime = CONFIG_ESP32BM_STATUS_WAIT_MAX_MS;
+
+struct HTTPStatusMember
+{
+    /** hash of the key, 0 for the slot shared by the members over StatusTrackerMaxMembers */
+    uint32_t keyHash;
+    uint32_t valueHash;
+    /** the status version in which the value changed last time */
+    uint32_t version;
+};
+
+/**
+ * @brief Gives a version to the status and remembers when each of its top level members changed
+ *
+ * It is a JSONWriter which writes nothing. WriteJSONStatus is called with it, between Begin
+ * and Commit, and it hashes the value of each member of the status object. Commit compares
+ * the hashes with the ones of the previous snapshot and increments the version if any changed.
+ *
+ * A delta from a version is answered with the members changed after it. A version which is
+ * unknown, older than the last change of the member names or from before a restart gets
+ * the full status.
+ */
+class HTTPStatusTracker : public JSONWriter
+{
+public:
+    HTTPStatusTracker(void);
+    virtual ~HTTPStatusTracker();
+
+    /**
+     * @brief Forgets the snapshot, the next one gets a new version and is sent in full
+     */
+    void Clear(void);
+
+    void Begin(void);
+
+    /**
+     * @brief Ends a snapshot, returns true if the version changed
+     *
+     * @param complete false if WriteJSONStatus failed, the snapshot is ignored
+     */
+    bool Commit(bool complete);
+
+    uint32_t Version(void);
+
+    /**
+     * @brief Returns true if a delta from the version `since` can be sent
+     */
+    bool HasDelta(uint32_t since);
+
+    /**
+     * @brief Returns true if the member changed after the version `since`
+     *
+     * Also true for any member if there is no delta from `since`.
+     */
+    bool Changed(const char *key, uint32_t since);
+
+    /**
+     * @brief Returns true if any of the members selected by `fields` changed after the version `since`
+     */
+    bool AnyChanged(uint32_t since, const JSONFieldList *fields);
+
+    virtual bool BeginObject(const char *key);
+    virtual bool EndObject(void);
+    virtual bool BeginArray(const char *key);
+    virtual bool EndArray(void);
+
+    virtual bool AddString(const char *key, const char *value);
+    virtual bool AddInt(const char *key, int64_t value);
+    virtual bool AddUInt(const char *key, uint64_t value);
+    virtual bool AddDouble(const char *key, double value);
+    virtual bool AddBool(const char *key, bool value);
+    virtual bool AddNull(const char *key);
+
+    virtual bool Flush(void);
+
+protected:
+    HTTPStatusMember members[StatusTrackerMaxMembers];
+    uint8_t count;
+    uint32_t version;
+    /** the version in which the member names changed */
+    uint32_t baseVersion;
+
+    /** the snapshot in progress */
+    HTTPStatusMember next[StatusTrackerMaxMembers];
+    uint8_t nextCount;
+    int8_t current;
+
+    int8_t Find(uint32_t keyHash);
+    void Mix(const void *data, size_t length);
+    void Hash(const char *key, char type, const void *data, size_t length);
+    bool Open(const char *key, char type);
+    bool Close(char type);
+};
+
+/**
+ * @brief Writes to another writer the members of the status changed after a version
+ *
+ * With `since` 0, or a version without a delta, all the members are written.
+ * The members are also filtered by the fields list, like with JSONFilterWriter.
+ */
+class HTTPStatusDeltaWriter : public JSONFilterWriter
+{
+public:
+    HTTPStatusDeltaWriter(JSONWriter& target, const JSONFieldList *fields, HTTPStatusTracker& tracker, uint32_t since);
+    virtual ~HTTPStatusDeltaWriter();
+
+protected:
+    HTTPStatusTracker& tracker;
+    uint32_t since;
+
+    virtual bool Selected(const char *key);
+};
+
+/**
+ * @brief A status.json request waiting for a change, see `?wait=`
+ *
+ * The handler returns without a response and the connection is answered later, from
+ * the server task, with the delta or, at the deadline, with the unchanged version.
+ */
+struct HTTPStatusWaiter
+{
+    int sockfd;
+    uint32_t since;
+    int64_t deadline;
+    HTTPContentFormat format;
+    JSONFieldList fields;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+
+#include <cstdio>
+
+#include "HTTPWorkerPool.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "HTTPWorkerPool";
+
+// -----------------------------------------------------------------------------
+
+HTTPWorkerPool::HTTPWorkerPool(void)
+{
+    queue = nullptr;
+    exited = nullptr;
+    taskCount = 0;
+    busy.store(0);
+    completed.store(0);
+    rejected.store(0);
+}
+
+HTTPWorkerPool::~HTTPWorkerPool()
+{
+    Stop();
+}
+
+esp_err_t HTTPWorkerPool::Start(uint8_t workers, uint32_t stackSize, UBaseType_t priority, BaseType_t coreId)
+{
+    if (IsRunning()) return ESP_ERR_INVALID_STATE;
+    if ((workers == 0) || (workers > HTTPWorkerMaxTasks)) return ESP_ERR_INVALID_ARG;
+
+    busy.store(0);
+    completed.store(0);
+    rejected.store(0);
+
+    queue = xQueueCreate(HTTPWorkQueueLength, sizeof(HTTPWorkItem));
+    exited = xSemaphoreCreateCounting(HTTPWorkerMaxTasks, 0);
+    if ((queue == nullptr) || (exited == nullptr)) {
+        ESP_LOGE(TAG, "Failed to create the queue");
+        Release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < workers; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "HTTP worker %u", (unsigned)i);
+        BaseType_t res = xTaskCreatePinnedToCore(WorkerTask, name, stackSize, this, priority, nullptr, coreId);
+        if (res != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker %u", (unsigned)i);
+            Stop();
+            return ESP_ERR_NO_MEM;
+        }
+        ++taskCount;
+    }
+
+    return ESP_OK;
+}
+
+void HTTPWorkerPool::Stop(void)
+{
+    if (queue == nullptr) return;
+
+    // queued after the pending work so that runs first
+    HTTPWorkItem item = { nullptr, nullptr };
+    for (uint8_t i = 0; i < taskCount; ++i) {
+        xQueueSendToBack(queue, &item, portMAX_DELAY);
+    }
+    for (uint8_t i = 0; i < taskCount; ++i) {
+        xSemaphoreTake(exited, portMAX_DELAY);
+    }
+    taskCount = 0;
+
+    Release();
+}
+
+void HTTPWorkerPool::Release(void)
+{
+    if (queue != nullptr) {
+        vQueueDelete(queue);
+        queue = nullptr;
+    }
+    if (exited != nullptr) {
+        vSemaphoreDelete(exited);
+        exited = nullptr;
+    }
+}
+
+bool HTTPWorkerPool::IsRunning(void)
+{
+    return taskCount > 0;
+}
+
+bool HTTPWorkerPool::Submit(HTTPWorkFunction function, void *arg)
+{
+    if ((function == nullptr) || !IsRunning()) return false;
+
+    HTTPWorkItem item = { function, arg };
+    if (xQueueSendToBack(queue, &item, 0) != pdTRUE) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+uint32_t HTTPWorkerPool::PendingCount(void)
+{
+    if (queue == nullptr) return 0;
+    return uxQueueMessagesWaiting(queue);
+}
+
+uint32_t HTTPWorkerPool::BusyCount(void)
+{
+    return busy.load(std::memory_order_relaxed);
+}
+
+uint32_t HTTPWorkerPool::CompletedCount(void)
+{
+    return completed.load(std::memory_order_relaxed);
+}
+
+uint32_t HTTPWorkerPool::RejectedCount(void)
+{
+    return rejected.load(std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+
+void HTTPWorkerPool::WorkerTask(void *param)
+{
+    HTTPWorkerPool *pool = static_cast<HTTPWorkerPool*>(param);
+    pool->Worker();
+    vTaskDelete(nullptr);
+}
+
+void HTTPWorkerPool::Worker(void)
+{
+    for (;;) {
+        HTTPWorkItem item;
+        if (xQueueReceive(queue, &item, portMAX_DELAY) != pdTRUE) continue;
+        if (item.function == nullptr) break;
+
+        busy.fetch_add(1, std::memory_order_relaxed);
+        item.function(item.arg);
+        busy.fetch_sub(1, std::memory_order_relaxed);
+        completed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    xSemaphoreGive(exited);
+}
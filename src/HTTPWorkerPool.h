@@ -0,0 +1,100 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTPWorkerPool_H
+#define HTTPWorkerPool_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+
+#include <atomic>
+
+const uint8_t HTTPWorkerMaxTasks = 4;
+const uint8_t HTTPWorkQueueLength = 8;
+
+typedef void (*HTTPWorkFunction)(void *arg);
+
+struct HTTPWorkItem
+{
+    HTTPWorkFunction function;  /**< nullptr tells a worker to exit */
+    void *arg;
+};
+
+/**
+ * @brief Tasks running the slow parts of the requests, like NVS commits, outside the server task
+ *
+ * The server task has a single thread so a handler waiting for flash delays all the other
+ * requests. A handler can answer quickly and Submit the slow part, which runs on one of the
+ * workers, in the order it was submitted.
+ *
+ * The workers may run at the same time so the functions must not touch the state owned by
+ * the server task, like the connection manager or the rate limiters, without a lock.
+ */
+class HTTPWorkerPool
+{
+public:
+    HTTPWorkerPool(void);
+    virtual ~HTTPWorkerPool();
+
+    /**
+     * @brief Creates the queue and the worker tasks
+     *
+     * @param coreId  core of the workers, tskNO_AFFINITY for any
+     */
+    esp_err_t Start(uint8_t workers, uint32_t stackSize, UBaseType_t priority, BaseType_t coreId);
+
+    /**
+     * @brief Runs the functions already submitted then deletes the workers
+     */
+    void Stop(void);
+
+    bool IsRunning(void);
+
+    /**
+     * @brief Queues `function(arg)` for a worker
+     *
+     * Does not wait. Returns false if the pool is not running or the queue is full,
+     * the caller still owns `arg` and should do the work itself.
+     */
+    bool Submit(HTTPWorkFunction function, void *arg);
+
+    uint32_t PendingCount(void);
+    uint32_t BusyCount(void);
+    uint32_t CompletedCount(void);
+    uint32_t RejectedCount(void);
+
+protected:
+    QueueHandle_t queue;
+    SemaphoreHandle_t exited;
+    uint8_t taskCount;
+
+    std::atomic<uint32_t> busy;
+    std::atomic<uint32_t> completed;
+    std::atomic<uint32_t> rejected;
+
+    void Release(void);
+
+    static void WorkerTask(void*);
+    void Worker(void);
+};
+
+#endif
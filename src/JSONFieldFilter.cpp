@@ -0,0 +1,263 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+
+#include <cstring>
+
+#include "JSONFieldFilter.h"
+#include "HTTPRoute.h"
+
+// -----------------------------------------------------------------------------
+
+JSONFieldList::JSONFieldList(void)
+{
+    Clear();
+}
+
+JSONFieldList::~JSONFieldList()
+{
+    //
+}
+
+void JSONFieldList::Clear(void)
+{
+    data[0] = 0;
+    count = 0;
+}
+
+bool JSONFieldList::Parse(const char *list)
+{
+    Clear();
+    if (list == nullptr) return true;
+
+    size_t len = strlen(list);
+    if (len >= JSONFieldListSize) return false;
+
+    // the query string is not decoded, "%2C" is an encoded comma
+    size_t out = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= len; ++i) {
+        bool end = (list[i] == 0) || (list[i] == ',');
+        size_t skip = 1;
+        if (!end && (list[i] == '%') && (list[i + 1] == '2') && ((list[i + 2] == 'C') || (list[i + 2] == 'c'))) {
+            end = true;
+            skip = 3;
+        }
+
+        if (!end) {
+            data[out++] = list[i];
+            continue;
+        }
+
+        if (out > start) {
+            if (count >= JSONFieldListMaxFields) {
+                Clear();
+                return false;
+            }
+            data[out++] = 0;
+            names[count++] = data + start;
+            start = out;
+        }
+        i += skip - 1;
+    }
+    return true;
+}
+
+bool JSONFieldList::ReadQuery(httpd_req_t *req)
+{
+    Clear();
+
+    // the other parameters can make the query as long as the URI, only the value of fields is copied
+    const char *query = HTTPQueryString(req->uri);
+    if ((query == nullptr) || (*query == 0)) return true;
+
+    char value[JSONFieldListSize];
+    esp_err_t err = httpd_query_key_value(query, "fields", value, sizeof(value));
+    if (err == ESP_ERR_NOT_FOUND) return true;
+    // ESP_ERR_HTTPD_RESULT_TRUNC, the list is too long
+    if (err != ESP_OK) return false;
+
+    return Parse(value);
+}
+
+bool JSONFieldList::IsEmpty(void) const
+{
+    return count == 0;
+}
+
+bool JSONFieldList::Contains(const char *key) const
+{
+    if (key == nullptr) return false;
+
+    for (uint8_t i = 0; i < count; ++i) {
+        if (strcmp(names[i], key) == 0) return true;
+    }
+    return false;
+}
+
+uint8_t JSONFieldList::Count(void) const
+{
+    return count;
+}
+
+const char* JSONFieldList::Name(uint8_t index) const
+{
+    if (index >= count) return nullptr;
+    return names[index];
+}
+
+// -----------------------------------------------------------------------------
+
+JSONFilterWriter::JSONFilterWriter(JSONWriter& targetWriter, const JSONFieldList *fieldList) :
+    JSONWriter(nullptr, 0, nullptr),
+    target(targetWriter)
+{
+    // the base class has no buffer, everything goes to the target
+    fields = fieldList;
+    skipDepth = 0;
+    ok = true;
+}
+
+JSONFilterWriter::~JSONFilterWriter()
+{
+    //
+}
+
+bool JSONFilterWriter::Selected(const char *key)
+{
+    if ((fields == nullptr) || fields->IsEmpty()) return true;
+    return fields->Contains(key);
+}
+
+bool JSONFilterWriter::Skip(const char *key)
+{
+    if (skipDepth != 0) return true;
+    if ((depth != 1) || (key == nullptr)) return false;
+    return !Selected(key);
+}
+
+bool JSONFilterWriter::OpenContainer(const char *key, bool isArray)
+{
+    if (depth + 1 >= JSONWriterMaxDepth) {
+        ok = false;
+        return false;
+    }
+
+    bool skip = Skip(key);
+    ++depth;
+    if (skip) {
+        if (skipDepth == 0) skipDepth = depth;
+        return IsOK();
+    }
+
+    return isArray ? target.BeginArray(key) : target.BeginObject(key);
+}
+
+bool JSONFilterWriter::CloseContainer(bool isArray)
+{
+    if (depth == 0) {
+        ok = false;
+        return false;
+    }
+
+    bool skip = (skipDepth != 0);
+    if (skipDepth == depth) skipDepth = 0;
+    --depth;
+    if (skip) return IsOK();
+
+    return isArray ? target.EndArray() : target.EndObject();
+}
+
+bool JSONFilterWriter::BeginObject(const char *key)
+{
+    return OpenContainer(key, false);
+}
+
+bool JSONFilterWriter::EndObject(void)
+{
+    return CloseContainer(false);
+}
+
+bool JSONFilterWriter::BeginArray(const char *key)
+{
+    return OpenContainer(key, true);
+}
+
+bool JSONFilterWriter::EndArray(void)
+{
+    return CloseContainer(true);
+}
+
+bool JSONFilterWriter::AddString(const char *key, const char *value)
+{
+    if (Skip(key)) return IsOK();
+    return target.AddString(key, value);
+}
+
+bool JSONFilterWriter::AddInt(const char *key, int64_t value)
+{
+    if (Skip(key)) return IsOK();
+    return target.AddInt(key, value);
+}
+
+bool JSONFilterWriter::AddUInt(const char *key, uint64_t value)
+{
+    if (Skip(key)) return IsOK();
+    return target.AddUInt(key, value);
+}
+
+bool JSONFilterWriter::AddDouble(const char *key, double value)
+{
+    if (Skip(key)) return IsOK();
+    return target.AddDouble(key, value);
+}
+
+bool JSONFilterWriter::AddBool(const char *key, bool value)
+{
+    if (Skip(key)) return IsOK();
+    return target.AddBool(key, value);
+}
+
+bool JSONFilterWriter::AddNull(const char *key)
+{
+    if (Skip(key)) return IsOK();
+    return target.AddNull(key);
+}
+
+bool JSONFilterWriter::Flush(void)
+{
+    if (!ok) return false;
+    return target.Flush();
+}
+
+bool JSONFilterWriter::IsOK(void)
+{
+    return ok && target.IsOK();
+}
+
+bool JSONFilterWriter::Wants(const char *key)
+{
+    return !Skip(key);
+}
+
+size_t JSONFilterWriter::BytesFlushed(void)
+{
+    return target.BytesFlushed();
+}
@@ -0,0 +1,124 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JSONFieldFilter_H
+#define JSONFieldFilter_H
+
+#include "JSONWriter.h"
+
+const size_t JSONFieldListSize = 128;
+const uint8_t JSONFieldListMaxFields = 16;
+
+/**
+ * @brief The names of the members requested with the `fields` query parameter
+ *
+ * The value is a comma separated list, like `?fields=title,appVersion`.
+ * An empty list selects all the members.
+ */
+class JSONFieldList
+{
+public:
+    JSONFieldList(void);
+    virtual ~JSONFieldList();
+
+    void Clear(void);
+
+    /**
+     * @brief Reads the list from a comma separated string
+     *
+     * Returns false if the string is too long or has too many names.
+     */
+    bool Parse(const char *list);
+
+    /**
+     * @brief Reads the `fields` query parameter of the request
+     *
+     * Returns false if the parameter is present but cannot be used, like a list over
+     * JSONFieldListSize characters, the list is left empty if the request has no `fields`
+     * parameter. The length of the other query parameters is not limited.
+     */
+    bool ReadQuery(httpd_req_t*);
+
+    bool IsEmpty(void) const;
+    bool Contains(const char *key) const;
+
+    uint8_t Count(void) const;
+    const char* Name(uint8_t index) const;
+
+protected:
+    char data[JSONFieldListSize];
+    const char *names[JSONFieldListMaxFields];
+    uint8_t count;
+};
+
+/**
+ * @brief Passes to another writer only the members of the top level object which are in a JSONFieldList
+ *
+ * The members left out are dropped with all their content, nested members are not filtered.
+ * The writing code sees a normal JSONWriter and can call Wants to skip computing
+ * the values which would be dropped anyway.
+ *
+ * @code{.cpp}
+ * JSONFilterWriter filter(writer, &fields);
+ * filter.BeginObject(nullptr);
+ * WriteJSONStatus(filter);
+ * filter.EndObject();
+ * @endcode
+ */
+class JSONFilterWriter : public JSONWriter
+{
+public:
+    JSONFilterWriter(JSONWriter& target, const JSONFieldList *fields);
+    virtual ~JSONFilterWriter();
+
+    virtual bool BeginObject(const char *key);
+    virtual bool EndObject(void);
+    virtual bool BeginArray(const char *key);
+    virtual bool EndArray(void);
+
+    virtual bool AddString(const char *key, const char *value);
+    virtual bool AddInt(const char *key, int64_t value);
+    virtual bool AddUInt(const char *key, uint64_t value);
+    virtual bool AddDouble(const char *key, double value);
+    virtual bool AddBool(const char *key, bool value);
+    virtual bool AddNull(const char *key);
+
+    virtual bool Flush(void);
+    virtual bool IsOK(void);
+    virtual bool Wants(const char *key);
+    virtual size_t BytesFlushed(void);
+
+protected:
+    JSONWriter& target;
+    const JSONFieldList *fields;
+
+    /** the depth of the container being dropped, zero if none */
+    uint8_t skipDepth;
+
+    /**
+     * @brief Returns true if the member of the top level object is passed to the target
+     */
+    virtual bool Selected(const char *key);
+
+    bool Skip(const char *key);
+    bool OpenContainer(const char *key, bool isArray);
+    bool CloseContainer(bool isArray);
+};
+
+#endif
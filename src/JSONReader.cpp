@@ -0,0 +1,461 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+
+#include "JSONReader.h"
+
+// -----------------------------------------------------------------------------
+
+bool JSONValue::ToInt64(int64_t& value) const
+{
+    if (type != JSONValueType::number) return false;
+
+    char *end = nullptr;
+    errno = 0;
+    long long val = strtoll(text, &end, 10);
+    if ((end != text + length) || (errno != 0)) {
+        // accept integers written like 1.0 or 1e3
+        double dval;
+        if (!ToDouble(dval)) return false;
+        if ((dval < (double)INT64_MIN) || (dval > (double)INT64_MAX)) return false;
+        val = (long long)dval;
+        if ((double)val != dval) return false;
+    }
+    value = (int64_t)val;
+    return true;
+}
+
+bool JSONValue::ToInt(int& value) const
+{
+    int64_t val;
+    if (!ToInt64(val)) return false;
+    if ((val < INT_MIN) || (val > INT_MAX)) return false;
+    value = (int)val;
+    return true;
+}
+
+bool JSONValue::ToUInt32(uint32_t& value) const
+{
+    int64_t val;
+    if (!ToInt64(val)) return false;
+    if ((val < 0) || (val > UINT32_MAX)) return false;
+    value = (uint32_t)val;
+    return true;
+}
+
+bool JSONValue::ToDouble(double& value) const
+{
+    if (type != JSONValueType::number) return false;
+
+    char *end = nullptr;
+    double val = strtod(text, &end);
+    if (end != text + length) return false;
+    value = val;
+    return true;
+}
+
+bool JSONValue::ToString(std::string& str) const
+{
+    if (type != JSONValueType::string) return false;
+    str.assign(text, length);
+    return true;
+}
+
+bool JSONValue::ToString(char *str, size_t len) const
+{
+    if (type != JSONValueType::string) return false;
+    if ((str == nullptr) || (len == 0)) return false;
+
+    size_t cnt = (length < len) ? length : len - 1;
+    memcpy(str, text, cnt);
+    str[cnt] = 0;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+JSONReader::JSONReader(JSONReaderHandler *readerHandler)
+{
+    handler = readerHandler;
+    Reset();
+}
+
+JSONReader::~JSONReader()
+{
+    //
+}
+
+void JSONReader::Reset(void)
+{
+    state = (handler == nullptr) ? State::error : State::value;
+    stringIsKey = false;
+    depth = 0;
+    arrayMask = 0;
+    key[0] = 0;
+    token[0] = 0;
+    tokenLen = 0;
+    unicodeValue = 0;
+    unicodeDigits = 0;
+    highSurrogate = 0;
+}
+
+bool JSONReader::HasError(void)
+{
+    return state == State::error;
+}
+
+bool JSONReader::Fail(void)
+{
+    state = State::error;
+    return true;
+}
+
+bool JSONReader::Feed(const char *data, size_t length)
+{
+    if (data == nullptr) return length == 0 && !HasError();
+
+    size_t idx = 0;
+    while (idx < length) {
+        if (state == State::error) return false;
+        if (Process(data[idx])) {
+            ++idx;
+        }
+    }
+    return state != State::error;
+}
+
+bool JSONReader::Finish(void)
+{
+    // a number at the top level is terminated only by the end of data
+    if ((state == State::number) && (depth == 0)) {
+        EndNumber();
+    }
+    else if ((state == State::literal) && (depth == 0)) {
+        EndLiteral();
+    }
+    return state == State::done;
+}
+
+bool JSONReader::InArray(void)
+{
+    return (arrayMask & ((uint32_t)1 << depth)) != 0;
+}
+
+// -----------------------------------------------------------------------------
+
+static bool IsWhitespace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+bool JSONReader::PutToken(char c)
+{
+    if (tokenLen + 1 >= JSONReaderTokenSize) return false;
+    token[tokenLen++] = c;
+    token[tokenLen] = 0;
+    return true;
+}
+
+bool JSONReader::PutCodePoint(uint32_t cp)
+{
+    if (cp < 0x80) {
+        return PutToken((char)cp);
+    }
+    if (cp < 0x800) {
+        return PutToken((char)(0xC0 | (cp >> 6))) &&
+               PutToken((char)(0x80 | (cp & 0x3F)));
+    }
+    if (cp < 0x10000) {
+        return PutToken((char)(0xE0 | (cp >> 12))) &&
+               PutToken((char)(0x80 | ((cp >> 6) & 0x3F))) &&
+               PutToken((char)(0x80 | (cp & 0x3F)));
+    }
+    return PutToken((char)(0xF0 | (cp >> 18))) &&
+           PutToken((char)(0x80 | ((cp >> 12) & 0x3F))) &&
+           PutToken((char)(0x80 | ((cp >> 6) & 0x3F))) &&
+           PutToken((char)(0x80 | (cp & 0x3F)));
+}
+
+bool JSONReader::Open(bool isArray)
+{
+    if (depth + 1 >= JSONReaderMaxDepth) return Fail();
+
+    const char *k = (InArray() || (depth == 0)) ? nullptr : key;
+    if (!handler->OnBegin(depth + 1, k, isArray)) return Fail();
+
+    ++depth;
+    uint32_t mask = (uint32_t)1 << depth;
+    if (isArray) arrayMask |= mask;
+    else         arrayMask &= ~mask;
+
+    state = isArray ? State::arrayStart : State::objectStart;
+    return true;
+}
+
+bool JSONReader::Close(bool isArray)
+{
+    if ((depth == 0) || (InArray() != isArray)) return Fail();
+
+    if (!handler->OnEnd(depth, isArray)) return Fail();
+
+    --depth;
+    state = (depth == 0) ? State::done : State::afterValue;
+    return true;
+}
+
+bool JSONReader::EndScalar(JSONValue& value)
+{
+    const char *k = (InArray() || (depth == 0)) ? nullptr : key;
+    if (!handler->OnValue(depth, k, value)) return Fail();
+
+    tokenLen = 0;
+    token[0] = 0;
+    state = (depth == 0) ? State::done : State::afterValue;
+    return true;
+}
+
+bool JSONReader::EndString(void)
+{
+    if (highSurrogate != 0) {
+        highSurrogate = 0;
+        if (!PutCodePoint(0xFFFD)) return Fail();
+    }
+
+    if (stringIsKey) {
+        if (tokenLen >= JSONReaderKeySize) return Fail();
+        memcpy(key, token, tokenLen + 1);
+        tokenLen = 0;
+        token[0] = 0;
+        state = State::colon;
+        return true;
+    }
+
+    JSONValue value;
+    value.type = JSONValueType::string;
+    value.boolean = false;
+    value.text = token;
+    value.length = tokenLen;
+    return EndScalar(value);
+}
+
+bool JSONReader::EndNumber(void)
+{
+    JSONValue value;
+    value.type = JSONValueType::number;
+    value.boolean = false;
+    value.text = token;
+    value.length = tokenLen;
+
+    // validate it now so the handlers can trust the type
+    double dval;
+    if (!value.ToDouble(dval)) return Fail();
+
+    return EndScalar(value);
+}
+
+bool JSONReader::EndLiteral(void)
+{
+    JSONValue value;
+    value.boolean = false;
+    value.text = token;
+    value.length = tokenLen;
+
+    if (strcmp(token, "true") == 0) {
+        value.type = JSONValueType::boolean;
+        value.boolean = true;
+    }
+    else if (strcmp(token, "false") == 0) {
+        value.type = JSONValueType::boolean;
+    }
+    else if (strcmp(token, "null") == 0) {
+        value.type = JSONValueType::null;
+    }
+    else return Fail();
+
+    return EndScalar(value);
+}
+
+bool JSONReader::BeginValue(char c)
+{
+    tokenLen = 0;
+    token[0] = 0;
+
+    if (c == '{') return Open(false);
+    if (c == '[') return Open(true);
+    if (c == '"') {
+        stringIsKey = false;
+        state = State::string;
+        return true;
+    }
+    if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+        PutToken(c);
+        state = State::number;
+        return true;
+    }
+    if ((c >= 'a') && (c <= 'z')) {
+        PutToken(c);
+        state = State::literal;
+        return true;
+    }
+    return Fail();
+}
+
+// -----------------------------------------------------------------------------
+
+bool JSONReader::Process(char c)
+{
+    switch (state) {
+        case State::value:
+            if (IsWhitespace(c)) return true;
+            return BeginValue(c);
+
+        case State::arrayStart:
+            if (IsWhitespace(c)) return true;
+            if (c == ']') return Close(true);
+            return BeginValue(c);
+
+        case State::objectStart:
+        case State::key:
+            if (IsWhitespace(c)) return true;
+            if ((c == '}') && (state == State::objectStart)) return Close(false);
+            if (c != '"') return Fail();
+            tokenLen = 0;
+            token[0] = 0;
+            stringIsKey = true;
+            state = State::string;
+            return true;
+
+        case State::colon:
+            if (IsWhitespace(c)) return true;
+            if (c != ':') return Fail();
+            state = State::value;
+            return true;
+
+        case State::afterValue:
+            if (IsWhitespace(c)) return true;
+            if (c == ',') {
+                state = InArray() ? State::value : State::key;
+                return true;
+            }
+            if (c == ']') return Close(true);
+            if (c == '}') return Close(false);
+            return Fail();
+
+        case State::string:
+            if (c == '"') return EndString();
+            if (c == '\\') {
+                state = State::stringEscape;
+                return true;
+            }
+            if ((uint8_t)c < 0x20) return Fail();
+            if (highSurrogate != 0) {
+                highSurrogate = 0;
+                if (!PutCodePoint(0xFFFD)) return Fail();
+            }
+            if (!PutToken(c)) return Fail();
+            return true;
+
+        case State::stringEscape:
+            state = State::string;
+            if (c == 'u') {
+                unicodeValue = 0;
+                unicodeDigits = 0;
+                state = State::stringUnicode;
+                return true;
+            }
+            if (highSurrogate != 0) {
+                highSurrogate = 0;
+                if (!PutCodePoint(0xFFFD)) return Fail();
+            }
+            switch (c) {
+                case '"':  c = '"'; break;
+                case '\\': c = '\\'; break;
+                case '/':  c = '/'; break;
+                case 'b':  c = '\b'; break;
+                case 'f':  c = '\f'; break;
+                case 'n':  c = '\n'; break;
+                case 'r':  c = '\r'; break;
+                case 't':  c = '\t'; break;
+                default: return Fail();
+            }
+            if (!PutToken(c)) return Fail();
+            return true;
+
+        case State::stringUnicode:
+            unicodeValue <<= 4;
+            if ((c >= '0') && (c <= '9'))      unicodeValue |= (uint32_t)(c - '0');
+            else if ((c >= 'a') && (c <= 'f')) unicodeValue |= (uint32_t)(c - 'a' + 10);
+            else if ((c >= 'A') && (c <= 'F')) unicodeValue |= (uint32_t)(c - 'A' + 10);
+            else return Fail();
+
+            if (++unicodeDigits < 4) return true;
+
+            state = State::string;
+            if ((unicodeValue >= 0xD800) && (unicodeValue <= 0xDBFF)) {
+                if (highSurrogate != 0) {
+                    if (!PutCodePoint(0xFFFD)) return Fail();
+                }
+                highSurrogate = unicodeValue;
+                return true;
+            }
+            if ((unicodeValue >= 0xDC00) && (unicodeValue <= 0xDFFF)) {
+                uint32_t cp = 0xFFFD;
+                if (highSurrogate != 0) {
+                    cp = 0x10000 + ((highSurrogate - 0xD800) << 10) + (unicodeValue - 0xDC00);
+                }
+                highSurrogate = 0;
+                if (!PutCodePoint(cp)) return Fail();
+                return true;
+            }
+            if (highSurrogate != 0) {
+                highSurrogate = 0;
+                if (!PutCodePoint(0xFFFD)) return Fail();
+            }
+            if (!PutCodePoint(unicodeValue)) return Fail();
+            return true;
+
+        case State::number:
+            if (((c >= '0') && (c <= '9')) || (c == '.') || (c == 'e') || (c == 'E') || (c == '+') || (c == '-')) {
+                if (!PutToken(c)) return Fail();
+                return true;
+            }
+            EndNumber();
+            return false; // process the terminating character again
+
+        case State::literal:
+            if ((c >= 'a') && (c <= 'z')) {
+                if (!PutToken(c)) return Fail();
+                return true;
+            }
+            EndLiteral();
+            return false; // process the terminating character again
+
+        case State::done:
+            if (IsWhitespace(c)) return true;
+            return Fail();
+
+        case State::error:
+        default:
+            return true;
+    }
+}
@@ -0,0 +1,164 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JSONReader_H
+#define JSONReader_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <string>
+
+const size_t JSONReaderKeySize = 32;
+const size_t JSONReaderTokenSize = 128;
+const uint8_t JSONReaderMaxDepth = 16;
+
+enum class JSONValueType : uint8_t {
+    null, boolean, number, string
+};
+
+/**
+ * @brief A scalar value found by JSONReader
+ *
+ * `text` is the unescaped string or the text of the number and is valid only
+ * during the call of JSONReaderHandler::OnValue.
+ */
+struct JSONValue
+{
+    JSONValueType type;
+    bool boolean;
+    const char *text;
+    size_t length;
+
+    bool ToInt(int&) const;
+    bool ToInt64(int64_t&) const;
+    bool ToUInt32(uint32_t&) const;
+    bool ToDouble(double&) const;
+
+    /**
+     * @brief Sets the string, fails if the value is not a string
+     */
+    bool ToString(std::string&) const;
+
+    /**
+     * @brief Sets the null terminated string, truncated to len - 1 characters
+     */
+    bool ToString(char *str, size_t len) const;
+};
+
+/**
+ * @brief Receives the events of a JSONReader
+ *
+ * `depth` is the depth of the container holding the value, 1 for the members of the top object.
+ * `key` is nullptr for the elements of an array.
+ * Return false to stop the parsing with an error.
+ */
+class JSONReaderHandler
+{
+public:
+    virtual ~JSONReaderHandler() {}
+
+    virtual bool OnValue(uint8_t depth, const char *key, const JSONValue& value) = 0;
+
+    virtual bool OnBegin(uint8_t depth, const char *key, bool isArray) { return true; }
+    virtual bool OnEnd(uint8_t depth, bool isArray) { return true; }
+};
+
+/**
+ * @brief Incremental JSON parser
+ *
+ * The data is pushed in chunks of any size, as received, and the values are reported
+ * to the handler as soon as they are complete. No DOM is built and no heap memory is used,
+ * keys are limited to JSONReaderKeySize - 1 and strings or numbers to JSONReaderTokenSize - 1 bytes.
+ *
+ * @code{.cpp}
+ * JSONReader reader(&handler);
+ * while (receiving) {
+ *     if (!reader.Feed(chunk, chunkLen)) break;
+ * }
+ * bool ok = reader.Finish();
+ * @endcode
+ */
+class JSONReader
+{
+public:
+    JSONReader(JSONReaderHandler *handler);
+    virtual ~JSONReader();
+
+    virtual void Reset(void);
+
+    /**
+     * @brief Parses a chunk of data, returns false on error
+     */
+    virtual bool Feed(const char *data, size_t length);
+
+    /**
+     * @brief Returns true if a complete JSON value was parsed without errors
+     */
+    virtual bool Finish(void);
+
+    virtual bool HasError(void);
+
+protected:
+    enum class State : uint8_t {
+        value, arrayStart, objectStart, key, colon, afterValue,
+        string, stringEscape, stringUnicode,
+        number, literal,
+        done, error
+    };
+
+    JSONReaderHandler *handler;
+
+    State state;
+    bool stringIsKey;
+
+    uint8_t depth;
+    /** bit n is set if the container at depth n is an array */
+    uint32_t arrayMask;
+
+    char key[JSONReaderKeySize];
+    char token[JSONReaderTokenSize];
+    size_t tokenLen;
+
+    uint32_t unicodeValue;
+    uint8_t unicodeDigits;
+    uint32_t highSurrogate;
+
+    bool Fail(void);
+
+    /**
+     * @brief Processes one character, returns false if the character must be processed again
+     */
+    bool Process(char c);
+
+    bool PutToken(char c);
+    bool PutCodePoint(uint32_t cp);
+
+    bool BeginValue(char c);
+    bool EndScalar(JSONValue&);
+    bool EndString(void);
+    bool EndNumber(void);
+    bool EndLiteral(void);
+
+    bool Open(bool isArray);
+    bool Close(bool isArray);
+
+    bool InArray(void);
+};
+
+#endif
@@ -0,0 +1,383 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "JSONWriter.h"
+
+// -----------------------------------------------------------------------------
+
+JSONStringSink::JSONStringSink(void)
+{
+    str = nullptr;
+    length = 0;
+    capacity = 0;
+}
+
+JSONStringSink::~JSONStringSink()
+{
+    if (str != nullptr) {
+        free(str);
+        str = nullptr;
+    }
+}
+
+bool JSONStringSink::Write(const char *data, size_t len)
+{
+    if (length + len + 1 > capacity) {
+        size_t newCapacity = (capacity == 0) ? 256 : capacity;
+        while (length + len + 1 > newCapacity) {
+            newCapacity *= 2;
+        }
+        char *newStr = (char*)realloc(str, newCapacity);
+        if (newStr == nullptr) return false;
+        str = newStr;
+        capacity = newCapacity;
+    }
+
+    memcpy(str + length, data, len);
+    length += len;
+    str[length] = 0;
+    return true;
+}
+
+char* JSONStringSink::Release(size_t *len)
+{
+    char *res = str;
+    if (len != nullptr) {
+        *len = length;
+    }
+
+    str = nullptr;
+    length = 0;
+    capacity = 0;
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+
+JSONBufferSink::JSONBufferSink(char *buf, size_t bufSize)
+{
+    buffer = buf;
+    size = (buf == nullptr) ? 0 : bufSize;
+    length = 0;
+}
+
+JSONBufferSink::~JSONBufferSink()
+{
+    //
+}
+
+bool JSONBufferSink::Write(const char *data, size_t len)
+{
+    if (length + len > size) return false;
+
+    memcpy(buffer + length, data, len);
+    length += len;
+    return true;
+}
+
+size_t JSONBufferSink::Length(void)
+{
+    return length;
+}
+
+// -----------------------------------------------------------------------------
+
+HTTPChunkSink::HTTPChunkSink(httpd_req_t *request)
+{
+    req = request;
+}
+
+HTTPChunkSink::~HTTPChunkSink()
+{
+    //
+}
+
+bool HTTPChunkSink::Write(const char *data, size_t len)
+{
+    if (len == 0) return true; // an empty chunk ends the response
+    return httpd_resp_send_chunk(req, data, len) == ESP_OK;
+}
+
+bool HTTPChunkSink::Finish(void)
+{
+    return httpd_resp_send_chunk(req, nullptr, 0) == ESP_OK;
+}
+
+// -----------------------------------------------------------------------------
+
+JSONWriter::JSONWriter(char *buf, size_t bufSize, JSONSink *dataSink)
+{
+    buffer = buf;
+    bufferSize = bufSize;
+    used = 0;
+    flushed = 0;
+    sink = dataSink;
+    ok = (buffer != nullptr) && (bufferSize > 0) && (sink != nullptr);
+    depth = 0;
+    notEmpty = 0;
+}
+
+JSONWriter::~JSONWriter()
+{
+    //
+}
+
+bool JSONWriter::IsOK(void)
+{
+    return ok;
+}
+
+bool JSONWriter::Wants(const char*)
+{
+    return true;
+}
+
+size_t JSONWriter::BytesFlushed(void)
+{
+    return flushed;
+}
+
+bool JSONWriter::Flush(void)
+{
+    if (!ok) return false;
+    if (used == 0) return true;
+
+    ok = sink->Write(buffer, used);
+    if (ok) {
+        flushed += used;
+    }
+    used = 0;
+    return ok;
+}
+
+bool JSONWriter::Put(char c)
+{
+    if (!ok) return false;
+
+    if (used >= bufferSize) {
+        if (!Flush()) return false;
+    }
+    buffer[used++] = c;
+    return true;
+}
+
+bool JSONWriter::Put(const char *str, size_t len)
+{
+    while (len > 0) {
+        if (!ok) return false;
+
+        if (used >= bufferSize) {
+            if (!Flush()) return false;
+        }
+        size_t cnt = bufferSize - used;
+        if (cnt > len) cnt = len;
+        memcpy(buffer + used, str, cnt);
+        used += cnt;
+        str += cnt;
+        len -= cnt;
+    }
+    return ok;
+}
+
+bool JSONWriter::PutEscaped(const char *str)
+{
+    const char hex[17] = "0123456789abcdef";
+
+    Put('"');
+    if (str != nullptr) {
+        const char *start = str;
+        while (*str != 0) {
+            uint8_t c = (uint8_t)*str;
+            if ((c >= 0x20) && (c != '"') && (c != '\\')) {
+                ++str;
+                continue;
+            }
+
+            // write the run of plain characters then the escape sequence
+            Put(start, str - start);
+            Put('\\');
+            switch (c) {
+                case '"':  Put('"'); break;
+                case '\\': Put('\\'); break;
+                case '\b': Put('b'); break;
+                case '\f': Put('f'); break;
+                case '\n': Put('n'); break;
+                case '\r': Put('r'); break;
+                case '\t': Put('t'); break;
+                default:
+                    Put("u00", 3);
+                    Put(hex[c >> 4]);
+                    Put(hex[c & 0x0F]);
+                    break;
+            }
+            ++str;
+            start = str;
+        }
+        Put(start, str - start);
+    }
+    return Put('"');
+}
+
+bool JSONWriter::PutUInt(uint64_t value)
+{
+    char digits[20];
+    uint8_t cnt = 0;
+
+    do {
+        digits[cnt++] = '0' + (char)(value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (cnt > 0) {
+        Put(digits[--cnt]);
+    }
+    return ok;
+}
+
+bool JSONWriter::Prefix(const char *key)
+{
+    if (!ok) return false;
+
+    if (depth > 0) {
+        uint32_t mask = (uint32_t)1 << depth;
+        if ((notEmpty & mask) != 0) {
+            Put(',');
+        }
+        else {
+            notEmpty |= mask;
+        }
+    }
+
+    if (key != nullptr) {
+        PutEscaped(key);
+        Put(':');
+    }
+    return ok;
+}
+
+bool JSONWriter::Open(const char *key, char c)
+{
+    if (depth + 1 >= JSONWriterMaxDepth) {
+        ok = false;
+        return false;
+    }
+
+    Prefix(key);
+    ++depth;
+    notEmpty &= ~((uint32_t)1 << depth);
+    return Put(c);
+}
+
+bool JSONWriter::Close(char c)
+{
+    if (depth == 0) {
+        ok = false;
+        return false;
+    }
+
+    --depth;
+    return Put(c);
+}
+
+// -----------------------------------------------------------------------------
+
+bool JSONWriter::BeginObject(const char *key)
+{
+    return Open(key, '{');
+}
+
+bool JSONWriter::EndObject(void)
+{
+    return Close('}');
+}
+
+bool JSONWriter::BeginArray(const char *key)
+{
+    return Open(key, '[');
+}
+
+bool JSONWriter::EndArray(void)
+{
+    return Close(']');
+}
+
+bool JSONWriter::AddString(const char *key, const char *value)
+{
+    Prefix(key);
+    return PutEscaped(value);
+}
+
+bool JSONWriter::AddString(const char *key, const std::string &value)
+{
+    return AddString(key, value.c_str());
+}
+
+bool JSONWriter::AddInt(const char *key, int64_t value)
+{
+    Prefix(key);
+    if (value < 0) {
+        Put('-');
+        return PutUInt((uint64_t)(-(value + 1)) + 1);
+    }
+    return PutUInt((uint64_t)value);
+}
+
+bool JSONWriter::AddUInt(const char *key, uint64_t value)
+{
+    Prefix(key);
+    return PutUInt(value);
+}
+
+bool JSONWriter::AddDouble(const char *key, double value)
+{
+    Prefix(key);
+
+    // JSON has no representation for NaN and infinity, cJSON writes null too
+    if (std::isnan(value) || std::isinf(value)) {
+        return Put("null", 4);
+    }
+
+    char str[32];
+    int len = snprintf(str, sizeof(str), "%.15g", value);
+    if ((len <= 0) || ((size_t)len >= sizeof(str))) {
+        ok = false;
+        return false;
+    }
+    return Put(str, len);
+}
+
+bool JSONWriter::AddBool(const char *key, bool value)
+{
+    Prefix(key);
+    if (value) return Put("true", 4);
+    return Put("false", 5);
+}
+
+bool JSONWriter::AddNull(const char *key)
+{
+    Prefix(key);
+    return Put("null", 4);
+}
@@ -0,0 +1,202 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JSONWriter_H
+#define JSONWriter_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+
+#include <string>
+
+/**
+ * @brief Destination of the data produced by a JSONWriter
+ */
+class JSONSink
+{
+public:
+    virtual ~JSONSink() {}
+
+    /**
+     * @brief Called with a non-empty block of data, returns false on error
+     */
+    virtual bool Write(const char *data, size_t length) = 0;
+};
+
+/**
+ * @brief Collects the data in a malloc'ed, null terminated, string
+ *
+ * Used where the whole text is needed, like for NVS or for the response cache.
+ */
+class JSONStringSink : public JSONSink
+{
+public:
+    JSONStringSink(void);
+    virtual ~JSONStringSink();
+
+    virtual bool Write(const char *data, size_t length);
+
+    /**
+     * @brief Returns the collected string and empties the sink
+     *
+     * @warning Delete returned string with 'free' !
+     */
+    char* Release(size_t *length);
+
+protected:
+    char *str;
+    size_t length;
+    size_t capacity;
+};
+
+/**
+ * @brief Collects the data in a fixed size buffer, fails if the buffer is too small
+ */
+class JSONBufferSink : public JSONSink
+{
+public:
+    JSONBufferSink(char *buffer, size_t size);
+    virtual ~JSONBufferSink();
+
+    virtual bool Write(const char *data, size_t length);
+
+    size_t Length(void);
+
+protected:
+    char *buffer;
+    size_t size;
+    size_t length;
+};
+
+/**
+ * @brief Sends the data as HTTP chunks
+ *
+ * The response headers must be set before the first write.
+ * Call Finish to send the terminating chunk.
+ */
+class HTTPChunkSink : public JSONSink
+{
+public:
+    HTTPChunkSink(httpd_req_t*);
+    virtual ~HTTPChunkSink();
+
+    virtual bool Write(const char *data, size_t length);
+
+    bool Finish(void);
+
+protected:
+    httpd_req_t *req;
+};
+
+const size_t JSONWriterBufferSize = 256;
+const uint8_t JSONWriterMaxDepth = 16;
+
+/**
+ * @brief Streaming JSON serializer
+ *
+ * Writes compact JSON in a buffer supplied by the caller, usually a small one from the stack,
+ * and hands it to the sink each time the buffer is full. No heap memory is used by the writer.
+ *
+ * All functions return false after the first error, check the result only at the end if you want.
+ * The `key` parameter must be nullptr for the elements of an array and not nullptr for
+ * the members of an object.
+ *
+ * @code{.cpp}
+ * char buffer[JSONWriterBufferSize];
+ * HTTPChunkSink sink(req);
+ * JSONWriter writer(buffer, JSONWriterBufferSize, &sink);
+ * writer.BeginObject(nullptr);
+ * writer.AddUInt("counter", counter);
+ * writer.AddString("name", name);
+ * writer.EndObject();
+ * if (writer.Flush()) sink.Finish();
+ * @endcode
+ *
+ * The functions writing the values are virtual, a CBORWriter or a MsgPackWriter
+ * can be given to the code written for a JSONWriter, as can a JSONFilterWriter.
+ */
+class JSONWriter
+{
+public:
+    JSONWriter(char *buffer, size_t bufferSize, JSONSink *sink);
+    virtual ~JSONWriter();
+
+    virtual bool BeginObject(const char *key);
+    virtual bool EndObject(void);
+    virtual bool BeginArray(const char *key);
+    virtual bool EndArray(void);
+
+    virtual bool AddString(const char *key, const char *value);
+    bool AddString(const char *key, const std::string &value);
+    virtual bool AddInt(const char *key, int64_t value);
+    virtual bool AddUInt(const char *key, uint64_t value);
+    virtual bool AddDouble(const char *key, double value);
+    virtual bool AddBool(const char *key, bool value);
+    virtual bool AddNull(const char *key);
+
+    /**
+     * @brief Sends the buffered data to the sink
+     */
+    virtual bool Flush(void);
+
+    virtual bool IsOK(void);
+
+    /**
+     * @brief Returns false if a member with this key would be left out of the output
+     *
+     * Always true for a JSONWriter. Check it before computing a value which is expensive
+     * to get, a JSONFilterWriter drops the members not requested with `?fields=`.
+     */
+    virtual bool Wants(const char *key);
+
+    /**
+     * @brief Returns the number of bytes handed to the sink
+     *
+     * If this is zero when an error occurs the HTTP response is not started
+     * and an error response can still be sent.
+     */
+    virtual size_t BytesFlushed(void);
+
+protected:
+    char *buffer;
+    size_t bufferSize;
+    size_t used;
+    size_t flushed;
+    JSONSink *sink;
+    bool ok;
+
+    uint8_t depth;
+    /** bit n is set if the container at depth n has at least one element */
+    uint32_t notEmpty;
+
+    bool Put(char c);
+    bool Put(const char *str, size_t len);
+    bool PutEscaped(const char *str);
+    bool PutUInt(uint64_t value);
+
+    /**
+     * @brief Writes the separator and the key, if any
+     */
+    bool Prefix(const char *key);
+
+    bool Open(const char *key, char c);
+    bool Close(char c);
+};
+
+#endif
@@ -0,0 +1,187 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "sdkconfig.h"
+
+#include <cstring>
+
+#include "OTAImageVerifier.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "OTAImageVerifier";
+
+// -----------------------------------------------------------------------------
+
+OTAImageVerifier::OTAImageVerifier(void)
+{
+    mbedtls_sha256_init(&shaContext);
+    shaStarted = false;
+    headLength = 0;
+    headChecked = false;
+    hasExpectedSHA256 = false;
+}
+
+OTAImageVerifier::~OTAImageVerifier()
+{
+    mbedtls_sha256_free(&shaContext);
+}
+
+void OTAImageVerifier::Begin(void)
+{
+    mbedtls_sha256_free(&shaContext);
+    mbedtls_sha256_init(&shaContext);
+    mbedtls_sha256_starts(&shaContext, 0);
+    shaStarted = true;
+
+    headLength = 0;
+    headChecked = false;
+    hasExpectedSHA256 = false;
+}
+
+static int HexValue(char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+bool OTAImageVerifier::SetExpectedSHA256(const char *hex)
+{
+    if (hex == nullptr) return false;
+    if (strlen(hex) != 2 * sizeof(expectedSHA256)) return false;
+
+    for (size_t i = 0; i < sizeof(expectedSHA256); ++i) {
+        int hi = HexValue(hex[2 * i]);
+        int lo = HexValue(hex[2 * i + 1]);
+        if ((hi < 0) || (lo < 0)) {
+            hasExpectedSHA256 = false;
+            return false;
+        }
+        expectedSHA256[i] = (uint8_t)((hi << 4) | lo);
+    }
+    hasExpectedSHA256 = true;
+    return true;
+}
+
+bool OTAImageVerifier::SetExpectedSHA256(const uint8_t *sha256)
+{
+    if (sha256 == nullptr) return false;
+
+    memcpy(expectedSHA256, sha256, sizeof(expectedSHA256));
+    hasExpectedSHA256 = true;
+    return true;
+}
+
+bool OTAImageVerifier::HasExpectedSHA256(void)
+{
+    return hasExpectedSHA256;
+}
+
+bool OTAImageVerifier::HeadChecked(void)
+{
+    return headChecked;
+}
+
+esp_err_t OTAImageVerifier::Update(const char *data, size_t length)
+{
+    if (!shaStarted) return ESP_ERR_INVALID_STATE;
+    if (length == 0) return ESP_OK;
+
+    mbedtls_sha256_update(&shaContext, (const unsigned char*)data, length);
+
+    if (headLength < OTAImageHeadSize) {
+        size_t len = OTAImageHeadSize - headLength;
+        if (len > length) len = length;
+        memcpy(head + headLength, data, len);
+        headLength += len;
+
+        if (headLength == OTAImageHeadSize) {
+            esp_err_t err = CheckHead();
+            if (err != ESP_OK) return err;
+            headChecked = true;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t OTAImageVerifier::CheckHead(void)
+{
+    esp_image_header_t imageHeader;
+    esp_app_desc_t appDesc;
+    memcpy(&imageHeader, head, sizeof(imageHeader));
+    memcpy(&appDesc, head + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(appDesc));
+
+    if (imageHeader.magic != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "Invalid image magic 0x%02x", imageHeader.magic);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+#ifdef CONFIG_IDF_FIRMWARE_CHIP_ID
+    if (imageHeader.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+        ESP_LOGE(TAG, "Image is for chip id %d, expected %d", (int)imageHeader.chip_id, CONFIG_IDF_FIRMWARE_CHIP_ID);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+#endif
+
+    if (appDesc.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        ESP_LOGE(TAG, "Invalid application description");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    const esp_app_desc_t *runningApp = esp_ota_get_app_description();
+#ifdef CONFIG_ESP32BM_OTA_CHECK_PROJECT_NAME
+    if ((runningApp != nullptr) &&
+        (strncmp(appDesc.project_name, runningApp->project_name, sizeof(appDesc.project_name)) != 0)) {
+        ESP_LOGE(TAG, "Image is for project %.32s", appDesc.project_name);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+#endif
+
+    ESP_LOGI(TAG, "Receiving %.32s version %.32s, running version %.32s",
+        appDesc.project_name, appDesc.version,
+        (runningApp == nullptr) ? "?" : runningApp->version);
+    return ESP_OK;
+}
+
+esp_err_t OTAImageVerifier::Finish(void)
+{
+    if (!shaStarted) return ESP_ERR_INVALID_STATE;
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&shaContext, digest);
+    shaStarted = false;
+
+    if (!headChecked) {
+        ESP_LOGE(TAG, "Image is too short");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    if (hasExpectedSHA256) {
+        if (memcmp(digest, expectedSHA256, sizeof(digest)) != 0) {
+            ESP_LOGE(TAG, "SHA256 mismatch");
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        ESP_LOGI(TAG, "SHA256 verified");
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,82 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OTAImageVerifier_H
+#define OTAImageVerifier_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_app_format.h"
+#include "mbedtls/sha256.h"
+
+/**
+ * @brief The image header, the header of the first segment and the application description
+ */
+const size_t OTAImageHeadSize = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+
+/**
+ * @brief Checks a firmware image while it is received
+ *
+ * As soon as the first OTAImageHeadSize bytes are received the image header and
+ * the application description are checked: magic numbers, chip id and project name.
+ * The SHA256 of the whole image is computed incrementally and, if an expected one
+ * was set, compared by Finish.
+ *
+ * Returns ESP_ERR_OTA_VALIDATE_FAILED on mismatch.
+ */
+class OTAImageVerifier
+{
+public:
+    OTAImageVerifier(void);
+    virtual ~OTAImageVerifier();
+
+    void Begin(void);
+
+    /**
+     * @brief Sets the expected SHA256 from 64 hex characters
+     */
+    bool SetExpectedSHA256(const char *hex);
+    bool SetExpectedSHA256(const uint8_t *sha256);
+
+    bool HasExpectedSHA256(void);
+
+    esp_err_t Update(const char *data, size_t length);
+
+    /**
+     * @brief Returns true after the head of the image was received and checked
+     */
+    bool HeadChecked(void);
+
+    esp_err_t Finish(void);
+
+protected:
+    mbedtls_sha256_context shaContext;
+    bool shaStarted;
+
+    uint8_t head[OTAImageHeadSize];
+    size_t headLength;
+    bool headChecked;
+
+    uint8_t expectedSHA256[32];
+    bool hasExpectedSHA256;
+
+    esp_err_t CheckHead(void);
+};
+
+#endif
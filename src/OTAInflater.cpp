@@ -0,0 +1,307 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+#if CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/crc.h"
+#else
+#include "esp32/rom/crc.h"
+#endif
+
+#include <cstdlib>
+
+#include "OTAInflater.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "OTAInflater";
+
+const uint8_t GzipFlagHeaderCRC = 0x02;
+const uint8_t GzipFlagExtra     = 0x04;
+const uint8_t GzipFlagName      = 0x08;
+const uint8_t GzipFlagComment   = 0x10;
+const uint8_t GzipFlagReserved  = 0xE0;
+
+const uint16_t GzipHeaderSize  = 10;
+const uint16_t GzipTrailerSize = 8;
+
+// -----------------------------------------------------------------------------
+
+OTAInflater::OTAInflater(void)
+{
+    decompressor = nullptr;
+    dictionary = nullptr;
+    dictionaryOffset = 0;
+    state = State::error;
+    flags = 0;
+    fieldLength = 0;
+    fieldReceived = 0;
+    crc = 0;
+    outputSize = 0;
+}
+
+OTAInflater::~OTAInflater()
+{
+    End();
+}
+
+bool OTAInflater::IsGzip(const uint8_t *data, size_t length)
+{
+    if ((data == nullptr) || (length < 2)) return false;
+    return (data[0] == 0x1F) && (data[1] == 0x8B);
+}
+
+esp_err_t OTAInflater::Begin(void)
+{
+    End();
+
+    decompressor = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    dictionary = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+    if ((decompressor == nullptr) || (dictionary == nullptr)) {
+        ESP_LOGE(TAG, "Failed to allocate the decompressor");
+        End();
+        return ESP_ERR_NO_MEM;
+    }
+
+    tinfl_init(decompressor);
+    dictionaryOffset = 0;
+
+    state = State::header;
+    flags = 0;
+    fieldLength = GzipHeaderSize;
+    fieldReceived = 0;
+    crc = 0;
+    outputSize = 0;
+    return ESP_OK;
+}
+
+void OTAInflater::End(void)
+{
+    if (decompressor != nullptr) {
+        free(decompressor);
+        decompressor = nullptr;
+    }
+    if (dictionary != nullptr) {
+        free(dictionary);
+        dictionary = nullptr;
+    }
+    state = State::error;
+}
+
+bool OTAInflater::IsActive(void)
+{
+    return decompressor != nullptr;
+}
+
+uint32_t OTAInflater::OutputSize(void)
+{
+    return outputSize;
+}
+
+esp_err_t OTAInflater::Finish(void)
+{
+    if (state != State::done) {
+        ESP_LOGE(TAG, "Incomplete gzip stream");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    return ESP_OK;
+}
+
+// -----------------------------------------------------------------------------
+
+void OTAInflater::NextHeaderState(void)
+{
+    // go to the next part of the header skipping the ones not present
+    fieldReceived = 0;
+    while (true) {
+        state = (State)((uint8_t)state + 1);
+        switch (state) {
+            case State::extraLength:
+                if ((flags & GzipFlagExtra) != 0) {
+                    fieldLength = 2;
+                    return;
+                }
+                break;
+            case State::extra:
+                if (((flags & GzipFlagExtra) != 0) && (fieldLength > 0)) return;
+                break;
+            case State::name:
+                if ((flags & GzipFlagName) != 0) return;
+                break;
+            case State::comment:
+                if ((flags & GzipFlagComment) != 0) return;
+                break;
+            case State::headerCRC:
+                if ((flags & GzipFlagHeaderCRC) != 0) {
+                    fieldLength = 2;
+                    return;
+                }
+                break;
+            default:
+                // State::data
+                return;
+        }
+    }
+}
+
+bool OTAInflater::CheckTrailer(void)
+{
+    uint32_t trailerCRC = (uint32_t)field[0] | ((uint32_t)field[1] << 8) |
+        ((uint32_t)field[2] << 16) | ((uint32_t)field[3] << 24);
+    uint32_t trailerSize = (uint32_t)field[4] | ((uint32_t)field[5] << 8) |
+        ((uint32_t)field[6] << 16) | ((uint32_t)field[7] << 24);
+
+    if (trailerCRC != crc) {
+        ESP_LOGE(TAG, "CRC32 mismatch");
+        return false;
+    }
+    if (trailerSize != outputSize) {
+        ESP_LOGE(TAG, "Size mismatch, %u instead of %u", (unsigned)outputSize, (unsigned)trailerSize);
+        return false;
+    }
+    return true;
+}
+
+bool OTAInflater::ProcessByte(uint8_t c)
+{
+    switch (state) {
+        case State::header:
+            field[fieldReceived++] = c;
+            if (fieldReceived < GzipHeaderSize) return true;
+            // only the deflate method is defined
+            if ((field[0] != 0x1F) || (field[1] != 0x8B) || (field[2] != 8)) return false;
+            flags = field[3];
+            if ((flags & GzipFlagReserved) != 0) return false;
+            NextHeaderState();
+            return true;
+
+        case State::extraLength:
+            field[fieldReceived++] = c;
+            if (fieldReceived < fieldLength) return true;
+            fieldLength = (uint16_t)field[0] | ((uint16_t)field[1] << 8);
+            NextHeaderState();
+            return true;
+
+        case State::extra:
+            if (++fieldReceived >= fieldLength) {
+                NextHeaderState();
+            }
+            return true;
+
+        case State::name:
+        case State::comment:
+            // null terminated strings
+            if (c == 0) {
+                NextHeaderState();
+            }
+            return true;
+
+        case State::headerCRC:
+            if (++fieldReceived >= fieldLength) {
+                NextHeaderState();
+            }
+            return true;
+
+        case State::trailer:
+            field[fieldReceived++] = c;
+            if (fieldReceived < GzipTrailerSize) return true;
+            if (!CheckTrailer()) return false;
+            state = State::done;
+            return true;
+
+        default:
+            // data after the end of the stream
+            return false;
+    }
+}
+
+esp_err_t OTAInflater::Inflate(const uint8_t *data, size_t *length, OTASink& sink)
+{
+    size_t consumed = 0;
+    while (true) {
+        size_t inBytes = *length - consumed;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - dictionaryOffset;
+        tinfl_status status = tinfl_decompress(decompressor, data + consumed, &inBytes,
+            dictionary, dictionary + dictionaryOffset, &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+        consumed += inBytes;
+
+        if (outBytes > 0) {
+            uint8_t *out = dictionary + dictionaryOffset;
+            crc = crc32_le(crc, out, outBytes);
+            outputSize += outBytes;
+            dictionaryOffset = (dictionaryOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+            esp_err_t res = sink.Write((const char*)out, outBytes);
+            if (res != ESP_OK) return res;
+        }
+
+        if (status < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Inflate error %d", (int)status);
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            state = State::trailer;
+            fieldReceived = 0;
+            break;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            if (consumed == *length) break;
+            if ((inBytes == 0) && (outBytes == 0)) {
+                ESP_LOGE(TAG, "Inflate does not progress");
+                return ESP_ERR_OTA_VALIDATE_FAILED;
+            }
+        }
+        // TINFL_STATUS_HAS_MORE_OUTPUT, the dictionary is full, call again
+    }
+
+    *length = consumed;
+    return ESP_OK;
+}
+
+esp_err_t OTAInflater::Feed(const uint8_t *data, size_t length, OTASink& sink)
+{
+    if (!IsActive()) return ESP_ERR_INVALID_STATE;
+
+    while (length > 0) {
+        if (state == State::error) return ESP_ERR_OTA_VALIDATE_FAILED;
+
+        if (state == State::data) {
+            size_t len = length;
+            esp_err_t res = Inflate(data, &len, sink);
+            if (res != ESP_OK) {
+                state = State::error;
+                return res;
+            }
+            data += len;
+            length -= len;
+            continue;
+        }
+
+        if (!ProcessByte(*data)) {
+            ESP_LOGE(TAG, "Invalid gzip stream");
+            state = State::error;
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        ++data;
+        --length;
+    }
+    return ESP_OK;
+}
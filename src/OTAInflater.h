@@ -0,0 +1,102 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OTAInflater_H
+#define OTAInflater_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/miniz.h"
+#else
+#include "esp32/rom/miniz.h"
+#endif
+
+#include "OTAPipeline.h"
+
+/**
+ * @brief Decompresses a gzip stream into an OTASink
+ *
+ * Uses the inflate implementation from ROM. The decompressor and the 32 KB dictionary,
+ * about 43 KB, are allocated by Begin and freed by End so the RAM is used only
+ * during a compressed update. The CRC32 and the size from the gzip trailer are checked.
+ */
+class OTAInflater
+{
+public:
+    OTAInflater(void);
+    virtual ~OTAInflater();
+
+    /**
+     * @brief Returns true if the data starts with the gzip magic bytes
+     */
+    static bool IsGzip(const uint8_t *data, size_t length);
+
+    esp_err_t Begin(void);
+    void End(void);
+
+    bool IsActive(void);
+
+    /**
+     * @brief Decompresses a chunk of the stream and writes the result to the sink
+     */
+    esp_err_t Feed(const uint8_t *data, size_t length, OTASink&);
+
+    /**
+     * @brief Returns ESP_OK if the whole stream, trailer included, was received and is valid
+     */
+    esp_err_t Finish(void);
+
+    /**
+     * @brief Number of decompressed bytes
+     */
+    uint32_t OutputSize(void);
+
+protected:
+    enum class State : uint8_t {
+        header, extraLength, extra, name, comment, headerCRC,
+        data, trailer, done, error
+    };
+
+    tinfl_decompressor *decompressor;
+    uint8_t *dictionary;
+    size_t dictionaryOffset;
+
+    State state;
+    uint8_t flags;
+    uint8_t field[10];
+    uint16_t fieldLength;
+    uint16_t fieldReceived;
+
+    uint32_t crc;
+    uint32_t outputSize;
+
+    /**
+     * @brief Processes one byte of the header or trailer
+     */
+    bool ProcessByte(uint8_t c);
+    void NextHeaderState(void);
+    bool CheckTrailer(void);
+
+    esp_err_t Inflate(const uint8_t *data, size_t *length, OTASink&);
+};
+
+#endif
@@ -0,0 +1,299 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+#include <new>
+#include <cstring>
+
+#include "OTAPartitionWriter.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "OTAPartitionWriter";
+
+// -----------------------------------------------------------------------------
+
+OTAPartitionWriter::OTAPartitionWriter(void)
+{
+    partition = nullptr;
+    sectorCount = 0;
+    clean = nullptr;
+
+    eraseTask = nullptr;
+    eraseDone = nullptr;
+    eraseStop = false;
+
+    writeOffset = 0;
+    writing = false;
+    updated = false;
+}
+
+OTAPartitionWriter::~OTAPartitionWriter()
+{
+    StopPreErase();
+
+    if (clean != nullptr) {
+        delete[] clean;
+        clean = nullptr;
+    }
+    if (eraseDone != nullptr) {
+        vSemaphoreDelete(eraseDone);
+        eraseDone = nullptr;
+    }
+}
+
+bool OTAPartitionWriter::IsAvailable(void)
+{
+    return (partition != nullptr) && (clean != nullptr);
+}
+
+uint32_t OTAPartitionWriter::SectorCount(void)
+{
+    return sectorCount;
+}
+
+uint32_t OTAPartitionWriter::CleanSectorCount(void)
+{
+    uint32_t count = 0;
+    for (uint32_t sector = 0; sector < sectorCount; ++sector) {
+        if (IsClean(sector)) ++count;
+    }
+    return count;
+}
+
+bool OTAPartitionWriter::IsClean(uint32_t sector)
+{
+    return (clean[sector / 32] & (1UL << (sector % 32))) != 0;
+}
+
+void OTAPartitionWriter::SetClean(uint32_t sector, bool value)
+{
+    if (value) {
+        clean[sector / 32] |= (1UL << (sector % 32));
+    }
+    else {
+        clean[sector / 32] &= ~(1UL << (sector % 32));
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+esp_err_t OTAPartitionWriter::StartPreErase(void)
+{
+    if (writing || updated) return ESP_ERR_INVALID_STATE;
+
+    // reap the task if it has finished
+    StopPreErase();
+
+    if (partition == nullptr) {
+        const esp_partition_t *running = esp_ota_get_running_partition();
+        esp_ota_img_states_t state;
+        if ((running != nullptr) && (esp_ota_get_state_partition(running, &state) == ESP_OK) &&
+            (state == ESP_OTA_IMG_PENDING_VERIFY)) {
+            // the previous application is needed for rollback
+            ESP_LOGI(TAG, "The running application is not verified yet");
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        const esp_partition_t *next = esp_ota_get_next_update_partition(nullptr);
+        if (next == nullptr) {
+            ESP_LOGW(TAG, "No OTA partition");
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        uint32_t count = next->size / OTAEraseSectorSize;
+        clean = new (std::nothrow) uint32_t[(count + 31) / 32];
+        if (clean == nullptr) return ESP_ERR_NO_MEM;
+        memset(clean, 0, ((count + 31) / 32) * sizeof(uint32_t));
+
+        sectorCount = count;
+        partition = next;
+    }
+
+    if (eraseDone == nullptr) {
+        eraseDone = xSemaphoreCreateBinary();
+        if (eraseDone == nullptr) return ESP_ERR_NO_MEM;
+    }
+
+    eraseStop = false;
+    BaseType_t res = xTaskCreate(PreEraseTask, "OTA pre-erase", OTAPreEraseStackSize, this,
+        tskIDLE_PRIORITY, &eraseTask);
+    if (res != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the pre-erase task");
+        eraseTask = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void OTAPartitionWriter::StopPreErase(void)
+{
+    if (eraseTask == nullptr) return;
+
+    // the task checks the flag after each sector, it may have finished already
+    eraseStop = true;
+    xSemaphoreTake(eraseDone, portMAX_DELAY);
+    eraseTask = nullptr;
+}
+
+void OTAPartitionWriter::PreEraseTask(void *param)
+{
+    OTAPartitionWriter *writer = static_cast<OTAPartitionWriter*>(param);
+    writer->PreErase();
+    xSemaphoreGive(writer->eraseDone);
+    vTaskDelete(nullptr);
+}
+
+void OTAPartitionWriter::PreErase(void)
+{
+    for (uint32_t sector = 0; (sector < sectorCount) && !eraseStop; ++sector) {
+        if (IsClean(sector)) continue;
+
+        esp_err_t err = EraseSector(sector);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "0x%x erasing sector %u", err, (unsigned)sector);
+            return;
+        }
+
+        // the flash is not accessible while erasing, leave time for the others
+        vTaskDelay(pdMS_TO_TICKS(OTAPreEraseDelay));
+    }
+
+    if (!eraseStop) {
+        ESP_LOGI(TAG, "Partition %s is clean, %u sectors checked",
+            partition->label, (unsigned)sectorCount);
+    }
+}
+
+esp_err_t OTAPartitionWriter::EraseSector(uint32_t sector)
+{
+    uint32_t address = sector * OTAEraseSectorSize;
+
+    // reading is faster than erasing and does not wear the flash
+    uint32_t data[32];
+    bool erased = true;
+    for (uint32_t offset = 0; erased && (offset < OTAEraseSectorSize); offset += sizeof(data)) {
+        esp_err_t err = esp_partition_read(partition, address + offset, data, sizeof(data));
+        if (err != ESP_OK) return err;
+        for (size_t i = 0; i < sizeof(data) / sizeof(data[0]); ++i) {
+            if (data[i] != 0xFFFFFFFF) {
+                erased = false;
+                break;
+            }
+        }
+    }
+
+    if (!erased) {
+        esp_err_t err = esp_partition_erase_range(partition, address, OTAEraseSectorSize);
+        if (err != ESP_OK) return err;
+    }
+
+    SetClean(sector, true);
+    return ESP_OK;
+}
+
+// -----------------------------------------------------------------------------
+
+esp_err_t OTAPartitionWriter::Begin(void)
+{
+    if (!IsAvailable()) return ESP_ERR_NOT_FOUND;
+
+    StopPreErase();
+
+    ESP_LOGI(TAG, "%u of %u sectors of %s are erased",
+        (unsigned)CleanSectorCount(), (unsigned)sectorCount, partition->label);
+
+    writeOffset = 0;
+    writing = true;
+    updated = false;
+    return ESP_OK;
+}
+
+esp_err_t OTAPartitionWriter::Write(const char *data, size_t length)
+{
+    if (!writing) return ESP_ERR_INVALID_STATE;
+    if (length == 0) return ESP_OK;
+    if (length > partition->size - writeOffset) return ESP_ERR_INVALID_SIZE;
+
+    // the writes are sequential, a sector starting before writeOffset was handled by a previous write
+    uint32_t first = writeOffset / OTAEraseSectorSize;
+    uint32_t last = (writeOffset + length - 1) / OTAEraseSectorSize;
+    for (uint32_t sector = first; sector <= last; ++sector) {
+        if ((sector * OTAEraseSectorSize >= writeOffset) && !IsClean(sector)) {
+            esp_err_t err = esp_partition_erase_range(partition, sector * OTAEraseSectorSize, OTAEraseSectorSize);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "0x%x esp_partition_erase_range", err);
+                return err;
+            }
+        }
+        SetClean(sector, false);
+    }
+
+    esp_err_t err = WriteData(data, length);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "0x%x esp_partition_write", err);
+        return err;
+    }
+
+    writeOffset += length;
+    return ESP_OK;
+}
+
+esp_err_t OTAPartitionWriter::WriteData(const char *data, size_t length)
+{
+    // encrypted writes are done in blocks of 16 bytes, only the last write may be shorter
+    size_t aligned = partition->encrypted ? (length & ~(size_t)15) : length;
+    if (aligned > 0) {
+        esp_err_t err = esp_partition_write(partition, writeOffset, data, aligned);
+        if (err != ESP_OK) return err;
+    }
+    if (aligned == length) return ESP_OK;
+
+    char tail[16];
+    memset(tail, 0xFF, sizeof(tail));
+    memcpy(tail, data + aligned, length - aligned);
+    return esp_partition_write(partition, writeOffset + aligned, tail, sizeof(tail));
+}
+
+esp_err_t OTAPartitionWriter::End(void)
+{
+    if (!writing) return ESP_ERR_INVALID_STATE;
+    writing = false;
+
+    // validates the image before changing the boot partition
+    esp_err_t err = esp_ota_set_boot_partition(partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "0x%x esp_ota_set_boot_partition", err);
+        StartPreErase();
+        return err;
+    }
+
+    updated = true;
+    return ESP_OK;
+}
+
+void OTAPartitionWriter::Abort(void)
+{
+    if (!writing) return;
+    writing = false;
+
+    StartPreErase();
+}
@@ -0,0 +1,111 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OTAPartitionWriter_H
+#define OTAPartitionWriter_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "sdkconfig.h"
+
+const uint32_t OTAEraseSectorSize = 4096;
+const uint32_t OTAPreEraseStackSize = 3072;
+const uint32_t OTAPreEraseDelay = CONFIG_ESP32BM_OTA_PRE_ERASE_DELAY_MS;
+
+/**
+ * @brief Writes a firmware image to the next OTA partition, erasing it in advance
+ *
+ * StartPreErase starts a task, with idle priority, which goes through the sectors of the
+ * next OTA partition, one sector every OTAPreEraseDelay milliseconds. Sectors already
+ * erased are only read, the others are erased. Both are recorded as clean.
+ *
+ * Begin stops the task and the image is written with esp_partition_write. Only the sectors
+ * not known to be clean are erased, so the update does not wait for the erase of the
+ * whole partition like esp_ota_begin does. End validates the image and sets it as the boot one.
+ * After Abort the written sectors are erased again in background.
+ *
+ * Nothing is erased while the running application waits to be verified, the previous
+ * one is needed for rollback.
+ */
+class OTAPartitionWriter
+{
+public:
+    OTAPartitionWriter(void);
+    virtual ~OTAPartitionWriter();
+
+    esp_err_t StartPreErase(void);
+    void StopPreErase(void);
+
+    /**
+     * @brief Returns true if StartPreErase found the partition
+     */
+    bool IsAvailable(void);
+
+    uint32_t SectorCount(void);
+    uint32_t CleanSectorCount(void);
+
+    /**
+     * @brief Stops the pre-erase task and prepares to write from the start of the partition
+     */
+    esp_err_t Begin(void);
+    esp_err_t Write(const char *data, size_t length);
+
+    /**
+     * @brief Validates the image and sets it as the boot partition
+     */
+    esp_err_t End(void);
+
+    /**
+     * @brief Drops the written image and restarts the pre-erase task
+     */
+    void Abort(void);
+
+protected:
+    const esp_partition_t *partition;
+    uint32_t sectorCount;
+    /** one bit for each sector, set if the sector is erased */
+    uint32_t *clean;
+
+    TaskHandle_t eraseTask;
+    SemaphoreHandle_t eraseDone;
+    volatile bool eraseStop;
+
+    uint32_t writeOffset;
+    bool writing;
+    /** set after a successful End, the partition holds the new application */
+    bool updated;
+
+    bool IsClean(uint32_t sector);
+    void SetClean(uint32_t sector, bool value);
+
+    /**
+     * @brief Checks a sector and erases it if it is not already erased
+     */
+    esp_err_t EraseSector(uint32_t sector);
+
+    esp_err_t WriteData(const char *data, size_t length);
+
+    static void PreEraseTask(void*);
+    void PreErase(void);
+};
+
+#endif
@@ -0,0 +1,330 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "sdkconfig.h"
+
+#include <cstring>
+
+#include "OTAPatcher.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "OTAPatcher";
+
+static uint32_t ReadUInt32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+        ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// -----------------------------------------------------------------------------
+
+OTAPatcher::OTAPatcher(void)
+{
+    output = nullptr;
+    base = nullptr;
+    state = State::error;
+    fieldReceived = 0;
+    command = OTAPatchEnd;
+    offset = 0;
+    remaining = 0;
+    targetSize = 0;
+    memset(targetSHA256, 0, sizeof(targetSHA256));
+    outputSize = 0;
+}
+
+OTAPatcher::~OTAPatcher()
+{
+    End();
+}
+
+bool OTAPatcher::IsPatch(const uint8_t *data, size_t length)
+{
+    if ((data == nullptr) || (length < sizeof(OTAPatchMagic))) return false;
+    return memcmp(data, OTAPatchMagic, sizeof(OTAPatchMagic)) == 0;
+}
+
+esp_err_t OTAPatcher::Begin(OTASink *sink)
+{
+    if (sink == nullptr) return ESP_ERR_INVALID_ARG;
+
+    output = sink;
+    base = nullptr;
+    state = State::detect;
+    fieldReceived = 0;
+    command = OTAPatchEnd;
+    offset = 0;
+    remaining = 0;
+    targetSize = 0;
+    outputSize = 0;
+    return ESP_OK;
+}
+
+void OTAPatcher::End(void)
+{
+    output = nullptr;
+    base = nullptr;
+    state = State::error;
+}
+
+bool OTAPatcher::IsActive(void)
+{
+    switch (state) {
+        case State::header:
+        case State::command:
+        case State::data:
+        case State::done:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool OTAPatcher::IsPassthrough(void)
+{
+    return state == State::passthrough;
+}
+
+const uint8_t* OTAPatcher::TargetSHA256(void)
+{
+    return targetSHA256;
+}
+
+uint32_t OTAPatcher::OutputSize(void)
+{
+    return outputSize;
+}
+
+esp_err_t OTAPatcher::Finish(void)
+{
+    switch (state) {
+        case State::detect:
+            // too short to be a patch, the output will reject it
+            if (fieldReceived > 0) {
+                state = State::passthrough;
+                return output->Write((const char*)field, fieldReceived);
+            }
+            return ESP_OK;
+        case State::passthrough:
+        case State::done:
+            return ESP_OK;
+        default:
+            ESP_LOGE(TAG, "Incomplete patch");
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+esp_err_t OTAPatcher::Output(const char *data, size_t length)
+{
+    if (length > targetSize - outputSize) {
+        ESP_LOGE(TAG, "The patch writes more than %u bytes", (unsigned)targetSize);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    outputSize += length;
+    return output->Write(data, length);
+}
+
+esp_err_t OTAPatcher::CheckHeader(void)
+{
+    const esp_app_desc_t *runningApp = esp_ota_get_app_description();
+    base = esp_ota_get_running_partition();
+    if ((runningApp == nullptr) || (base == nullptr)) {
+        ESP_LOGE(TAG, "The running application is not known");
+        return ESP_FAIL;
+    }
+
+    const uint8_t *baseSHA256 = field + sizeof(OTAPatchMagic);
+    if (memcmp(baseSHA256, runningApp->app_elf_sha256, sizeof(runningApp->app_elf_sha256)) != 0) {
+        ESP_LOGE(TAG, "The patch is not for the running application");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    targetSize = ReadUInt32(baseSHA256 + 32);
+    memcpy(targetSHA256, baseSHA256 + 36, sizeof(targetSHA256));
+    if (targetSize == 0) {
+        ESP_LOGE(TAG, "Invalid patch header");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    ESP_LOGI(TAG, "Applying a patch for a %u bytes image", (unsigned)targetSize);
+    return ESP_OK;
+}
+
+esp_err_t OTAPatcher::StartCommand(void)
+{
+    command = field[0];
+    offset = ReadUInt32(field + 1);
+    remaining = ReadUInt32(field + 5);
+
+    if ((command == OTAPatchCopy) || (command == OTAPatchAdd)) {
+        if ((offset > base->size) || (remaining > base->size - offset)) {
+            ESP_LOGE(TAG, "The patch reads outside of the running partition");
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+    }
+
+    switch (command) {
+        case OTAPatchEnd:
+            if (outputSize != targetSize) {
+                ESP_LOGE(TAG, "The patch wrote %u bytes instead of %u",
+                    (unsigned)outputSize, (unsigned)targetSize);
+                return ESP_ERR_OTA_VALIDATE_FAILED;
+            }
+            state = State::done;
+            return ESP_OK;
+        case OTAPatchCopy:
+            return Copy();
+        case OTAPatchAdd:
+        case OTAPatchInsert:
+            if (remaining > 0) {
+                state = State::data;
+            }
+            return ESP_OK;
+        default:
+            ESP_LOGE(TAG, "Invalid patch command %u", command);
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+}
+
+esp_err_t OTAPatcher::Copy(void)
+{
+    while (remaining > 0) {
+        size_t len = (remaining < sizeof(buffer)) ? remaining : sizeof(buffer);
+        esp_err_t res = esp_partition_read(base, offset, buffer, len);
+        if (res != ESP_OK) {
+            ESP_LOGE(TAG, "0x%x esp_partition_read", res);
+            return res;
+        }
+        res = Output((const char*)buffer, len);
+        if (res != ESP_OK) return res;
+
+        offset += len;
+        remaining -= len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t OTAPatcher::Add(const uint8_t *data, size_t length)
+{
+    while (length > 0) {
+        size_t len = (length < sizeof(buffer)) ? length : sizeof(buffer);
+        esp_err_t res = esp_partition_read(base, offset, buffer, len);
+        if (res != ESP_OK) {
+            ESP_LOGE(TAG, "0x%x esp_partition_read", res);
+            return res;
+        }
+        for (size_t i = 0; i < len; ++i) {
+            buffer[i] = (uint8_t)(buffer[i] + data[i]);
+        }
+        res = Output((const char*)buffer, len);
+        if (res != ESP_OK) return res;
+
+        offset += len;
+        data += len;
+        length -= len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t OTAPatcher::Write(const char *data, size_t length)
+{
+    const uint8_t *src = (const uint8_t*)data;
+    esp_err_t res = ESP_OK;
+
+    while ((length > 0) && (res == ESP_OK)) {
+        switch (state) {
+            case State::passthrough:
+                return output->Write((const char*)src, length);
+
+            case State::detect:
+                field[fieldReceived++] = *src++;
+                --length;
+                if (fieldReceived < sizeof(OTAPatchMagic)) break;
+                if (IsPatch(field, fieldReceived)) {
+#ifdef CONFIG_ESP32BM_OTA_DELTA
+                    state = State::header;
+#else
+                    ESP_LOGE(TAG, "Firmware patches are not enabled");
+                    res = ESP_ERR_NOT_SUPPORTED;
+#endif
+                    break;
+                }
+                state = State::passthrough;
+                res = output->Write((const char*)field, fieldReceived);
+                break;
+
+            case State::header:
+            case State::command: {
+                size_t size = (state == State::header) ? OTAPatchHeaderSize : OTAPatchCommandSize;
+                size_t len = size - fieldReceived;
+                if (len > length) len = length;
+                memcpy(field + fieldReceived, src, len);
+                fieldReceived += len;
+                src += len;
+                length -= len;
+                if (fieldReceived < size) break;
+
+                fieldReceived = 0;
+                if (state == State::header) {
+                    res = CheckHeader();
+                    state = State::command;
+                }
+                else {
+                    res = StartCommand();
+                }
+                break;
+            }
+
+            case State::data: {
+                size_t len = (length < remaining) ? length : remaining;
+                if (command == OTAPatchAdd) {
+                    res = Add(src, len);
+                }
+                else {
+                    res = Output((const char*)src, len);
+                }
+                src += len;
+                length -= len;
+                remaining -= len;
+                if (remaining == 0) {
+                    state = State::command;
+                }
+                break;
+            }
+
+            case State::done:
+                ESP_LOGE(TAG, "Data after the end of the patch");
+                res = ESP_ERR_OTA_VALIDATE_FAILED;
+                break;
+
+            default:
+                res = ESP_ERR_OTA_VALIDATE_FAILED;
+                break;
+        }
+    }
+
+    if (res != ESP_OK) {
+        state = State::error;
+    }
+    return res;
+}
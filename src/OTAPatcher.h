@@ -0,0 +1,137 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OTAPatcher_H
+#define OTAPatcher_H
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#include "OTAPipeline.h"
+
+/**
+ * Patch format, all numbers are little endian
+ *
+ * The header, OTAPatchHeaderSize bytes:
+ * - the magic "PXD1"
+ * - the SHA256 of the elf file of the base application, app_elf_sha256 from its description
+ * - uint32_t size of the new image
+ * - the SHA256 of the new image
+ *
+ * followed by commands of OTAPatchCommandSize bytes: uint8_t type, uint32_t offset, uint32_t length
+ * - copy:   writes `length` bytes of the base image from `offset`
+ * - add:    followed by `length` bytes added to the bytes of the base image from `offset`
+ * - insert: followed by `length` bytes written as they are, `offset` is not used
+ * - end:    the last command
+ *
+ * Patches are made by tools/paxdelta.py.
+ */
+const uint8_t OTAPatchMagic[4] = { 'P', 'X', 'D', '1' };
+const size_t OTAPatchHeaderSize  = 72;
+const size_t OTAPatchCommandSize = 9;
+
+const uint8_t OTAPatchEnd    = 0;
+const uint8_t OTAPatchCopy   = 1;
+const uint8_t OTAPatchAdd    = 2;
+const uint8_t OTAPatchInsert = 3;
+
+/**
+ * @brief Size of the buffer used to read the base image
+ */
+const size_t OTAPatchBufferSize = 256;
+
+/**
+ * @brief Rebuilds a firmware image from a patch and the running application
+ *
+ * Sits between the received data and an OTASink. The first bytes tell if the data is
+ * a patch, if not the data is passed through unchanged. The patch must be made against
+ * the running application, the SHA256 of its elf file is checked before anything is written.
+ */
+class OTAPatcher : public OTASink
+{
+public:
+    OTAPatcher(void);
+    virtual ~OTAPatcher();
+
+    /**
+     * @brief Returns true if the data starts with the patch magic bytes
+     */
+    static bool IsPatch(const uint8_t *data, size_t length);
+
+    esp_err_t Begin(OTASink *output);
+    void End(void);
+
+    /**
+     * @brief Returns true if the data is a patch
+     */
+    bool IsActive(void);
+
+    /**
+     * @brief Returns true if the data was found not to be a patch
+     */
+    bool IsPassthrough(void);
+
+    virtual esp_err_t Write(const char *data, size_t length);
+
+    /**
+     * @brief Returns ESP_OK if the data was not a patch or if the whole patch was applied
+     */
+    esp_err_t Finish(void);
+
+    /**
+     * @brief The SHA256 of the new image, from the header of the patch
+     */
+    const uint8_t* TargetSHA256(void);
+
+    /**
+     * @brief Number of bytes written to the output
+     */
+    uint32_t OutputSize(void);
+
+protected:
+    enum class State : uint8_t {
+        detect, passthrough, header, command, data, done, error
+    };
+
+    OTASink *output;
+    const esp_partition_t *base;
+
+    State state;
+    uint8_t field[OTAPatchHeaderSize];
+    size_t fieldReceived;
+
+    uint8_t command;
+    uint32_t offset;
+    uint32_t remaining;
+
+    uint32_t targetSize;
+    uint8_t targetSHA256[32];
+    uint32_t outputSize;
+
+    uint8_t buffer[OTAPatchBufferSize];
+
+    esp_err_t CheckHeader(void);
+    esp_err_t StartCommand(void);
+    esp_err_t Copy(void);
+    esp_err_t Add(const uint8_t *data, size_t length);
+    esp_err_t Output(const char *data, size_t length);
+};
+
+#endif
@@ -0,0 +1,395 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+
+#include <new>
+#include <cstring>
+
+#include "OTAPipeline.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "OTAPipeline";
+
+// -----------------------------------------------------------------------------
+
+OTAPipeline::OTAPipeline(void)
+{
+    ota = nullptr;
+    partitionWriter = nullptr;
+    for (uint8_t i = 0; i < OTABufferCount; ++i) {
+        buffers[i] = nullptr;
+    }
+    current = nullptr;
+    currentLength = 0;
+    freeQueue = nullptr;
+    fullQueue = nullptr;
+    doneSemaphore = nullptr;
+    writerTask = nullptr;
+
+    error = ESP_OK;
+    bytesWritten = 0;
+    startTime = 0;
+    elapsedMs = 0;
+}
+
+OTAPipeline::~OTAPipeline()
+{
+    Abort();
+}
+
+bool OTAPipeline::IsRunning(void)
+{
+    return writerTask != nullptr;
+}
+
+esp_err_t OTAPipeline::GetError(void)
+{
+    return error;
+}
+
+uint32_t OTAPipeline::BytesWritten(void)
+{
+    return bytesWritten;
+}
+
+uint32_t OTAPipeline::ElapsedMs(void)
+{
+    return elapsedMs;
+}
+
+esp_err_t OTAPipeline::Start(ESP32SimpleOTA *simpleOTA, OTAPartitionWriter *writer)
+{
+    if (simpleOTA == nullptr) return ESP_ERR_INVALID_ARG;
+    if (IsRunning()) return ESP_ERR_INVALID_STATE;
+
+    ota = simpleOTA;
+    partitionWriter = writer;
+    current = nullptr;
+    currentLength = 0;
+    error = ESP_OK;
+    bytesWritten = 0;
+    elapsedMs = 0;
+
+    freeQueue = xQueueCreate(OTABufferCount, sizeof(char*));
+    fullQueue = xQueueCreate(OTABufferCount + 1, sizeof(Block));
+    doneSemaphore = xSemaphoreCreateBinary();
+    if ((freeQueue == nullptr) || (fullQueue == nullptr) || (doneSemaphore == nullptr)) {
+        ESP_LOGE(TAG, "Failed to create the queues");
+        Release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < OTABufferCount; ++i) {
+        buffers[i] = new (std::nothrow) char[OTABufferSize];
+        if (buffers[i] == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate buffer %d", i);
+            Release();
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSendToBack(freeQueue, &buffers[i], 0);
+    }
+
+    verifier.Begin();
+    startTime = esp_timer_get_time();
+
+    // same priority as the receiving task so both make progress
+    BaseType_t res = xTaskCreate(WriterTask, "OTA writer", OTAWriterStackSize, this,
+        uxTaskPriorityGet(nullptr), &writerTask);
+    if (res != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the writer task");
+        writerTask = nullptr;
+        Release();
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+bool OTAPipeline::SetExpectedSHA256(const char *hex)
+{
+    if (!IsRunning()) return false;
+    return verifier.SetExpectedSHA256(hex);
+}
+
+bool OTAPipeline::SetExpectedSHA256(const uint8_t *sha256)
+{
+    if (!IsRunning()) return false;
+    return verifier.SetExpectedSHA256(sha256);
+}
+
+bool OTAPipeline::HasExpectedSHA256(void)
+{
+    return verifier.HasExpectedSHA256();
+}
+
+char* OTAPipeline::GetBuffer(TickType_t waitTicks)
+{
+    if (!IsRunning()) return nullptr;
+
+    char *buffer = nullptr;
+    if (xQueueReceive(freeQueue, &buffer, waitTicks) != pdTRUE) return nullptr;
+    return buffer;
+}
+
+esp_err_t OTAPipeline::Submit(char *buffer, size_t length)
+{
+    if (!IsRunning()) return ESP_ERR_INVALID_STATE;
+    if ((buffer == nullptr) || (length == 0) || (length > OTABufferSize)) return ESP_ERR_INVALID_ARG;
+
+    Block block;
+    block.data = buffer;
+    block.length = length;
+    if (xQueueSendToBack(fullQueue, &block, portMAX_DELAY) != pdTRUE) return ESP_FAIL;
+
+    return error;
+}
+
+esp_err_t OTAPipeline::Write(const char *data, size_t length)
+{
+    while (length > 0) {
+        size_t available = 0;
+        char *buffer = GetWriteBuffer(&available);
+        if (buffer == nullptr) return ESP_FAIL;
+
+        size_t len = (length < available) ? length : available;
+        memcpy(buffer, data, len);
+        data += len;
+        length -= len;
+
+        esp_err_t res = CommitWrite(len);
+        if (res != ESP_OK) return res;
+    }
+    return ESP_OK;
+}
+
+char* OTAPipeline::GetWriteBuffer(size_t *available)
+{
+    if (current == nullptr) {
+        current = GetBuffer(portMAX_DELAY);
+        currentLength = 0;
+        if (current == nullptr) return nullptr;
+    }
+
+    if (available != nullptr) {
+        *available = OTABufferSize - currentLength;
+    }
+    return current + currentLength;
+}
+
+esp_err_t OTAPipeline::CommitWrite(size_t length)
+{
+    if (current == nullptr) return ESP_ERR_INVALID_STATE;
+    if (currentLength + length > OTABufferSize) return ESP_ERR_INVALID_SIZE;
+
+    currentLength += length;
+    if (currentLength < OTABufferSize) return error;
+
+    // whole buffers are submitted so the writes are sector aligned
+    esp_err_t res = Submit(current, currentLength);
+    current = nullptr;
+    currentLength = 0;
+    return res;
+}
+
+esp_err_t OTAPipeline::Finish(void)
+{
+    if (!IsRunning()) return ESP_ERR_INVALID_STATE;
+
+    if ((current != nullptr) && (currentLength > 0)) {
+        Submit(current, currentLength);
+    }
+    current = nullptr;
+    currentLength = 0;
+
+    Stop(true);
+
+    elapsedMs = (uint32_t)((esp_timer_get_time() - startTime) / 1000);
+    if (error == ESP_OK) {
+        uint32_t ms = (elapsedMs == 0) ? 1 : elapsedMs;
+        double rate = (double)bytesWritten / ms / 1000.0;
+        ESP_LOGI(TAG, "%u bytes written in %u ms, %.3f MB/s",
+            (unsigned)bytesWritten, (unsigned)elapsedMs, rate);
+    }
+
+    return error;
+}
+
+void OTAPipeline::Abort(void)
+{
+    if (!IsRunning()) return;
+
+    // the current buffer, if any, is freed by Release
+    current = nullptr;
+    currentLength = 0;
+
+    Stop(false);
+    elapsedMs = (uint32_t)((esp_timer_get_time() - startTime) / 1000);
+}
+
+void OTAPipeline::Stop(bool finalize)
+{
+    // a block without data is the end marker, its length tells if the image must be finalized
+    Block block;
+    block.data = nullptr;
+    block.length = finalize ? 1 : 0;
+    xQueueSendToBack(fullQueue, &block, portMAX_DELAY);
+
+    xSemaphoreTake(doneSemaphore, portMAX_DELAY);
+    writerTask = nullptr;
+
+    Release();
+}
+
+void OTAPipeline::Release(void)
+{
+    if (freeQueue != nullptr) {
+        vQueueDelete(freeQueue);
+        freeQueue = nullptr;
+    }
+    if (fullQueue != nullptr) {
+        vQueueDelete(fullQueue);
+        fullQueue = nullptr;
+    }
+    if (doneSemaphore != nullptr) {
+        vSemaphoreDelete(doneSemaphore);
+        doneSemaphore = nullptr;
+    }
+    for (uint8_t i = 0; i < OTABufferCount; ++i) {
+        if (buffers[i] != nullptr) {
+            delete[] buffers[i];
+            buffers[i] = nullptr;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void OTAPipeline::WriterTask(void *param)
+{
+    OTAPipeline *pipeline = static_cast<OTAPipeline*>(param);
+    pipeline->Writer();
+    vTaskDelete(nullptr);
+}
+
+esp_err_t OTAPipeline::FlashBegin(void)
+{
+    if (partitionWriter != nullptr) return partitionWriter->Begin();
+    return ota->Begin();
+}
+
+esp_err_t OTAPipeline::FlashWrite(const char *data, size_t length)
+{
+    if (partitionWriter != nullptr) return partitionWriter->Write(data, length);
+    return ota->Write(data, length);
+}
+
+esp_err_t OTAPipeline::FlashEnd(void)
+{
+    if (partitionWriter != nullptr) return partitionWriter->End();
+    return ota->End();
+}
+
+void OTAPipeline::FlashAbort(void)
+{
+    // ESP32SimpleOTA erases the partition again on the next Begin
+    if (partitionWriter != nullptr) {
+        partitionWriter->Abort();
+    }
+}
+
+void OTAPipeline::Writer(void)
+{
+    bool begun = false;
+    bool ended = false;
+    esp_err_t err = ESP_OK;
+
+    while (true) {
+        Block block;
+        if (xQueueReceive(fullQueue, &block, portMAX_DELAY) != pdTRUE) continue;
+
+        if (block.data == nullptr) {
+            if ((block.length != 0) && (err == ESP_OK)) {
+                // on verification errors End is not called so the boot partition is not changed
+                err = verifier.Finish();
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "0x%x image verification", err);
+                }
+                else if (begun) {
+                    err = FlashEnd();
+                    if (err != ESP_OK) {
+                        ESP_LOGE(TAG, "0x%x End", err);
+                    }
+                    ended = true;
+                }
+                else {
+                    ESP_LOGE(TAG, "No data received");
+                    err = ESP_FAIL;
+                }
+                error = err;
+            }
+            break;
+        }
+
+        // after an error the data is dropped but the buffers are still returned
+        // so the receiving task is not blocked
+        if (err == ESP_OK) {
+            err = verifier.Update(block.data, block.length);
+        }
+        if (err == ESP_OK) {
+            // only the last block is shorter than OTABufferSize so the first one holds
+            // the head of the image, which is checked before Begin erases the partition
+            if (!begun) {
+                if (verifier.HeadChecked()) {
+                    begun = true;
+                    err = FlashBegin();
+                    if (err != ESP_OK) {
+                        ESP_LOGE(TAG, "0x%x Begin", err);
+                    }
+                }
+                else {
+                    ESP_LOGE(TAG, "Image is too short");
+                    err = ESP_ERR_OTA_VALIDATE_FAILED;
+                }
+            }
+            if (err == ESP_OK) {
+                err = FlashWrite(block.data, block.length);
+                if (err == ESP_OK) {
+                    bytesWritten = bytesWritten + block.length;
+                }
+                else {
+                    ESP_LOGE(TAG, "0x%x Write", err);
+                }
+            }
+        }
+        // set on every error, a rejected block included, so the next Submit reports it
+        error = err;
+
+        xQueueSendToBack(freeQueue, &block.data, portMAX_DELAY);
+    }
+
+    if (begun && !ended) {
+        FlashAbort();
+    }
+
+    xSemaphoreGive(doneSemaphore);
+}
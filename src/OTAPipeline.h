@@ -0,0 +1,191 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OTAPipeline_H
+#define OTAPipeline_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#include "ESP32SimpleOTA.h"
+#include "OTAPartitionWriter.h"
+#include "OTAImageVerifier.h"
+
+const size_t OTASectorSize = 4096;
+const size_t OTABufferSize = CONFIG_ESP32BM_OTA_BUFFER_SIZE;
+const uint8_t OTABufferCount = CONFIG_ESP32BM_OTA_BUFFER_COUNT;
+const uint32_t OTAWriterStackSize = 4096;
+
+static_assert(OTABufferSize % OTASectorSize == 0, "The OTA buffer size must be a multiple of the flash sector size");
+
+/**
+ * @brief Destination of the data of an OTA image
+ *
+ * Lets the stages of an update, like decompression and patching, be chained.
+ */
+class OTASink
+{
+public:
+    virtual ~OTASink() {}
+
+    virtual esp_err_t Write(const char *data, size_t length) = 0;
+};
+
+/**
+ * @brief Overlaps receiving an OTA image with writing it to flash
+ *
+ * The receiving task fills free buffers and submits them, a writer task drains them
+ * into ESP32SimpleOTA. Each buffer, except the last one, is full so the writes are
+ * sector aligned. While the writer is busy with a flash write or erase the receiver
+ * can fill the other buffers.
+ *
+ * The buffers and the writer task exist only between Start and Finish or Abort.
+ *
+ * The image is checked by an OTAImageVerifier before ESP32SimpleOTA::Begin, so an image
+ * for another chip or project is rejected after the first block, before erasing the partition.
+ *
+ * If an OTAPartitionWriter is given to Start it is used instead of ESP32SimpleOTA, the
+ * sectors it has erased in advance are written without waiting for an erase.
+ *
+ * The data can be copied with Write or received directly in the current buffer:
+ *
+ * @code{.cpp}
+ * pipeline.Start(ota);
+ * while (receiving) {
+ *     size_t available;
+ *     char *buffer = pipeline.GetWriteBuffer(&available);
+ *     // receive up to available bytes in buffer
+ *     pipeline.CommitWrite(length);
+ * }
+ * esp_err_t res = pipeline.Finish();
+ * @endcode
+ */
+class OTAPipeline : public OTASink
+{
+public:
+    OTAPipeline(void);
+    virtual ~OTAPipeline();
+
+    /**
+     * @brief Allocates the buffers and starts the writer task
+     *
+     * ESP32SimpleOTA::Begin, or OTAPartitionWriter::Begin, is called by the writer task
+     * before the first write.
+     */
+    esp_err_t Start(ESP32SimpleOTA*, OTAPartitionWriter *partitionWriter = nullptr);
+
+    /**
+     * @brief Sets the expected SHA256 of the image, call it after Start
+     */
+    bool SetExpectedSHA256(const char *hex);
+    bool SetExpectedSHA256(const uint8_t *sha256);
+    bool HasExpectedSHA256(void);
+
+    /**
+     * @brief Copies the data in the current buffer, which is submitted to the writer when full
+     */
+    virtual esp_err_t Write(const char *data, size_t length);
+
+    /**
+     * @brief Returns the free part of the current buffer, waiting for one if needed
+     *
+     * @param available receives the number of bytes which can be written
+     */
+    char* GetWriteBuffer(size_t *available);
+
+    /**
+     * @brief Marks as used the bytes written in the buffer returned by GetWriteBuffer
+     */
+    esp_err_t CommitWrite(size_t length);
+
+    /**
+     * @brief Submits the last, partial, buffer, waits for the data to be written
+     * then calls ESP32SimpleOTA::End
+     */
+    esp_err_t Finish(void);
+
+    /**
+     * @brief Stops the writer without finalizing the image
+     */
+    void Abort(void);
+
+    /**
+     * @brief Returns the first error of the writer, the submitted data is dropped after it
+     */
+    esp_err_t GetError(void);
+
+    bool IsRunning(void);
+
+    /**
+     * @brief Statistics of the last update
+     */
+    uint32_t BytesWritten(void);
+    uint32_t ElapsedMs(void);
+
+protected:
+    struct Block {
+        char *data;
+        size_t length;
+    };
+
+    ESP32SimpleOTA *ota;
+    OTAPartitionWriter *partitionWriter;
+    OTAImageVerifier verifier;
+
+    char *buffers[OTABufferCount];
+    /** the buffer being filled, submitted when full */
+    char *current;
+    size_t currentLength;
+
+    QueueHandle_t freeQueue;
+    QueueHandle_t fullQueue;
+    SemaphoreHandle_t doneSemaphore;
+    TaskHandle_t writerTask;
+
+    volatile esp_err_t error;
+    volatile uint32_t bytesWritten;
+    int64_t startTime;
+    uint32_t elapsedMs;
+
+    char* GetBuffer(TickType_t waitTicks);
+    esp_err_t Submit(char *buffer, size_t length);
+
+    static void WriterTask(void*);
+    void Writer(void);
+
+    /**
+     * @brief Calls ESP32SimpleOTA or, if set, the OTAPartitionWriter
+     */
+    esp_err_t FlashBegin(void);
+    esp_err_t FlashWrite(const char *data, size_t length);
+    esp_err_t FlashEnd(void);
+    void FlashAbort(void);
+
+    /**
+     * @brief Sends the end marker and waits for the writer task to exit
+     */
+    void Stop(bool finalize);
+    void Release(void);
+};
+
+#endif
@@ -0,0 +1,138 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include <new>
+
+#include "RequestBufferPool.h"
+
+// -----------------------------------------------------------------------------
+
+static const char* TAG = "ReqBufPool";
+
+// -----------------------------------------------------------------------------
+
+RequestBufferPool::RequestBufferPool(void)
+{
+    for (uint8_t i = 0; i < RequestBufferCount; ++i) {
+        buffers[i] = nullptr;
+        owners[i] = -1;
+    }
+    exhausted = 0;
+    mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+RequestBufferPool::~RequestBufferPool()
+{
+    Destroy();
+}
+
+bool RequestBufferPool::Create(void)
+{
+    for (uint8_t i = 0; i < RequestBufferCount; ++i) {
+        if (buffers[i] == nullptr) {
+            buffers[i] = new (std::nothrow) char[RequestBufferSize];
+            if (buffers[i] == nullptr) {
+                ESP_LOGE(TAG, "Failed to allocate request buffer %d", i);
+                Destroy();
+                return false;
+            }
+        }
+        owners[i] = -1;
+    }
+    return true;
+}
+
+void RequestBufferPool::Destroy(void)
+{
+    for (uint8_t i = 0; i < RequestBufferCount; ++i) {
+        if (buffers[i] != nullptr) {
+            delete[] buffers[i];
+            buffers[i] = nullptr;
+        }
+        owners[i] = -1;
+    }
+}
+
+char* RequestBufferPool::Acquire(int sockfd)
+{
+    char *buffer = nullptr;
+
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < RequestBufferCount; ++i) {
+        if ((buffers[i] != nullptr) && (owners[i] < 0)) {
+            owners[i] = sockfd;
+            buffer = buffers[i];
+            break;
+        }
+    }
+    if (buffer == nullptr) {
+        ++exhausted;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (buffer == nullptr) {
+        ESP_LOGW(TAG, "No free request buffer for socket %d", sockfd);
+    }
+    return buffer;
+}
+
+void RequestBufferPool::Release(char *buffer)
+{
+    if (buffer == nullptr) return;
+
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < RequestBufferCount; ++i) {
+        if (buffers[i] == buffer) {
+            owners[i] = -1;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+void RequestBufferPool::ReleaseSocket(int sockfd)
+{
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < RequestBufferCount; ++i) {
+        if (owners[i] == sockfd) {
+            owners[i] = -1;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+uint32_t RequestBufferPool::ExhaustedCount(void)
+{
+    return exhausted;
+}
+
+// -----------------------------------------------------------------------------
+
+RequestBuffer::RequestBuffer(RequestBufferPool& bufferPool, int sockfd) : pool(bufferPool)
+{
+    data = pool.Acquire(sockfd);
+}
+
+RequestBuffer::~RequestBuffer()
+{
+    pool.Release(data);
+    data = nullptr;
+}
@@ -0,0 +1,87 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RequestBufferPool_H
+#define RequestBufferPool_H
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+const uint8_t RequestBufferCount = CONFIG_ESP32BM_REQ_BUFFER_COUNT;
+const size_t RequestBufferSize = CONFIG_ESP32BM_REQ_BUFFER_SIZE;
+
+/**
+ * @brief A fixed number of equal size buffers for request bodies
+ *
+ * Each buffer is owned by the socket of the session using it, so concurrent requests
+ * never share memory. The buffers are allocated by Create and reused until Destroy.
+ * A buffer still owned by a socket when the session is closed is freed by ReleaseSocket.
+ *
+ * Acquire and Release are protected by a critical section and can be used from any task.
+ */
+class RequestBufferPool
+{
+public:
+    RequestBufferPool(void);
+    virtual ~RequestBufferPool();
+
+    bool Create(void);
+    void Destroy(void);
+
+    /**
+     * @brief Returns a free buffer of RequestBufferSize bytes or nullptr if the pool is exhausted
+     */
+    char* Acquire(int sockfd);
+
+    void Release(char *buffer);
+
+    /**
+     * @brief Releases the buffers owned by a socket, call it when the session is closed
+     */
+    void ReleaseSocket(int sockfd);
+
+    /**
+     * @brief Number of times Acquire failed because all buffers were in use
+     */
+    uint32_t ExhaustedCount(void);
+
+protected:
+    char *buffers[RequestBufferCount];
+    int owners[RequestBufferCount];
+    uint32_t exhausted;
+    portMUX_TYPE mux;
+};
+
+/**
+ * @brief Holds a buffer from a RequestBufferPool and releases it when going out of scope
+ */
+class RequestBuffer
+{
+public:
+    RequestBuffer(RequestBufferPool&, int sockfd);
+    ~RequestBuffer();
+
+    char *data;
+    const size_t size = RequestBufferSize;
+
+protected:
+    RequestBufferPool &pool;
+};
+
+#endif
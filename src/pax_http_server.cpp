@@ -21,22 +21,37 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_ota_ops.h"
 
-#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
 #include <cstring>
+#include <cerrno>
+
+#include "lwip/sockets.h"
 
 #include "sdkconfig.h"
+#include "esp_idf_version.h"
+#ifdef CONFIG_ESP32BM_HTTPS
+#include "esp_https_server.h"
+#endif
 #include "pax_http_server.h"
 #include "Configuration.h"
-#include "cJSON.h"
+#include "JSONWriter.h"
+#include "HTTPAsset.h"
 
 // -----------------------------------------------------------------------------
 
 static const char* TAG = "PaxHttpSrv";
 
-const uint8_t queueLength = 8;
+const uint8_t queueLength = CONFIG_ESP32BM_CMD_QUEUE_LENGTH;
+const uint8_t batchLength = (CONFIG_ESP32BM_CMD_BATCH_LENGTH < queueLength) ?
+    CONFIG_ESP32BM_CMD_BATCH_LENGTH : queueLength;
 
-#ifdef CONFIG_ESP32BM_WEB_Compressed_index
+#ifdef CONFIG_ESP32BM_WEB_ASSET_TABLE
+#include "web_assets.h"
+#elif defined(CONFIG_ESP32BM_WEB_Compressed_index)
 extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
 extern const uint8_t index_html_gz_end[]   asm("_binary_index_html_gz_end");
 #else
@@ -45,8 +60,15 @@ extern const uint8_t index_html_end[]   asm("_binary_index_html_end");
 #endif
 
 #ifdef CONFIG_ESP32BM_WEB_USE_favicon
-extern const uint8_t index_html_start[] asm("_binary_favicon_ico_start");
-extern const uint8_t index_html_end[]   asm("_binary_favicon_ico_end");
+extern const uint8_t favicon_ico_start[] asm("_binary_favicon_ico_start");
+extern const uint8_t favicon_ico_end[]   asm("_binary_favicon_ico_end");
+#endif
+
+#ifdef CONFIG_ESP32BM_HTTPS
+extern const uint8_t servercert_pem_start[] asm("_binary_servercert_pem_start");
+extern const uint8_t servercert_pem_end[]   asm("_binary_servercert_pem_end");
+extern const uint8_t prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
+extern const uint8_t prvtkey_pem_end[]   asm("_binary_prvtkey_pem_end");
 #endif
 
 // -----------------------------------------------------------------------------
@@ -64,57 +86,204 @@ static esp_err_t request_handler(httpd_req_t *req)
     return server->HandleRequest(req);
 }
 
-// -----------------------------------------------------------------------------
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    if (req == nullptr) return ESP_FAIL;
 
-PaxHttpServer::PaxHttpServer(void)
+    PaxHttpServer* server = (PaxHttpServer *) req->user_ctx;
+    if (server == nullptr) return ESP_FAIL;
+
+    return server->HandleWebSocket(req);
+}
+
+struct WSResult
 {
-    serverQueue = 0;
-    serverHandle = nullptr;
-    working = false;
-    simpleOTA = nullptr;
-    configuration = nullptr;
+    httpd_handle_t handle;
+    int sockfd;
+    uint32_t session;
+    uint8_t frame[8];
+};
+
+static void ws_result_work(void *arg)
+{
+    WSResult *res = (WSResult *) arg;
+    if (res == nullptr) return;
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_BINARY;
+    frame.payload = res->frame;
+    frame.len = sizeof(res->frame);
+
+    // the result is dropped if the client is gone, its socket may be used by another client
+    PaxHttpServer* server = (PaxHttpServer *) httpd_get_global_user_ctx(res->handle);
+    if ((server != nullptr) && server->IsWebSocketSession(res->sockfd, res->session)) {
+        httpd_ws_send_frame_async(res->handle, res->sockfd, &frame);
+    }
+
+    delete res;
 }
+#endif
 
-PaxHttpServer::~PaxHttpServer()
+static esp_err_t open_handler(httpd_handle_t handle, int sockfd)
 {
-    StopServer();
-    DestroyQueue();
+    PaxHttpServer* server = (PaxHttpServer *) httpd_get_global_user_ctx(handle);
+    if (server == nullptr) return ESP_OK;
+
+    return server->SocketOpened(handle, sockfd);
 }
 
-bool PaxHttpServer::Initialize(void) {
-    if (serverQueue != 0) {
-        DestroyQueue();
+static int recv_override(httpd_handle_t handle, int sockfd, char *buf, size_t length, int flags)
+{
+    PaxHttpServer* server = (PaxHttpServer *) httpd_get_global_user_ctx(handle);
+    if (server == nullptr) return HTTPD_SOCK_ERR_INVALID;
+
+    return server->SocketRecv(sockfd, buf, length, flags);
+}
+
+static int send_override(httpd_handle_t handle, int sockfd, const char *buf, size_t length, int flags)
+{
+    PaxHttpServer* server = (PaxHttpServer *) httpd_get_global_user_ctx(handle);
+    if (server == nullptr) return HTTPD_SOCK_ERR_INVALID;
+
+    return server->SocketSend(sockfd, buf, length, flags);
+}
+
+static void close_handler(httpd_handle_t handle, int sockfd)
+{
+    PaxHttpServer* server = (PaxHttpServer *) httpd_get_global_user_ctx(handle);
+    if (server != nullptr) {
+        server->SocketClosed(sockfd);
     }
-    return CreateQueue();
+
+    // when close_fn is set the server does not close the socket
+    close(sockfd);
+}
+
+/**
+ * @brief Reads an unsigned value from the query string, returns false if the key is missing or invalid
+ */
+static bool QueryUInt32(const char *query, const char *key, uint32_t& value)
+{
+    char str[12];
+    if (httpd_query_key_value(query, key, str, sizeof(str)) != ESP_OK) return false;
+    // strtoul accepts, and negates, a leading '-'
+    if ((str[0] < '0') || (str[0] > '9')) return false;
+
+    char *end;
+    errno = 0;
+    unsigned long val = strtoul(str, &end, 10);
+    if ((*end != 0) || (errno != 0) || (val > UINT32_MAX)) return false;
+    value = (uint32_t)val;
+    return true;
 }
 
-QueueHandle_t PaxHttpServer::GetQueueHandle(void) {
-    if (serverQueue == 0) {
-        CreateQueue();
+static const char* statusWaitHeader =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: %s\r\n"
+    "Content-Length: %u\r\n"
+    "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+    "Pragma: no-cache\r\n"
+    "Vary: Accept\r\n"
+    "X-Status-Version: %u\r\n"
+    "\r\n";
+
+static void global_ctx_free(void*)
+{
+    // the global context is the server object, it is not owned by httpd
+}
+
+static void status_work(void *arg)
+{
+    PaxHttpServer* server = (PaxHttpServer *) arg;
+    if (server != nullptr) {
+        server->PublishStatus();
+        server->CheckConnections();
     }
-    return serverQueue;
 }
 
-bool PaxHttpServer::CreateQueue(void)
+static void status_timer_callback(void *arg)
 {
-    if (serverQueue != 0) {
-        xQueueReset(serverQueue);
-        return true;
+    PaxHttpServer* server = (PaxHttpServer *) arg;
+    if (server == nullptr) return;
+
+    httpd_handle_t handle = server->GetServerHandle();
+    if (handle != nullptr) {
+        httpd_queue_work(handle, status_work, server);
     }
+}
 
-    serverQueue = xQueueCreate(queueLength, sizeof(HTTPCommand));
-    if (serverQueue == 0) {
-        ESP_LOGE(TAG, "xQueueCreate");
-        return false;
+// -----------------------------------------------------------------------------
+
+const HTTPRoute PaxHttpServer::baseRoutes[] = {
+    HTTPRoute(HTTP_GET,  "/",             &PaxHttpServer::HandleGet_Index),
+    HTTPRoute(HTTP_GET,  "/index.html",   &PaxHttpServer::HandleGet_Index),
+#ifdef CONFIG_ESP32BM_WEB_USE_favicon
+    HTTPRoute(HTTP_GET,  "/favicon.ico",  &PaxHttpServer::HandleGet_Favicon),
+#endif
+    HTTPRoute(HTTP_GET,  "/info.json",    &PaxHttpServer::HandleGet_InfoJson),
+    HTTPRoute(HTTP_GET,  "/status.json",  &PaxHttpServer::HandleGet_StatusJson),
+    HTTPRoute(HTTP_GET,  "/status/stream", &PaxHttpServer::HandleGet_StatusStream),
+    HTTPRoute(HTTP_GET,  "/metrics",      &PaxHttpServer::HandleGet_Metrics),
+    HTTPRoute(HTTP_GET,  "/config.json",  &PaxHttpServer::HandleGet_ConfigJson),
+    HTTPRoute(HTTP_POST, "/cmd.json",     &PaxHttpServer::HandlePost_CmdJson),
+    HTTPRoute(HTTP_POST, "/cmds.json",    &PaxHttpServer::HandlePost_CmdBatchJson),
+    HTTPRoute(HTTP_POST, "/cmd.bin",      &PaxHttpServer::HandlePost_CmdBin),
+    HTTPRoute(HTTP_POST, "/config.json",  &PaxHttpServer::HandlePost_ConfigJson),
+    HTTPRoute(HTTP_POST, "/update",       &PaxHttpServer::HandlePost_Update),
+};
+const size_t PaxHttpServer::baseRoutesCount = sizeof(PaxHttpServer::baseRoutes) / sizeof(PaxHttpServer::baseRoutes[0]);
+
+// -----------------------------------------------------------------------------
+
+PaxHttpServer::PaxHttpServer(void)
+{
+    serverHandle = nullptr;
+    working = false;
+    customRoutes = nullptr;
+    customRoutesCount = 0;
+    simpleOTA = nullptr;
+    otaSessionActive = false;
+    otaTotal = 0;
+    otaReceived = 0;
+    otaLastTime = 0;
+    otaEncoding = OTAEncoding::unknown;
+    otaAsyncBusy.store(false);
+    otaAsyncReq = nullptr;
+    otaAsyncSockfd = -1;
+    configuration = nullptr;
+    boardInfo = nullptr;
+    statusTimer = nullptr;
+    statusEventLength = 0;
+    statusEventHash = 0;
+    statusEventTime = 0;
+    for (uint8_t i = 0; i < StatusWaitMaxClients; ++i) {
+        statusWaiters[i].sockfd = -1;
     }
-    return true;
+    assetETag[0] = 0;
+    assetCacheControl[0] = 0;
+    configSnapshot.store(nullptr);
+    configWriteMutex = nullptr;
+    configWriteErrors.store(0);
 }
-void PaxHttpServer::DestroyQueue(void)
+
+PaxHttpServer::~PaxHttpServer()
 {
-    if (serverQueue == 0) return;
+    StopServer();
+    commandRing.Destroy();
+}
+
+bool PaxHttpServer::Initialize(void) {
+    return commandRing.Create();
+}
 
-    vQueueDelete(serverQueue);
-    serverQueue = 0;
+HTTPCommandRing* PaxHttpServer::GetCommandRing(void) {
+    if (!commandRing.IsCreated()) {
+        if (!commandRing.Create()) return nullptr;
+    }
+    return &commandRing;
 }
 
 esp_err_t PaxHttpServer::StartServer(ESP32SimpleOTA *sOTA, Configuration *boardConfiguration, BoardInfo *boardInfoIn)
@@ -140,17 +309,59 @@ esp_err_t PaxHttpServer::StartServer(ESP32SimpleOTA *sOTA, Configuration *boardC
         return ESP_ERR_INVALID_ARG;
     }
 
+    SetAssetETag();
+
+    if (!routeIndex.Build(customRoutes, customRoutesCount, baseRoutes, baseRoutesCount)) {
+        ESP_LOGW(TAG, "Not enough memory to index the routes, they are scanned");
+    }
+
+    if (!requestBuffers.Create()) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (configWriteMutex == nullptr) {
+        configWriteMutex = xSemaphoreCreateMutex();
+    }
+    if ((CONFIG_ESP32BM_HTTP_WORKERS > 0) && (configWriteMutex != nullptr)) {
+        BaseType_t coreId = (CONFIG_ESP32BM_HTTP_WORKER_CORE_ID < 0) ? tskNO_AFFINITY : CONFIG_ESP32BM_HTTP_WORKER_CORE_ID;
+        if (workers.Start(CONFIG_ESP32BM_HTTP_WORKERS, CONFIG_ESP32BM_HTTP_WORKER_STACK_SIZE,
+                CONFIG_ESP32BM_HTTP_WORKER_PRIORITY, coreId) != ESP_OK) {
+            ESP_LOGW(TAG, "The slow requests are handled by the server task");
+        }
+    }
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    connections.Configure(config);
+    connections.Clear();
+    metrics.Clear();
+    commandLimiter.Configure(CONFIG_ESP32BM_RATE_CMD_PER_MIN, CONFIG_ESP32BM_RATE_CMD_BURST, CONFIG_ESP32BM_RATE_CLIENT_PERCENT);
+    configLimiter.Configure(CONFIG_ESP32BM_RATE_CONFIG_PER_MIN, CONFIG_ESP32BM_RATE_CONFIG_BURST, CONFIG_ESP32BM_RATE_CLIENT_PERCENT);
 
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.global_user_ctx = this;
+    config.global_user_ctx_free_fn = global_ctx_free;
+    config.open_fn = open_handler;
+    config.close_fn = close_handler;
 
-    esp_err_t err = httpd_start(&serverHandle, &config);
+    esp_err_t err = Start(config);
     if (err != ESP_OK) {
         serverHandle = nullptr;
         ESP_LOGE(TAG, "%d httpd_start", err);
         return err;
     }
 
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    // registered before the wildcard handlers, the handlers are matched in order
+    httpd_uri_t uri_ws;
+    memset(&uri_ws, 0, sizeof(uri_ws));
+    uri_ws.uri = "/ws";
+    uri_ws.method = HTTP_GET;
+    uri_ws.handler = ws_handler;
+    uri_ws.user_ctx = this;
+    uri_ws.is_websocket = true;
+    httpd_register_uri_handler(serverHandle, &uri_ws);
+#endif
+
     httpd_uri_t uri_get = {
         .uri      = "/*",
         .method   = HTTP_GET,
@@ -172,6 +383,22 @@ esp_err_t PaxHttpServer::StartServer(ESP32SimpleOTA *sOTA, Configuration *boardC
 
     working = true;
 
+    statusStream.Clear();
+    statusEventLength = 0;
+    statusTracker.Clear();
+    for (uint8_t i = 0; i < StatusWaitMaxClients; ++i) {
+        statusWaiters[i].sockfd = -1;
+    }
+    if (StartStatusTimer() != ESP_OK) {
+        ESP_LOGW(TAG, "Status stream is not available");
+    }
+
+#ifdef CONFIG_ESP32BM_OTA_PRE_ERASE
+    if (otaPartition.StartPreErase() != ESP_OK) {
+        ESP_LOGW(TAG, "The OTA partition is not erased in advance");
+    }
+#endif
+
     return err;
 }
 
@@ -181,78 +408,241 @@ void PaxHttpServer::StopServer(void)
 
     working = false;
 
+    StopStatusTimer();
+
+    // runs the queued configuration commits, a detached upload is stopped by working
+    // and must complete its request before the server is stopped
+    workers.Stop();
+
+#ifdef CONFIG_ESP32BM_HTTPS
+    httpd_ssl_stop(serverHandle);
+#else
     httpd_stop(serverHandle);
+#endif
     serverHandle = nullptr;
+    statusStream.Clear();
+
+    char *snapshot = configSnapshot.exchange(nullptr);
+    if (snapshot != nullptr) free(snapshot);
+    if (configWriteMutex != nullptr) {
+        vSemaphoreDelete(configWriteMutex);
+        configWriteMutex = nullptr;
+    }
+
+    OTAAbort();
+    otaAsyncBusy.store(false);
+    otaPartition.StopPreErase();
+    requestBuffers.Destroy();
+
+    for (uint8_t i = 0; i < HTTPContentFormatCount; ++i) {
+        infoCache[i].Invalidate();
+        configCache[i].Invalidate();
+    }
+}
+
+esp_err_t PaxHttpServer::Start(const httpd_config_t& config)
+{
+#ifdef CONFIG_ESP32BM_HTTPS
+    httpd_ssl_config_t sslConfig = HTTPD_SSL_CONFIG_DEFAULT();
+    sslConfig.httpd = config;
+    sslConfig.port_secure = CONFIG_ESP32BM_HTTPS_PORT;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+    sslConfig.servercert = servercert_pem_start;
+    sslConfig.servercert_len = servercert_pem_end - servercert_pem_start;
+#else
+    sslConfig.cacert_pem = servercert_pem_start;
+    sslConfig.cacert_len = servercert_pem_end - servercert_pem_start;
+#endif
+    sslConfig.prvtkey_pem = prvtkey_pem_start;
+    sslConfig.prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
+#ifdef CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+    // a client coming back resumes its session instead of a full handshake
+    sslConfig.session_tickets = true;
+#endif
+    return httpd_ssl_start(&serverHandle, &sslConfig);
+#else
+    return httpd_start(&serverHandle, &config);
+#endif
+}
+
+httpd_handle_t PaxHttpServer::GetServerHandle(void)
+{
+    return serverHandle;
+}
+
+void PaxHttpServer::SetCustomRoutes(const HTTPRoute *routes, size_t count)
+{
+    customRoutes = routes;
+    customRoutesCount = (routes == nullptr) ? 0 : count;
+}
+
+const HTTPRoute* PaxHttpServer::FindRoute(httpd_req_t* req)
+{
+    if (routeIndex.IsBuilt()) {
+        return routeIndex.Find(req->method, req->uri);
+    }
+
+    // the index could not be allocated, scan the tables
+    size_t pathLen = 0;
+    uint32_t hash = HTTPRouteHashURI(req->uri, &pathLen);
+
+    for (size_t i = 0; i < customRoutesCount; ++i) {
+        if (customRoutes[i].Matches(req->method, hash, req->uri, pathLen))
+            return &customRoutes[i];
+    }
+    for (size_t i = 0; i < baseRoutesCount; ++i) {
+        if (baseRoutes[i].Matches(req->method, hash, req->uri, pathLen))
+            return &baseRoutes[i];
+    }
+    return nullptr;
 }
 
 esp_err_t PaxHttpServer::HandleRequest(httpd_req_t* req)
 {
     if (req == nullptr) return ESP_FAIL;
 
+    int sockfd = httpd_req_to_sockfd(req);
+    uint32_t receivedBefore = 0, sentBefore = 0;
+#ifdef CONFIG_ESP32BM_HTTPS
+    // the TLS layer may take open_fn, then the connection is seen at its first request
+    if (!connections.Traffic(sockfd, receivedBefore, sentBefore)) {
+        connections.Opened(sockfd);
+    }
+#endif
+    connections.RequestBegin(sockfd);
+    connections.Traffic(sockfd, receivedBefore, sentBefore);
+    int64_t start = esp_timer_get_time();
+
+    const HTTPRoute *route = FindRoute(req);
+    esp_err_t res = DispatchRequest(req, route);
+
+    int64_t duration = esp_timer_get_time() - start;
+    uint32_t received = receivedBefore, sent = sentBefore;
+    connections.Traffic(sockfd, received, sent);
+    metrics.Record(route, res, duration, received - receivedBefore, sent - sentBefore);
+
+    connections.RequestEnd(sockfd);
+    return res;
+}
+
+esp_err_t PaxHttpServer::DispatchRequest(httpd_req_t* req, const HTTPRoute *route)
+{
     if (!working) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Not working");
         return ESP_FAIL;
     }
 
+    if (route != nullptr) {
+        return (this->*(route->handler))(req);
+    }
+
+    esp_err_t res;
     switch (req->method) {
     case HTTP_GET:
-        return HandleGetRequest(req);
+        if (HandleGet_Asset(req, &res)) return res;
+        if (HandleGET_Custom(req, &res)) return res;
+        break;
     case HTTP_POST:
-        return HandlePostRequest(req);
+        if (HandlePOST_Custom(req, &res)) return res;
+        break;
     default:
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Method not implemented");
         return ESP_FAIL;
     }
+
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "404 :)");
+    return ESP_FAIL;
 }
 
-esp_err_t PaxHttpServer::HandleGetRequest(httpd_req_t* req)
+void PaxHttpServer::SetAssetETag(void)
 {
-    if (req == nullptr) return ESP_FAIL;
-
-    std::string str = req->uri;
-    esp_err_t res;
-
-    if (str == "/info.json") {
-        return HandleGet_InfoJson(req);
+    if (CONFIG_ESP32BM_WEB_ASSETS_MAX_AGE > 0) {
+        snprintf(assetCacheControl, sizeof(assetCacheControl), "public, max-age=%d", CONFIG_ESP32BM_WEB_ASSETS_MAX_AGE);
+    }
+    else {
+        strcpy(assetCacheControl, "no-cache");
     }
 
-    if (str == "/status.json") {
-        return HandleGet_StatusJson(req);
+    assetETag[0] = 0;
+    if (boardInfo == nullptr) return;
+
+    // elfSHA256 is written in groups separated by '-', the first 64 bits are enough
+    const size_t hexLen = 16;
+    size_t idx = 0;
+    assetETag[idx++] = '"';
+    for (char c : boardInfo->elfSHA256) {
+        if (c == '-') continue;
+        assetETag[idx++] = c;
+        if (idx > hexLen) break;
     }
+    if (idx <= hexLen) {
+        // no SHA256, no ETag
+        assetETag[0] = 0;
+        return;
+    }
+    assetETag[idx++] = '"';
+    assetETag[idx] = 0;
+}
 
-    if (str == "/config.json") {
-        return HandleGet_ConfigJson(req);
+esp_err_t PaxHttpServer::SendEmbeddedFile(httpd_req_t* req, const uint8_t *start, const uint8_t *end, const char *type, const char *encoding)
+{
+    if (HTTPRequestMatchesETag(req, assetETag)) {
+        return HTTPSendNotModified(req, assetETag, assetCacheControl);
     }
 
-    if ((str == "/") || (str == "/index.html")){
-        res = httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
-        if (res != ESP_OK) return res;
+    esp_err_t res = httpd_resp_set_type(req, type);
+    if (res != ESP_OK) return res;
 
-    #ifdef CONFIG_ESP32BM_WEB_Compressed_index
-        res = httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    if (encoding != nullptr) {
+        res = httpd_resp_set_hdr(req, "Content-Encoding", encoding);
         if (res != ESP_OK) return res;
-
-        return httpd_resp_send(req, (const char *)index_html_gz_start, index_html_gz_end - index_html_gz_start);
-    #else
-        return httpd_resp_send(req, (const char *)index_html_start, index_html_end - index_html_start);
-    #endif
     }
 
-    #ifdef CONFIG_ESP32BM_WEB_USE_favicon
-    if (str == "/favicon.ico"){
-        esp_err_t res = httpd_resp_set_type(req, "image/x-icon");
+    if (assetETag[0] != 0) {
+        res = httpd_resp_set_hdr(req, "ETag", assetETag);
+        if (res != ESP_OK) return res;
+        res = httpd_resp_set_hdr(req, "Cache-Control", assetCacheControl);
         if (res != ESP_OK) return res;
-
-        return httpd_resp_send(req, (const char *)index_html_start, index_html_end - index_html_start);
     }
-    #endif
 
-    if (HandleGET_Custom(req, &res)) {
-        return res;
-    }
+    return httpd_resp_send(req, (const char *)start, end - start);
+}
+
+bool PaxHttpServer::HandleGet_Asset(httpd_req_t* req, esp_err_t *res)
+{
+#ifdef CONFIG_ESP32BM_WEB_ASSET_TABLE
+    const HTTPAsset *asset = HTTPFindAsset(webAssets, webAssetCount, req->uri);
+    if (asset == nullptr) return false;
+
+    *res = HTTPSendAsset(req, *asset, assetCacheControl);
+    return true;
+#else
+    return false;
+#endif
+}
+
+esp_err_t PaxHttpServer::HandleGet_Index(httpd_req_t* req)
+{
+#ifdef CONFIG_ESP32BM_WEB_ASSET_TABLE
+    esp_err_t res;
+    if (HandleGet_Asset(req, &res)) return res;
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "404 :)");
+    return ESP_FAIL;
+#elif defined(CONFIG_ESP32BM_WEB_Compressed_index)
+    return SendEmbeddedFile(req, index_html_gz_start, index_html_gz_end, HTTPD_TYPE_TEXT, "gzip");
+#else
+    return SendEmbeddedFile(req, index_html_start, index_html_end, HTTPD_TYPE_TEXT, nullptr);
+#endif
+}
 
+esp_err_t PaxHttpServer::HandleGet_Favicon(httpd_req_t* req)
+{
+#ifdef CONFIG_ESP32BM_WEB_USE_favicon
+    return SendEmbeddedFile(req, favicon_ico_start, favicon_ico_end, "image/x-icon", nullptr);
+#else
     httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "404 :)");
     return ESP_FAIL;
+#endif
 }
 
 esp_err_t PaxHttpServer::SetJsonHeader(httpd_req_t* req)
@@ -266,362 +656,1685 @@ esp_err_t PaxHttpServer::SetJsonHeader(httpd_req_t* req)
     return httpd_resp_set_hdr(req, "Pragma", "no-cache");
 }
 
-// -----------------------------------------------------------------------------
-
-char* PaxHttpServer::CreateJSONInfoString(bool addWhitespaces)
+esp_err_t PaxHttpServer::SetDocumentHeader(httpd_req_t* req, HTTPContentFormat format)
 {
-    char *str = nullptr;
+    esp_err_t res = SetJsonHeader(req);
+    if (res != ESP_OK) return res;
 
-    if (configuration == nullptr) { return str; }
-    if (boardInfo == nullptr) { return str; }
+    if (format != HTTPContentFormat::json) {
+        res = httpd_resp_set_type(req, HTTPContentFormatType(format));
+        if (res != ESP_OK) return res;
+    }
 
-    cJSON *cfg = cJSON_CreateObject();
+    return httpd_resp_set_hdr(req, "Vary", "Accept");
+}
 
-    if (cJSON_AddStringToObject(cfg, "title", configuration->name.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "tagline", boardInfo->tagline.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
+char* PaxHttpServer::CreateDocument(HTTPContentFormat format, DocumentFunction function, size_t *length, const JSONFieldList *fields)
+{
+    char buffer[JSONWriterBufferSize];
+    JSONStringSink sink;
+    HTTPFormatWriter formatWriter(format, buffer, JSONWriterBufferSize, &sink);
+    JSONFilterWriter filter(formatWriter.Writer(), fields);
+    JSONWriter& writer = (fields != nullptr) ? filter : formatWriter.Writer();
 
-    if (cJSON_AddStringToObject(cfg, "appName", boardInfo->appName.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "appVersion", boardInfo->appVersion.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "link", boardInfo->link.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "compileTime", boardInfo->compileTime.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "idfVersion", boardInfo->idfVersion.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "elfSHA256", boardInfo->elfSHA256.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
-    if (cJSON_AddStringToObject(cfg, "hwInfo", boardInfo->hwInfo.c_str()) == NULL) {
-        cJSON_Delete(cfg);
-        return str;
-    }
+    writer.BeginObject(nullptr);
+    bool res = (this->*function)(writer);
+    writer.EndObject();
 
-    if (addWhitespaces) { str = cJSON_Print(cfg); }
-    else                { str = cJSON_PrintUnformatted(cfg); }
+    if (!res || !writer.Flush()) { return nullptr; }
 
-    cJSON_Delete(cfg);
-    return str;
+    return sink.Release(length);
 }
 
-esp_err_t PaxHttpServer::HandleGet_InfoJson(httpd_req_t* req)
+esp_err_t PaxHttpServer::SendCachedDocument(httpd_req_t* req, HTTPCachedResponse *caches, DocumentFunction function, const char *name)
 {
-    char *str = CreateJSONInfoString(true);
-    if (str == nullptr) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "info.json");
+    if (configuration == nullptr) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "configuration is null");
         return ESP_FAIL;
     }
 
-    esp_err_t res = SetJsonHeader(req);
-    if(res != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "info.json");
+    JSONFieldList fields;
+    if (!fields.ReadQuery(req)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "fields");
+        return ESP_FAIL;
+    }
+
+    HTTPContentFormat format = HTTPAcceptedFormat(req);
+
+    if (!fields.IsEmpty()) {
+        size_t length = 0;
+        char *str = CreateDocument(format, function, &length, &fields);
+        if (str == nullptr) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, name);
+            return ESP_FAIL;
+        }
+        esp_err_t res = SetDocumentHeader(req, format);
+        if (res == ESP_OK) {
+            res = httpd_resp_send(req, str, length);
+        }
         free(str);
         return res;
     }
 
-    res = httpd_resp_sendstr(req, str);
-    free(str);
-    return res;
+    HTTPCachedResponse& cache = caches[(uint8_t)format];
+
+    uint32_t generation = configuration->GetChangeCount();
+    if (!cache.IsValid(generation)) {
+        size_t length = 0;
+        char *str = CreateDocument(format, function, &length);
+        if (str == nullptr) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, name);
+            return ESP_FAIL;
+        }
+        cache.Set(str, length, generation);
+    }
+
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    return cache.Send(req, HTTPContentFormatType(format));
 }
 
 // -----------------------------------------------------------------------------
 
-char* PaxHttpServer::CreateJSONStatusString(bool addWhitespaces)
+bool PaxHttpServer::WriteJSONInfo(JSONWriter& writer)
 {
-    return nullptr;
+    if (configuration == nullptr) { return false; }
+    if (boardInfo == nullptr) { return false; }
+
+    writer.AddString("title", configuration->name);
+    writer.AddString("tagline", boardInfo->tagline);
+
+    writer.AddString("appName", boardInfo->appName);
+    writer.AddString("appVersion", boardInfo->appVersion);
+    writer.AddString("link", boardInfo->link);
+    writer.AddString("compileTime", boardInfo->compileTime);
+    writer.AddString("idfVersion", boardInfo->idfVersion);
+    writer.AddString("elfSHA256", boardInfo->elfSHA256);
+    writer.AddString("hwInfo", boardInfo->hwInfo);
+
+    return writer.IsOK();
 }
 
-esp_err_t PaxHttpServer::HandleGet_StatusJson(httpd_req_t* req)
+char* PaxHttpServer::CreateJSONInfoString(size_t *length)
 {
-    char *str = CreateJSONStatusString(true);
-    if (str == nullptr) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "status.json");
-        return ESP_FAIL;
-    }
-
-    esp_err_t res = SetJsonHeader(req);
-    if(res != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "status.json");
-        free(str);
-        return res;
-    }
+    return CreateDocument(HTTPContentFormat::json, &PaxHttpServer::WriteJSONInfo, length);
+}
 
-    res = httpd_resp_sendstr(req, str);
-    free(str);
-    return res;
+esp_err_t PaxHttpServer::HandleGet_InfoJson(httpd_req_t* req)
+{
+    return SendCachedDocument(req, infoCache, &PaxHttpServer::WriteJSONInfo, "info.json");
 }
 
 // -----------------------------------------------------------------------------
 
-esp_err_t PaxHttpServer::HandleGet_ConfigJson(httpd_req_t* req)
+bool PaxHttpServer::WriteJSONStatus(JSONWriter&)
 {
-    if (configuration == nullptr) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "configuration is null");
-        return ESP_FAIL;
-    }
+    return false;
+}
 
-    char *str = configuration->CreateJSONConfigString(true);
-    if (str == nullptr) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "config.json");
+esp_err_t PaxHttpServer::HandleGet_StatusJson(httpd_req_t* req)
+{
+    JSONFieldList fields;
+    if (!fields.ReadQuery(req)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "fields");
         return ESP_FAIL;
     }
 
-    esp_err_t res = SetJsonHeader(req);
-    if(res != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "config.json");
-        free(str);
-        return res;
+    // used in place, the query is not limited by a buffer
+    uint32_t since = 0;
+    uint32_t waitTime = 0;
+    const char *query = HTTPQueryString(req->uri);
+    if (query != nullptr) {
+        QueryUInt32(query, "since", since);
+        QueryUInt32(query, "wait", waitTime);
     }
 
-    res = httpd_resp_sendstr(req, str);
-    free(str);
-    return res;
-}
-
-// -----------------------------------------------------------------------------
+    HTTPContentFormat format = HTTPAcceptedFormat(req);
 
-esp_err_t PaxHttpServer::HandlePostRequest(httpd_req_t* req)
-{
-    if (req == nullptr) return ESP_FAIL;
+    // a full document does not need the current version, the one sent may be older
+    // and a delta since it then repeats some members
+    if ((since > 0) || (waitTime > 0)) {
+        RefreshStatusVersion();
+    }
+    if ((waitTime > 0) && !statusTracker.AnyChanged(since, &fields)) {
+        // if there is no free slot the unchanged version is sent now
+        if (WaitForStatus(req, since, waitTime, format)) return ESP_OK;
+    }
 
-    std::string str = req->uri;
-    esp_err_t res;
+    char version[12];
+    snprintf(version, sizeof(version), "%u", (unsigned)statusTracker.Version());
 
-    if (str == "/cmd.json") {
-        return HandlePost_CmdJson(req);
+    esp_err_t res = SetDocumentHeader(req, format);
+    if (res == ESP_OK) {
+        res = httpd_resp_set_hdr(req, "X-Status-Version", version);
     }
-
-    if (str == "/config.json") {
-        return HandlePost_ConfigJson(req);
+    if (res != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "status.json");
+        return res;
     }
 
-    if (str == "/update") {
-        res = HandleOTA(req);
-        if (res == ESP_OK) {
-            httpd_resp_sendstr(req, "OTA OK.");
-        }
-        else {
-            httpd_resp_sendstr(req, "OTA Failed !");
+    char buffer[JSONWriterBufferSize];
+    HTTPChunkSink sink(req);
+    HTTPFormatWriter formatWriter(format, buffer, JSONWriterBufferSize, &sink);
+    HTTPStatusDeltaWriter writer(formatWriter.Writer(), &fields, statusTracker, since);
+
+    writer.BeginObject(nullptr);
+    bool ok = WriteJSONStatus(writer);
+    writer.EndObject();
+
+    if (ok) {
+        ok = writer.Flush();
+        if (ok) {
+            return sink.Finish() ? ESP_OK : ESP_FAIL;
         }
-        return res;
     }
 
-    if (HandlePOST_Custom(req, &res)) {
-        return res;
+    if (writer.BytesFlushed() == 0) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "status.json");
     }
-
-    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "404 :)");
+    // else the response is already started, returning ESP_FAIL closes the connection
     return ESP_FAIL;
 }
 
-esp_err_t PaxHttpServer::HandlePost_CmdJson(httpd_req_t* req)
+void PaxHttpServer::RefreshStatusVersion(void)
 {
-    size_t totalLen = req->content_len;
-    size_t curLen = 0;
-    size_t recLen = 0;
+    statusTracker.Begin();
+    statusTracker.BeginObject(nullptr);
+    bool res = WriteJSONStatus(statusTracker);
+    statusTracker.EndObject();
+    statusTracker.Commit(res);
+}
 
-    if (totalLen >= workBufferSize) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cmd content too long");
-        return ESP_FAIL;
-    }
-    while (curLen < totalLen) {
-        recLen = httpd_req_recv(req, &workBuffer[curLen], totalLen - curLen);
-        if (recLen <= 0) {
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to receive data");
-            return ESP_FAIL;
+char* PaxHttpServer::CreateStatusDocument(HTTPContentFormat format, const JSONFieldList *fields, uint32_t since, size_t *length)
+{
+    char buffer[JSONWriterBufferSize];
+    JSONStringSink sink;
+    HTTPFormatWriter formatWriter(format, buffer, JSONWriterBufferSize, &sink);
+    HTTPStatusDeltaWriter writer(formatWriter.Writer(), fields, statusTracker, since);
+
+    writer.BeginObject(nullptr);
+    bool res = WriteJSONStatus(writer);
+    writer.EndObject();
+
+    if (!res || !writer.Flush()) { return nullptr; }
+
+    return sink.Release(length);
+}
+
+bool PaxHttpServer::WaitForStatus(httpd_req_t* req, uint32_t since, uint32_t waitTime, HTTPContentFormat format)
+{
+    int sockfd = httpd_req_to_sockfd(req);
+    if (sockfd < 0) return false;
+
+    HTTPStatusWaiter *waiter = nullptr;
+    for (uint8_t i = 0; i < StatusWaitMaxClients; ++i) {
+        if (statusWaiters[i].sockfd < 0) {
+            waiter = &statusWaiters[i];
+            break;
         }
-        curLen += recLen;
     }
-    workBuffer[totalLen] = '\0';
+    if (waiter == nullptr) return false;
 
-    HTTPCommand cmd;
+    // the list of the request points in its own buffer, the waiter needs a copy
+    if (!waiter->fields.ReadQuery(req)) return false;
+
+    if (waitTime > StatusWaitMaxTime) waitTime = StatusWaitMaxTime;
+
+    waiter->sockfd = sockfd;
+    waiter->since = since;
+    waiter->deadline = esp_timer_get_time() + (int64_t)waitTime * 1000;
+    waiter->format = format;
+
+    // the response is sent later, by AnswerStatusWaiters, the connection has no deadline until then
+    connections.SetStreaming(sockfd);
+    return true;
+}
+
+void PaxHttpServer::AnswerStatusWaiters(void)
+{
+    bool waiting = false;
+    for (uint8_t i = 0; i < StatusWaitMaxClients; ++i) {
+        if (statusWaiters[i].sockfd >= 0) waiting = true;
+    }
+    if (!waiting) return;
+
+    RefreshStatusVersion();
+
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < StatusWaitMaxClients; ++i) {
+        HTTPStatusWaiter& waiter = statusWaiters[i];
+        if (waiter.sockfd < 0) continue;
+
+        if ((now >= waiter.deadline) || statusTracker.AnyChanged(waiter.since, &waiter.fields)) {
+            AnswerStatusWaiter(waiter);
+        }
+    }
+}
 
-    cJSON *root = cJSON_Parse(workBuffer);
-    if (root == nullptr) {
-        const char *errStr = cJSON_GetErrorPtr();
-        if (errStr != nullptr) {
-            ESP_LOGE(TAG, "JSON error before: \"%s\"", errStr);
+void PaxHttpServer::AnswerStatusWaiter(HTTPStatusWaiter& waiter)
+{
+    int sockfd = waiter.sockfd;
+    waiter.sockfd = -1;
+
+    bool sent = false;
+    size_t length = 0;
+    char *body = CreateStatusDocument(waiter.format, &waiter.fields, waiter.since, &length);
+    if (body != nullptr) {
+        char header[256];
+        int len = snprintf(header, sizeof(header), statusWaitHeader,
+            HTTPContentFormatType(waiter.format), (unsigned)length, (unsigned)statusTracker.Version());
+
+        // like the events, a response which can not be sent at once closes the connection
+        if ((len > 0) && ((size_t)len < sizeof(header))) {
+            sent = (httpd_socket_send(serverHandle, sockfd, header, len, MSG_DONTWAIT) == len) &&
+                   (httpd_socket_send(serverHandle, sockfd, body, length, MSG_DONTWAIT) == (int)length);
         }
+        free(body);
+    }
+
+    if (sent) {
+        connections.EndStreaming(sockfd);
     }
     else {
-        cJSON *item;
+        ESP_LOGW(TAG, "Closing waiting status request %d", sockfd);
+        httpd_sess_trigger_close(serverHandle, sockfd);
+    }
+}
 
-        item = cJSON_GetObjectItem(root, "cmd");
-        if (item != nullptr) {
-            if (cJSON_IsNumber(item)) {
-                cmd.command = (uint8_t)item->valueint;
-            }
+void PaxHttpServer::RemoveStatusWaiter(int sockfd)
+{
+    for (uint8_t i = 0; i < StatusWaitMaxClients; ++i) {
+        if (statusWaiters[i].sockfd == sockfd) {
+            statusWaiters[i].sockfd = -1;
         }
+    }
+}
 
-        item = cJSON_GetObjectItem(root, "data");
-        if (item != nullptr) {
-            if (cJSON_IsNumber(item)) {
-                cmd.data = (uint32_t)item->valuedouble;
-            }
-            else {
-                if (cJSON_IsString(item)) {
-                    if (item->valuestring != nullptr)
-                        cmd.data = (uint32_t)strtoul(item->valuestring, nullptr, 10);
-                }
-            }
+void PaxHttpServer::NotifyStatusChanged(void)
+{
+    httpd_handle_t handle = serverHandle;
+    if (handle != nullptr) {
+        httpd_queue_work(handle, status_work, this);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+esp_err_t PaxHttpServer::StartStatusTimer(void)
+{
+    if (statusTimer == nullptr) {
+        esp_timer_create_args_t args = {};
+        args.callback = status_timer_callback;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "statusStream";
+
+        esp_err_t err = esp_timer_create(&args, &statusTimer);
+        if (err != ESP_OK) {
+            statusTimer = nullptr;
+            ESP_LOGE(TAG, "0x%x esp_timer_create", err);
+            return err;
         }
+    }
+
+    return esp_timer_start_periodic(statusTimer, (uint64_t)CONFIG_ESP32BM_SSE_INTERVAL_MS * 1000);
+}
+
+void PaxHttpServer::StopStatusTimer(void)
+{
+    if (statusTimer == nullptr) return;
+
+    esp_timer_stop(statusTimer);
+    esp_timer_delete(statusTimer);
+    statusTimer = nullptr;
+}
+
+size_t PaxHttpServer::CreateStatusEvent(void)
+{
+    const char prefix[] = "data: ";
+    const size_t prefixLen = sizeof(prefix) - 1;
+    const size_t suffixLen = 2;
+
+    memcpy(statusEvent, prefix, prefixLen);
+
+    char buffer[JSONWriterBufferSize];
+    JSONBufferSink sink(statusEvent + prefixLen, CONFIG_ESP32BM_SSE_EVENT_SIZE - prefixLen - suffixLen);
+    JSONWriter writer(buffer, JSONWriterBufferSize, &sink);
+
+    writer.BeginObject(nullptr);
+    bool res = WriteJSONStatus(writer);
+    writer.EndObject();
+    if (!res || !writer.Flush()) return 0;
+
+    // compact JSON has no new lines so it is a single data line
+    size_t len = prefixLen + sink.Length();
+    statusEvent[len++] = '\n';
+    statusEvent[len++] = '\n';
+    return len;
+}
 
-        cJSON_Delete(root);
-        root = nullptr;
+bool PaxHttpServer::RefreshStatusEvent(bool& changed)
+{
+    changed = false;
+
+    size_t len = CreateStatusEvent();
+    if (len == 0) {
+        // statusEvent was overwritten, the next valid event will be sent
+        statusEventLength = 0;
+        return false;
     }
 
-    httpd_resp_set_type(req, "text/plain");
-    httpd_resp_set_hdr(req, "Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
-    httpd_resp_set_hdr(req, "Pragma", "no-cache");
+    uint32_t hash = HTTPContentHash(statusEvent, len);
+    if ((hash != statusEventHash) || (statusEventLength != len)) {
+        statusEventHash = hash;
+        statusEventLength = len;
+        statusEventTime = esp_timer_get_time();
+        changed = true;
+    }
+    return true;
+}
 
-    if (cmd.command == 0) {
-        httpd_resp_sendstr(req, "Command ignored");
-        return ESP_FAIL;
+void PaxHttpServer::PublishStatus(void)
+{
+    if (serverHandle == nullptr) return;
+
+    AnswerStatusWaiters();
+
+    if (statusStream.Count() == 0) return;
+
+    bool changed;
+    if (!RefreshStatusEvent(changed)) return;
+
+    if (changed) {
+        statusStream.Send(serverHandle, statusEvent, statusEventLength);
+        return;
     }
 
-    httpd_resp_sendstr(req, "Command processed");
+    int64_t now = esp_timer_get_time();
+    if (now - statusEventTime >= (int64_t)CONFIG_ESP32BM_SSE_KEEPALIVE_S * 1000000) {
+        const char keepalive[] = ": keepalive\n\n";
+        statusEventTime = now;
+        statusStream.Send(serverHandle, keepalive, sizeof(keepalive) - 1);
+    }
+}
+
+esp_err_t PaxHttpServer::SocketOpened(httpd_handle_t handle, int sockfd)
+{
+    connections.Opened(sockfd);
+#ifndef CONFIG_ESP32BM_HTTPS
+    // a secure session already has the functions of the TLS layer, its traffic is not counted
+    httpd_sess_set_recv_override(handle, sockfd, recv_override);
+    httpd_sess_set_send_override(handle, sockfd, send_override);
+#endif
+    return ESP_OK;
+}
+
+void PaxHttpServer::SocketClosed(int sockfd)
+{
+    connections.Closed(sockfd);
+    statusStream.Unsubscribe(sockfd);
+    RemoveStatusWaiter(sockfd);
+    requestBuffers.ReleaseSocket(sockfd);
+}
+
+int PaxHttpServer::SocketRecv(int sockfd, char *buf, size_t length, int flags)
+{
+    if (!connections.CanReceive(sockfd)) return HTTPD_SOCK_ERR_FAIL;
+
+    // same as the default function of the server
+    int res = recv(sockfd, buf, length, flags);
+    if (res < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return HTTPD_SOCK_ERR_TIMEOUT;
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    connections.Received(sockfd, res);
+    return res;
+}
+
+int PaxHttpServer::SocketSend(int sockfd, const char *buf, size_t length, int flags)
+{
+    int res = send(sockfd, buf, length, flags);
+    if (res < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return HTTPD_SOCK_ERR_TIMEOUT;
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    connections.Sent(sockfd, res);
+    return res;
+}
+
+void PaxHttpServer::CheckConnections(void)
+{
+    connections.Evict(serverHandle);
+}
+
+esp_err_t PaxHttpServer::HandleGet_StatusStream(httpd_req_t* req)
+{
+    esp_err_t res = statusStream.Subscribe(req);
+    if (res == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        httpd_resp_sendstr(req, "Too many status subscribers");
+        return ESP_OK;
+    }
+    if (res != ESP_OK) return res;
+    connections.SetStreaming(httpd_req_to_sockfd(req));
 
-    if (serverQueue != 0) {
-        xQueueSendToBack(serverQueue, &cmd, (TickType_t)0);
+    // the new subscriber gets the current status at once
+    bool changed;
+    if (RefreshStatusEvent(changed)) {
+        if (changed) {
+            statusStream.Send(serverHandle, statusEvent, statusEventLength);
+        }
+        else {
+            statusStream.SendTo(serverHandle, httpd_req_to_sockfd(req), statusEvent, statusEventLength);
+        }
     }
 
+    // the response stays open, the next events are sent by PublishStatus
     return ESP_OK;
 }
 
-esp_err_t PaxHttpServer::HandlePost_ConfigJson(httpd_req_t* req)
+// -----------------------------------------------------------------------------
+
+esp_err_t PaxHttpServer::HandleGet_Metrics(httpd_req_t* req)
 {
-    size_t totalLen = req->content_len;
-    size_t curLen = 0;
-    size_t recLen = 0;
+    esp_err_t res = httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    if (res != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "metrics");
+        return res;
+    }
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    char buffer[HTTPMetricsBufferSize];
+    HTTPChunkSink sink(req);
+    HTTPMetricsText text(buffer, HTTPMetricsBufferSize, &sink);
+
+    metrics.Write(text);
+
+    text.Describe("esp32bm_http_connections", "gauge", "Open connections");
+    text.Printf("esp32bm_http_connections %u\n", (unsigned)connections.OpenCount());
+    text.Describe("esp32bm_http_connections_opened_total", "counter", "Connections accepted");
+    text.Printf("esp32bm_http_connections_opened_total %u\n", (unsigned)connections.OpenedCount());
+    text.Describe("esp32bm_http_connections_evicted_total", "counter", "Slow or idle connections closed by the server");
+    text.Printf("esp32bm_http_connections_evicted_total %u\n", (unsigned)connections.EvictedCount());
+    text.Describe("esp32bm_http_request_buffers_exhausted_total", "counter", "Requests rejected for lack of a request buffer");
+    text.Printf("esp32bm_http_request_buffers_exhausted_total %u\n", (unsigned)requestBuffers.ExhaustedCount());
+
+    text.Describe("esp32bm_http_rate_limited_total", "counter", "Requests rejected with 429, by endpoint");
+    text.Printf("esp32bm_http_rate_limited_total{endpoint=\"cmd\"} %u\n", (unsigned)commandLimiter.RejectedCount());
+    text.Printf("esp32bm_http_rate_limited_total{endpoint=\"config\"} %u\n", (unsigned)configLimiter.RejectedCount());
+    text.Describe("esp32bm_commands_dropped_total", "counter", "Commands dropped because the queue was full");
+    text.Printf("esp32bm_commands_dropped_total %u\n", (unsigned)commandRing.DroppedCount());
+    text.Describe("esp32bm_commands_queued", "gauge", "Commands waiting in the queue, by lane");
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        text.Printf("esp32bm_commands_queued{lane=\"%u\"} %u\n", (unsigned)lane, (unsigned)commandRing.Occupancy(lane));
+    }
+    text.Describe("esp32bm_commands_queued_max", "gauge", "Most commands waiting in the queue, by lane");
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        text.Printf("esp32bm_commands_queued_max{lane=\"%u\"} %u\n", (unsigned)lane, (unsigned)commandRing.HighWaterMark(lane));
+    }
+    text.Describe("esp32bm_command_payload_blocks", "gauge", "Payload blocks in use");
+    text.Printf("esp32bm_command_payload_blocks %u\n", (unsigned)commandRing.PayloadBlocksUsed());
+    text.Describe("esp32bm_command_payload_blocks_max", "gauge", "Most payload blocks in use");
+    text.Printf("esp32bm_command_payload_blocks_max %u\n", (unsigned)commandRing.PayloadHighWaterMark());
+
+    text.Describe("esp32bm_http_workers_busy", "gauge", "Workers running a job");
+    text.Printf("esp32bm_http_workers_busy %u\n", (unsigned)workers.BusyCount());
+    text.Describe("esp32bm_http_work_pending", "gauge", "Jobs waiting for a worker");
+    text.Printf("esp32bm_http_work_pending %u\n", (unsigned)workers.PendingCount());
+    text.Describe("esp32bm_http_work_completed_total", "counter", "Jobs run by the workers");
+    text.Printf("esp32bm_http_work_completed_total %u\n", (unsigned)workers.CompletedCount());
+    text.Describe("esp32bm_config_write_errors_total", "counter", "Background configuration commits which failed");
+    text.Printf("esp32bm_config_write_errors_total %u\n", (unsigned)configWriteErrors.load());
+
+    text.Describe("esp32bm_free_heap_bytes", "gauge", "Free heap memory");
+    text.Printf("esp32bm_free_heap_bytes %u\n", (unsigned)esp_get_free_heap_size());
+    text.Describe("esp32bm_min_free_heap_bytes", "gauge", "Lowest free heap memory since boot");
+    text.Printf("esp32bm_min_free_heap_bytes %u\n", (unsigned)esp_get_minimum_free_heap_size());
+    text.Describe("esp32bm_uptime_seconds", "counter", "Time since boot");
+    text.Printf("esp32bm_uptime_seconds %u\n", (unsigned)(esp_timer_get_time() / 1000000));
+
+    WriteMetrics_Custom(text);
+
+    if (!text.Flush()) return ESP_FAIL;
+    return sink.Finish() ? ESP_OK : ESP_FAIL;
+}
 
-    if (totalLen >= workBufferSize) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "config content too long");
-        return ESP_FAIL;
+bool PaxHttpServer::WriteJSONConfig(JSONWriter& writer)
+{
+    if (configuration == nullptr) { return false; }
+    // the passwords are not sent, a client which posts the configuration back keeps them
+    return configuration->WriteJSON(writer, false);
+}
+
+esp_err_t PaxHttpServer::HandleGet_ConfigJson(httpd_req_t* req)
+{
+    return SendCachedDocument(req, configCache, &PaxHttpServer::WriteJSONConfig, "config.json");
+}
+
+// -----------------------------------------------------------------------------
+
+esp_err_t PaxHttpServer::ReceiveJSON(httpd_req_t* req, RequestBuffer& buffer, JSONReader& reader)
+{
+    if (buffer.data == nullptr) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_sendstr(req, "No free request buffer");
+        return ESP_ERR_NO_MEM;
     }
-    while (curLen < totalLen) {
-        recLen = httpd_req_recv(req, &workBuffer[curLen], totalLen - curLen);
+
+    // the body is parsed as received so its length is not limited by the buffer size
+    size_t remaining = req->content_len;
+    bool parsing = true;
+    while (remaining > 0) {
+        size_t len = (remaining < buffer.size) ? remaining : buffer.size;
+        int recLen = httpd_req_recv(req, buffer.data, len);
+        if (recLen == HTTPD_SOCK_ERR_TIMEOUT) continue;
         if (recLen <= 0) {
             httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to receive data");
             return ESP_FAIL;
         }
-        curLen += recLen;
+        remaining -= recLen;
+
+        // after an error the rest of the body is read and discarded
+        if (parsing) {
+            parsing = reader.Feed(buffer.data, recLen);
+        }
     }
-    workBuffer[totalLen] = '\0';
 
-    if (configuration == nullptr) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "configuration is null");
-        return ESP_FAIL;
+    return reader.Finish() ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief Reads a decimal string, like "4000000000", as an unsigned 32 bit integer
+ */
+static bool StringToUInt32(const JSONValue& value, uint32_t& result)
+{
+    if ((value.type != JSONValueType::string) || (value.length == 0)) return false;
+    // strtoul accepts, and negates, a leading '-'
+    if ((value.text[0] < '0') || (value.text[0] > '9')) return false;
+
+    char *end = nullptr;
+    errno = 0;
+    unsigned long val = strtoul(value.text, &end, 10);
+    if ((end != value.text + value.length) || (errno != 0) || (val > UINT32_MAX)) return false;
+    result = (uint32_t)val;
+    return true;
+}
+
+/**
+ * @brief Sets a HTTPCommand from a member, `cmd`, `data` or `lane`, of a cmd.json object
+ *
+ * Returns false if the value of a known member is out of its range or is not an integer,
+ * `data` may also be a string of decimal digits. Other members are ignored.
+ */
+static bool SetCommandMember(HTTPCommand& cmd, const char *key, const JSONValue& value)
+{
+    uint32_t val;
+    if (strcmp(key, "cmd") == 0) {
+        if (!value.ToUInt32(val) || (val > UINT8_MAX)) return false;
+        cmd.command = (uint8_t)val;
+    }
+    else if (strcmp(key, "lane") == 0) {
+        if (!value.ToUInt32(val) || (val >= HTTPCommandLanes)) return false;
+        cmd.lane = (uint8_t)val;
     }
+    else if (strcmp(key, "data") == 0) {
+        // ToUInt32 takes only the numbers with an integer value in [0, UINT32_MAX]
+        if (!value.ToUInt32(val) && !StringToUInt32(value, val)) return false;
+        cmd.data = val;
+    }
+    return true;
+}
 
-    bool res = configuration->SetFromJSONString(workBuffer);
-    if (!res) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to process data");
+class HTTPCommandReader : public JSONReaderHandler
+{
+public:
+    HTTPCommandReader(HTTPCommand& command) : cmd(command) {}
+
+    virtual bool OnValue(uint8_t depth, const char *key, const JSONValue& value)
+    {
+        if ((depth != 1) || (key == nullptr)) return true;
+
+        return SetCommandMember(cmd, key, value);
+    }
+
+protected:
+    HTTPCommand& cmd;
+};
+
+/**
+ * @brief Reads an array of command objects
+ *
+ * Each element is an entry, the ones which are not objects get command 0 so they are ignored.
+ * Fails if the top value is not an array or if it has more than maxCount elements.
+ */
+class HTTPBatchReader : public JSONReaderHandler
+{
+public:
+    HTTPBatchReader(HTTPCommand *commands, uint8_t maxCount) :
+        cmds(commands), max(maxCount), count(0), tooMany(false), inEntry(false), entryIsObject(false), entryIsValid(false) {}
+
+    virtual bool OnBegin(uint8_t depth, const char *key, bool isArray)
+    {
+        if (depth == 1) return isArray;
+        if (depth == 2) {
+            if (!NewEntry()) return false;
+            inEntry = true;
+            entryIsObject = !isArray;
+            entryIsValid = true;
+        }
+        return true;
+    }
+
+    virtual bool OnEnd(uint8_t depth, bool isArray)
+    {
+        if ((depth == 2) && inEntry) {
+            inEntry = false;
+            // an entry with an invalid value is ignored, like the entries which are not objects
+            if (!entryIsValid) cmds[count].command = 0;
+            ++count;
+        }
+        return true;
+    }
+
+    virtual bool OnValue(uint8_t depth, const char *key, const JSONValue& value)
+    {
+        if (depth == 0) return false; // not an array
+        if (depth == 1) {
+            if (!NewEntry()) return false;
+            ++count;
+            return true;
+        }
+        if ((depth == 2) && inEntry && entryIsObject && (key != nullptr)) {
+            if (!SetCommandMember(cmds[count], key, value)) entryIsValid = false;
+        }
+        return true;
+    }
+
+    uint8_t Count(void) { return count; }
+    bool TooMany(void) { return tooMany; }
+
+protected:
+    HTTPCommand *cmds;
+    uint8_t max;
+    uint8_t count;
+    bool tooMany;
+    bool inEntry;
+    bool entryIsObject;
+    bool entryIsValid;
+
+    bool NewEntry(void)
+    {
+        if (count >= max) {
+            tooMany = true;
+            return false;
+        }
+        cmds[count] = HTTPCommand();
+        cmds[count].id = count;
+        return true;
+    }
+};
+
+esp_err_t PaxHttpServer::HandlePost_CmdJson(httpd_req_t* req)
+{
+    uint32_t retryAfter;
+    if (!commandLimiter.Admit(req, &retryAfter)) {
+        // the unread body is discarded by the server
+        return HTTPSendTooManyRequests(req, retryAfter);
+    }
+
+    HTTPCommand cmd;
+    HTTPCommandReader handler(cmd);
+    JSONReader reader(&handler);
+
+    RequestBuffer buffer(requestBuffers, httpd_req_to_sockfd(req));
+    esp_err_t res = ReceiveJSON(req, buffer, reader);
+    if (res == ESP_ERR_INVALID_ARG) {
+        ESP_LOGE(TAG, "Invalid JSON command");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON command");
         return ESP_FAIL;
     }
+    else if (res != ESP_OK) return ESP_FAIL;
 
-    esp_err_t err = configuration->WriteToNVS(false);
-    if (err != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to process data");
+    if (cmd.command == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Command ignored");
         return ESP_FAIL;
     }
 
     httpd_resp_set_type(req, "text/plain");
     httpd_resp_set_hdr(req, "Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
     httpd_resp_set_hdr(req, "Pragma", "no-cache");
+
+    if (!QueueCommand(cmd)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_sendstr(req, "Command queue full");
+        return ESP_FAIL;
+    }
+
     httpd_resp_sendstr(req, "Command processed");
     return ESP_OK;
 }
 
-// -----------------------------------------------------------------------------
-
-bool PaxHttpServer::HandleGET_Custom(httpd_req_t *req, esp_err_t *res)
+esp_err_t PaxHttpServer::HandlePost_CmdBatchJson(httpd_req_t* req)
 {
-    return false;
-}
+    // a batch takes one token, it replaces many requests
+    uint32_t retryAfter;
+    if (!commandLimiter.Admit(req, &retryAfter)) {
+        return HTTPSendTooManyRequests(req, retryAfter);
+    }
 
-bool PaxHttpServer::HandlePOST_Custom(httpd_req_t *req, esp_err_t *res)
-{
-    return false;
-}
+    // the batch is on the stack of the server task, with the JSON buffer of the response
+    static_assert(batchLength * (sizeof(HTTPCommand) + 1) <= 1024, "The command batch is too large for the stack");
+    HTTPCommand cmds[batchLength];
+    HTTPBatchReader handler(cmds, batchLength);
+    JSONReader reader(&handler);
+
+    RequestBuffer buffer(requestBuffers, httpd_req_to_sockfd(req));
+    esp_err_t res = ReceiveJSON(req, buffer, reader);
+    if (res == ESP_ERR_INVALID_ARG) {
+        if (handler.TooMany()) {
+            httpd_resp_set_status(req, "413 Payload Too Large");
+            httpd_resp_sendstr(req, "Too many commands");
+        }
+        else {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON command array");
+        }
+        return ESP_FAIL;
+    }
+    else if (res != ESP_OK) return ESP_FAIL;
+
+    uint8_t status[batchLength];
+    uint8_t valid = 0;
+    for (uint8_t i = 0; i < handler.Count(); ++i) {
+        status[i] = (cmds[i].command == 0) ? WSAckIgnored : WSAckQueued;
+        if (cmds[i].command != 0) {
+            // keep the valid commands together, in order
+            cmds[valid++] = cmds[i];
+        }
+    }
 
-// -----------------------------------------------------------------------------
+    // a batch is queued in a single lane
+    for (uint8_t i = 1; i < valid; ++i) {
+        if (cmds[i].lane != cmds[0].lane) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "All commands of a batch must use the same lane");
+            return ESP_FAIL;
+        }
+    }
 
-esp_err_t PaxHttpServer::HandleOTA(httpd_req_t* req)
-{
-    const size_t buffSize = 1024;
-    char buff[buffSize];
-    int pageLen = req->content_len;
-    int rxLen;
-    bool headerReceived = false;
-    bool done = false;
-    esp_err_t result = ESP_OK;
+    bool queued = QueueCommands(cmds, valid);
+    if (!queued) {
+        for (uint8_t i = 0; i < handler.Count(); ++i) {
+            if (status[i] == WSAckQueued) status[i] = WSAckQueueFull;
+        }
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+    }
 
-    if (simpleOTA == nullptr) {
-        ESP_LOGE(TAG, "OTA is null !");
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "OTA is not available !");
-        return ESP_FAIL;
+    res = SetJsonHeader(req);
+    if (res != ESP_OK) return res;
+
+    char jsonBuffer[JSONWriterBufferSize];
+    HTTPChunkSink sink(req);
+    JSONWriter writer(jsonBuffer, JSONWriterBufferSize, &sink);
+
+    writer.BeginObject(nullptr);
+    writer.AddUInt("queued", queued ? valid : 0);
+    writer.BeginArray("status");
+    for (uint8_t i = 0; i < handler.Count(); ++i) {
+        writer.AddUInt(nullptr, status[i]);
     }
+    writer.EndArray();
+    writer.EndObject();
 
-    if (pageLen > simpleOTA->GetMaxImageSize()) {
-        ESP_LOGE(TAG, "OTA content is too big (%d bytes) !", pageLen);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "OTA content is too big !");
+    if (!writer.Flush() || !sink.Finish()) return ESP_FAIL;
+    return queued ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t PaxHttpServer::HandlePost_CmdBin(httpd_req_t* req)
+{
+    uint32_t retryAfter;
+    if (!commandLimiter.Admit(req, &retryAfter)) {
+        return HTTPSendTooManyRequests(req, retryAfter);
+    }
+
+    // used in place, the query is not limited by a buffer
+    HTTPCommand cmd;
+    uint32_t val;
+    const char *query = HTTPQueryString(req->uri);
+    if ((query == nullptr) || !QueryUInt32(query, "cmd", val) || (val == 0) || (val > 0xFF)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "cmd is required");
         return ESP_FAIL;
     }
+    cmd.command = (uint8_t)val;
+    if (QueryUInt32(query, "data", val)) {
+        cmd.data = val;
+    }
+    if (QueryUInt32(query, "lane", val) && (val < HTTPCommandLanes)) {
+        cmd.lane = (uint8_t)val;
+    }
 
-    while (!done) {
-        size_t reqLen = pageLen > buffSize ? buffSize : pageLen;
-        rxLen = httpd_req_recv(req, buff, reqLen);
-        if (rxLen < 0) {
-            if (rxLen != HTTPD_SOCK_ERR_TIMEOUT) {
-                ESP_LOGE(TAG, "httpd_req_recv: %d", rxLen);
+    if (req->content_len > 0) {
+        if (!commandRing.AllocPayload(req->content_len, cmd.payload)) {
+            bool tooLarge = req->content_len > HTTPPayloadBlockSize * HTTPPayloadBlockCount;
+            httpd_resp_set_status(req, tooLarge ? "413 Payload Too Large" : "503 Service Unavailable");
+            if (!tooLarge) httpd_resp_set_hdr(req, "Retry-After", "1");
+            httpd_resp_sendstr(req, "No room for the payload");
+            return ESP_FAIL;
+        }
+
+        // received in place, the consumer reads it from the same blocks
+        size_t received = 0;
+        while (received < cmd.payload.length) {
+            int recLen = httpd_req_recv(req, (char *)cmd.payload.data + received, cmd.payload.length - received);
+            if (recLen == HTTPD_SOCK_ERR_TIMEOUT) continue;
+            if (recLen <= 0) {
+                commandRing.FreePayload(cmd.payload);
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to receive data");
                 return ESP_FAIL;
             }
+            received += recLen;
         }
-        else if (rxLen == 0) {
-            done = true;
-        }
-        else { /* rxLen > 0 */
-            if (!headerReceived) {
-                headerReceived = true;
+    }
 
-                result = simpleOTA->Begin();
-                if (result != ESP_OK) { return result; }
-            }
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
 
-            result = simpleOTA->Write(buff, rxLen);
-            if (result != ESP_OK) { return result; }
+    if (!QueueCommand(cmd)) {
+        commandRing.FreePayload(cmd.payload);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_sendstr(req, "Command queue full");
+        return ESP_FAIL;
+    }
 
-            if (pageLen > rxLen) {
-                pageLen -= rxLen;
-            }
-            else done = true;
-        }
+    httpd_resp_sendstr(req, "Command processed");
+    return ESP_OK;
+}
+
+bool PaxHttpServer::QueueCommands(HTTPCommand *cmds, uint8_t count)
+{
+    if (count == 0) return true;
+
+    for (uint8_t i = 0; i < count; ++i) {
+        cmds[i].flags |= HTTPCommandFlagBatch;
     }
+    cmds[count - 1].flags |= HTTPCommandFlagBatchEnd;
 
-    if (!headerReceived) {
-        ESP_LOGE(TAG, "Firmware file - no data received");
-        return ESP_FAIL;
+    if (!commandRing.PushAll(cmds, count)) {
+        ESP_LOGW(TAG, "Command queue full, batch of %u commands dropped", (unsigned)count);
+        return false;
+    }
+    return true;
+}
+
+bool PaxHttpServer::QueueCommand(const HTTPCommand& cmd)
+{
+    if (!commandRing.Push(cmd)) {
+        ESP_LOGW(TAG, "Command queue full, command %u dropped", (unsigned)cmd.command);
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+static void WSPutUInt16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = (uint8_t)(value & 0xFF);
+    buf[1] = (uint8_t)(value >> 8);
+}
+
+static void WSPutUInt32(uint8_t *buf, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; ++i) {
+        buf[i] = (uint8_t)(value & 0xFF);
+        value = value >> 8;
+    }
+}
+
+esp_err_t PaxHttpServer::HandleWebSocket(httpd_req_t* req)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if (req->method == HTTP_GET) {
+        // the handshake is done, the connection stays open
+        connections.SetStreaming(httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+
+    const size_t commandFrameLen = 8;
+    const size_t maxFrameLen = 16;
+    uint8_t payload[maxFrameLen];
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+
+    // first call gets the length of the frame
+    esp_err_t res = httpd_ws_recv_frame(req, &frame, 0);
+    if (res != ESP_OK) return res;
+
+    if (frame.len > maxFrameLen) {
+        // not a client of this channel, returning an error closes the connection
+        ESP_LOGW(TAG, "WebSocket frame too long (%d bytes)", (int)frame.len);
+        return ESP_FAIL;
+    }
+    if (frame.len > 0) {
+        frame.payload = payload;
+        res = httpd_ws_recv_frame(req, &frame, maxFrameLen);
+        if (res != ESP_OK) return res;
+    }
+
+    if (frame.type != HTTPD_WS_TYPE_BINARY) {
+        // only binary frames are used, other data frames are ignored
+        return ESP_OK;
+    }
+
+    uint8_t status = WSAckBadFrame;
+    uint16_t id = 0;
+
+    if (frame.len == commandFrameLen) {
+        id = (uint16_t)payload[2] | ((uint16_t)payload[3] << 8);
+
+        if (payload[0] == WSFrameCommand) {
+            HTTPCommand cmd;
+            cmd.command = payload[1];
+            cmd.id = id;
+            cmd.data = (uint32_t)payload[4] | ((uint32_t)payload[5] << 8) |
+                ((uint32_t)payload[6] << 16) | ((uint32_t)payload[7] << 24);
+            cmd.sockfd = httpd_req_to_sockfd(req);
+            cmd.session = connections.Session(cmd.sockfd);
+
+            if (cmd.command == 0) {
+                status = WSAckIgnored;
+            }
+            else if (!commandLimiter.Admit(req, nullptr)) {
+                status = WSAckLimited;
+            }
+            else {
+                status = QueueCommand(cmd) ? WSAckQueued : WSAckQueueFull;
+            }
+        }
+    }
+
+    uint8_t ack[4];
+    ack[0] = WSFrameAck;
+    ack[1] = status;
+    WSPutUInt16(&ack[2], id);
+
+    httpd_ws_frame_t ackFrame;
+    memset(&ackFrame, 0, sizeof(ackFrame));
+    ackFrame.final = true;
+    ackFrame.type = HTTPD_WS_TYPE_BINARY;
+    ackFrame.payload = ack;
+    ackFrame.len = sizeof(ack);
+    return httpd_ws_send_frame(req, &ackFrame);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t PaxHttpServer::SendCommandResult(const HTTPCommand& cmd, uint32_t result)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if ((cmd.sockfd < 0) || (cmd.session == 0)) return ESP_ERR_INVALID_ARG;
+    if (serverHandle == nullptr) return ESP_ERR_INVALID_STATE;
+
+    WSResult *res = new (std::nothrow) WSResult;
+    if (res == nullptr) return ESP_ERR_NO_MEM;
+
+    res->handle = serverHandle;
+    res->sockfd = cmd.sockfd;
+    res->session = cmd.session;
+    res->frame[0] = WSFrameResult;
+    res->frame[1] = 0;
+    WSPutUInt16(&res->frame[2], cmd.id);
+    WSPutUInt32(&res->frame[4], result);
+
+    esp_err_t err = httpd_queue_work(serverHandle, ws_result_work, res);
+    if (err != ESP_OK) {
+        delete res;
+    }
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+bool PaxHttpServer::IsWebSocketSession(int sockfd, uint32_t session)
+{
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if ((serverHandle == nullptr) || (session == 0)) return false;
+    if (connections.Session(sockfd) != session) return false;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 2, 0)
+    if (httpd_ws_get_fd_info(serverHandle, sockfd) != HTTPD_WS_CLIENT_WEBSOCKET) return false;
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+esp_err_t PaxHttpServer::HandlePost_ConfigJson(httpd_req_t* req)
+{
+    if (configuration == nullptr) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "configuration is null");
+        return ESP_FAIL;
+    }
+
+    uint32_t retryAfter;
+    if (!configLimiter.Admit(req, &retryAfter)) {
+        return HTTPSendTooManyRequests(req, retryAfter);
+    }
+
+    // the same handler reads JSON, CBOR and MessagePack
+    HTTPFormatReader formatReader(HTTPRequestFormat(req), configuration);
+    JSONReader& reader = formatReader.Reader();
+
+    RequestBuffer buffer(requestBuffers, httpd_req_to_sockfd(req));
+    configuration->BeginJSON(true);
+    esp_err_t res = ReceiveJSON(req, buffer, reader);
+    if (res != ESP_OK && res != ESP_ERR_INVALID_ARG) {
+        RestoreConfiguration();
+        return ESP_FAIL;
+    }
+
+    if (!configuration->EndJSON(res == ESP_OK)) {
+        // the members are set while parsing, restore the saved configuration
+        RestoreConfiguration();
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "failed to process data");
+        return ESP_FAIL;
+    }
+
+    // the commit waits for flash, a worker does it while this task serves other requests
+    bool queued = SaveConfigurationAsync();
+    if (queued) {
+        httpd_resp_set_status(req, "202 Accepted");
+    }
+    else if (SaveConfiguration() != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "failed to process data");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
+    httpd_resp_set_hdr(req, "Pragma", "no-cache");
+    httpd_resp_sendstr(req, queued ? "Configuration accepted" : "Command processed");
+    return ESP_OK;
+}
+
+bool PaxHttpServer::SaveConfigurationAsync(void)
+{
+    if (!workers.IsRunning()) return false;
+
+    char *str = configuration->CreateJSONConfigString(nullptr);
+    if (str == nullptr) return false;
+
+    // a waiting snapshot means its work is queued and will take this one instead
+    char *older = configSnapshot.exchange(str);
+    if (older != nullptr) {
+        free(older);
+        return true;
+    }
+
+    if (workers.Submit(ConfigWriteWork, this)) return true;
+
+    str = configSnapshot.exchange(nullptr);
+    if (str != nullptr) free(str);
+    return false;
+}
+
+esp_err_t PaxHttpServer::SaveConfiguration(void)
+{
+    // waits for a commit running on a worker, so the older snapshot is not written last
+    if (configWriteMutex != nullptr) xSemaphoreTake(configWriteMutex, portMAX_DELAY);
+    esp_err_t err = configuration->WriteToNVS(false);
+    if (configWriteMutex != nullptr) xSemaphoreGive(configWriteMutex);
+    return err;
+}
+
+void PaxHttpServer::RestoreConfiguration(void)
+{
+    if (configWriteMutex != nullptr) xSemaphoreTake(configWriteMutex, portMAX_DELAY);
+
+    // an accepted configuration still waiting for a worker is saved first
+    char *str = configSnapshot.exchange(nullptr);
+    if (str != nullptr) {
+        configuration->WriteStringToNVS(str);
+        free(str);
+    }
+    configuration->ReadFromNVS();
+
+    if (configWriteMutex != nullptr) xSemaphoreGive(configWriteMutex);
+}
+
+void PaxHttpServer::ConfigWriteWork(void *arg)
+{
+    PaxHttpServer *server = static_cast<PaxHttpServer*>(arg);
+    server->WriteConfigSnapshot();
+}
+
+void PaxHttpServer::WriteConfigSnapshot(void)
+{
+    xSemaphoreTake(configWriteMutex, portMAX_DELAY);
+
+    char *str = configSnapshot.exchange(nullptr);
+    if (str != nullptr) {
+        esp_err_t err = configuration->WriteStringToNVS(str);
+        free(str);
+        if (err != ESP_OK) {
+            configWriteErrors.fetch_add(1, std::memory_order_relaxed);
+            ESP_LOGE(TAG, "0x%x Failed to save the configuration", err);
+        }
+    }
+
+    xSemaphoreGive(configWriteMutex);
+}
+
+// -----------------------------------------------------------------------------
+
+bool PaxHttpServer::HandleGET_Custom(httpd_req_t *req, esp_err_t *res)
+{
+    return false;
+}
+
+bool PaxHttpServer::HandlePOST_Custom(httpd_req_t *req, esp_err_t *res)
+{
+    return false;
+}
+
+bool PaxHttpServer::WriteMetrics_Custom(HTTPMetricsText& text)
+{
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+esp_err_t PaxHttpServer::HandlePost_Update(httpd_req_t* req)
+{
+    // an upload takes long, a worker receives it while this task serves the other requests
+    esp_err_t res;
+    if (HandleUpdateAsync(req, &res)) return res;
+
+    // on this task the upload is received in parts so the other requests run between them
+    if (req->content_len > OTAMaxPartSize) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_sendstr(req, "Send the firmware in parts with Content-Range");
+        return ESP_FAIL;
+    }
+    return HandleUpdate(req);
+}
+
+bool PaxHttpServer::HandleUpdateAsync(httpd_req_t* req, esp_err_t *res)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    if (!workers.IsRunning()) return false;
+
+    // the state of the upload is used by one request at a time
+    if (otaAsyncBusy.exchange(true)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_sendstr(req, "Another upload request is running");
+        *res = ESP_FAIL;
+        return true;
+    }
+
+    httpd_req_t *copy = nullptr;
+    if (httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+        otaAsyncBusy.store(false);
+        return false;
+    }
+    otaAsyncReq = copy;
+    otaAsyncSockfd = httpd_req_to_sockfd(req);
+    if (!workers.Submit(UpdateWork, this)) {
+        httpd_req_async_handler_complete(copy);
+        otaAsyncBusy.store(false);
+        return false;
+    }
+
+    // the connection has no deadline until the worker is done
+    connections.SetDetached(otaAsyncSockfd);
+    *res = ESP_OK;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PaxHttpServer::UpdateWork(void *arg)
+{
+    PaxHttpServer *server = static_cast<PaxHttpServer*>(arg);
+    httpd_req_t *req = server->otaAsyncReq;
+    server->HandleUpdate(req);
+
+    // queued before the request is completed so the connection is waiting again
+    // when the server task reads the next request from it
+    if (httpd_queue_work(server->serverHandle, UpdateDoneWork, server) != ESP_OK) {
+        server->otaAsyncBusy.store(false);
+    }
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    httpd_req_async_handler_complete(req);
+#endif
+}
+
+void PaxHttpServer::UpdateDoneWork(void *arg)
+{
+    PaxHttpServer *server = static_cast<PaxHttpServer*>(arg);
+    server->connections.EndDetached(server->otaAsyncSockfd);
+    server->otaAsyncBusy.store(false);
+}
+
+esp_err_t PaxHttpServer::HandleUpdate(httpd_req_t* req)
+{
+    char contentRange[64];
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", contentRange, sizeof(contentRange)) == ESP_OK) {
+        return HandleOTAPart(req, contentRange);
+    }
+
+    esp_err_t res = HandleOTA(req);
+    if (res == ESP_OK) {
+        SendOTAResult(req);
+    }
+    else if (res == ESP_ERR_OTA_VALIDATE_FAILED) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid firmware image !");
+    }
+    else {
+        httpd_resp_sendstr(req, "OTA Failed !");
+    }
+    return res;
+}
+
+bool PaxHttpServer::SetOTAExpectedSHA256(httpd_req_t* req)
+{
+    // the header is optional, without it only the head of the image is checked
+    char hex[72];
+    if (httpd_req_get_hdr_value_str(req, "X-Image-SHA256", hex, sizeof(hex)) != ESP_OK) return true;
+
+    if (!otaPipeline.SetExpectedSHA256(hex)) {
+        ESP_LOGE(TAG, "Invalid X-Image-SHA256");
+        return false;
+    }
+    return true;
+}
+
+esp_err_t PaxHttpServer::SendOTAResult(httpd_req_t* req)
+{
+    char str[64];
+    uint32_t ms = otaPipeline.ElapsedMs();
+    snprintf(str, sizeof(str), "OTA OK. %u bytes in %u ms, %.3f MB/s",
+        (unsigned)otaPipeline.BytesWritten(), (unsigned)ms,
+        (double)otaPipeline.BytesWritten() / (ms == 0 ? 1 : ms) / 1000.0);
+    return httpd_resp_sendstr(req, str);
+}
+
+esp_err_t PaxHttpServer::SendOTAError(httpd_req_t* req, esp_err_t err)
+{
+    if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid firmware image !");
+    }
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA Failed !");
+}
+
+esp_err_t PaxHttpServer::OTAStart(size_t total)
+{
+    OTAAbort();
+
+    esp_err_t res = otaPipeline.Start(simpleOTA, otaPartition.IsAvailable() ? &otaPartition : nullptr);
+    if (res != ESP_OK) return res;
+
+    otaSessionActive = true;
+    otaTotal = total;
+    otaReceived = 0;
+    otaLastTime = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t PaxHttpServer::OTAReceiveHead(httpd_req_t* req, size_t length)
+{
+    // the first bytes of the upload tell if it is compressed or a patch
+    uint8_t head[4];
+    size_t headLen = (length < sizeof(head)) ? length : sizeof(head);
+    size_t rxTotal = 0;
+    while (rxTotal < headLen) {
+        int rxLen = httpd_req_recv(req, (char*)head + rxTotal, headLen - rxTotal);
+        if (rxLen == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (rxLen <= 0) {
+            ESP_LOGE(TAG, "httpd_req_recv: %d", rxLen);
+            return ESP_FAIL;
+        }
+        rxTotal += rxLen;
+    }
+    otaReceived += headLen;
+    otaLastTime = esp_timer_get_time();
+
+    bool gzip = OTAInflater::IsGzip(head, headLen);
+    char encoding[16];
+    if (httpd_req_get_hdr_value_str(req, "Content-Encoding", encoding, sizeof(encoding)) == ESP_OK) {
+        gzip = gzip || (strcmp(encoding, "gzip") == 0);
+    }
+
+    // a patch is found after decompression so the patcher is always in the chain
+    esp_err_t res = otaPatcher.Begin(&otaPipeline);
+    if (res != ESP_OK) return res;
+
+    if (!gzip) {
+        otaEncoding = OTAEncoding::identity;
+        return otaPatcher.Write((const char*)head, headLen);
+    }
+
+#ifdef CONFIG_ESP32BM_OTA_GZIP
+    res = otaInflater.Begin();
+    if (res != ESP_OK) return res;
+    otaEncoding = OTAEncoding::gzip;
+    return otaInflater.Feed(head, headLen, otaPatcher);
+#else
+    ESP_LOGE(TAG, "Compressed firmware images are not enabled");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t PaxHttpServer::OTAReceive(httpd_req_t* req, size_t length)
+{
+    if ((otaEncoding == OTAEncoding::unknown) && (length > 0)) {
+        size_t headLen = otaReceived;
+        esp_err_t res = OTAReceiveHead(req, length);
+        if (res != ESP_OK) return res;
+        length -= otaReceived - headLen;
+    }
+
+    if ((otaEncoding == OTAEncoding::gzip) || !otaPatcher.IsPassthrough()) {
+        uint8_t data[OTAReceiveChunkSize];
+        while (length > 0) {
+            // a worker receiving the upload stops with the server
+            if (!working) return ESP_ERR_INVALID_STATE;
+
+            size_t len = (length < sizeof(data)) ? length : sizeof(data);
+            int rxLen = httpd_req_recv(req, (char*)data, len);
+            if (rxLen == HTTPD_SOCK_ERR_TIMEOUT) continue;
+            if (rxLen <= 0) {
+                ESP_LOGE(TAG, "httpd_req_recv: %d", rxLen);
+                return ESP_FAIL;
+            }
+            otaReceived += rxLen;
+            length -= rxLen;
+            otaLastTime = esp_timer_get_time();
+
+            esp_err_t res;
+            if (otaEncoding == OTAEncoding::gzip) {
+                res = otaInflater.Feed(data, rxLen, otaPatcher);
+            }
+            else {
+                res = otaPatcher.Write((const char*)data, rxLen);
+            }
+            if (res != ESP_OK) return res;
+        }
+        return ESP_OK;
+    }
+
+    // a plain image, received directly in the buffers of the pipeline
+    while (length > 0) {
+        if (!working) return ESP_ERR_INVALID_STATE;
+
+        size_t len = 0;
+        char *buffer = otaPipeline.GetWriteBuffer(&len);
+        if (buffer == nullptr) return ESP_FAIL;
+
+        if (len > length) len = length;
+        int rxLen = httpd_req_recv(req, buffer, len);
+        if (rxLen == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (rxLen <= 0) {
+            ESP_LOGE(TAG, "httpd_req_recv: %d", rxLen);
+            return ESP_FAIL;
+        }
+        otaReceived += rxLen;
+        length -= rxLen;
+        otaLastTime = esp_timer_get_time();
+
+        esp_err_t res = otaPipeline.CommitWrite(rxLen);
+        if (res != ESP_OK) return res;
+    }
+    return ESP_OK;
+}
+
+esp_err_t PaxHttpServer::OTAComplete(void)
+{
+    esp_err_t res = ESP_OK;
+    if (otaEncoding == OTAEncoding::gzip) {
+        res = otaInflater.Finish();
+        if (res == ESP_OK) {
+            ESP_LOGI(TAG, "Decompressed %u bytes to %u bytes",
+                (unsigned)otaReceived, (unsigned)otaInflater.OutputSize());
+        }
+    }
+    if ((res == ESP_OK) && (otaEncoding != OTAEncoding::unknown)) {
+        res = otaPatcher.Finish();
+    }
+    if ((res == ESP_OK) && otaPatcher.IsActive()) {
+        ESP_LOGI(TAG, "Patched to %u bytes", (unsigned)otaPatcher.OutputSize());
+        // the SHA256 from the X-Image-SHA256 header takes precedence
+        if (!otaPipeline.HasExpectedSHA256()) {
+            otaPipeline.SetExpectedSHA256(otaPatcher.TargetSHA256());
+        }
+    }
+    otaInflater.End();
+    otaPatcher.End();
+    otaEncoding = OTAEncoding::unknown;
+    otaSessionActive = false;
+
+    if (res != ESP_OK) {
+        otaPipeline.Abort();
+        return res;
+    }
+    return otaPipeline.Finish();
+}
+
+void PaxHttpServer::OTAAbort(void)
+{
+    otaInflater.End();
+    otaPatcher.End();
+    otaEncoding = OTAEncoding::unknown;
+    otaSessionActive = false;
+    otaPipeline.Abort();
+}
+
+/**
+ * @brief Parses "bytes first-last/total" or "bytes *\/total"
+ *
+ * For the second form `first` is set to SIZE_MAX.
+ */
+static bool ParseContentRange(const char *str, size_t& first, size_t& last, size_t& total)
+{
+    if (strncmp(str, "bytes ", 6) != 0) return false;
+    str += 6;
+
+    char *end = nullptr;
+    if (*str == '*') {
+        first = SIZE_MAX;
+        last = 0;
+        ++str;
+    }
+    else {
+        first = strtoul(str, &end, 10);
+        if ((end == str) || (*end != '-')) return false;
+        str = end + 1;
+        last = strtoul(str, &end, 10);
+        if ((end == str) || (last < first)) return false;
+        str = end;
+    }
+
+    if (*str != '/') return false;
+    ++str;
+    total = strtoul(str, &end, 10);
+    if ((end == str) || (*end != 0) || (total == 0)) return false;
+    if ((first != SIZE_MAX) && (last >= total)) return false;
+    return true;
+}
+
+esp_err_t PaxHttpServer::SendOTAProgress(httpd_req_t* req, const char *status)
+{
+    // the Range header tells the client where to resume
+    char range[32];
+    char str[64];
+    snprintf(str, sizeof(str), "%u of %u bytes received",
+        (unsigned)otaReceived, (unsigned)otaTotal);
+
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    if (otaSessionActive && (otaReceived > 0)) {
+        snprintf(range, sizeof(range), "bytes=0-%u", (unsigned)(otaReceived - 1));
+        httpd_resp_set_hdr(req, "Range", range);
+    }
+    return httpd_resp_sendstr(req, str);
+}
+
+esp_err_t PaxHttpServer::HandleOTAPart(httpd_req_t* req, const char *contentRange)
+{
+    const char *statusIncomplete = "202 Accepted";
+    const char *statusNotSatisfiable = "416 Range Not Satisfiable";
+
+    if (simpleOTA == nullptr) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "OTA is not available !");
+        return ESP_FAIL;
+    }
+
+    size_t first, last, total;
+    if (!ParseContentRange(contentRange, first, last, total)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Content-Range");
+        return ESP_FAIL;
+    }
+    if (total > (size_t)simpleOTA->GetMaxImageSize()) {
+        ESP_LOGE(TAG, "OTA content is too big (%u bytes) !", (unsigned)total);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "OTA content is too big !");
+        return ESP_FAIL;
+    }
+
+    if (otaSessionActive) {
+        int64_t idle = esp_timer_get_time() - otaLastTime;
+        if ((idle > (int64_t)OTASessionTimeout * 1000000) || (otaTotal != total)) {
+            ESP_LOGW(TAG, "OTA upload abandoned at %u of %u bytes", (unsigned)otaReceived, (unsigned)otaTotal);
+            OTAAbort();
+        }
+    }
+
+    // "bytes */total" asks for the state of the upload
+    if (first == SIZE_MAX) {
+        if (!otaSessionActive) {
+            otaReceived = 0;
+            otaTotal = total;
+        }
+        return SendOTAProgress(req, statusIncomplete);
+    }
+
+    size_t length = last - first + 1;
+    if (req->content_len != length) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content-Length does not match Content-Range");
+        return ESP_FAIL;
+    }
+
+    if (!otaSessionActive) {
+        if (first != 0) {
+            otaReceived = 0;
+            otaTotal = total;
+            return SendOTAProgress(req, statusNotSatisfiable);
+        }
+        esp_err_t res = OTAStart(total);
+        if (res != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA Failed !");
+            return res;
+        }
+    }
+
+    if (!SetOTAExpectedSHA256(req)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid X-Image-SHA256");
+        return ESP_FAIL;
+    }
+
+    // the image is written sequentially, a part starting after the received data
+    // must be sent again after the missing ones
+    if (first > otaReceived) {
+        return SendOTAProgress(req, statusNotSatisfiable);
+    }
+
+    // skip the data already received, when the client resends it
+    size_t skip = otaReceived - first;
+    if (skip > length) skip = length;
+    while (skip > 0) {
+        char discard[128];
+        size_t len = (skip < sizeof(discard)) ? skip : sizeof(discard);
+        int rxLen = httpd_req_recv(req, discard, len);
+        if (rxLen == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (rxLen <= 0) return ESP_FAIL;
+        skip -= rxLen;
+        length -= rxLen;
+    }
+
+    // on receive errors the session is kept so the client can resume
+    esp_err_t res = OTAReceive(req, length);
+    if (res != ESP_OK) {
+        res = otaPipeline.GetError();
+        if (res != ESP_OK) {
+            OTAAbort();
+            SendOTAError(req, res);
+        }
+        return ESP_FAIL;
+    }
+
+    if (otaReceived < otaTotal) {
+        return SendOTAProgress(req, statusIncomplete);
+    }
+
+    res = OTAComplete();
+    if (res != ESP_OK) {
+        SendOTAError(req, res);
+        return res;
+    }
+
+    ESP_LOGI(TAG, "OTA done, you should restart");
+    SendOTAResult(req);
+    return ESP_OK;
+}
+
+esp_err_t PaxHttpServer::HandleOTA(httpd_req_t* req)
+{
+    size_t total = req->content_len;
+
+    if (simpleOTA == nullptr) {
+        ESP_LOGE(TAG, "OTA is null !");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "OTA is not available !");
+        return ESP_FAIL;
+    }
+
+    if (total > (size_t)simpleOTA->GetMaxImageSize()) {
+        ESP_LOGE(TAG, "OTA content is too big (%u bytes) !", (unsigned)total);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "OTA content is too big !");
+        return ESP_FAIL;
+    }
+
+    if (total == 0) {
+        ESP_LOGE(TAG, "Firmware file - no data received");
+        return ESP_FAIL;
+    }
+
+    // an upload without Content-Range replaces an unfinished one
+    esp_err_t result = OTAStart(total);
+    if (result != ESP_OK) { return result; }
+
+    if (!SetOTAExpectedSHA256(req)) {
+        OTAAbort();
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    result = OTAReceive(req, total);
+    if (result != ESP_OK) {
+        // the error of the writer, like a rejected image, is more relevant
+        if (otaPipeline.GetError() != ESP_OK) {
+            result = otaPipeline.GetError();
+        }
+        OTAAbort();
+        return result;
     }
 
-    result = simpleOTA->End();
+    result = OTAComplete();
     if (result != ESP_OK) { return result; }
 
     ESP_LOGI(TAG, "OTA done, you should restart");
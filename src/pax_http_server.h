@@ -23,24 +23,81 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 
 #include "ESP32SimpleOTA.h"
 #include "Configuration.h"
 #include "BoardInfo.h"
+#include "HTTPRoute.h"
+#include "HTTPResponseCache.h"
+#include "JSONWriter.h"
+#include "JSONReader.h"
+#include "HTTPEventStream.h"
+#include "RequestBufferPool.h"
+#include "HTTPConnectionManager.h"
+#include "HTTPMetrics.h"
+#include "HTTPRateLimiter.h"
+#include "HTTPCommandRing.h"
+#include "HTTPWorkerPool.h"
+#include "HTTPContentFormat.h"
+#include "JSONFieldFilter.h"
+#include "HTTPStatusTracker.h"
+#include "OTAPipeline.h"
+#include "OTAInflater.h"
+#include "OTAPatcher.h"
 
-struct HTTPCommand
-{
-    uint8_t command;
-    uint32_t data;
+/**
+ * WebSocket command channel, binary frames, multi-byte values are little endian
+ *
+ * - request, client to board: type (1 byte), cmd (1 byte), id (2 bytes), data (4 bytes)
+ * - ack, board to client: type (1 byte), status (1 byte), id (2 bytes)
+ * - result, board to client: type (1 byte), reserved (1 byte), id (2 bytes), result (4 bytes)
+ */
+const uint8_t WSFrameCommand = 0x01;
+const uint8_t WSFrameAck     = 0x81;
+const uint8_t WSFrameResult  = 0x82;
 
-    HTTPCommand() {
-        command = 0;
-        data = 0;
-    }
-};
+const uint8_t WSAckQueued    = 0;
+const uint8_t WSAckIgnored   = 1;
+const uint8_t WSAckQueueFull = 2;
+const uint8_t WSAckBadFrame  = 3;
+const uint8_t WSAckLimited   = 4;
+
+/**
+ * Resumable firmware upload, parts are sent to /update with a Content-Range header
+ *
+ * - "bytes first-last/total" appends a part, the response is 202 with the Range received
+ *   so far, "bytes=0-n", or 200 when the image is complete
+ * - "bytes *\/total" returns the Range received so far, use it to resume
+ * - a part starting after the received data is answered with 416 and the Range
+ * - the X-Image-SHA256 header, on any request of an upload, sets the expected SHA256 of the image,
+ *   of the decompressed image for a compressed upload
+ *
+ * The data is written sequentially, parts of an upload sent over parallel connections
+ * must arrive in order. An unfinished upload is dropped after OTASessionTimeout seconds
+ * of inactivity, when a part is received.
+ */
+const uint32_t OTASessionTimeout = CONFIG_ESP32BM_OTA_SESSION_TIMEOUT_S;
+
+/**
+ * An upload request is detached and received by a worker if ESP-IDF has asynchronous requests,
+ * from 5.1. Otherwise the server task receives it and the other requests wait, so an upload
+ * sent in one request, or a part of it, may have at most OTAMaxPartSize bytes.
+ */
+const size_t OTAMaxPartSize = CONFIG_ESP32BM_OTA_MAX_PART_SIZE;
 
-const size_t workBufferSize = 1000;
+/**
+ * The firmware image may be gzip compressed, detected by Content-Encoding or by the magic bytes.
+ * The image, compressed or not, may be a patch for the running application, see OTAPatcher.
+ * Compressed uploads and patches are received in blocks of OTAReceiveChunkSize bytes from the stack.
+ */
+enum class OTAEncoding : uint8_t {
+    unknown, identity, gzip
+};
+const size_t OTAReceiveChunkSize = 512;
 
 class PaxHttpServer
 {
@@ -49,55 +106,347 @@ public:
     virtual ~PaxHttpServer();
 
     /**
-     * Currently only creates the serverQueue.
-     * If serverQueue exists, is destroyed and created again.
+     * Currently only creates the command ring.
+     * If the command ring exists, it is emptied.
      */
     bool Initialize(void);
 
     /**
-     * If serverQueue is not created tries to create one.
-     * Returns the serverQueue.
+     * If the command ring is not created tries to create it.
+     * Returns the command ring or nullptr.
+     *
+     * The commands are taken from the ring, by a single task, with Receive
+     * and, after they are handled, given back with Release.
      */
-    QueueHandle_t GetQueueHandle(void);
+    HTTPCommandRing* GetCommandRing(void);
 
     esp_err_t StartServer(ESP32SimpleOTA*, Configuration*, BoardInfo*);
     void StopServer(void);
 
+    httpd_handle_t GetServerHandle(void);
+
+    /**
+     * @brief Sends the result of a command to the WebSocket client which sent it
+     *
+     * Can be called from any task, the frame is sent from the server task.
+     * Returns ESP_ERR_INVALID_ARG if the command has no WebSocket client.
+     */
+    esp_err_t SendCommandResult(const HTTPCommand&, uint32_t result);
+
+    /**
+     * @brief Returns true if the socket is still the WebSocket connection of the session
+     *
+     * Called from the server task before a result is sent. The client which sent the command
+     * may be gone and its socket number given to another connection.
+     */
+    bool IsWebSocketSession(int sockfd, uint32_t session);
+
+    /**
+     * @brief Handles the frames of the WebSocket command channel, /ws
+     */
+    esp_err_t HandleWebSocket(httpd_req_t*);
+
     esp_err_t HandleRequest(httpd_req_t*);
 
-protected:
     /**
-     * The queue for http server events.
-     * Is created by Initialize or GetQueueHandle functions.
-     * Is destroyed by destructor
+     * @brief Sends the status to the event stream subscribers if it changed
+     *
+     * Is queued periodically in the server task by statusTimer.
+     * Answers the status.json requests waiting for a change, see AnswerStatusWaiters.
      */
-    QueueHandle_t serverQueue;
+    void PublishStatus(void);
 
     /**
-     * If queue is allready created, is emptied otherwise is created
+     * @brief Checks the status now instead of at the next tick of statusTimer
+     *
+     * Call it, from any task, after a change of the status to lower the latency
+     * of the event stream and of the status.json requests waiting for a change.
      */
-    bool CreateQueue(void);
-    void DestroyQueue(void);
+    void NotifyStatusChanged(void);
+
+    /**
+     * @brief Called by the server when a socket is opened
+     *
+     * Replaces the receive and send functions of the socket with SocketRecv and SocketSend.
+     */
+    esp_err_t SocketOpened(httpd_handle_t, int sockfd);
+
+    /**
+     * @brief Called by the server when a socket is closed
+     */
+    void SocketClosed(int sockfd);
+
+    /**
+     * @brief Receive and send functions of the sockets, they update the connection statistics
+     *
+     * SocketRecv fails if the request is past its deadline so the server closes the connection.
+     */
+    int SocketRecv(int sockfd, char *buf, size_t length, int flags);
+    int SocketSend(int sockfd, const char *buf, size_t length, int flags);
+
+    /**
+     * @brief Closes the connections past their deadlines
+     *
+     * Is queued periodically in the server task by statusTimer.
+     */
+    void CheckConnections(void);
+
+protected:
+    /**
+     * The commands received by the server, for the application.
+     * Is created by Initialize or GetCommandRing functions.
+     * Is destroyed by destructor
+     */
+    HTTPCommandRing commandRing;
 
     httpd_handle_t serverHandle;
     bool working;
 
-    char workBuffer[workBufferSize];
+    /**
+     * @brief Starts esp_http_server or, with CONFIG_ESP32BM_HTTPS, esp_https_server
+     *
+     * The same handlers are used by both. The TLS certificate and key are embedded
+     * from certs/servercert.pem and certs/prvtkey.pem of the project.
+     */
+    esp_err_t Start(const httpd_config_t&);
+
+    HTTPConnectionManager connections;
+
+    /**
+     * @brief Request counters and latencies by route, recorded by HandleRequest
+     */
+    HTTPMetrics metrics;
+
+    /**
+     * @brief Calls the handler of the route or the ones for requests without a route
+     */
+    esp_err_t DispatchRequest(httpd_req_t*, const HTTPRoute*);
+
+    /**
+     * @brief Buffers for request bodies, each request gets its own
+     */
+    RequestBufferPool requestBuffers;
+
+    /**
+     * @brief Receives the body of the request in buffer sized chunks and feeds them to the reader
+     *
+     * Returns ESP_ERR_INVALID_ARG, without sending a response, if the body is not valid JSON.
+     * For the other errors the response is sent: 503 if there was no free buffer
+     * and 500 for receive errors.
+     */
+    esp_err_t ReceiveJSON(httpd_req_t*, RequestBuffer&, JSONReader&);
+
+    /**
+     * @brief The routes handled by this class
+     *
+     * Matching is done on method and the hash of the path, both computed at compile time,
+     * and the routes are found with a binary search in routeIndex, so dispatching a request
+     * does not allocate memory.
+     */
+    static const HTTPRoute baseRoutes[];
+    static const size_t baseRoutesCount;
 
-    esp_err_t HandleGetRequest(httpd_req_t*);
-    esp_err_t HandlePostRequest(httpd_req_t*);
+    const HTTPRoute *customRoutes;
+    size_t customRoutesCount;
+
+    /** the custom and the base routes, indexed when the server starts */
+    HTTPRouteIndex routeIndex;
+
+    /**
+     * @brief Sets the route table of a derived class
+     *
+     * Call it from the constructor of the derived class, the routes are indexed by StartServer.
+     * The table must outlive the server, use a static const array.
+     * Custom routes are checked before the base routes so they can replace them.
+     */
+    void SetCustomRoutes(const HTTPRoute *routes, size_t count);
+
+    /**
+     * @brief Returns the route matching the request or nullptr
+     */
+    const HTTPRoute* FindRoute(httpd_req_t*);
 
     virtual esp_err_t SetJsonHeader(httpd_req_t*);
+
+    /**
+     * @brief Sets the headers of a response negotiated with the Accept header
+     *
+     * Like SetJsonHeader, for the format, and adds `Vary: Accept`.
+     */
+    esp_err_t SetDocumentHeader(httpd_req_t*, HTTPContentFormat);
+
+    /**
+     * @brief ETag of the embedded files and their Cache-Control value
+     *
+     * The ETag is derived from the SHA256 of the firmware so it changes only on firmware updates.
+     * Is set by StartServer, it remains empty if boardInfo has no elfSHA256.
+     */
+    char assetETag[ETagBufLen];
+    char assetCacheControl[32];
+    void SetAssetETag(void);
+
+    /**
+     * @brief Sends an embedded file, or 304 if the client has the same version
+     *
+     * @param encoding value for the Content-Encoding header or nullptr
+     */
+    esp_err_t SendEmbeddedFile(httpd_req_t*, const uint8_t *start, const uint8_t *end, const char *type, const char *encoding);
+
+    /**
+     * @brief Server-Sent Events for status
+     *
+     * statusEvent holds the last event sent, as `data: {status json}\n\n`.
+     */
+    HTTPEventStream statusStream;
+    esp_timer_handle_t statusTimer;
+    char statusEvent[CONFIG_ESP32BM_SSE_EVENT_SIZE];
+    size_t statusEventLength;
+    uint32_t statusEventHash;
+    int64_t statusEventTime;
+
+    /**
+     * @brief Writes the status event in statusEvent and returns its length, 0 on error
+     */
+    size_t CreateStatusEvent(void);
+
+    /**
+     * @brief Creates the status event and updates its hash, length and time if it changed
+     */
+    bool RefreshStatusEvent(bool& changed);
+
+    esp_err_t StartStatusTimer(void);
+    void StopStatusTimer(void);
+
+    /**
+     * @brief Versions of the status, for status.json `?since=` and `?wait=`
+     */
+    HTTPStatusTracker statusTracker;
+    HTTPStatusWaiter statusWaiters[StatusWaitMaxClients];
+
+    /**
+     * @brief Calls WriteJSONStatus with statusTracker, which increments the version if the status changed
+     */
+    void RefreshStatusVersion(void);
+
+    /**
+     * @brief Returns the status members changed after the version `since`, all of them if `since` is 0
+     *
+     * @warning Delete returned string with 'free' !
+     */
+    char* CreateStatusDocument(HTTPContentFormat, const JSONFieldList *fields, uint32_t since, size_t *length);
+
+    /**
+     * @brief Keeps the request in statusWaiters, returns false if there is no free slot
+     */
+    bool WaitForStatus(httpd_req_t*, uint32_t since, uint32_t waitTime, HTTPContentFormat);
+
+    /**
+     * @brief Answers the waiting requests whose status changed or whose time expired
+     */
+    void AnswerStatusWaiters(void);
+    void AnswerStatusWaiter(HTTPStatusWaiter&);
+    void RemoveStatusWaiter(int sockfd);
+
+    esp_err_t HandleGet_StatusStream(httpd_req_t*);
+
+    /**
+     * @brief Sends the file from the asset table matching the URI, if CONFIG_ESP32BM_WEB_ASSET_TABLE is set
+     *
+     * @return false if there is no such file
+     */
+    bool HandleGet_Asset(httpd_req_t*, esp_err_t*);
+
+    esp_err_t HandleGet_Index(httpd_req_t*);
+    esp_err_t HandleGet_Favicon(httpd_req_t*);
     virtual esp_err_t HandleGet_InfoJson(httpd_req_t*);
     virtual esp_err_t HandleGet_StatusJson(httpd_req_t*);
+
+    /**
+     * @brief Sends the metrics in the Prometheus text format
+     *
+     * Derived classes can add their own metrics with WriteMetrics_Custom.
+     */
+    esp_err_t HandleGet_Metrics(httpd_req_t*);
     virtual esp_err_t HandleGet_ConfigJson(httpd_req_t*);
 
+    /**
+     * @brief Adds a command to commandRing, returns false if its lane is full
+     */
+    bool QueueCommand(const HTTPCommand&);
+
+    /**
+     * @brief Adds all the commands to commandRing, in order, or none if there is not enough space
+     *
+     * Sets the batch flags of the commands, all must use the same lane.
+     */
+    bool QueueCommands(HTTPCommand*, uint8_t count);
+
+    /**
+     * @brief Admission control for the commands, from /cmd.json and the WebSocket, and for the configuration writes
+     *
+     * Configured from Kconfig by StartServer.
+     */
+    HTTPRateLimiter commandLimiter;
+    HTTPRateLimiter configLimiter;
+
+    /**
+     * @brief Tasks for the slow parts of the requests, like the NVS commits of the configuration
+     *
+     * Started by StartServer with the Kconfig settings, if CONFIG_ESP32BM_HTTP_WORKERS is not 0.
+     */
+    HTTPWorkerPool workers;
+
+    /**
+     * @brief Queues the NVS commit of the configuration for a worker
+     *
+     * The configuration is serialized now, on the server task, and the worker writes that
+     * snapshot. If a previous snapshot is still waiting it is replaced, only the latest is written.
+     * Returns false if the commit was not queued, call SaveConfiguration instead.
+     */
+    bool SaveConfigurationAsync(void);
+
+    /**
+     * @brief Saves the configuration to NVS now
+     */
+    esp_err_t SaveConfiguration(void);
+
+    /**
+     * @brief Reads again the saved configuration, after a failed update
+     */
+    void RestoreConfiguration(void);
+
+    std::atomic<char*> configSnapshot;
+    SemaphoreHandle_t configWriteMutex;
+    std::atomic<uint32_t> configWriteErrors;
+
+    static void ConfigWriteWork(void*);
+    void WriteConfigSnapshot(void);
+
     virtual esp_err_t HandlePost_CmdJson(httpd_req_t*);
+
+    /**
+     * @brief Queues an array of commands, `[{"cmd": 1, "data": 2}, ...]`, all or none of them
+     *
+     * The response is `{"queued": n, "status": [...]}` with a status for each entry,
+     * the WSAck values: queued, ignored if cmd is missing or 0, or queue full.
+     * The array can have up to CONFIG_ESP32BM_CMD_BATCH_LENGTH entries, at most the length of the queue.
+     */
+    esp_err_t HandlePost_CmdBatchJson(httpd_req_t*);
+
+    /**
+     * @brief Queues a command with a binary payload, `/cmd.bin?cmd=5&data=0&lane=1`
+     *
+     * The body is received directly in the payload pool of the command ring and handed to
+     * the consumer without copies. It can have up to the size of the pool.
+     */
+    esp_err_t HandlePost_CmdBin(httpd_req_t*);
     virtual esp_err_t HandlePost_ConfigJson(httpd_req_t*);
 
     /**
      * @brief Handles custom GET paths
      *
+     * Called only for paths not found in the route tables, prefer SetCustomRoutes.
+     *
      * If this function returns false, a HTTPD_404_NOT_FOUND will be returned.
      *
      * You should handle all the cases, errors included, and return true.
@@ -107,28 +456,156 @@ protected:
     /**
      * @brief Handles custom POST paths
      *
+     * Called only for paths not found in the route tables, prefer SetCustomRoutes.
+     *
      * If this function returns false, a HTTPD_404_NOT_FOUND will be returned.
      *
      * You should handle all the cases, errors included, and return true.
      */
     virtual bool HandlePOST_Custom(httpd_req_t*, esp_err_t*);
 
+    /**
+     * @brief Adds metrics to the response of /metrics, called after the ones of the server
+     *
+     * Returns the result of the last text function.
+     */
+    virtual bool WriteMetrics_Custom(HTTPMetricsText&);
+
     ESP32SimpleOTA *simpleOTA;
+    OTAPipeline otaPipeline;
+    /** writes the image instead of simpleOTA if it has erased the partition in advance */
+    OTAPartitionWriter otaPartition;
     esp_err_t HandleOTA(httpd_req_t*);
+    esp_err_t HandleOTAPart(httpd_req_t*, const char *contentRange);
+    esp_err_t HandlePost_Update(httpd_req_t*);
+
+    /**
+     * @brief Handles an upload, or a part of it, on the server task or on a worker
+     */
+    esp_err_t HandleUpdate(httpd_req_t*);
+
+    /**
+     * @brief Detaches the upload request and queues it for a worker
+     *
+     * Only one upload request is handled by the workers at a time, another one is answered
+     * with 503 while it runs. Returns false if the request must be handled by the server task,
+     * `res` is set only when true is returned.
+     */
+    bool HandleUpdateAsync(httpd_req_t*, esp_err_t *res);
+
+    /** set while a worker handles otaAsyncReq, which is received on otaAsyncSockfd */
+    std::atomic<bool> otaAsyncBusy;
+    httpd_req_t *otaAsyncReq;
+    int otaAsyncSockfd;
+
+    static void UpdateWork(void*);
+    static void UpdateDoneWork(void*);
+
+    /**
+     * @brief State of the firmware upload
+     *
+     * otaReceived counts the received bytes, compressed or not.
+     */
+    bool otaSessionActive;
+    size_t otaTotal;
+    size_t otaReceived;
+    int64_t otaLastTime;
+    OTAEncoding otaEncoding;
+    OTAInflater otaInflater;
+    OTAPatcher otaPatcher;
+
+    esp_err_t OTAStart(size_t total);
+
+    /**
+     * @brief Receives the first bytes of an upload and finds if it is compressed or a patch
+     */
+    esp_err_t OTAReceiveHead(httpd_req_t*, size_t length);
+    esp_err_t OTAReceive(httpd_req_t*, size_t length);
+    esp_err_t OTAComplete(void);
+    void OTAAbort(void);
+
+    /**
+     * @brief Sets the expected SHA256 from the X-Image-SHA256 header, if present
+     *
+     * Returns false if the header is not valid.
+     */
+    bool SetOTAExpectedSHA256(httpd_req_t*);
+
+    esp_err_t SendOTAProgress(httpd_req_t*, const char *status);
+    esp_err_t SendOTAResult(httpd_req_t*);
+    esp_err_t SendOTAError(httpd_req_t*, esp_err_t);
 
     Configuration *configuration;
 
     BoardInfo *boardInfo;
 
     /**
+     * @brief Cached info.json and config.json responses, one for each HTTPContentFormat
+     *
+     * All are tagged with the configuration's change counter,
+     * info.json includes the name of the board, which is part of the configuration.
+     */
+    HTTPCachedResponse infoCache[HTTPContentFormatCount];
+    HTTPCachedResponse configCache[HTTPContentFormatCount];
+
+    typedef bool (PaxHttpServer::*DocumentFunction)(JSONWriter&);
+
+    /**
+     * @brief Returns an object, with the members written by `function`, in the format
+     *
+     * If `fields` is not null only the members in the list are written.
+     *
      * @warning Delete returned string with 'free' !
      */
-    virtual char* CreateJSONInfoString(bool addWhitespaces);
+    char* CreateDocument(HTTPContentFormat, DocumentFunction function, size_t *length, const JSONFieldList *fields = nullptr);
+
+    /**
+     * @brief Sends the document in the format asked by the client, from the cache entry of the format
+     *
+     * A document filtered with `?fields=` is created for the request and not cached.
+     */
+    esp_err_t SendCachedDocument(httpd_req_t*, HTTPCachedResponse *caches, DocumentFunction function, const char *name);
 
     /**
+     * @brief Writes the members of config.json
+     */
+    bool WriteJSONConfig(JSONWriter&);
+
+    /**
+     * @brief Writes the members of info.json
+     *
+     * The object is opened and closed by the caller.
+     */
+    virtual bool WriteJSONInfo(JSONWriter&);
+
+    /**
+     * @brief Writes the members of status.json
+     *
+     * Override it in the derived class, the base class has no status and returns false.
+     * The object is opened and closed by the caller and the output is streamed
+     * to the client through a small buffer so keep a consistent state if the function fails.
+     * With `?fields=` or `?since=` the writer drops the members not requested or not changed,
+     * use `writer.Wants` to skip reading the values which are not needed.
+     * It is called more than once for a request, to track the status version, so it should
+     * not change the state of the board.
+     *
+     * @code{.cpp}
+     * bool MyServer::WriteJSONStatus(JSONWriter& writer)
+     * {
+     *     writer.AddUInt("temperature", temperature);
+     *     if (writer.Wants("scan")) WriteScanResults(writer);
+     *     return writer.IsOK();
+     * }
+     * @endcode
+     */
+    virtual bool WriteJSONStatus(JSONWriter&);
+
+    /**
+     * @brief Returns info.json as a string, used to fill the cache
+     *
      * @warning Delete returned string with 'free' !
      */
-    virtual char* CreateJSONStatusString(bool addWhitespaces);
+    char* CreateJSONInfoString(size_t *length);
 };
 
 #endif
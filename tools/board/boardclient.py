@@ -0,0 +1,325 @@
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Client side of the scripts which measure a board, Python 3 standard library only.
+
+The requests are written and read on a plain socket, or a TLS one, so the
+scripts see the bytes on the wire and control when a connection is reused.
+"""
+
+import argparse
+import base64
+import os
+import re
+import socket
+import ssl
+import time
+
+
+class BoardError(Exception):
+    pass
+
+
+class Response:
+    def __init__(self, status, headers, body, wire_bytes, elapsed):
+        self.status = status
+        self.headers = headers
+        self.body = body
+        # the bytes received, status line, headers and chunk framing included
+        self.wire_bytes = wire_bytes
+        self.elapsed = elapsed
+
+
+class Connection:
+    """A keep-alive HTTP/1.1 connection to the board."""
+
+    def __init__(self, board, timeout=10.0):
+        self.board = board
+        self.timeout = timeout
+        self.sock = None
+        self.buf = b''
+        self.received = 0
+        # the TLS session of the last connection, for a resumed handshake
+        self.session = None
+        self.session_reused = False
+        self.connect_time = 0.0
+
+    def connect(self, session=None):
+        self.close()
+        start = time.perf_counter()
+        sock = socket.create_connection((self.board.host, self.board.port), self.timeout)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        if self.board.tls:
+            sock = self.board.tls_context().wrap_socket(sock, server_hostname=self.board.host,
+                                                        session=session)
+            self.session = sock.session
+            self.session_reused = sock.session_reused
+        self.connect_time = time.perf_counter() - start
+        self.sock = sock
+        self.buf = b''
+
+    def close(self):
+        if self.sock is not None:
+            try:
+                self.sock.close()
+            except OSError:
+                pass
+        self.sock = None
+
+    def _recv(self):
+        data = self.sock.recv(4096)
+        if not data:
+            raise BoardError('connection closed by the board')
+        self.received += len(data)
+        self.buf += data
+
+    def _read_line(self):
+        while b'\r\n' not in self.buf:
+            self._recv()
+        line, self.buf = self.buf.split(b'\r\n', 1)
+        return line
+
+    def _read_exact(self, length):
+        while len(self.buf) < length:
+            self._recv()
+        data, self.buf = self.buf[:length], self.buf[length:]
+        return data
+
+    def send(self, data):
+        self.sock.sendall(data)
+
+    def request(self, method, path, body=None, headers=None):
+        """Sends a request and reads the response, connects if needed."""
+        if self.sock is None:
+            self.connect(self.session)
+
+        lines = ['{} {} HTTP/1.1'.format(method, path), 'Host: {}'.format(self.board.host)]
+        for name, value in (headers or {}).items():
+            lines.append('{}: {}'.format(name, value))
+        if body is not None:
+            lines.append('Content-Length: {}'.format(len(body)))
+        data = ('\r\n'.join(lines) + '\r\n\r\n').encode('ascii') + (body or b'')
+
+        start = time.perf_counter()
+        self.received = len(self.buf)
+        try:
+            self.send(data)
+            response = self._read_response(method)
+        except (OSError, BoardError):
+            self.close()
+            raise
+        response.elapsed = time.perf_counter() - start
+
+        if self.board.tls:
+            # with TLS 1.3 the session ticket comes after the handshake, with the first response
+            self.session = self.sock.session
+
+        if response.headers.get('connection', '').lower() == 'close':
+            self.close()
+        return response
+
+    def _read_response(self, method):
+        status_line = self._read_line().decode('latin-1')
+        match = re.match(r'HTTP/1\.[01] (\d+)', status_line)
+        if match is None:
+            raise BoardError('bad status line: {!r}'.format(status_line))
+        status = int(match.group(1))
+
+        headers = {}
+        while True:
+            line = self._read_line().decode('latin-1')
+            if not line:
+                break
+            name, _, value = line.partition(':')
+            headers[name.strip().lower()] = value.strip()
+
+        body = b''
+        if method == 'HEAD' or status in (101, 204, 304):
+            pass
+        elif headers.get('transfer-encoding', '').lower() == 'chunked':
+            while True:
+                size = int(self._read_line().split(b';')[0], 16)
+                if size == 0:
+                    self._read_line()
+                    break
+                body += self._read_exact(size)
+                self._read_exact(2)
+        elif 'content-length' in headers:
+            body = self._read_exact(int(headers['content-length']))
+        else:
+            # the body ends with the connection
+            try:
+                while True:
+                    self._recv()
+            except BoardError:
+                pass
+            body, self.buf = self.buf, b''
+            self.close()
+
+        wire_bytes = self.received - len(self.buf)
+        return Response(status, headers, body, wire_bytes, 0.0)
+
+
+class WebSocket:
+    """A client WebSocket on a Connection, binary frames only."""
+
+    OP_TEXT = 0x1
+    OP_BINARY = 0x2
+    OP_CLOSE = 0x8
+    OP_PING = 0x9
+    OP_PONG = 0xA
+
+    def __init__(self, conn, path):
+        key = base64.b64encode(os.urandom(16)).decode('ascii')
+        response = conn.request('GET', path, headers={
+            'Upgrade': 'websocket',
+            'Connection': 'Upgrade',
+            'Sec-WebSocket-Key': key,
+            'Sec-WebSocket-Version': '13',
+        })
+        if response.status != 101:
+            raise BoardError('{} answered {} to the WebSocket handshake'.format(path, response.status))
+        self.conn = conn
+
+    def send(self, payload, opcode=OP_BINARY):
+        """Sends a frame, masked like every frame from a client."""
+        header = bytearray([0x80 | opcode])
+        length = len(payload)
+        if length < 126:
+            header.append(0x80 | length)
+        elif length < 65536:
+            header.append(0x80 | 126)
+            header += length.to_bytes(2, 'big')
+        else:
+            header.append(0x80 | 127)
+            header += length.to_bytes(8, 'big')
+        mask = os.urandom(4)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.conn.send(bytes(header) + mask + masked)
+
+    def recv(self):
+        """Returns the payload of the next binary frame, answers the pings."""
+        while True:
+            head = self.conn._read_exact(2)
+            opcode = head[0] & 0x0F
+            length = head[1] & 0x7F
+            if length == 126:
+                length = int.from_bytes(self.conn._read_exact(2), 'big')
+            elif length == 127:
+                length = int.from_bytes(self.conn._read_exact(8), 'big')
+            mask = self.conn._read_exact(4) if head[1] & 0x80 else None
+            payload = self.conn._read_exact(length)
+            if mask:
+                payload = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+
+            if opcode == self.OP_BINARY:
+                return payload
+            if opcode == self.OP_PING:
+                self.send(payload, self.OP_PONG)
+            elif opcode == self.OP_CLOSE:
+                raise BoardError('WebSocket closed by the board')
+
+    def close(self):
+        try:
+            self.send(b'', self.OP_CLOSE)
+        except OSError:
+            pass
+        self.conn.close()
+
+
+class Board:
+    def __init__(self, host, port=None, tls=False, cafile=None):
+        self.host = host
+        self.tls = tls
+        self.port = port if port else (443 if tls else 80)
+        self.cafile = cafile
+        self._context = None
+
+    def tls_context(self):
+        if self._context is None:
+            if self.cafile:
+                context = ssl.create_default_context(cafile=self.cafile)
+            else:
+                # the boards use self signed certificates
+                context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+                context.check_hostname = False
+                context.verify_mode = ssl.CERT_NONE
+            self._context = context
+        return self._context
+
+    def connection(self, timeout=10.0):
+        return Connection(self, timeout)
+
+    def request(self, method, path, body=None, headers=None, timeout=10.0):
+        """A request on its own connection."""
+        conn = self.connection(timeout)
+        try:
+            return conn.request(method, path, body, headers)
+        finally:
+            conn.close()
+
+    def metrics(self):
+        """Returns the values of /metrics, by name with the labels, like 'name{route="/"}'."""
+        response = self.request('GET', '/metrics')
+        if response.status != 200:
+            raise BoardError('/metrics answered {}'.format(response.status))
+        values = {}
+        for line in response.body.decode('utf-8').splitlines():
+            if not line or line.startswith('#'):
+                continue
+            name, _, value = line.rpartition(' ')
+            try:
+                values[name] = float(value)
+            except ValueError:
+                pass
+        return values
+
+
+def add_board_arguments(parser):
+    parser.add_argument('host', help='address of the board')
+    parser.add_argument('--port', type=int, help='port, 80 or 443 with --tls')
+    parser.add_argument('--tls', action='store_true', help='use HTTPS')
+    parser.add_argument('--cafile', help='certificate to verify the board with, not verified by default')
+
+
+def board_from_args(args):
+    return Board(args.host, args.port, args.tls, args.cafile)
+
+
+def percentile(values, p):
+    """The p-th percentile, nearest rank, of a list of values."""
+    if not values:
+        return float('nan')
+    ordered = sorted(values)
+    rank = max(1, int(-(-p * len(ordered) // 100)))
+    return ordered[min(rank, len(ordered)) - 1]
+
+
+def latency_summary(values):
+    """min, p50, p90, p99 and max of a list of durations in seconds, as ms."""
+    if not values:
+        return 'no samples'
+    return 'min {:.1f}  p50 {:.1f}  p90 {:.1f}  p99 {:.1f}  max {:.1f} ms'.format(
+        min(values) * 1000, percentile(values, 50) * 1000, percentile(values, 90) * 1000,
+        percentile(values, 99) * 1000, max(values) * 1000)
+
+
+def positive_int(text):
+    value = int(text)
+    if value <= 0:
+        raise argparse.ArgumentTypeError('must be greater than 0')
+    return value
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Round trip time of a command, WebSocket against POST /cmd.json.
+
+  cmd_latency.py board -n 200 --cmd 1 --data 0
+
+The same command is sent, one at a time, on:
+
+  ws         the /ws WebSocket, the time until its ack
+  post       POST /cmd.json on a keep-alive connection
+  post-new   POST /cmd.json on a new connection for each command
+
+With --result the WebSocket time is until the result frame, which is sent only
+if the application calls PaxHttpServer::SendCommandResult for the command.
+The commands are rate limited, raise the limits in menuconfig or use
+--interval, the limited ones are counted apart and not in the times.
+"""
+
+import argparse
+import json
+import socket
+import struct
+import sys
+import time
+
+from boardclient import (BoardError, WebSocket, add_board_arguments, board_from_args,
+                         latency_summary, positive_int)
+
+WS_FRAME_COMMAND = 0x01
+WS_FRAME_ACK = 0x81
+WS_FRAME_RESULT = 0x82
+
+WS_ACK_NAMES = {0: 'queued', 1: 'ignored', 2: 'queue full', 3: 'bad frame', 4: 'limited'}
+WS_ACK_QUEUED = 0
+WS_ACK_LIMITED = 4
+
+
+def count(counts, name):
+    counts[name] = counts.get(name, 0) + 1
+
+
+def run_ws(board, args):
+    times, counts = [], {}
+    ws = WebSocket(board.connection(), '/ws')
+    try:
+        ws.conn.sock.settimeout(args.timeout)
+        for i in range(args.count):
+            cmd_id = i & 0xFFFF
+            frame = struct.pack('<BBHI', WS_FRAME_COMMAND, args.cmd, cmd_id, args.data)
+
+            start = time.perf_counter()
+            ws.send(frame)
+            status = None
+            while True:
+                payload = ws.recv()
+                if len(payload) >= 4 and payload[0] == WS_FRAME_ACK:
+                    if struct.unpack_from('<H', payload, 2)[0] != cmd_id:
+                        continue
+                    status = payload[1]
+                    if not args.result or status != WS_ACK_QUEUED:
+                        break
+                elif len(payload) >= 8 and payload[0] == WS_FRAME_RESULT:
+                    if args.result and struct.unpack_from('<H', payload, 2)[0] == cmd_id:
+                        break
+            elapsed = time.perf_counter() - start
+
+            count(counts, WS_ACK_NAMES.get(status, 'status {}'.format(status)))
+            if status == WS_ACK_QUEUED:
+                times.append(elapsed)
+            time.sleep(args.interval)
+    except socket.timeout:
+        count(counts, 'timeout')
+    finally:
+        ws.close()
+    return times, counts
+
+
+def run_post(board, args, reuse):
+    times, counts = [], {}
+    body = json.dumps({'cmd': args.cmd, 'data': args.data}).encode('utf-8')
+    headers = {'Content-Type': 'application/json'}
+
+    conn = board.connection(args.timeout)
+    try:
+        for _ in range(args.count):
+            if not reuse:
+                conn.close()
+            try:
+                start = time.perf_counter()
+                response = conn.request('POST', '/cmd.json', body, headers)
+                elapsed = time.perf_counter() - start
+            except socket.timeout:
+                count(counts, 'timeout')
+                continue
+
+            count(counts, str(response.status))
+            if response.status == 200:
+                times.append(elapsed)
+            time.sleep(args.interval)
+    finally:
+        conn.close()
+    return times, counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Command round trip time, WebSocket against POST')
+    add_board_arguments(parser)
+    parser.add_argument('-n', '--count', type=positive_int, default=100,
+                        help='commands sent on each channel, default 100')
+    parser.add_argument('--cmd', type=int, default=1, help='command code, 1 to 255, default 1')
+    parser.add_argument('--data', type=int, default=0, help='command data, default 0')
+    parser.add_argument('--interval', type=float, default=0.0,
+                        help='pause between commands in seconds, to stay under the rate limit')
+    parser.add_argument('--result', action='store_true',
+                        help='WebSocket time until the result frame instead of the ack')
+    parser.add_argument('--timeout', type=float, default=5.0, help='seconds to wait for an answer')
+    parser.add_argument('--channel', action='append', choices=('ws', 'post', 'post-new'),
+                        help='channel to measure, can be repeated, all by default')
+    args = parser.parse_args()
+
+    if not 1 <= args.cmd <= 255:
+        parser.error('--cmd must be between 1 and 255')
+
+    board = board_from_args(args)
+    channels = args.channel or ('ws', 'post', 'post-new')
+    runners = {
+        'ws': lambda: run_ws(board, args),
+        'post': lambda: run_post(board, args, True),
+        'post-new': lambda: run_post(board, args, False),
+    }
+
+    for channel in channels:
+        try:
+            times, counts = runners[channel]()
+        except (OSError, BoardError) as e:
+            print('{:<9} error: {}'.format(channel, e))
+            continue
+        answers = ', '.join('{} {}'.format(n, name) for name, n in sorted(counts.items()))
+        print('{:<9} {}'.format(channel, latency_summary(times)))
+        print('{:<9} {}'.format('', answers))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
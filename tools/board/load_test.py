@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Load test of the connection management of a board.
+
+  load_test.py board --clients 24 --slow 4 --idle 4 --duration 30
+
+Runs at the same time:
+
+  clients  poll /status.json on keep-alive connections, reconnecting when the
+           board closes them, like browser tabs
+  slow     send the headers of a request a few bytes at a time and never
+           finish, like slowloris
+  idle     open a connection and send nothing
+  probe    one request on a new connection each second, the latency a new
+           client sees
+
+There are more connections than the sockets of the server, so the board must
+purge the least recently used ones and evict the slow and idle ones. At the end
+are printed the latencies, the errors and, from /metrics, the connections
+opened and evicted during the test.
+"""
+
+import argparse
+import socket
+import sys
+import threading
+import time
+
+from boardclient import (BoardError, add_board_arguments, board_from_args,
+                         latency_summary, positive_int)
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.times = []
+        self.errors = {}
+        self.requests = 0
+        self.reconnects = 0
+
+    def add_time(self, elapsed):
+        with self.lock:
+            self.times.append(elapsed)
+            self.requests += 1
+
+    def add_error(self, error):
+        name = type(error).__name__ if not isinstance(error, BoardError) else str(error)
+        with self.lock:
+            self.errors[name] = self.errors.get(name, 0) + 1
+
+    def add_reconnect(self):
+        with self.lock:
+            self.reconnects += 1
+
+
+def polling_client(board, args, stop, stats):
+    conn = board.connection(args.timeout)
+    connected = False
+    while not stop.is_set():
+        try:
+            if conn.sock is None:
+                if connected:
+                    stats.add_reconnect()
+                connected = True
+            start = time.perf_counter()
+            response = conn.request('GET', args.path)
+            elapsed = time.perf_counter() - start
+            if response.status == 200:
+                stats.add_time(elapsed)
+            else:
+                stats.add_error(BoardError('status {}'.format(response.status)))
+        except (OSError, BoardError) as e:
+            stats.add_error(e)
+            conn.close()
+        stop.wait(args.interval)
+    conn.close()
+
+
+def slow_client(board, args, stop, stats):
+    request = 'GET {} HTTP/1.1\r\nHost: {}\r\nX-Padding: {}'.format(
+        args.path, board.host, 'x' * 4096).encode('ascii')
+    while not stop.is_set():
+        try:
+            sock = socket.create_connection((board.host, board.port), args.timeout)
+        except OSError as e:
+            stats.add_error(e)
+            stop.wait(1.0)
+            continue
+        try:
+            # a few bytes every second, the request is never complete
+            for i in range(0, len(request), 4):
+                if stop.is_set():
+                    break
+                sock.sendall(request[i:i + 4])
+                stop.wait(1.0)
+        except OSError:
+            # closed by the board, expected
+            stats.add_reconnect()
+        finally:
+            sock.close()
+
+
+def idle_client(board, args, stop, stats):
+    while not stop.is_set():
+        try:
+            sock = socket.create_connection((board.host, board.port), args.timeout)
+        except OSError as e:
+            stats.add_error(e)
+            stop.wait(1.0)
+            continue
+        sock.settimeout(1.0)
+        try:
+            while not stop.is_set():
+                try:
+                    if not sock.recv(1):
+                        # closed by the board, expected
+                        stats.add_reconnect()
+                        break
+                except socket.timeout:
+                    pass
+        except OSError:
+            stats.add_reconnect()
+        finally:
+            sock.close()
+
+
+def probe_client(board, args, stop, stats):
+    while not stop.is_set():
+        try:
+            response = board.request('GET', args.path, timeout=args.timeout)
+            if response.status == 200:
+                stats.add_time(response.elapsed)
+            else:
+                stats.add_error(BoardError('status {}'.format(response.status)))
+        except (OSError, BoardError) as e:
+            stats.add_error(e)
+        stop.wait(1.0)
+
+
+def read_counters(board):
+    names = ('esp32bm_http_connections_opened_total', 'esp32bm_http_connections_evicted_total')
+    try:
+        values = board.metrics()
+    except (OSError, BoardError):
+        return None
+    return [values.get(name, 0) for name in names]
+
+
+def print_stats(name, stats):
+    errors = ', '.join('{} {}'.format(n, e) for e, n in sorted(stats.errors.items())) or 'none'
+    print('{:<8} {} requests, {}'.format(name, stats.requests, latency_summary(stats.times)))
+    print('{:<8} errors: {}, reconnects {}'.format('', errors, stats.reconnects))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load test of the connection management')
+    add_board_arguments(parser)
+    parser.add_argument('--clients', type=positive_int, default=24,
+                        help='clients polling on keep-alive connections, default 24')
+    parser.add_argument('--slow', type=int, default=4, help='slowloris clients, default 4')
+    parser.add_argument('--idle', type=int, default=4, help='idle connections, default 4')
+    parser.add_argument('--duration', type=positive_int, default=30, help='seconds, default 30')
+    parser.add_argument('--interval', type=float, default=0.5,
+                        help='pause of the polling clients between requests, default 0.5 s')
+    parser.add_argument('--path', default='/status.json', help='path requested, default /status.json')
+    parser.add_argument('--timeout', type=float, default=10.0, help='seconds to wait for an answer')
+    args = parser.parse_args()
+
+    board = board_from_args(args)
+    counters_before = read_counters(board)
+
+    stop = threading.Event()
+    clients, slow, idle, probe = Stats(), Stats(), Stats(), Stats()
+    threads = []
+    for _ in range(args.clients):
+        threads.append(threading.Thread(target=polling_client, args=(board, args, stop, clients)))
+    for _ in range(args.slow):
+        threads.append(threading.Thread(target=slow_client, args=(board, args, stop, slow)))
+    for _ in range(args.idle):
+        threads.append(threading.Thread(target=idle_client, args=(board, args, stop, idle)))
+    threads.append(threading.Thread(target=probe_client, args=(board, args, stop, probe)))
+
+    print('{} polling, {} slow and {} idle clients for {} s'.format(
+        args.clients, args.slow, args.idle, args.duration))
+    for t in threads:
+        t.daemon = True
+        t.start()
+    try:
+        time.sleep(args.duration)
+    except KeyboardInterrupt:
+        pass
+    stop.set()
+    for t in threads:
+        t.join(args.timeout + 2)
+
+    print_stats('clients', clients)
+    print_stats('probe', probe)
+    print('slow     closed by the board {} times'.format(slow.reconnects))
+    print('idle     closed by the board {} times'.format(idle.reconnects))
+
+    counters_after = read_counters(board)
+    if counters_before is not None and counters_after is not None:
+        print('board    {:.0f} connections opened, {:.0f} evicted'.format(
+            counters_after[0] - counters_before[0], counters_after[1] - counters_before[1]))
+    else:
+        print('board    no /metrics, the connection counters are not known')
+
+    return 0 if probe.times else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Firmware upload in parts, with Content-Range, like the web interface.
+
+  ota_upload.py board app.bin --sha256 app.bin
+
+The file, an image, a gzip compressed image or a patch, is sent to /update
+in parts of 64 KB by default. After a network error or a 5xx the board is
+asked how much it received and the upload resumes from there. Any other
+error is the answer of the board to a bad upload and ends it.
+
+With --sha256 the SHA256 of the given uncompressed image is sent in the
+X-Image-SHA256 header and the board verifies it before activating the image.
+"""
+
+import argparse
+import hashlib
+import re
+import sys
+import time
+
+from boardclient import (BoardError, add_board_arguments, board_from_args,
+                         positive_int)
+
+
+def received_bytes(response):
+    """The bytes received by the board, from the Range header of its answer."""
+    match = re.match(r'bytes=0-(\d+)', response.headers.get('range', ''))
+    return int(match.group(1)) + 1 if match else 0
+
+
+def retriable(status):
+    # 416 has the Range received by the board
+    return status is None or status == 416 or status >= 500
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Firmware upload in parts, with Content-Range')
+    add_board_arguments(parser)
+    parser.add_argument('file', help='image, gzip compressed image or patch')
+    parser.add_argument('--sha256', metavar='IMAGE', help='uncompressed image to send the SHA256 of')
+    parser.add_argument('--part-size', type=positive_int, default=65536,
+                        help='bytes in a part, at most CONFIG_ESP32BM_OTA_MAX_PART_SIZE, default 65536')
+    parser.add_argument('--retries', type=int, default=5, help='retries after an error, default 5')
+    parser.add_argument('--timeout', type=float, default=60.0, help='seconds to wait for an answer')
+    args = parser.parse_args()
+
+    with open(args.file, 'rb') as f:
+        data = f.read()
+    if not data:
+        print('error: {} is empty'.format(args.file), file=sys.stderr)
+        return 1
+    total = len(data)
+
+    headers = {}
+    if args.sha256:
+        with open(args.sha256, 'rb') as f:
+            headers['X-Image-SHA256'] = hashlib.sha256(f.read()).hexdigest()
+
+    board = board_from_args(args)
+    conn = board.connection(args.timeout)
+    start = time.perf_counter()
+    first, retries = 0, 0
+    try:
+        while True:
+            last = min(first + args.part_size, total) - 1
+            if first > last:
+                # "bytes */total" asks the board where to resume
+                part_headers = dict(headers, **{'Content-Range': 'bytes */{}'.format(total)})
+                body = b''
+            else:
+                part_headers = dict(headers, **{'Content-Range': 'bytes {}-{}/{}'.format(first, last, total)})
+                body = data[first:last + 1]
+
+            status, response = None, None
+            try:
+                response = conn.request('POST', '/update', body, part_headers)
+                status = response.status
+            except (OSError, BoardError) as e:
+                conn.close()
+                message = type(e).__name__
+
+            if status == 200:
+                print('\n' + response.body.decode('utf-8', 'replace'))
+                break
+            if status == 202:
+                first, retries = received_bytes(response), 0
+                print('\r{} of {} bytes'.format(first, total), end='', flush=True)
+                continue
+
+            if response is not None:
+                message = '{} {}'.format(status, response.body.decode('utf-8', 'replace'))
+            if not retriable(status) or retries >= args.retries:
+                print('\nerror: {}'.format(message), file=sys.stderr)
+                return 1
+            retries += 1
+            print('\n{}, retrying'.format(message), file=sys.stderr)
+            if status == 416:
+                first = received_bytes(response)
+            else:
+                time.sleep(retries)
+                # the part may be received or not, the board tells where to resume
+                first = total
+    finally:
+        conn.close()
+
+    print('{} bytes in {:.1f} s'.format(total, time.perf_counter() - start))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
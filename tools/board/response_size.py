@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Bytes on the wire and heap used by the JSON responses of a board.
+
+  response_size.py board --save before.json    with the old firmware
+  response_size.py board --compare before.json with the new one
+
+Each endpoint is requested many times on a keep-alive connection. For each one
+are reported the bytes received, status line, headers and chunk framing
+included, the size of the body and the latency.
+
+The heap is read from /metrics before and after the requests of each endpoint:
+the drop of the lowest free heap since boot shows a request which needs more
+heap than any time before, run it soon after boot, and a lower free heap after
+the requests shows a leak. A firmware without /metrics, like the ones before
+the streaming writer, is measured only on the wire.
+"""
+
+import argparse
+import json
+import sys
+
+from boardclient import (Board, BoardError, add_board_arguments, board_from_args,
+                         percentile, positive_int)
+
+ENDPOINTS = ('/info.json', '/status.json', '/config.json')
+
+FREE_HEAP = 'esp32bm_free_heap_bytes'
+MIN_FREE_HEAP = 'esp32bm_min_free_heap_bytes'
+
+
+def read_heap(board):
+    try:
+        values = board.metrics()
+    except (OSError, BoardError):
+        return None
+    if FREE_HEAP not in values:
+        return None
+    return values.get(FREE_HEAP), values.get(MIN_FREE_HEAP)
+
+
+def measure(board, path, count):
+    heap_before = read_heap(board)
+
+    conn = board.connection()
+    wire, body, times, encoding = [], [], [], ''
+    try:
+        for _ in range(count):
+            response = conn.request('GET', path)
+            if response.status != 200:
+                raise BoardError('{} answered {}'.format(path, response.status))
+            wire.append(response.wire_bytes)
+            body.append(len(response.body))
+            times.append(response.elapsed)
+            encoding = 'chunked' if 'transfer-encoding' in response.headers else 'length'
+    finally:
+        conn.close()
+
+    heap_after = read_heap(board)
+
+    result = {
+        'wire': max(wire),
+        'body': max(body),
+        'encoding': encoding,
+        'p50_ms': percentile(times, 50) * 1000,
+        'p99_ms': percentile(times, 99) * 1000,
+    }
+    if heap_before is not None and heap_after is not None:
+        result['leak'] = heap_before[0] - heap_after[0]
+        if heap_before[1] is not None and heap_after[1] is not None:
+            result['min_drop'] = heap_before[1] - heap_after[1]
+    return result
+
+
+def format_row(path, result):
+    heap = '-'
+    if 'leak' in result:
+        heap = 'leak {:.0f}'.format(result['leak'])
+        if 'min_drop' in result:
+            heap = 'min drop {:.0f}, '.format(result['min_drop']) + heap
+    return '{:<14} {:>7} {:>7} {:>8} {:>8.1f} {:>8.1f}  {}'.format(
+        path, result['wire'], result['body'], result['encoding'],
+        result['p50_ms'], result['p99_ms'], heap)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bytes on the wire and heap of the JSON responses')
+    add_board_arguments(parser)
+    parser.add_argument('-n', '--count', type=positive_int, default=50,
+                        help='requests for each endpoint, default 50')
+    parser.add_argument('--path', action='append', help='endpoint to measure, can be repeated')
+    parser.add_argument('--save', help='write the results to a JSON file')
+    parser.add_argument('--compare', help='JSON file saved by a previous run to compare with')
+    args = parser.parse_args()
+
+    board = board_from_args(args)
+    paths = args.path or ENDPOINTS
+
+    previous = {}
+    if args.compare:
+        with open(args.compare) as f:
+            previous = json.load(f)
+
+    results = {}
+    print('{:<14} {:>7} {:>7} {:>8} {:>8} {:>8}  {}'.format(
+        'endpoint', 'wire', 'body', 'framing', 'p50 ms', 'p99 ms', 'heap bytes'))
+    try:
+        for path in paths:
+            results[path] = measure(board, path, args.count)
+            print(format_row(path, results[path]))
+            if path in previous:
+                before = previous[path]
+                print(format_row('  before', before))
+                print('  wire {:+d} bytes, body {:+d} bytes'.format(
+                    results[path]['wire'] - before['wire'], results[path]['body'] - before['body']))
+    except (OSError, BoardError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        return 1
+
+    if not any('leak' in r for r in results.values()):
+        print('no heap values, the firmware has no /metrics')
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(results, f, indent=2)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
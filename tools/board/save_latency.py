@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Latency of /status.json while the configuration is saved.
+
+  save_latency.py board --saves 10
+
+A client polls /status.json on a keep-alive connection, every 50 ms by
+default, first alone then while another client saves the configuration with
+POST /config.json. The configuration posted is the one read from the board,
+unchanged, the passwords left out of GET /config.json are kept by the board.
+
+The percentiles of both phases are printed, run it with the firmware before
+and after a change to compare them. The saves are rate limited, keep
+--interval above the period of the limit set in menuconfig.
+"""
+
+import argparse
+import sys
+import threading
+import time
+
+from boardclient import (BoardError, add_board_arguments, board_from_args,
+                         latency_summary, percentile, positive_int)
+
+
+class Poller:
+    def __init__(self, board, path, period, timeout):
+        self.board = board
+        self.path = path
+        self.period = period
+        self.timeout = timeout
+        self.lock = threading.Lock()
+        self.samples = []
+        self.errors = 0
+        self.stop = threading.Event()
+        self.thread = threading.Thread(target=self.run)
+        self.thread.daemon = True
+
+    def run(self):
+        conn = self.board.connection(self.timeout)
+        while not self.stop.is_set():
+            start = time.perf_counter()
+            try:
+                response = conn.request('GET', self.path)
+                ok = response.status == 200
+            except (OSError, BoardError):
+                conn.close()
+                ok = False
+            end = time.perf_counter()
+            with self.lock:
+                if ok:
+                    self.samples.append((start, end - start))
+                else:
+                    self.errors += 1
+            self.stop.wait(max(0.0, self.period - (end - start)))
+        conn.close()
+
+    def take(self, since, until):
+        """Returns the durations of the requests started between `since` and `until`."""
+        with self.lock:
+            return [d for t, d in self.samples if since <= t < until]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Latency of /status.json while the configuration is saved')
+    add_board_arguments(parser)
+    parser.add_argument('--saves', type=positive_int, default=10, help='configuration saves, default 10')
+    parser.add_argument('--interval', type=float, default=2.0,
+                        help='seconds between the saves, default 2')
+    parser.add_argument('--idle', type=float, default=10.0,
+                        help='seconds polled before the saves, default 10')
+    parser.add_argument('--period', type=float, default=0.05,
+                        help='seconds between the status requests, default 0.05')
+    parser.add_argument('--path', default='/status.json', help='path polled, default /status.json')
+    parser.add_argument('--timeout', type=float, default=30.0, help='seconds to wait for an answer')
+    args = parser.parse_args()
+
+    board = board_from_args(args)
+    try:
+        response = board.request('GET', '/config.json', timeout=args.timeout)
+    except (OSError, BoardError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        return 1
+    if response.status != 200:
+        print('error: GET /config.json answered {}'.format(response.status), file=sys.stderr)
+        return 1
+    config = response.body
+
+    poller = Poller(board, args.path, args.period, args.timeout)
+    idle_start = time.perf_counter()
+    poller.thread.start()
+    time.sleep(args.idle)
+
+    save_times, save_answers = [], {}
+    saves_start = time.perf_counter()
+    conn = board.connection(args.timeout)
+    try:
+        for _ in range(args.saves):
+            try:
+                response = conn.request('POST', '/config.json', config,
+                                        {'Content-Type': 'application/json'})
+                status = str(response.status)
+                if response.status == 200:
+                    save_times.append(response.elapsed)
+            except (OSError, BoardError) as e:
+                conn.close()
+                status = type(e).__name__
+            save_answers[status] = save_answers.get(status, 0) + 1
+            time.sleep(args.interval)
+    finally:
+        conn.close()
+        poller.stop.set()
+        poller.thread.join(args.timeout)
+
+    idle = poller.take(idle_start, saves_start)
+    during = poller.take(saves_start, time.perf_counter())
+
+    print('{:<8} {:>5} requests, {}'.format('idle', len(idle), latency_summary(idle)))
+    print('{:<8} {:>5} requests, {}'.format('saving', len(during), latency_summary(during)))
+    if idle and during:
+        print('p99 while saving is {:.1f}x the idle p99'.format(
+            percentile(during, 99) / percentile(idle, 99)))
+    print('saves    {}, {}'.format(
+        ', '.join('{} {}'.format(n, s) for s, n in sorted(save_answers.items())),
+        latency_summary(save_times)))
+    print('status   {} failed requests'.format(poller.errors))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
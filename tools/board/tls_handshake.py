@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Cost of the TLS handshake of a board, full against resumed.
+
+  tls_handshake.py board -n 20
+
+Each round requests /status.json three ways:
+
+  full     a new connection without a session, a full handshake
+  resumed  a new connection with the session of the previous one, resumed if
+           the board has session tickets or a session cache
+  reused   a second request on the keep-alive connection, no handshake
+
+For the new connections the handshake time, TCP connect included, is printed
+apart from the time of the whole request. A board which does not resume the
+sessions is reported, the resumed connections are then full handshakes.
+"""
+
+import argparse
+import sys
+import time
+
+from boardclient import (BoardError, add_board_arguments, board_from_args,
+                         latency_summary, positive_int)
+
+
+def timed_request(conn, path):
+    response = conn.request('GET', path)
+    if response.status != 200:
+        raise BoardError('{} answered {}'.format(path, response.status))
+    return response.elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description='TLS handshake, full against resumed')
+    add_board_arguments(parser)
+    parser.add_argument('-n', '--count', type=positive_int, default=20, help='rounds, default 20')
+    parser.add_argument('--path', default='/status.json', help='path requested, default /status.json')
+    parser.add_argument('--pause', type=float, default=0.2,
+                        help='seconds between the connections, default 0.2')
+    args = parser.parse_args()
+    args.tls = True
+
+    board = board_from_args(args)
+    handshakes = {'full': [], 'resumed': []}
+    requests = {'full': [], 'resumed': [], 'reused': []}
+    resumed_count = 0
+
+    try:
+        for _ in range(args.count):
+            conn = board.connection()
+            conn.connect(None)
+            handshakes['full'].append(conn.connect_time)
+            requests['full'].append(conn.connect_time + timed_request(conn, args.path))
+            requests['reused'].append(timed_request(conn, args.path))
+            session = conn.session
+            conn.close()
+            time.sleep(args.pause)
+
+            conn = board.connection()
+            conn.connect(session)
+            if conn.session_reused:
+                resumed_count += 1
+            handshakes['resumed'].append(conn.connect_time)
+            requests['resumed'].append(conn.connect_time + timed_request(conn, args.path))
+            conn.close()
+            time.sleep(args.pause)
+    except (OSError, BoardError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        return 1
+
+    print('handshake, TCP connect included')
+    for name in ('full', 'resumed'):
+        print('  {:<8} {}'.format(name, latency_summary(handshakes[name])))
+    print('request, with the handshake of a new connection')
+    for name in ('full', 'resumed', 'reused'):
+        print('  {:<8} {}'.format(name, latency_summary(requests[name])))
+    print('{} of {} sessions resumed'.format(resumed_count, args.count))
+    if resumed_count == 0:
+        print('the board does not resume the sessions, enable the session tickets')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,439 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * Host test of HTTPCommandRing
+ *
+ * The counters are checked from a single thread first. Then producer threads push single
+ * commands and batches, some with payloads, into both lanes while a consumer thread takes them
+ * with Receive, which waits on the task notification stubbed with a condition variable.
+ * The consumer checks the order of the commands of each producer in each lane, that the
+ * commands of a batch are consecutive, the content of the payloads and, with a map of the
+ * owner of each payload block, that no block is claimed twice.
+ *
+ *   cmd_ring_test [producers] [commands per producer]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "HTTPCommandRing.h"
+
+// -----------------------------------------------------------------------------
+
+static std::atomic<unsigned> failures(0);
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        ++failures; \
+    } \
+} while (0)
+
+const uint8_t sentinelCommand = 0xFF;
+
+class TestRing : public HTTPCommandRing
+{
+public:
+    const uint8_t* Pool(void) { return pool; }
+};
+
+static HTTPCommand MakeCommand(uint8_t command, uint8_t lane, uint32_t data)
+{
+    HTTPCommand cmd;
+    cmd.command = command;
+    cmd.lane = lane;
+    cmd.data = data;
+    return cmd;
+}
+
+// -----------------------------------------------------------------------------
+
+static void TestCounters(void)
+{
+    TestRing ring;
+    HTTPCommand cmd;
+
+    CHECK(!ring.Push(MakeCommand(1, HTTPCommandLaneNormal, 0)));
+    CHECK(ring.DroppedCount() == 1);
+    CHECK(ring.Create());
+    CHECK(ring.DroppedCount() == 0);
+
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        CHECK(ring.Occupancy(lane) == 0);
+        CHECK(ring.HighWaterMark(lane) == 0);
+    }
+    CHECK(!ring.Receive(cmd, 0));
+
+    for (uint32_t i = 0; i < 5; ++i) {
+        CHECK(ring.Push(MakeCommand(1, HTTPCommandLaneNormal, i)));
+    }
+    HTTPCommand batch[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        // the lane of the first command is used for all
+        batch[i] = MakeCommand(2, (i == 0) ? HTTPCommandLaneHigh : HTTPCommandLaneNormal, i);
+    }
+    CHECK(ring.PushAll(batch, 3));
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == 5);
+    CHECK(ring.Occupancy(HTTPCommandLaneHigh) == 3);
+    CHECK(ring.HighWaterMark(HTTPCommandLaneNormal) == 5);
+    CHECK(ring.HighWaterMark(HTTPCommandLaneHigh) == 3);
+
+    // the high priority lane first, each in order
+    for (uint32_t i = 0; i < 3; ++i) {
+        CHECK(ring.Receive(cmd, 0));
+        CHECK((cmd.command == 2) && (cmd.data == i) && (cmd.lane == HTTPCommandLaneHigh));
+    }
+    for (uint32_t i = 0; i < 5; ++i) {
+        CHECK(ring.Receive(cmd, 0));
+        CHECK((cmd.command == 1) && (cmd.data == i) && (cmd.lane == HTTPCommandLaneNormal));
+    }
+    CHECK(!ring.Receive(cmd, 0));
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == 0);
+    CHECK(ring.HighWaterMark(HTTPCommandLaneNormal) == 5);
+
+    // a full lane, the other one is not affected
+    uint32_t pushed = 0;
+    while (ring.Push(MakeCommand(3, HTTPCommandLaneNormal, pushed))) ++pushed;
+    CHECK(pushed == HTTPCommandRingSize);
+    CHECK(ring.DroppedCount() == 1);
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == HTTPCommandRingSize);
+    CHECK(ring.HighWaterMark(HTTPCommandLaneNormal) == HTTPCommandRingSize);
+    CHECK(ring.Push(MakeCommand(4, HTTPCommandLaneHigh, 0)));
+    CHECK(ring.Receive(cmd, 0) && (cmd.command == 4));
+
+    // all or none, a batch larger than the free slots adds nothing
+    CHECK(ring.Receive(cmd, 0) && (cmd.data == 0));
+    CHECK(ring.Receive(cmd, 0) && (cmd.data == 1));
+    HTTPCommand three[3];
+    for (uint32_t i = 0; i < 3; ++i) three[i] = MakeCommand(5, HTTPCommandLaneNormal, 100 + i);
+    CHECK(!ring.PushAll(three, 3));
+    CHECK(ring.DroppedCount() == 4);
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == HTTPCommandRingSize - 2);
+    CHECK(ring.PushAll(three, 2));
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == HTTPCommandRingSize);
+
+    for (uint32_t i = 2; i < HTTPCommandRingSize; ++i) {
+        CHECK(ring.Receive(cmd, 0) && (cmd.command == 3) && (cmd.data == i));
+    }
+    CHECK(ring.Receive(cmd, 0) && (cmd.command == 5) && (cmd.data == 100));
+    CHECK(ring.Receive(cmd, 0) && (cmd.command == 5) && (cmd.data == 101));
+    CHECK(!ring.Receive(cmd, 0));
+
+    // a batch can not be larger than a lane
+    std::vector<HTTPCommand> large(HTTPCommandRingSize + 1, MakeCommand(6, HTTPCommandLaneNormal, 0));
+    CHECK(!ring.PushAll(large.data(), HTTPCommandRingSize + 1));
+    CHECK(ring.DroppedCount() == 4 + HTTPCommandRingSize + 1);
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == 0);
+    CHECK(ring.PushAll(large.data(), (uint8_t)HTTPCommandRingSize));
+    CHECK(ring.Occupancy(HTTPCommandLaneNormal) == HTTPCommandRingSize);
+
+    // Receive waits, then gives up
+    ring.Create();
+    auto start = std::chrono::steady_clock::now();
+    CHECK(!ring.Receive(cmd, 20));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+    // the payload pool
+    HTTPPayload payload;
+    CHECK(!ring.AllocPayload(0, payload));
+    CHECK(!ring.AllocPayload(HTTPPayloadBlockSize * HTTPPayloadBlockCount + 1, payload));
+    CHECK(ring.AllocPayload(HTTPPayloadBlockSize * HTTPPayloadBlockCount, payload));
+    CHECK(payload.blockCount == HTTPPayloadBlockCount);
+    CHECK(ring.PayloadBlocksUsed() == HTTPPayloadBlockCount);
+    ring.FreePayload(payload);
+    CHECK(ring.PayloadBlocksUsed() == 0);
+    CHECK(ring.PayloadHighWaterMark() == HTTPPayloadBlockCount);
+
+    std::vector<HTTPPayload> single(HTTPPayloadBlockCount);
+    for (uint8_t i = 0; i < HTTPPayloadBlockCount; ++i) {
+        CHECK(ring.AllocPayload(1, single[i]));
+        CHECK(single[i].data == ring.Pool() + single[i].firstBlock * HTTPPayloadBlockSize);
+    }
+    CHECK(!ring.AllocPayload(1, payload));
+    CHECK(payload.blockCount == 0);
+
+    // free blocks which are not contiguous do not make a run
+    ring.FreePayload(single[3]);
+    ring.FreePayload(single[5]);
+    CHECK(!ring.AllocPayload(HTTPPayloadBlockSize + 1, payload));
+    ring.FreePayload(single[4]);
+    CHECK(ring.AllocPayload(3 * HTTPPayloadBlockSize, payload));
+    CHECK((payload.firstBlock == 3) && (payload.blockCount == 3));
+    CHECK(ring.PayloadBlocksUsed() == HTTPPayloadBlockCount);
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * The data of a command is its sequence number in the lane, for its producer. The id has
+ * the length of the batch and the index in it, from which the consumer knows what follows.
+ */
+struct StressState
+{
+    TestRing ring;
+    unsigned commandsPerProducer;
+
+    std::atomic<int> blockOwner[HTTPPayloadBlockCount];
+    std::atomic<unsigned> doubleClaims;
+    std::atomic<uint32_t> pushedCommands;
+    std::atomic<uint32_t> droppedCommands;
+};
+
+static uint8_t PayloadByte(unsigned producer, uint32_t seq, size_t index)
+{
+    return (uint8_t)(producer * 31 + seq * 7 + index);
+}
+
+static void SetOwner(StressState& state, const HTTPPayload& payload, int from, int to)
+{
+    for (uint8_t b = 0; b < payload.blockCount; ++b) {
+        int expected = from;
+        if (!state.blockOwner[payload.firstBlock + b].compare_exchange_strong(expected, to))
+            ++state.doubleClaims;
+    }
+}
+
+static bool AllocPayloads(StressState& state, unsigned producer, HTTPCommand *cmds, const size_t *lengths, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; ++i) {
+        if (lengths[i] == 0) continue;
+
+        if (!state.ring.AllocPayload(lengths[i], cmds[i].payload)) {
+            while (i-- > 0) {
+                SetOwner(state, cmds[i].payload, (int)producer, -1);
+                state.ring.FreePayload(cmds[i].payload);
+            }
+            return false;
+        }
+        SetOwner(state, cmds[i].payload, -1, (int)producer);
+        for (size_t j = 0; j < lengths[i]; ++j) {
+            cmds[i].payload.data[j] = PayloadByte(producer, cmds[i].data, j);
+        }
+    }
+    return true;
+}
+
+static void Producer(StressState& state, unsigned producer)
+{
+    uint32_t random = 12345 + producer;
+    auto Random = [&random](uint32_t range) {
+        random = random * 1103515245u + 12345u;
+        return (random >> 8) % range;
+    };
+
+    uint32_t seq[HTTPCommandLanes] = { 0, 0 };
+    unsigned sent = 0;
+    while (sent < state.commandsPerProducer) {
+        uint8_t lane = (uint8_t)Random(HTTPCommandLanes);
+        uint8_t count = 1 + Random(4);
+        if (count > state.commandsPerProducer - sent) count = state.commandsPerProducer - sent;
+
+        HTTPCommand cmds[4];
+        size_t lengths[4];
+        for (uint8_t i = 0; i < count; ++i) {
+            HTTPCommand& cmd = cmds[i];
+            cmd.command = 1 + producer;
+            cmd.lane = lane;
+            cmd.data = seq[lane] + i;
+            cmd.id = (uint16_t)((count << 8) | i);
+            if (count > 1) {
+                cmd.flags = HTTPCommandFlagBatch;
+                if (i == count - 1) cmd.flags |= HTTPCommandFlagBatchEnd;
+            }
+            lengths[i] = (Random(4) == 0) ? 1 + Random(3 * HTTPPayloadBlockSize) : 0;
+        }
+
+        // the payloads of a batch are claimed together, waiting with some of them could
+        // block the producers which hold the other blocks
+        while (!AllocPayloads(state, producer, cmds, lengths, count)) std::this_thread::yield();
+
+        // on failure the payloads are still owned by the producer, the same batch is pushed again
+        while (!state.ring.PushAll(cmds, count)) {
+            state.droppedCommands += count;
+            std::this_thread::yield();
+        }
+        state.pushedCommands += count;
+        seq[lane] += count;
+        sent += count;
+    }
+}
+
+struct BatchState
+{
+    bool open;
+    unsigned producer;
+    uint8_t length;
+    uint8_t index;
+};
+
+static uint32_t Consumer(StressState& state, unsigned producers)
+{
+    std::vector<uint32_t> expected(producers * HTTPCommandLanes, 0);
+    BatchState batch[HTTPCommandLanes] = {};
+    uint32_t received = 0;
+
+    for (;;) {
+        HTTPCommand cmd;
+        // waits only on the notifications, a lost wakeup blocks the test
+        if (!state.ring.Receive(cmd, portMAX_DELAY)) {
+            CHECK(false);
+            break;
+        }
+        if (cmd.command == sentinelCommand) break;
+
+        unsigned producer = cmd.command - 1;
+        CHECK(producer < producers);
+        CHECK(cmd.lane < HTTPCommandLanes);
+        if ((producer >= producers) || (cmd.lane >= HTTPCommandLanes)) break;
+        ++received;
+
+        // the order of each producer, in each lane
+        uint32_t& next = expected[producer * HTTPCommandLanes + cmd.lane];
+        CHECK(cmd.data == next);
+        next = cmd.data + 1;
+
+        // the commands of a batch are consecutive in their lane
+        BatchState& b = batch[cmd.lane];
+        uint8_t length = cmd.id >> 8;
+        uint8_t index = cmd.id & 0xFF;
+        if (b.open) {
+            CHECK((producer == b.producer) && (length == b.length) && (index == b.index + 1));
+        }
+        else {
+            CHECK(index == 0);
+        }
+        b.open = (index + 1 < length);
+        b.producer = producer;
+        b.length = length;
+        b.index = index;
+
+        uint8_t flags = 0;
+        if (length > 1) {
+            flags = HTTPCommandFlagBatch;
+            if (index == length - 1) flags |= HTTPCommandFlagBatchEnd;
+        }
+        CHECK(cmd.flags == flags);
+
+        if (cmd.payload.blockCount > 0) {
+            CHECK(cmd.payload.data == state.ring.Pool() + cmd.payload.firstBlock * HTTPPayloadBlockSize);
+            CHECK(cmd.payload.firstBlock + cmd.payload.blockCount <= HTTPPayloadBlockCount);
+            bool same = true;
+            for (size_t j = 0; j < cmd.payload.length; ++j) {
+                if (cmd.payload.data[j] != PayloadByte(producer, cmd.data, j)) same = false;
+            }
+            CHECK(same);
+
+            // the blocks are given back before Release so a producer can claim them at once
+            SetOwner(state, cmd.payload, (int)producer, -1);
+        }
+        state.ring.Release(cmd);
+        CHECK(cmd.payload.blockCount == 0);
+
+        for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+            CHECK(state.ring.Occupancy(lane) <= HTTPCommandRingSize);
+        }
+    }
+
+    for (unsigned p = 0; p < producers; ++p) {
+        CHECK(expected[p * HTTPCommandLanes] + expected[p * HTTPCommandLanes + 1] == state.commandsPerProducer);
+    }
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        CHECK(!batch[lane].open);
+    }
+    return received;
+}
+
+static void TestStress(unsigned producers, unsigned commandsPerProducer)
+{
+    StressState state;
+    state.commandsPerProducer = commandsPerProducer;
+    for (auto& owner : state.blockOwner) owner = -1;
+    state.doubleClaims = 0;
+    state.pushedCommands = 0;
+    state.droppedCommands = 0;
+    CHECK(state.ring.Create());
+
+    auto start = std::chrono::steady_clock::now();
+    std::future<uint32_t> consumer = std::async(std::launch::async, Consumer, std::ref(state), producers);
+
+    // the producers and the sentinel are on another thread so a blocked ring fails the test
+    std::thread feeder([&state, producers] {
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < producers; ++p) {
+            threads.emplace_back(Producer, std::ref(state), p);
+        }
+        for (auto& t : threads) t.join();
+
+        // after all the other commands, the high priority lane is taken first
+        while (!state.ring.Push(MakeCommand(sentinelCommand, HTTPCommandLaneNormal, 0))) {
+            ++state.droppedCommands;
+            std::this_thread::yield();
+        }
+    });
+
+    if (consumer.wait_for(std::chrono::seconds(60)) != std::future_status::ready) {
+        fprintf(stderr, "FAILED the ring is blocked\n");
+        std::_Exit(1);
+    }
+    feeder.join();
+    uint32_t received = consumer.get();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(received == producers * commandsPerProducer);
+    CHECK(received == state.pushedCommands);
+    CHECK(state.doubleClaims == 0);
+    CHECK(state.ring.DroppedCount() == state.droppedCommands);
+    CHECK(state.ring.PayloadBlocksUsed() == 0);
+    CHECK(state.ring.PayloadHighWaterMark() <= HTTPPayloadBlockCount);
+    for (uint8_t lane = 0; lane < HTTPCommandLanes; ++lane) {
+        CHECK(state.ring.Occupancy(lane) == 0);
+        CHECK(state.ring.HighWaterMark(lane) > 0);
+        CHECK(state.ring.HighWaterMark(lane) <= HTTPCommandRingSize);
+    }
+
+    printf("%u producers: %u commands in %.0f ms, %u retried pushes, high water marks %u and %u of %u, payload %u of %u blocks\n",
+        producers, (unsigned)received, ms, (unsigned)state.droppedCommands,
+        (unsigned)state.ring.HighWaterMark(HTTPCommandLaneHigh), (unsigned)state.ring.HighWaterMark(HTTPCommandLaneNormal),
+        (unsigned)HTTPCommandRingSize, state.ring.PayloadHighWaterMark(), HTTPPayloadBlockCount);
+}
+
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned producers = (argc > 1) ? atoi(argv[1]) : 6;
+    unsigned commands = (argc > 2) ? atoi(argv[2]) : 50000;
+
+    TestCounters();
+    TestStress(1, commands);
+    TestStress(producers, commands);
+
+    if (failures != 0) {
+        printf("cmd_ring_test: %u checks failed\n", (unsigned)failures);
+        return 1;
+    }
+    printf("cmd_ring_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,336 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * Host benchmark of the response formats
+ *
+ * The documents of info.json and config.json, written with the members of
+ * PaxHttpServer::WriteJSONInfo and Configuration::WriteJSON, and a status document of
+ * a board with sensors are written by JSONWriter, CBORWriter and MsgPackWriter through
+ * a buffer of JSONWriterBufferSize bytes, like HTTPFormatWriter does for the responses.
+ * For each format are reported the size, the time to write the document and the time
+ * to read it back with JSONReader or BinaryReader, like a POST of config.json.
+ * The values read back must be the same in every format.
+ *
+ *   format_bench [iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "JSONWriter.h"
+#include "BinaryWriter.h"
+#include "JSONReader.h"
+#include "BinaryReader.h"
+
+// HTTPChunkSink is built with JSONWriter.cpp but not used here
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    return ESP_FAIL;
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Collects the data of a writer, the capacity is kept between the documents
+ */
+class StringSink : public JSONSink
+{
+public:
+    std::string data;
+
+    bool Write(const char *block, size_t length)
+    {
+        data.append(block, length);
+        return true;
+    }
+};
+
+/**
+ * @brief Keeps the values read as text, to compare the documents of the formats
+ */
+class RecordingHandler : public JSONReaderHandler
+{
+public:
+    std::string values;
+    bool record;
+
+    RecordingHandler(bool recordValues) : record(recordValues) {}
+
+    bool OnValue(uint8_t depth, const char *key, const JSONValue& value)
+    {
+        char text[JSONReaderTokenSize];
+        if (value.type == JSONValueType::string) {
+            if (!value.ToString(text, sizeof(text))) return false;
+        }
+        else if (value.type == JSONValueType::number) {
+            double number;
+            if (!value.ToDouble(number)) return false;
+            if (record) snprintf(text, sizeof(text), "%.9g", number);
+        }
+        else if (value.type == JSONValueType::boolean) {
+            strcpy(text, value.boolean ? "true" : "false");
+        }
+        else {
+            strcpy(text, "null");
+        }
+
+        if (record) {
+            values += std::to_string(depth) + ' ' + (key != nullptr ? key : "-") + '=' + text + '\n';
+        }
+        return true;
+    }
+
+    bool OnBegin(uint8_t depth, const char *key, bool isArray)
+    {
+        if (record) {
+            values += std::to_string(depth) + ' ' + (key != nullptr ? key : "-") + (isArray ? "[\n" : "{\n");
+        }
+        return true;
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+typedef bool (*DocumentFn)(JSONWriter&);
+
+// the members of PaxHttpServer::WriteJSONInfo
+static bool WriteInfo(JSONWriter& writer)
+{
+    writer.AddString("title", "pax-board-kitchen");
+    writer.AddString("tagline", "Kitchen sensors and lights");
+    writer.AddString("appName", "ExampleBoard");
+    writer.AddString("appVersion", "1.4.2-17-g3c9e0d1");
+    writer.AddString("link", "https://github.com/CalinRadoni/ESP32BoardManager");
+    writer.AddString("compileTime", "Oct 17 2020 21:08:06");
+    writer.AddString("idfVersion", "v4.1-dirty");
+    writer.AddString("elfSHA256", "4f2a9c1d7e6b58a03c9d2e1f0a7b6c5d4e3f2a1b0c9d8e7f6a5b4c3d2e1f0a9b");
+    writer.AddString("hwInfo", "ESP32 rev 1, 2 cores, WiFi BT BLE, 4 MB flash");
+    return writer.IsOK();
+}
+
+// the members of Configuration::WriteJSON
+static bool WriteConfig(JSONWriter& writer)
+{
+    writer.AddUInt("version", 1);
+    writer.AddString("name", "pax-board-kitchen");
+    writer.AddString("pass", "correct horse battery staple");
+    writer.AddString("ap1s", "HomeNetwork");
+    writer.AddString("ap1p", "a long wifi passphrase");
+    writer.AddString("ap2s", "HomeNetwork-5G");
+    writer.AddString("ap2p", "another long passphrase");
+    writer.AddString("ipAddr", "192.168.1.50");
+    writer.AddString("ipMask", "255.255.255.0");
+    writer.AddString("ipGateway", "192.168.1.1");
+    writer.AddString("ipDNS", "192.168.1.1");
+    return writer.IsOK();
+}
+
+// a status of a board from a WriteJSONStatus override, mostly numbers
+static bool WriteStatus(JSONWriter& writer)
+{
+    writer.AddUInt("uptime", 1234567);
+    writer.AddUInt("heap", 181234);
+    writer.AddUInt("minHeap", 150112);
+    writer.AddInt("rssi", -67);
+    writer.AddBool("connected", true);
+    writer.BeginArray("sensors");
+    for (unsigned i = 0; i < 8; ++i) {
+        writer.BeginObject(nullptr);
+        writer.AddUInt("id", i);
+        writer.AddDouble("value", 20.5 + 0.25 * i);
+        writer.AddBool("ok", (i % 3) != 0);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.BeginArray("relays");
+    for (unsigned i = 0; i < 4; ++i) {
+        writer.AddBool(nullptr, (i % 2) != 0);
+    }
+    writer.EndArray();
+    return writer.IsOK();
+}
+
+// -----------------------------------------------------------------------------
+
+enum class Format : uint8_t {
+    json, cbor, msgpack
+};
+
+static const char* FormatName(Format format)
+{
+    switch (format) {
+        case Format::json: return "json";
+        case Format::cbor: return "cbor";
+        case Format::msgpack: return "msgpack";
+    }
+    return "?";
+}
+
+/**
+ * @brief Writes the document like the handlers of the server, returns false on error
+ */
+static bool WriteDocument(Format format, DocumentFn document, StringSink& sink)
+{
+    char buffer[JSONWriterBufferSize];
+    sink.data.clear();
+
+    bool ok = false;
+    switch (format) {
+        case Format::json: {
+            JSONWriter writer(buffer, JSONWriterBufferSize, &sink);
+            writer.BeginObject(nullptr);
+            ok = document(writer);
+            writer.EndObject();
+            ok = ok && writer.Flush();
+            break;
+        }
+        case Format::cbor: {
+            CBORWriter writer(buffer, JSONWriterBufferSize, &sink);
+            writer.BeginObject(nullptr);
+            ok = document(writer);
+            writer.EndObject();
+            ok = ok && writer.Flush();
+            break;
+        }
+        case Format::msgpack: {
+            MsgPackWriter writer(buffer, JSONWriterBufferSize, &sink);
+            writer.BeginObject(nullptr);
+            ok = document(writer);
+            writer.EndObject();
+            ok = ok && writer.Flush();
+            break;
+        }
+    }
+    return ok;
+}
+
+static bool ReadDocument(Format format, const std::string& data, RecordingHandler& handler)
+{
+    if (format == Format::json) {
+        JSONReader reader(&handler);
+        reader.Feed(data.data(), data.size());
+        return reader.Finish();
+    }
+
+    BinaryReader reader((format == Format::cbor) ? BinaryFormat::cbor : BinaryFormat::msgpack, &handler);
+    reader.Feed(data.data(), data.size());
+    return reader.Finish();
+}
+
+// -----------------------------------------------------------------------------
+
+static volatile size_t sink;
+
+const unsigned benchRounds = 5;
+
+/**
+ * @brief Returns the time of an operation in ns, the best of benchRounds runs
+ */
+template <typename Operation>
+static double Measure(unsigned iterations, Operation operation)
+{
+    double best = 0;
+
+    for (unsigned round = 0; round < benchRounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            if (!operation()) {
+                fprintf(stderr, "FAILED operation\n");
+                exit(1);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        if ((round == 0) || (ns < best)) best = ns;
+    }
+    return best;
+}
+
+// -----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = (argc > 1) ? (unsigned)strtoul(argv[1], nullptr, 10) : 100000;
+    if (iterations == 0) iterations = 1;
+
+    struct Document {
+        const char *name;
+        DocumentFn write;
+    };
+    const Document docs[] = {
+        { "info.json", WriteInfo },
+        { "config.json", WriteConfig },
+        { "status, 8 sensors", WriteStatus },
+    };
+    const Format formats[] = { Format::json, Format::cbor, Format::msgpack };
+
+    unsigned failures = 0;
+    printf("ns per document, best of %u runs of %u documents\n", benchRounds, iterations);
+    printf("%-18s %-8s %7s %7s %10s %10s\n", "", "", "bytes", "size", "write", "read");
+
+    for (const Document& doc : docs) {
+        std::string jsonValues;
+        size_t jsonSize = 0;
+
+        for (Format format : formats) {
+            // the values read back must be the ones of the JSON document
+            StringSink out;
+            RecordingHandler recorder(true);
+            if (!WriteDocument(format, doc.write, out) || !ReadDocument(format, out.data, recorder)) {
+                fprintf(stderr, "FAILED %s can not be written and read as %s\n", doc.name, FormatName(format));
+                ++failures;
+                continue;
+            }
+            if (format == Format::json) {
+                jsonValues = recorder.values;
+                jsonSize = out.data.size();
+            }
+            else if (recorder.values != jsonValues) {
+                fprintf(stderr, "FAILED %s as %s does not have the values of the JSON document\n", doc.name, FormatName(format));
+                ++failures;
+            }
+
+            const std::string data = out.data;
+            double write = Measure(iterations, [format, &doc, &out]() {
+                bool ok = WriteDocument(format, doc.write, out);
+                sink = out.data.size();
+                return ok;
+            });
+            double read = Measure(iterations, [format, &data]() {
+                RecordingHandler handler(false);
+                return ReadDocument(format, data, handler);
+            });
+
+            printf("%-18s %-8s %7u %6.0f%% %10.1f %10.1f\n", doc.name, FormatName(format), (unsigned)data.size(),
+                (100.0 * data.size()) / jsonSize, write, read);
+        }
+    }
+
+    if (failures != 0) {
+        printf("format_bench: %u checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
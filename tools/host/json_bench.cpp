@@ -0,0 +1,313 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * Host benchmark of JSONReader
+ *
+ * The documents received by the server, a command and a configuration, plus an array of
+ * commands and a larger document, are parsed and every value is visited:
+ * - JSONReader, the document fed whole and in chunks of 64 bytes, like from httpd_req_recv
+ * - cJSON, the parser which JSONReader replaced, the document parsed to a tree which is walked
+ *   and deleted, with the peak of the heap used by the tree
+ * cJSON is built when HAVE_CJSON is defined, the Makefile does it if it finds cJSON.c in
+ * CJSON_DIR, by default the copy from ESP-IDF, $(IDF_PATH)/components/json/cJSON.
+ *
+ *   json_bench [iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "JSONReader.h"
+
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Visits the values like the handlers of the server, the strings are copied
+ */
+class CountingHandler : public JSONReaderHandler
+{
+public:
+    unsigned values;
+    unsigned containers;
+    size_t stringBytes;
+
+    CountingHandler(void) { Clear(); }
+
+    void Clear(void)
+    {
+        values = 0;
+        containers = 0;
+        stringBytes = 0;
+    }
+
+    bool OnValue(uint8_t depth, const char *key, const JSONValue& value)
+    {
+        ++values;
+        if (value.type == JSONValueType::string) {
+            char str[JSONReaderTokenSize];
+            if (!value.ToString(str, sizeof(str))) return false;
+            stringBytes += value.length;
+        }
+        else if (value.type == JSONValueType::number) {
+            double number;
+            if (!value.ToDouble(number)) return false;
+        }
+        return true;
+    }
+
+    bool OnBegin(uint8_t depth, const char *key, bool isArray)
+    {
+        ++containers;
+        return true;
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+#ifdef HAVE_CJSON
+
+static size_t heapUsed = 0;
+static size_t heapPeak = 0;
+
+// the size is kept before the block to count the heap used by the tree
+static void* CountingMalloc(size_t size)
+{
+    size_t *block = (size_t*)malloc(size + sizeof(size_t));
+    if (block == nullptr) return nullptr;
+
+    *block = size;
+    heapUsed += size;
+    if (heapUsed > heapPeak) heapPeak = heapUsed;
+    return block + 1;
+}
+
+static void CountingFree(void *ptr)
+{
+    if (ptr == nullptr) return;
+
+    size_t *block = (size_t*)ptr - 1;
+    heapUsed -= *block;
+    free(block);
+}
+
+static void VisitCJSON(const cJSON *item, CountingHandler& counter)
+{
+    for (; item != nullptr; item = item->next) {
+        if (cJSON_IsObject(item) || cJSON_IsArray(item)) {
+            ++counter.containers;
+            VisitCJSON(item->child, counter);
+        }
+        else {
+            ++counter.values;
+            if (cJSON_IsString(item) && (item->valuestring != nullptr)) {
+                char str[JSONReaderTokenSize];
+                strncpy(str, item->valuestring, sizeof(str) - 1);
+                str[sizeof(str) - 1] = 0;
+                counter.stringBytes += strlen(item->valuestring);
+            }
+        }
+    }
+}
+
+static bool ParseCJSON(const std::string& doc, CountingHandler& counter)
+{
+    cJSON *root = cJSON_Parse(doc.c_str());
+    if (root == nullptr) return false;
+
+    VisitCJSON(root, counter);
+    cJSON_Delete(root);
+    return true;
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+
+static bool ParseReader(const std::string& doc, size_t chunk, CountingHandler& counter)
+{
+    JSONReader reader(&counter);
+
+    for (size_t pos = 0; pos < doc.size(); pos += chunk) {
+        size_t len = doc.size() - pos;
+        if (len > chunk) len = chunk;
+        if (!reader.Feed(doc.data() + pos, len)) return false;
+    }
+    return reader.Finish();
+}
+
+// -----------------------------------------------------------------------------
+
+static std::string CommandDoc(unsigned cmd, unsigned data)
+{
+    return "{\"cmd\": " + std::to_string(cmd) + ", \"data\": " + std::to_string(data) + "}";
+}
+
+static std::string BatchDoc(unsigned count)
+{
+    std::string doc = "[";
+    for (unsigned i = 0; i < count; ++i) {
+        if (i != 0) doc += ", ";
+        doc += CommandDoc(1 + i, 1000 * i);
+    }
+    return doc + "]";
+}
+
+static std::string ConfigDoc(void)
+{
+    return "{\"version\": 1, \"name\": \"pax-board-kitchen\", \"pass\": \"correct horse battery staple\", "
+        "\"ap1s\": \"HomeNetwork\", \"ap1p\": \"a long wifi passphrase\", "
+        "\"ap2s\": \"HomeNetwork-5G\", \"ap2p\": \"another long passphrase\", "
+        "\"ipAddr\": \"192.168.1.50\", \"ipMask\": \"255.255.255.0\", "
+        "\"ipGateway\": \"192.168.1.1\", \"ipDNS\": \"192.168.1.1\"}";
+}
+
+// a status like document, nested objects and arrays, escapes and numbers of all kinds
+static std::string LargeDoc(unsigned sensors)
+{
+    std::string doc = "{\"uptime\": 123456789, \"heap\": {\"free\": 181234, \"min\": 150112}, \"sensors\": [";
+    for (unsigned i = 0; i < sensors; ++i) {
+        if (i != 0) doc += ", ";
+        doc += "{\"id\": " + std::to_string(i) +
+            ", \"name\": \"sensor \\\"" + std::to_string(i) + "\\\" \\u00b0C\"" +
+            ", \"value\": " + std::to_string(i) + ".25e-1" +
+            ", \"ok\": " + ((i % 3) ? "true" : "false") +
+            ", \"last\": [1, -2, 3.5, null]}";
+    }
+    return doc + "], \"log\": \"line one\\nline two\\ttabbed\"}";
+}
+
+// -----------------------------------------------------------------------------
+
+static volatile unsigned sink;
+
+const unsigned benchRounds = 5;
+
+/**
+ * @brief Returns the time of a parse in ns, the best of benchRounds runs
+ */
+template <typename Parse>
+static double Measure(unsigned iterations, Parse parse)
+{
+    double best = 0;
+
+    for (unsigned round = 0; round < benchRounds; ++round) {
+        CountingHandler counter;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            if (!parse(counter)) {
+                fprintf(stderr, "FAILED parse\n");
+                exit(1);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        sink = counter.values;
+
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        if ((round == 0) || (ns < best)) best = ns;
+    }
+    return best;
+}
+
+static double MBps(size_t bytes, double ns)
+{
+    return (bytes * 1000.0) / ns;
+}
+
+// -----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = (argc > 1) ? (unsigned)strtoul(argv[1], nullptr, 10) : 20000;
+    if (iterations == 0) iterations = 1;
+
+    struct Document {
+        const char *name;
+        std::string text;
+    };
+    std::vector<Document> docs = {
+        { "cmd.json", CommandDoc(3, 12345) },
+        { "16 commands", BatchDoc(16) },
+        { "config.json", ConfigDoc() },
+        { "large, 64 items", LargeDoc(64) },
+    };
+
+#ifdef HAVE_CJSON
+    cJSON_Hooks hooks = { CountingMalloc, CountingFree };
+    cJSON_InitHooks(&hooks);
+#endif
+
+    unsigned failures = 0;
+    printf("sizeof(JSONReader) %u bytes, no heap\n", (unsigned)sizeof(JSONReader));
+    printf("MB/s, best of %u runs of %u parses\n", benchRounds, iterations);
+    printf("%-16s %7s %7s %12s %12s %12s %10s\n", "", "bytes", "values",
+        "reader", "reader/64B", "cJSON", "cJSON heap");
+
+    for (const Document& doc : docs) {
+        // the reader must see every value, in one chunk, in chunks and byte by byte
+        CountingHandler whole, chunked, bytes;
+        if (!ParseReader(doc.text, doc.text.size(), whole) ||
+            !ParseReader(doc.text, 64, chunked) ||
+            !ParseReader(doc.text, 1, bytes) ||
+            (whole.values != chunked.values) || (whole.values != bytes.values) ||
+            (whole.stringBytes != bytes.stringBytes)) {
+            fprintf(stderr, "FAILED %s is not parsed the same in chunks\n", doc.name);
+            ++failures;
+        }
+
+        double reader = Measure(iterations, [&doc](CountingHandler& c) { return ParseReader(doc.text, doc.text.size(), c); });
+        double reader64 = Measure(iterations, [&doc](CountingHandler& c) { return ParseReader(doc.text, 64, c); });
+
+        printf("%-16s %7u %7u %12.1f %12.1f", doc.name, (unsigned)doc.text.size(), whole.values,
+            MBps(doc.text.size(), reader), MBps(doc.text.size(), reader64));
+
+#ifdef HAVE_CJSON
+        CountingHandler tree;
+        heapPeak = 0;
+        if (!ParseCJSON(doc.text, tree) || (tree.values != whole.values) || (tree.containers != whole.containers)) {
+            fprintf(stderr, "FAILED %s is not parsed the same by cJSON\n", doc.name);
+            ++failures;
+        }
+        size_t peak = heapPeak;
+
+        double cjson = Measure(iterations, [&doc](CountingHandler& c) { return ParseCJSON(doc.text, c); });
+        printf(" %12.1f %10u\n", MBps(doc.text.size(), cjson), (unsigned)peak);
+#else
+        printf(" %12s %10s\n", "-", "-");
+#endif
+    }
+
+#ifndef HAVE_CJSON
+    printf("cJSON was not found, set CJSON_DIR to the directory of cJSON.c\n");
+#endif
+
+    if (failures != 0) {
+        printf("json_bench: %u checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,541 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * Host test of OTAPatcher and OTAInflater
+ *
+ * The running partition is a buffer read by a stubbed esp_partition_read. A base and a new
+ * image are made, the patches are made from them by tools/paxdelta.py, with and without gzip,
+ * and fed in random sized chunks, like from httpd_req_recv, through the same chain as
+ * /update: OTAInflater, OTAPatcher and a sink in place of the OTA pipeline. The output must
+ * be the new image and have the SHA256 from the header of the patch.
+ * Hand made patches check the header, the bounds of the copy and add commands and the errors.
+ *
+ *   ota_patch_test [path/to/paxdelta.py]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+#include <openssl/evp.h>
+
+#include "esp_ota_ops.h"
+
+#include "OTAInflater.h"
+#include "OTAPatcher.h"
+
+// -----------------------------------------------------------------------------
+
+typedef std::vector<uint8_t> Bytes;
+
+const size_t partitionSize = 256 * 1024;
+const size_t appDescOffset = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
+const size_t elfSHA256Offset = appDescOffset + offsetof(esp_app_desc_t, app_elf_sha256);
+
+static Bytes partitionData;
+static esp_partition_t runningPartition;
+static esp_app_desc_t runningApp;
+
+static unsigned failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        ++failures; \
+    } \
+} while (0)
+
+// -----------------------------------------------------------------------------
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+    if (partition != &runningPartition) return ESP_ERR_INVALID_ARG;
+    if ((offset > partition->size) || (size > partition->size - offset)) return ESP_ERR_INVALID_SIZE;
+
+    memcpy(dst, partitionData.data() + offset, size);
+    return ESP_OK;
+}
+
+const esp_app_desc_t* esp_ota_get_app_description(void)
+{
+    return &runningApp;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void)
+{
+    return &runningPartition;
+}
+
+// -----------------------------------------------------------------------------
+
+class CaptureSink : public OTASink
+{
+public:
+    Bytes data;
+
+    virtual esp_err_t Write(const char *buffer, size_t length) {
+        data.insert(data.end(), (const uint8_t*)buffer, (const uint8_t*)buffer + length);
+        return ESP_OK;
+    }
+};
+
+static Bytes SHA256(const Bytes& data)
+{
+    Bytes digest(32);
+    unsigned int len = 0;
+    EVP_Digest(data.data(), data.size(), digest.data(), &len, EVP_sha256(), nullptr);
+    return digest;
+}
+
+static uint32_t randomState = 1;
+
+static uint8_t Random8(void)
+{
+    randomState = randomState * 1103515245u + 12345u;
+    return (uint8_t)(randomState >> 16);
+}
+
+static Bytes RandomBytes(size_t length)
+{
+    Bytes data(length);
+    for (auto& b : data) b = Random8();
+    return data;
+}
+
+/**
+ * @brief An image with a header, an application description and `body` as the rest
+ */
+static Bytes MakeImage(const char *version, const Bytes& body)
+{
+    Bytes image(appDescOffset + sizeof(esp_app_desc_t), 0);
+    image[0] = ESP_IMAGE_HEADER_MAGIC;
+    image[1] = 4;
+
+    esp_app_desc_t desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.magic_word = ESP_APP_DESC_MAGIC_WORD;
+    strncpy(desc.version, version, sizeof(desc.version) - 1);
+    strncpy(desc.project_name, "ota_patch_test", sizeof(desc.project_name) - 1);
+    // each build has another SHA256 of the elf file
+    Bytes elf(version, version + strlen(version));
+    Bytes elfSHA256 = SHA256(elf);
+    memcpy(desc.app_elf_sha256, elfSHA256.data(), sizeof(desc.app_elf_sha256));
+    memcpy(image.data() + appDescOffset, &desc, sizeof(desc));
+
+    image.insert(image.end(), body.begin(), body.end());
+    return image;
+}
+
+/**
+ * @brief Makes `base` the running application
+ */
+static void SetRunning(const Bytes& base)
+{
+    partitionData.assign(partitionSize, 0xFF);
+    memcpy(partitionData.data(), base.data(), base.size());
+
+    memset(&runningPartition, 0, sizeof(runningPartition));
+    runningPartition.size = partitionSize;
+    strcpy(runningPartition.label, "ota_0");
+
+    memcpy(&runningApp, base.data() + appDescOffset, sizeof(runningApp));
+}
+
+// -----------------------------------------------------------------------------
+
+struct PatchResult
+{
+    esp_err_t err;
+    Bytes output;
+    Bytes targetSHA256;
+    bool wasPatch;
+};
+
+/**
+ * @brief Feeds `data` in chunks of random sizes through the chain used by /update
+ */
+static PatchResult Apply(const Bytes& data, size_t maxChunk)
+{
+    PatchResult result;
+    CaptureSink sink;
+    OTAPatcher patcher;
+    OTAInflater inflater;
+
+    bool gzip = OTAInflater::IsGzip(data.data(), data.size());
+    esp_err_t err = patcher.Begin(&sink);
+    if ((err == ESP_OK) && gzip) err = inflater.Begin();
+
+    size_t pos = 0;
+    while ((err == ESP_OK) && (pos < data.size())) {
+        size_t len = 1 + Random8() * 256u % maxChunk;
+        if (len > data.size() - pos) len = data.size() - pos;
+        if (gzip) {
+            err = inflater.Feed(data.data() + pos, len, patcher);
+        }
+        else {
+            err = patcher.Write((const char*)data.data() + pos, len);
+        }
+        pos += len;
+    }
+    if ((err == ESP_OK) && gzip) err = inflater.Finish();
+    if (err == ESP_OK) err = patcher.Finish();
+
+    result.err = err;
+    result.output = sink.data;
+    result.targetSHA256.assign(patcher.TargetSHA256(), patcher.TargetSHA256() + 32);
+    result.wasPatch = patcher.IsActive();
+    inflater.End();
+    patcher.End();
+    return result;
+}
+
+static Bytes Gzip(const Bytes& data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 + 15 window bits writes a gzip header and trailer
+    deflateInit2(&stream, 9, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
+
+    Bytes out(deflateBound(&stream, data.size()));
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Builds PXD1 patches by hand
+ */
+class PatchBuilder
+{
+public:
+    Bytes data;
+
+    PatchBuilder(const Bytes& baseElfSHA256, uint32_t targetSize, const Bytes& targetSHA256) {
+        data.insert(data.end(), OTAPatchMagic, OTAPatchMagic + sizeof(OTAPatchMagic));
+        data.insert(data.end(), baseElfSHA256.begin(), baseElfSHA256.end());
+        UInt32(targetSize);
+        data.insert(data.end(), targetSHA256.begin(), targetSHA256.end());
+    }
+
+    void Command(uint8_t cmd, uint32_t offset, uint32_t length, const Bytes& payload = Bytes()) {
+        data.push_back(cmd);
+        UInt32(offset);
+        UInt32(length);
+        data.insert(data.end(), payload.begin(), payload.end());
+    }
+
+    void End(void) {
+        Command(OTAPatchEnd, 0, 0);
+    }
+
+protected:
+    void UInt32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) data.push_back((uint8_t)(value >> (8 * i)));
+    }
+};
+
+static Bytes ElfSHA256(const Bytes& image)
+{
+    return Bytes(image.begin() + elfSHA256Offset, image.begin() + elfSHA256Offset + 32);
+}
+
+// -----------------------------------------------------------------------------
+
+static bool ReadFile(const std::string& name, Bytes& data)
+{
+    FILE *f = fopen(name.c_str(), "rb");
+    if (f == nullptr) return false;
+    data.clear();
+    uint8_t buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        data.insert(data.end(), buffer, buffer + len);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool WriteFile(const std::string& name, const Bytes& data)
+{
+    FILE *f = fopen(name.c_str(), "wb");
+    if (f == nullptr) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return (fclose(f) == 0) && ok;
+}
+
+/**
+ * @brief Counts the commands of an uncompressed patch, by type
+ */
+static void CountCommands(const Bytes& patch, unsigned counts[4])
+{
+    memset(counts, 0, 4 * sizeof(unsigned));
+    size_t pos = OTAPatchHeaderSize;
+    while (pos + OTAPatchCommandSize <= patch.size()) {
+        uint8_t cmd = patch[pos];
+        uint32_t length = patch[pos + 5] | (patch[pos + 6] << 8) | (patch[pos + 7] << 16) | ((uint32_t)patch[pos + 8] << 24);
+        pos += OTAPatchCommandSize;
+        if (cmd > OTAPatchInsert) return;
+        ++counts[cmd];
+        if (cmd == OTAPatchEnd) return;
+        if ((cmd == OTAPatchAdd) || (cmd == OTAPatchInsert)) pos += length;
+    }
+}
+
+static void TestPaxDelta(const char *paxdelta)
+{
+    // the new image keeps most of the base, with changed, inserted, moved and removed parts
+    Bytes body = RandomBytes(120 * 1024);
+    Bytes base = MakeImage("1.0.0", body);
+
+    Bytes newBody(body.begin(), body.begin() + 30000);
+    for (size_t i = 0; i < 2000; i += 7) newBody[10000 + i] += 3;                          // add
+    Bytes inserted = RandomBytes(3000);
+    newBody.insert(newBody.end(), inserted.begin(), inserted.end());                        // insert
+    newBody.insert(newBody.end(), body.begin() + 80000, body.begin() + 100000);             // moved
+    newBody.insert(newBody.end(), body.begin() + 30000, body.begin() + 80000);              // copy
+    Bytes newImage = MakeImage("1.1.0", newBody);
+
+    char dir[] = "/tmp/ota_patch_testXXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        fprintf(stderr, "FAILED mkdtemp\n");
+        ++failures;
+        return;
+    }
+    std::string d(dir);
+    CHECK(WriteFile(d + "/base.bin", base));
+    CHECK(WriteFile(d + "/new.bin", newImage));
+
+    std::string cmd = std::string("python3 ") + paxdelta + " diff " + d + "/base.bin " + d + "/new.bin ";
+    CHECK(system((cmd + d + "/new.pxd.gz > /dev/null").c_str()) == 0);
+    CHECK(system((cmd + d + "/new.pxd --no-gzip > /dev/null").c_str()) == 0);
+
+    Bytes patch, patchGz;
+    CHECK(ReadFile(d + "/new.pxd", patch));
+    CHECK(ReadFile(d + "/new.pxd.gz", patchGz));
+    system(("rm -rf " + d).c_str());
+    if (patch.empty() || patchGz.empty()) return;
+
+    // PXD1 header made by paxdelta.py
+    CHECK(memcmp(patch.data(), OTAPatchMagic, sizeof(OTAPatchMagic)) == 0);
+    CHECK(Bytes(patch.begin() + 4, patch.begin() + 36) == ElfSHA256(base));
+    CHECK(OTAInflater::IsGzip(patchGz.data(), patchGz.size()));
+
+    unsigned counts[4];
+    CountCommands(patch, counts);
+    printf("paxdelta: %u bytes image, patch %u bytes, %u gzip, %u copy, %u add, %u insert\n",
+        (unsigned)newImage.size(), (unsigned)patch.size(), (unsigned)patchGz.size(),
+        counts[OTAPatchCopy], counts[OTAPatchAdd], counts[OTAPatchInsert]);
+    CHECK(counts[OTAPatchEnd] == 1);
+    CHECK(counts[OTAPatchCopy] > 0);
+    CHECK(counts[OTAPatchAdd] > 0);
+    CHECK(counts[OTAPatchInsert] > 0);
+
+    SetRunning(base);
+    Bytes newSHA256 = SHA256(newImage);
+    const size_t chunks[] = { 1, 13, 1460, 4096 };
+    for (size_t maxChunk : chunks) {
+        for (const Bytes *p : { &patch, &patchGz }) {
+            PatchResult res = Apply(*p, maxChunk);
+            CHECK(res.err == ESP_OK);
+            CHECK(res.wasPatch);
+            CHECK(res.output == newImage);
+            CHECK(SHA256(res.output) == newSHA256);
+            CHECK(res.targetSHA256 == newSHA256);
+        }
+    }
+
+    // the description of the new build is written, not copied from the running one
+    PatchResult res = Apply(patchGz, 4096);
+    CHECK(ElfSHA256(res.output) == ElfSHA256(newImage));
+    CHECK(ElfSHA256(res.output) != ElfSHA256(base));
+
+    // a patch for another build of the same base image is rejected before writing anything
+    Bytes other = base;
+    other[elfSHA256Offset] ^= 1;
+    SetRunning(other);
+    res = Apply(patchGz, 4096);
+    CHECK(res.err == ESP_ERR_OTA_VALIDATE_FAILED);
+    CHECK(res.output.empty());
+}
+
+static void TestCommands(void)
+{
+    Bytes base = MakeImage("2.0.0", RandomBytes(8192));
+    SetRunning(base);
+    Bytes elf = ElfSHA256(base);
+
+    // copy, add and insert, each alone and together
+    {
+        Bytes delta = RandomBytes(100);
+        Bytes inserted = RandomBytes(700);
+        Bytes expected(base.begin() + 1000, base.begin() + 1500);
+        for (size_t i = 0; i < delta.size(); ++i) expected.push_back((uint8_t)(base[4000 + i] + delta[i]));
+        expected.insert(expected.end(), inserted.begin(), inserted.end());
+        // the erased flash after the image can be copied too
+        expected.insert(expected.end(), partitionData.end() - 300, partitionData.end());
+
+        PatchBuilder p(elf, expected.size(), SHA256(expected));
+        p.Command(OTAPatchCopy, 1000, 500);
+        p.Command(OTAPatchAdd, 4000, delta.size(), delta);
+        p.Command(OTAPatchInsert, 0xFFFFFFFF, inserted.size(), inserted);
+        p.Command(OTAPatchCopy, partitionSize - 300, 300);
+        p.End();
+
+        for (const Bytes& data : { p.data, Gzip(p.data) }) {
+            PatchResult res = Apply(data, 64);
+            CHECK(res.err == ESP_OK);
+            CHECK(res.output == expected);
+            CHECK(res.targetSHA256 == SHA256(expected));
+        }
+    }
+
+    // empty add and insert commands
+    {
+        Bytes expected(base.begin(), base.begin() + 10);
+        PatchBuilder p(elf, expected.size(), SHA256(expected));
+        p.Command(OTAPatchInsert, 0, 0);
+        p.Command(OTAPatchAdd, 0, 0);
+        p.Command(OTAPatchCopy, 0, 10);
+        p.End();
+        CHECK(Apply(p.data, 5).err == ESP_OK);
+    }
+
+    // copy and add outside of the running partition
+    struct { uint8_t cmd; uint32_t offset; uint32_t length; } outside[] = {
+        { OTAPatchCopy, partitionSize - 10, 11 },
+        { OTAPatchCopy, partitionSize + 1, 0 },
+        { OTAPatchCopy, 0xFFFFFF00, 0x200 },      // the end wraps around
+        { OTAPatchCopy, 16, 0xFFFFFFF8 },
+        { OTAPatchAdd, partitionSize - 4, 5 },
+        { OTAPatchAdd, 0xFFFFFFFF, 1 },
+    };
+    for (auto& o : outside) {
+        PatchBuilder p(elf, 1024, Bytes(32, 0));
+        Bytes payload((o.cmd == OTAPatchAdd) ? o.length : 0, 1);
+        p.Command(o.cmd, o.offset, o.length, payload);
+        p.End();
+        PatchResult res = Apply(p.data, 4096);
+        CHECK(res.err == ESP_ERR_OTA_VALIDATE_FAILED);
+        CHECK(res.output.empty());
+    }
+    {
+        // up to the end of the partition is allowed
+        PatchBuilder p(elf, 10, Bytes(32, 0));
+        p.Command(OTAPatchCopy, partitionSize - 10, 10);
+        p.End();
+        CHECK(Apply(p.data, 4096).err == ESP_OK);
+    }
+
+    // more or less output than the size from the header
+    {
+        PatchBuilder p(elf, 100, Bytes(32, 0));
+        p.Command(OTAPatchCopy, 0, 101);
+        p.End();
+        PatchResult res = Apply(p.data, 4096);
+        CHECK(res.err == ESP_ERR_OTA_VALIDATE_FAILED);
+        CHECK(res.output.size() <= 100);
+    }
+    {
+        PatchBuilder p(elf, 100, Bytes(32, 0));
+        p.Command(OTAPatchCopy, 0, 99);
+        p.End();
+        CHECK(Apply(p.data, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+
+    // invalid, truncated and with data after the end
+    {
+        PatchBuilder p(elf, 100, Bytes(32, 0));
+        p.Command(7, 0, 100);
+        CHECK(Apply(p.data, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+    {
+        PatchBuilder p(elf, 100, Bytes(32, 0));
+        p.Command(OTAPatchInsert, 0, 100, Bytes(50, 0));
+        CHECK(Apply(p.data, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+
+        PatchBuilder h(elf, 100, Bytes(32, 0));
+        h.data.resize(OTAPatchHeaderSize - 1);
+        CHECK(Apply(h.data, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+    {
+        PatchBuilder p(elf, 100, Bytes(32, 0));
+        p.Command(OTAPatchCopy, 0, 100);
+        p.End();
+        p.data.push_back(0);
+        CHECK(Apply(p.data, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+    {
+        PatchBuilder p(elf, 0, Bytes(32, 0));
+        p.End();
+        CHECK(Apply(p.data, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+
+    // a corrupted gzip stream
+    {
+        PatchBuilder p(elf, 100, Bytes(32, 0));
+        p.Command(OTAPatchCopy, 0, 100);
+        p.End();
+        Bytes gz = Gzip(p.data);
+        gz[gz.size() - 8] ^= 1;   // the CRC32 of the trailer
+        CHECK(Apply(gz, 4096).err == ESP_ERR_OTA_VALIDATE_FAILED);
+    }
+
+    // a full image passes through unchanged, compressed or not
+    {
+        Bytes image = MakeImage("3.0.0", RandomBytes(5000));
+        for (const Bytes& data : { image, Gzip(image) }) {
+            PatchResult res = Apply(data, 100);
+            CHECK(res.err == ESP_OK);
+            CHECK(!res.wasPatch);
+            CHECK(res.output == image);
+        }
+        PatchResult res = Apply(Bytes(image.begin(), image.begin() + 3), 100);
+        CHECK(res.err == ESP_OK);
+        CHECK(res.output.size() == 3);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    const char *paxdelta = (argc > 1) ? argv[1] : "../paxdelta.py";
+
+    TestPaxDelta(paxdelta);
+    TestCommands();
+
+    if (failures != 0) {
+        printf("ota_patch_test: %u checks failed\n", failures);
+        return 1;
+    }
+    printf("ota_patch_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+/**
+This file is part of ESP32BoardManager esp-idf component
+(https://github.com/CalinRadoni/ESP32BoardManager)
+Copyright (C) 2020 by Calin Radoni
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * Host benchmark of the route dispatch
+ *
+ * The base routes of PaxHttpServer and a table of custom routes, more than 50 routes together,
+ * are looked up by three dispatchers:
+ * - index, the lookup of PaxHttpServer::FindRoute, HTTPRouteIndex from src/HTTPRoute.cpp, the hash
+ *   of the path then a binary search in the routes sorted by hash
+ * - scan, the hash of the path then a scan of the custom and the base route tables, the lookup
+ *   which the index replaced and which FindRoute still does if the index can not be allocated
+ * - if-chain, the dispatch which the route tables replaced, the URI copied to a std::string and
+ *   compared with each path of the method of the request, extended to the same routes
+ * Only the lookup is timed, the handlers are not called.
+ *
+ *   route_bench [iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "HTTPRoute.h"
+
+// -----------------------------------------------------------------------------
+
+// HTTPRouteHandler needs the class, only the type of the handlers is used
+class PaxHttpServer
+{
+public:
+    esp_err_t Handle(httpd_req_t *req) { return ESP_OK; }
+};
+
+struct RoutePath
+{
+    httpd_method_t method;
+    const char *path;
+};
+
+// in the order of PaxHttpServer::baseRoutes
+static const RoutePath basePaths[] = {
+    { HTTP_GET,  "/" },
+    { HTTP_GET,  "/index.html" },
+    { HTTP_GET,  "/favicon.ico" },
+    { HTTP_GET,  "/info.json" },
+    { HTTP_GET,  "/status.json" },
+    { HTTP_GET,  "/status/stream" },
+    { HTTP_GET,  "/metrics" },
+    { HTTP_GET,  "/config.json" },
+    { HTTP_POST, "/cmd.json" },
+    { HTTP_POST, "/cmds.json" },
+    { HTTP_POST, "/cmd.bin" },
+    { HTTP_POST, "/config.json" },
+    { HTTP_POST, "/update" },
+};
+
+// a board with many custom routes, scanned before the base routes like in FindRoute
+static const RoutePath customPaths[] = {
+    { HTTP_GET,  "/sensors.json" },
+    { HTTP_GET,  "/sensors/temperature.json" },
+    { HTTP_GET,  "/sensors/humidity.json" },
+    { HTTP_GET,  "/sensors/pressure.json" },
+    { HTTP_GET,  "/sensors/light.json" },
+    { HTTP_GET,  "/sensors/voltage.json" },
+    { HTTP_GET,  "/sensors/current.json" },
+    { HTTP_GET,  "/sensors/history.json" },
+    { HTTP_POST, "/sensors/calibrate.json" },
+    { HTTP_GET,  "/leds.json" },
+    { HTTP_POST, "/leds.json" },
+    { HTTP_POST, "/leds/color.json" },
+    { HTTP_POST, "/leds/brightness.json" },
+    { HTTP_POST, "/leds/effect.json" },
+    { HTTP_GET,  "/leds/effects.json" },
+    { HTTP_GET,  "/relays.json" },
+    { HTTP_POST, "/relays/1.json" },
+    { HTTP_POST, "/relays/2.json" },
+    { HTTP_POST, "/relays/3.json" },
+    { HTTP_POST, "/relays/4.json" },
+    { HTTP_GET,  "/schedule.json" },
+    { HTTP_POST, "/schedule.json" },
+    { HTTP_POST, "/schedule/clear.json" },
+    { HTTP_GET,  "/log.json" },
+    { HTTP_POST, "/log/clear.json" },
+    { HTTP_GET,  "/log/level.json" },
+    { HTTP_POST, "/log/level.json" },
+    { HTTP_GET,  "/wifi/scan.json" },
+    { HTTP_GET,  "/wifi/status.json" },
+    { HTTP_POST, "/wifi/connect.json" },
+    { HTTP_GET,  "/time.json" },
+    { HTTP_POST, "/time.json" },
+    { HTTP_GET,  "/mqtt.json" },
+    { HTTP_POST, "/mqtt.json" },
+    { HTTP_GET,  "/files.json" },
+    { HTTP_POST, "/files/delete.json" },
+    { HTTP_GET,  "/app.js" },
+    { HTTP_GET,  "/app.css" },
+    { HTTP_GET,  "/logo.svg" },
+    { HTTP_GET,  "/manifest.json" },
+    { HTTP_POST, "/reboot" },
+    { HTTP_POST, "/factory-reset" },
+    { HTTP_GET,  "/diag/tasks.json" },
+    { HTTP_GET,  "/diag/heap.json" },
+};
+
+const size_t basePathCount = sizeof(basePaths) / sizeof(basePaths[0]);
+const size_t customPathCount = sizeof(customPaths) / sizeof(customPaths[0]);
+
+static std::vector<HTTPRoute> baseRoutes;
+static std::vector<HTTPRoute> customRoutes;
+static HTTPRouteIndex routeIndex;
+
+// the paths in the order of the scan, the index is the result of both dispatchers
+static std::vector<RoutePath> allPaths;
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief The lookup of PaxHttpServer::FindRoute
+ */
+static const HTTPRoute* FindRoute(httpd_req_t *req)
+{
+    return routeIndex.Find(req->method, req->uri);
+}
+
+/**
+ * @brief The scan of the route tables, done by PaxHttpServer::FindRoute without the index
+ */
+static const HTTPRoute* ScanRoutes(httpd_req_t *req)
+{
+    size_t pathLen = 0;
+    uint32_t hash = HTTPRouteHashURI(req->uri, &pathLen);
+
+    for (size_t i = 0; i < customRoutes.size(); ++i) {
+        if (customRoutes[i].Matches(req->method, hash, req->uri, pathLen))
+            return &customRoutes[i];
+    }
+    for (size_t i = 0; i < baseRoutes.size(); ++i) {
+        if (baseRoutes[i].Matches(req->method, hash, req->uri, pathLen))
+            return &baseRoutes[i];
+    }
+    return nullptr;
+}
+
+static int RouteIndex(const HTTPRoute *route)
+{
+    if (route == nullptr) return -1;
+    for (size_t i = 0; i < customRoutes.size(); ++i) {
+        if (route == &customRoutes[i]) return (int)i;
+    }
+    return (int)(customRoutes.size() + (route - baseRoutes.data()));
+}
+
+/**
+ * @brief The replaced dispatch, a `if (str == "...")` for each route of the method
+ *
+ * The paths of each method are compared like the chain of HandleGetRequest and
+ * HandlePostRequest, with the URI copied in a std::string.
+ */
+static int IfChain(httpd_req_t *req)
+{
+    std::string str = req->uri;
+    for (size_t i = 0; i < allPaths.size(); ++i) {
+        if ((allPaths[i].method == req->method) && (str == allPaths[i].path)) return (int)i;
+    }
+    return -1;
+}
+
+// -----------------------------------------------------------------------------
+
+struct BenchCase
+{
+    const char *name;
+    std::vector<httpd_req_t*> requests;
+};
+
+static httpd_req_t* MakeRequest(httpd_method_t method, const char *uri)
+{
+    // the uri of httpd_req_t is const, like in esp_http_server.h
+    httpd_req_t *req = (httpd_req_t*)calloc(1, sizeof(httpd_req_t));
+    req->method = method;
+    strncpy(const_cast<char*>(req->uri), uri, sizeof(req->uri) - 1);
+    return req;
+}
+
+static volatile int sink;
+
+const unsigned benchRounds = 5;
+
+/**
+ * @brief Returns the time of a lookup in ns, the best of benchRounds runs
+ */
+template <typename Lookup>
+static double Measure(const BenchCase& bench, unsigned iterations, Lookup lookup)
+{
+    double best = 0;
+    size_t count = bench.requests.size();
+
+    for (unsigned round = 0; round < benchRounds; ++round) {
+        int sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            sum += lookup(bench.requests[i % count]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        sink = sum;
+
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        if ((round == 0) || (ns < best)) best = ns;
+    }
+    return best;
+}
+
+// -----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = (argc > 1) ? (unsigned)strtoul(argv[1], nullptr, 10) : 1000000;
+    if (iterations == 0) iterations = 1;
+
+    for (size_t i = 0; i < customPathCount; ++i) {
+        customRoutes.push_back(HTTPRoute(customPaths[i].method, customPaths[i].path, &PaxHttpServer::Handle));
+        allPaths.push_back(customPaths[i]);
+    }
+    for (size_t i = 0; i < basePathCount; ++i) {
+        baseRoutes.push_back(HTTPRoute(basePaths[i].method, basePaths[i].path, &PaxHttpServer::Handle));
+        allPaths.push_back(basePaths[i]);
+    }
+
+    if (!routeIndex.Build(customRoutes.data(), customRoutes.size(), baseRoutes.data(), baseRoutes.size())) {
+        fprintf(stderr, "FAILED to build the index\n");
+        return 1;
+    }
+
+    // the dispatchers must find the same route
+    unsigned failures = 0;
+    std::vector<httpd_req_t*> everyRoute;
+    for (size_t i = 0; i < allPaths.size(); ++i) {
+        httpd_req_t *req = MakeRequest(allPaths[i].method, allPaths[i].path);
+        everyRoute.push_back(req);
+        if ((RouteIndex(FindRoute(req)) != (int)i) || (RouteIndex(ScanRoutes(req)) != (int)i) || (IfChain(req) != (int)i)) {
+            fprintf(stderr, "FAILED %s is not dispatched to its route\n", allPaths[i].path);
+            ++failures;
+        }
+    }
+
+    // a custom route replaces the base route with the same method and path
+    const HTTPRoute overrides[] = { HTTPRoute(HTTP_GET, "/info.json", &PaxHttpServer::Handle) };
+    HTTPRouteIndex overrideIndex;
+    httpd_req_t *info = MakeRequest(HTTP_GET, "/info.json?fields=title");
+    if (!overrideIndex.Build(overrides, 1, baseRoutes.data(), baseRoutes.size()) ||
+        (overrideIndex.Find(info->method, info->uri) != &overrides[0])) {
+        fprintf(stderr, "FAILED a custom route does not replace the base route\n");
+        ++failures;
+    }
+
+    size_t middle = customPathCount / 2;
+    std::vector<BenchCase> cases = {
+        { "first route", { MakeRequest(customPaths[0].method, customPaths[0].path) } },
+        { "middle route", { MakeRequest(customPaths[middle].method, customPaths[middle].path) } },
+        { "last route", { MakeRequest(HTTP_POST, "/update") } },
+        { "GET /status.json", { MakeRequest(HTTP_GET, "/status.json") } },
+        { "with a query", { MakeRequest(HTTP_GET, "/status.json?since=12&wait=1000&fields=heap,uptime") } },
+        { "not found", { MakeRequest(HTTP_GET, "/assets/fonts/roboto-regular.woff2") } },
+        { "every route", everyRoute },
+    };
+
+    printf("%u routes, ns per lookup, best of %u runs of %u lookups\n", (unsigned)allPaths.size(), benchRounds, iterations);
+    printf("%-18s %10s %10s %10s\n", "", "index", "scan", "if-chain");
+    for (const BenchCase& bench : cases) {
+        double index = Measure(bench, iterations, [](httpd_req_t *req) { return (int)(intptr_t)FindRoute(req); });
+        double scan = Measure(bench, iterations, [](httpd_req_t *req) { return (int)(intptr_t)ScanRoutes(req); });
+        double chain = Measure(bench, iterations, IfChain);
+        printf("%-18s %10.1f %10.1f %10.1f\n", bench.name, index, scan, chain);
+    }
+    printf("the if-chain does not match a path with a query string\n");
+
+    if (failures != 0) {
+        printf("route_bench: %u checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+// Host stub of ESP32SimpleOTA.h, declared only
+#pragma once
+
+#include <stddef.h>
+
+#include "esp_err.h"
+
+class ESP32SimpleOTA
+{
+public:
+    esp_err_t Begin(void);
+    esp_err_t Write(const char *data, size_t length);
+    esp_err_t End(void);
+    int GetMaxImageSize(void);
+};
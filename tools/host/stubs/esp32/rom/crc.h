@@ -0,0 +1,6 @@
+// Host stub of the ROM CRC, implemented with zlib in miniz_stub.cpp
+#pragma once
+
+#include <stdint.h>
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,12 @@
+// Host stub of esp_ota_ops.h, the test provides the functions
+#pragma once
+
+#include "esp_err.h"
+#include "esp_app_format.h"
+#include "esp_partition.h"
+
+#define ESP_ERR_OTA_BASE            0x1500
+#define ESP_ERR_OTA_VALIDATE_FAILED (ESP_ERR_OTA_BASE + 0x03)
+
+const esp_app_desc_t* esp_ota_get_app_description(void);
+const esp_partition_t* esp_ota_get_running_partition(void);
@@ -0,0 +1,4 @@
+// Host stub of the FreeRTOS queues, declared only
+#pragma once
+
+#include "FreeRTOS.h"
@@ -0,0 +1,4 @@
+// Host stub of the FreeRTOS semaphores, declared only
+#pragma once
+
+#include "queue.h"
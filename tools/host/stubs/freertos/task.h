@@ -0,0 +1,12 @@
+// Host stub of the FreeRTOS tasks, a task is a thread, the notifications use a condition variable
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+
+/** returns the task of the calling thread, created at the first call */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
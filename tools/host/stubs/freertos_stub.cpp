@@ -0,0 +1,52 @@
+// Host stub of the FreeRTOS task notifications, a counter and a condition variable for each thread
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+struct HostTask
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t count = 0;
+};
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // never freed, a task handle may be used by other threads after its thread ended
+    thread_local HostTask *task = new HostTask;
+    return task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        ++task->count;
+    }
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    HostTask *task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+
+    auto ready = [task] { return task->count != 0; };
+    if (ticksToWait == portMAX_DELAY) {
+        task->cv.wait(lock, ready);
+    }
+    else {
+        task->cv.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), ready);
+    }
+
+    uint32_t count = task->count;
+    if (count != 0) {
+        task->count = (clearCountOnExit != pdFALSE) ? 0 : count - 1;
+    }
+    return count;
+}
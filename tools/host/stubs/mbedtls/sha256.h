@@ -0,0 +1,8 @@
+// Host stub of mbedtls/sha256.h, declared only
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t state[28];
+} mbedtls_sha256_context;
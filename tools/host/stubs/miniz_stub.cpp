@@ -0,0 +1,54 @@
+// Host stub of the ROM inflate and CRC32, implemented with zlib
+//
+// tinfl writes to a circular dictionary, the output window is [pOut_buf_next, + *pOut_buf_size).
+// zlib keeps its own window so the output is written there directly.
+
+#include <cstring>
+
+#include "esp32/rom/miniz.h"
+#include "esp32/rom/crc.h"
+
+void tinfl_init(tinfl_decompressor *r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+    mz_uint8 *, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size, const mz_uint32 decomp_flags)
+{
+    if ((decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) != 0) return TINFL_STATUS_BAD_PARAM;
+
+    if (!r->started) {
+        if (inflateInit2(&r->stream, -15) != Z_OK) return TINFL_STATUS_FAILED;
+        r->started = 1;
+    }
+
+    r->stream.next_in = (Bytef*)pIn_buf_next;
+    r->stream.avail_in = (uInt)*pIn_buf_size;
+    r->stream.next_out = pOut_buf_next;
+    r->stream.avail_out = (uInt)*pOut_buf_size;
+
+    int res = inflate(&r->stream, Z_NO_FLUSH);
+
+    *pIn_buf_size -= r->stream.avail_in;
+    *pOut_buf_size -= r->stream.avail_out;
+
+    if (res == Z_STREAM_END) {
+        inflateEnd(&r->stream);
+        r->started = 0;
+        return TINFL_STATUS_DONE;
+    }
+    if ((res != Z_OK) && (res != Z_BUF_ERROR)) {
+        inflateEnd(&r->stream);
+        r->started = 0;
+        return TINFL_STATUS_FAILED;
+    }
+    if (r->stream.avail_out == 0) return TINFL_STATUS_HAS_MORE_OUTPUT;
+    return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    // same as the ROM function, the value is inverted before and after
+    return (uint32_t)crc32(crc, buf, len);
+}
@@ -0,0 +1,12 @@
+// Host configuration, the defaults from Kconfig
+#pragma once
+
+#define CONFIG_ESP32BM_CMD_QUEUE_LENGTH 32
+#define CONFIG_ESP32BM_CMD_PAYLOAD_BLOCK_SIZE 256
+#define CONFIG_ESP32BM_CMD_PAYLOAD_BLOCKS 16
+
+#define CONFIG_ESP32BM_OTA_BUFFER_SIZE 4096
+#define CONFIG_ESP32BM_OTA_BUFFER_COUNT 3
+#define CONFIG_ESP32BM_OTA_GZIP 1
+#define CONFIG_ESP32BM_OTA_DELTA 1
+#define CONFIG_ESP32BM_OTA_PRE_ERASE_DELAY_MS 50
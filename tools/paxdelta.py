@@ -0,0 +1,296 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Makes and applies the firmware patches used for delta updates.
+
+A patch is made against the firmware image running on the board and is
+uploaded to /update like a full image. The format is described in
+src/OTAPatcher.h.
+
+  paxdelta.py diff base.bin new.bin new.pxd.gz
+  paxdelta.py apply base.bin new.pxd.gz rebuilt.bin
+
+`diff` applies the patch it made and checks that the result is identical
+to the new image before writing it.
+"""
+
+import argparse
+import gzip
+import hashlib
+import struct
+import sys
+
+PATCH_MAGIC = b'PXD1'
+PATCH_HEADER = struct.Struct('<4s32sI32s')
+PATCH_COMMAND = struct.Struct('<BII')
+
+CMD_END = 0
+CMD_COPY = 1
+CMD_ADD = 2
+CMD_INSERT = 3
+
+IMAGE_MAGIC = 0xE9
+APP_DESC_OFFSET = 24 + 8
+APP_DESC_MAGIC = 0xABCD5432
+APP_ELF_SHA256_OFFSET = APP_DESC_OFFSET + 144
+
+# length of the blocks looked up in the base image and the step between them
+BLOCK_SIZE = 16
+BLOCK_STEP = 4
+
+# runs of identical bytes shorter than this are part of an `add` command
+MIN_COPY = 24
+
+# an approximate match ends when it has this many more mismatches than matches
+MISMATCH_LIMIT = 32
+
+
+class PatchError(Exception):
+    pass
+
+
+def elf_sha256(image):
+    """Returns app_elf_sha256 from the application description of an image."""
+    if len(image) < APP_ELF_SHA256_OFFSET + 32 or image[0] != IMAGE_MAGIC:
+        raise PatchError('not a firmware image')
+    magic, = struct.unpack_from('<I', image, APP_DESC_OFFSET)
+    if magic != APP_DESC_MAGIC:
+        raise PatchError('the image has no application description')
+    return image[APP_ELF_SHA256_OFFSET:APP_ELF_SHA256_OFFSET + 32]
+
+
+def match_length(base, bpos, new, npos):
+    """Length of the identical bytes of base from bpos and new from npos."""
+    limit = min(len(base) - bpos, len(new) - npos)
+    length = 0
+    while length + 64 <= limit and \
+            base[bpos + length:bpos + length + 64] == new[npos + length:npos + length + 64]:
+        length += 64
+    while length < limit and base[bpos + length] == new[npos + length]:
+        length += 1
+    return length
+
+
+def approximate_length(base, bpos, new, npos):
+    """Length of the following bytes worth encoding as differences from base.
+
+    Like bsdiff, keeps the length where matches minus mismatches is the highest.
+    """
+    limit = min(len(base) - bpos, len(new) - npos)
+    score = best = best_length = 0
+    for i in range(limit):
+        if base[bpos + i] == new[npos + i]:
+            score += 1
+            if score > best:
+                best = score
+                best_length = i + 1
+        else:
+            score -= 1
+            if score < best - MISMATCH_LIMIT:
+                break
+    return best_length
+
+
+class PatchWriter:
+    def __init__(self, base, new):
+        self.base = base
+        self.new = new
+        self.out = bytearray()
+        self.out += PATCH_HEADER.pack(PATCH_MAGIC, elf_sha256(base), len(new),
+                                      hashlib.sha256(new).digest())
+
+    def command(self, cmd, offset, length, data=b''):
+        self.out += PATCH_COMMAND.pack(cmd, offset, length)
+        self.out += data
+
+    def insert(self, npos, length):
+        if length > 0:
+            self.command(CMD_INSERT, 0, length, self.new[npos:npos + length])
+
+    def aligned(self, bpos, npos, length):
+        """Encodes new[npos:npos + length] using base from bpos as copy and add commands."""
+        diff = bytes((n - b) & 0xFF for n, b in
+                     zip(self.new[npos:npos + length], self.base[bpos:bpos + length]))
+        start = 0
+        while start < length:
+            # find the next run of MIN_COPY identical bytes
+            zero = diff.find(b'\0' * MIN_COPY, start)
+            if zero < 0:
+                zero = length
+            if zero > start:
+                self.command(CMD_ADD, bpos + start, zero - start, diff[start:zero])
+            if zero >= length:
+                break
+            end = zero
+            while end < length and diff[end] == 0:
+                end += 1
+            self.command(CMD_COPY, bpos + zero, end - zero)
+            start = end
+
+    def end(self):
+        self.command(CMD_END, 0, 0)
+        return bytes(self.out)
+
+
+def make_patch(base, new):
+    writer = PatchWriter(base, new)
+
+    index = {}
+    for bpos in range(0, len(base) - BLOCK_SIZE + 1, BLOCK_STEP):
+        index.setdefault(base[bpos:bpos + BLOCK_SIZE], bpos)
+
+    done = 0
+    npos = 0
+    while npos + BLOCK_SIZE <= len(new):
+        bpos = index.get(new[npos:npos + BLOCK_SIZE])
+        if bpos is None:
+            npos += 1
+            continue
+
+        # extend the match backwards over the bytes not encoded yet
+        back = 0
+        while npos - back > done and bpos - back > 0 and \
+                new[npos - back - 1] == base[bpos - back - 1]:
+            back += 1
+        start = npos - back
+        bstart = bpos - back
+
+        length = back + match_length(base, bpos, new, npos)
+        length += approximate_length(base, bstart + length, new, start + length)
+
+        writer.insert(done, start - done)
+        writer.aligned(bstart, start, length)
+        done = start + length
+        npos = done
+
+    writer.insert(done, len(new) - done)
+    return writer.end()
+
+
+def apply_patch(base, patch):
+    """Returns the image rebuilt from base and patch, the patch may be gzip compressed."""
+    if patch[:2] == b'\x1f\x8b':
+        patch = gzip.decompress(patch)
+    if len(patch) < PATCH_HEADER.size:
+        raise PatchError('the patch is too short')
+
+    magic, base_sha256, size, target_sha256 = PATCH_HEADER.unpack_from(patch, 0)
+    if magic != PATCH_MAGIC:
+        raise PatchError('not a patch')
+    if base_sha256 != elf_sha256(base):
+        raise PatchError('the patch is not for this base image')
+
+    out = bytearray()
+    pos = PATCH_HEADER.size
+    while True:
+        if pos + PATCH_COMMAND.size > len(patch):
+            raise PatchError('the patch is truncated')
+        cmd, offset, length = PATCH_COMMAND.unpack_from(patch, pos)
+        pos += PATCH_COMMAND.size
+
+        if cmd == CMD_END:
+            break
+        if cmd in (CMD_COPY, CMD_ADD) and offset + length > len(base):
+            raise PatchError('the patch reads outside of the base image')
+        if cmd in (CMD_ADD, CMD_INSERT) and pos + length > len(patch):
+            raise PatchError('the patch is truncated')
+
+        if cmd == CMD_COPY:
+            out += base[offset:offset + length]
+        elif cmd == CMD_ADD:
+            out += bytes((b + d) & 0xFF for b, d in
+                         zip(base[offset:offset + length], patch[pos:pos + length]))
+            pos += length
+        elif cmd == CMD_INSERT:
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise PatchError('invalid command {}'.format(cmd))
+
+    if pos != len(patch):
+        raise PatchError('data after the end of the patch')
+    if len(out) != size:
+        raise PatchError('the patch made {} bytes instead of {}'.format(len(out), size))
+    if hashlib.sha256(out).digest() != target_sha256:
+        raise PatchError('SHA256 mismatch')
+    return bytes(out)
+
+
+def read_file(name):
+    with open(name, 'rb') as f:
+        return f.read()
+
+
+def write_file(name, data):
+    with open(name, 'wb') as f:
+        f.write(data)
+
+
+def cmd_diff(args):
+    base = read_file(args.base)
+    new = read_file(args.new)
+    elf_sha256(new)
+
+    patch = make_patch(base, new)
+    if apply_patch(base, patch) != new:
+        raise PatchError('the patch does not rebuild the new image')
+    if not args.no_gzip:
+        patch = gzip.compress(patch, 9)
+
+    write_file(args.patch, patch)
+    print('{}: {} bytes, {:.1f}% of the {} bytes image'.format(
+        args.patch, len(patch), 100.0 * len(patch) / len(new), len(new)))
+
+
+def cmd_apply(args):
+    base = read_file(args.base)
+    patch = read_file(args.patch)
+    write_file(args.new, apply_patch(base, patch))
+    print('{}: rebuilt and verified'.format(args.new))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Firmware patches for delta updates')
+    sub = parser.add_subparsers(dest='command')
+    sub.required = True
+
+    p = sub.add_parser('diff', help='make a patch from the running image to the new one')
+    p.add_argument('base', help='the firmware image running on the board')
+    p.add_argument('new', help='the new firmware image')
+    p.add_argument('patch', help='the patch to write')
+    p.add_argument('--no-gzip', action='store_true', help='do not compress the patch')
+    p.set_defaults(func=cmd_diff)
+
+    p = sub.add_parser('apply', help='rebuild an image from the base image and a patch')
+    p.add_argument('base', help='the base firmware image')
+    p.add_argument('patch', help='the patch')
+    p.add_argument('new', help='the image to write')
+    p.set_defaults(func=cmd_apply)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except (PatchError, OSError) as e:
+        print('error: {}'.format(e), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
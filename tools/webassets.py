@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+
+# This file is part of ESP32BoardManager esp-idf component
+# (https://github.com/CalinRadoni/ESP32BoardManager)
+# Copyright (C) 2020 by Calin Radoni
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Makes the table of the embedded web files, see src/HTTPAsset.h.
+
+  webassets.py web
+
+For each file of the directory writes a gzip and, if the brotli module or
+program is available, a brotli compressed copy, then writes:
+
+  web_assets.h      the asset table, included by pax_http_server.cpp
+  web_assets.cmake  the list of files to embed, included by CMakeLists.txt
+
+A compressed copy is used only if it is smaller. The uncompressed file is
+embedded only if no compressed copy is smaller or with --identity, every
+browser accepts gzip.
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+try:
+    import brotli
+except ImportError:
+    brotli = None
+
+HEADER_NAME = 'web_assets.h'
+CMAKE_NAME = 'web_assets.cmake'
+
+GENERATED = (HEADER_NAME, CMAKE_NAME)
+COMPRESSED_EXT = ('.gz', '.br')
+
+# length of the content hash in the ETags, keep them shorter than ETagBufLen
+ETAG_HEX_LEN = 16
+
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.htm': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.jpg': 'image/jpeg',
+    '.jpeg': 'image/jpeg',
+    '.gif': 'image/gif',
+    '.ico': 'image/x-icon',
+    '.webp': 'image/webp',
+    '.woff': 'font/woff',
+    '.woff2': 'font/woff2',
+    '.txt': 'text/plain',
+    '.webmanifest': 'application/manifest+json',
+}
+
+# these are already compressed
+NO_COMPRESSION = ('.png', '.jpg', '.jpeg', '.gif', '.webp', '.woff', '.woff2')
+
+
+def symbol_name(file_name):
+    """Name of the symbols made by EMBED_FILES, from the file name only."""
+    return '_binary_' + re.sub(r'[^A-Za-z0-9]', '_', file_name)
+
+
+def compress_gzip(data):
+    # mtime 0 so the output, and the firmware, depend only on the content
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def compress_brotli(data):
+    if brotli is not None:
+        return brotli.compress(data, quality=11)
+    program = shutil.which('brotli')
+    if program is None:
+        return None
+    res = subprocess.run([program, '-c', '-q', '11'], input=data, stdout=subprocess.PIPE, check=True)
+    return res.stdout
+
+
+def write_if_changed(path, data):
+    """Keeps the timestamp of unchanged files so the firmware is not rebuilt."""
+    if os.path.isfile(path):
+        with open(path, 'rb') as f:
+            if f.read() == data:
+                return
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def remove_if_exists(path):
+    if os.path.isfile(path):
+        os.remove(path)
+
+
+def collect(web_dir):
+    files = []
+    for root, dirs, names in os.walk(web_dir):
+        dirs.sort()
+        for name in sorted(names):
+            if name in GENERATED or name.endswith(COMPRESSED_EXT):
+                continue
+            files.append(os.path.relpath(os.path.join(root, name), web_dir))
+    return files
+
+
+def make_asset(web_dir, rel_path, use_brotli, keep_identity):
+    path = os.path.join(web_dir, rel_path)
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    ext = os.path.splitext(rel_path)[1].lower()
+    mime = MIME_TYPES.get(ext, 'application/octet-stream')
+    digest = hashlib.sha256(data).hexdigest()[:ETAG_HEX_LEN]
+
+    variants = {}
+    if ext not in NO_COMPRESSION:
+        gz = compress_gzip(data)
+        if len(gz) < len(data):
+            variants['gzip'] = (path + '.gz', gz, digest + '-gz')
+        br = compress_brotli(data) if use_brotli else None
+        if br is not None and len(br) < len(data):
+            variants['brotli'] = (path + '.br', br, digest + '-br')
+
+    for name, ext_name in (('gzip', '.gz'), ('brotli', '.br')):
+        if name in variants:
+            write_if_changed(variants[name][0], variants[name][1])
+        else:
+            remove_if_exists(path + ext_name)
+
+    if keep_identity or 'gzip' not in variants:
+        variants['identity'] = (path, data, digest)
+
+    return {
+        'path': '/' + rel_path.replace(os.sep, '/'),
+        'type': mime,
+        'size': len(data),
+        'variants': variants,
+    }
+
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def write_header(web_dir, assets):
+    lines = [
+        '// Generated by tools/webassets.py, do not edit',
+        '',
+        '#ifndef web_assets_H',
+        '#define web_assets_H',
+        '',
+        '#include "HTTPAsset.h"',
+        '',
+    ]
+
+    for asset in assets:
+        for file_path, _, _ in asset['variants'].values():
+            symbol = symbol_name(os.path.basename(file_path))
+            lines.append('extern const uint8_t {0}_start[] asm("{0}_start");'.format(symbol))
+            lines.append('extern const uint8_t {0}_end[]   asm("{0}_end");'.format(symbol))
+    lines.append('')
+
+    lines.append('static const HTTPAsset webAssets[] = {')
+    for asset in assets:
+        fields = [c_string(asset['path']), c_string(asset['type'])]
+        for name in ('identity', 'gzip', 'brotli'):
+            if name in asset['variants']:
+                file_path, _, etag = asset['variants'][name]
+                symbol = symbol_name(os.path.basename(file_path))
+                fields.append('{{ {0}_start, {0}_end, {1} }}'.format(symbol, c_string('"' + etag + '"')))
+            else:
+                fields.append('{ nullptr, nullptr, nullptr }')
+        lines.append('    { ' + ',\n      '.join(fields) + ' },')
+    lines.append('};')
+    lines.append('static const size_t webAssetCount = sizeof(webAssets) / sizeof(webAssets[0]);')
+    lines.append('')
+    lines.append('#endif')
+    lines.append('')
+
+    write_if_changed(os.path.join(web_dir, HEADER_NAME), '\n'.join(lines).encode())
+
+
+def write_cmake(web_dir, assets):
+    lines = [
+        '# Generated by tools/webassets.py, do not edit',
+        '',
+        'set(ESP32BM_WEB_ASSET_FILES',
+    ]
+    for asset in assets:
+        for file_path, _, _ in asset['variants'].values():
+            rel = os.path.relpath(file_path, web_dir).replace(os.sep, '/')
+            lines.append('    "${CMAKE_CURRENT_LIST_DIR}/' + rel + '"')
+    lines.append(')')
+    lines.append('')
+
+    write_if_changed(os.path.join(web_dir, CMAKE_NAME), '\n'.join(lines).encode())
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Table of the embedded web files')
+    parser.add_argument('web_dir', help='directory with the files of the web interface')
+    parser.add_argument('--identity', action='store_true',
+                        help='embed the uncompressed files even if they have a gzip copy')
+    parser.add_argument('--no-brotli', action='store_true', help='do not make brotli copies')
+    args = parser.parse_args()
+
+    use_brotli = not args.no_brotli
+    if use_brotli and brotli is None and shutil.which('brotli') is None:
+        print('brotli not found, only gzip copies are made', file=sys.stderr)
+        use_brotli = False
+
+    files = collect(args.web_dir)
+    if not files:
+        print('No files in ' + args.web_dir, file=sys.stderr)
+        return 1
+
+    # EMBED_FILES names the symbols after the file name, without its directory
+    seen = {}
+    for rel_path in files:
+        name = os.path.basename(rel_path)
+        if name in seen:
+            print('{} and {} have the same file name'.format(seen[name], rel_path), file=sys.stderr)
+            return 1
+        seen[name] = rel_path
+
+    assets = [make_asset(args.web_dir, f, use_brotli, args.identity) for f in files]
+    write_header(args.web_dir, assets)
+    write_cmake(args.web_dir, assets)
+
+    total = 0
+    for asset in assets:
+        sizes = ', '.join('{} {}'.format(name, len(data)) for name, (_, data, _) in sorted(asset['variants'].items()))
+        print('{:<24} {:>7} -> {}'.format(asset['path'], asset['size'], sizes))
+        total += sum(len(data) for _, data, _ in asset['variants'].values())
+    print('{} assets, {} bytes embedded'.format(len(assets), total))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())